@@ -2,6 +2,8 @@
 
 #include "StaminaMessages.h"
 
+#include <unistd.h>
+
 using namespace stamina;
 // IMPLEMENTATION FOR Stamina::Stamina::Options
 
@@ -39,6 +41,39 @@ Options::checkOptions() {
 		StaminaMessages::error("Max approx count should be greater than 0.0. Got: " + std::to_string(max_approx_count), STAMINA_ERRORS::ERR_GENERAL);
 		good = false;
 	}
+	// Make sure we have at least one thread to explore with
+	if (threads < 1) {
+		StaminaMessages::error("Number of threads should be at least 1. Got: " + std::to_string(threads), STAMINA_ERRORS::ERR_GENERAL);
+		good = false;
+	}
+	else if (threads > 1 && method != STAMINA_METHODS::ITERATIVE_METHOD) {
+		StaminaMessages::warning("Multithreaded exploration is only supported by the iterative method. Using 1 thread.");
+		threads = 1;
+	}
+	// Make sure we check at least one property at a time
+	if (property_threads < 1) {
+		StaminaMessages::error("Number of property threads should be at least 1. Got: " + std::to_string(property_threads), STAMINA_ERRORS::ERR_GENERAL);
+		good = false;
+	}
+	else if (property_threads > 1 && shared_truncation) {
+		StaminaMessages::warning("Properties share one truncation, so they are not checked in parallel.");
+		property_threads = 1;
+	}
+	// The spill directory must exist if we are going to spill
+	if ((spill_budget > 0 || memory_cap > 0) && access(spill_dir.c_str(), W_OK) != 0) {
+		StaminaMessages::error("Spill directory " + spill_dir + " does not exist or is not writable.", STAMINA_ERRORS::ERR_GENERAL);
+		good = false;
+	}
+	// Resuming needs a checkpoint to resume from
+	if (resume && checkpoint_file == "") {
+		StaminaMessages::error("--resume needs a checkpoint file (--checkpoint).", STAMINA_ERRORS::ERR_GENERAL);
+		good = false;
+	}
+	else if (checkpoint_file != "" && method != STAMINA_METHODS::ITERATIVE_METHOD) {
+		StaminaMessages::warning("Checkpoints are only supported by the iterative method. No checkpoints will be written.");
+		checkpoint_file = "";
+		resume = false;
+	}
 	return good;
 }
 
@@ -59,8 +94,21 @@ Options::setArgs(struct arguments * arguments) {
 	property = arguments->property;
 	consts = arguments->consts;
 	export_trans = arguments->export_trans;
+	export_trans_binary = arguments->export_trans_binary;
 	rank_transitions = arguments->rank_transitions;
 	max_iterations = arguments->max_iterations;
 	max_states = arguments->max_states;
 	method = arguments->method;
+	threads = arguments->threads;
+	spill_budget = arguments->spill_budget;
+	spill_dir = arguments->spill_dir;
+	property_threads = arguments->property_threads;
+	shared_truncation = arguments->shared_truncation;
+	compiled_generator = arguments->compiled_generator;
+	checkpoint_file = arguments->checkpoint_file;
+	checkpoint_interval = arguments->checkpoint_interval;
+	resume = arguments->resume;
+	metrics_out = arguments->metrics_out;
+	memory_cap = arguments->memory_cap;
+	perf_counters = arguments->perf_counters;
 }
@@ -42,10 +42,23 @@ namespace stamina {
 		inline static std::string property;
 		inline static std::string consts;
 		inline static std::string export_trans;
+		inline static bool export_trans_binary;
 		inline static bool rank_transitions;
 		inline static uint64_t max_iterations;
 		inline static uint64_t max_states;
 		inline static uint8_t method;
+		inline static uint16_t threads;
+		inline static uint64_t spill_budget; // In MB
+		inline static std::string spill_dir;
+		inline static uint16_t property_threads;
+		inline static bool shared_truncation;
+		inline static bool compiled_generator;
+		inline static std::string checkpoint_file;
+		inline static uint64_t checkpoint_interval; // In seconds
+		inline static bool resume;
+		inline static std::string metrics_out;
+		inline static uint64_t memory_cap; // In MB
+		inline static bool perf_counters;
 	};
 	/**
 	* Tells us if a string ends with another
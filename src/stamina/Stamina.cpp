@@ -8,12 +8,30 @@
 #include "StaminaMessages.h"
 
 #include "util/ModelModify.h"
+#include "util/SpillFile.h"
+#include "util/Metrics.h"
+#include "util/PerfCounters.h"
+#include "util/MemoryAccounting.h"
 
 #include <stdlib.h>
 #include <iomanip>
 #include <stdlib.h>
 #include <string_view>
 #include <sstream>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+
+// Rough upper bound on the memory one truncation uses for each state it explores (state storage,
+// per-state data and transitions), used to decide how many properties we can check at once
+#define ESTIMATED_BYTES_PER_STATE 512
+// How often a property pair waiting for memory checks MemAvailable again, since it changes as the
+// running checks grow and shrink (not only when one of them finishes)
+#define ADMISSION_POLL_INTERVAL_MS 500
 
 using namespace stamina;
 
@@ -32,6 +50,22 @@ Stamina::Stamina(struct arguments * arguments) {
 	if (!good) {
 		StaminaMessages::errorAndExit("One or more parameters passed in were invalid.");
 	}
+	util::SpillFile::configure(Options::spill_budget << 20, Options::spill_dir);
+	util::MemoryAccounting::setCap(Options::memory_cap << 20);
+	if (Options::perf_counters) {
+		// Before any exploration or checking threads are started
+		if (!util::PerfCounters::enable()) {
+			StaminaMessages::warning("Cannot open performance counters (perf_event_open), so none will be reported. Is /proc/sys/kernel/perf_event_paranoid too high?");
+		}
+		else {
+			for (uint8_t event = util::PerfCounters::CYCLES; event < util::PerfCounters::NUMBER_OF_EVENTS; event++) {
+				util::PerfCounters::Event counterEvent = static_cast<util::PerfCounters::Event>(event);
+				if (!util::PerfCounters::isAvailable(counterEvent)) {
+					StaminaMessages::warning(std::string("Hardware counter ") + util::PerfCounters::getEventName(counterEvent) + " is not available on this system, so it will not be reported");
+				}
+			}
+		}
+	}
 }
 
 Stamina::~Stamina() {
@@ -41,15 +75,32 @@ Stamina::~Stamina() {
 void
 Stamina::run() {
 	initialize();
-	// Check each property in turn
-	for (int i = 0; i + 1 < propertiesVector->size(); i += 2 ) {
-		auto propMin = (*propertiesVector)[i];
-		auto propMax = (*propertiesVector)[i + 1];
-		modelChecker->modelCheckProperty(
-			propMin
-			, propMax
-			, *modelFile
-		);
+	uint64_t numberOfPairs = propertiesVector->size() / 2;
+	if (Options::shared_truncation && numberOfPairs > 1) {
+		auto results = modelChecker->modelCheckProperties(*propertiesVector, *modelFile);
+		for (auto const & resultInformation : results) {
+			StaminaMessages::writeResults(resultInformation, std::cout);
+		}
+	}
+	else if (Options::property_threads <= 1 || numberOfPairs <= 1) {
+		// Check each property in turn
+		for (int i = 0; i + 1 < propertiesVector->size(); i += 2 ) {
+			auto propMin = (*propertiesVector)[i];
+			auto propMax = (*propertiesVector)[i + 1];
+			modelChecker->modelCheckProperty(
+				propMin
+				, propMax
+				, *modelFile
+			);
+			StaminaMessages::writeResults(modelChecker->getResultInformation(), std::cout);
+		}
+	}
+	else {
+		runParallel(numberOfPairs);
+	}
+	StaminaMessages::info("Peak memory used by the builders:\n" + util::MemoryAccounting::getPeak().toString());
+	if (Options::metrics_out != "") {
+		writeMetrics();
 	}
 	// Finished!
 	StaminaMessages::good("Finished running!");
@@ -57,6 +108,130 @@ Stamina::run() {
 
 // PRIVATE METHODS
 
+void
+Stamina::runParallel(uint64_t numberOfPairs) {
+	uint16_t numberOfThreads = std::min(static_cast<uint64_t>(Options::property_threads), numberOfPairs);
+	StaminaMessages::info("Checking " + std::to_string(numberOfPairs) + " property pairs with up to " + std::to_string(numberOfThreads) + " at once");
+	// Each check keeps its own model checker until its results can be reported in file order
+	std::vector<std::shared_ptr<StaminaModelChecker>> checkers(numberOfPairs);
+	std::vector<bool> finished(numberOfPairs, false);
+	uint64_t nextPair = 0;
+	uint64_t nextToReport = 0;
+	uint16_t running = 0;
+	uint64_t memoryPerCheck = estimateMemoryPerCheck(numberOfThreads);
+	std::mutex scheduleLock;
+	std::condition_variable memoryFreed;
+
+	auto worker = [&]() {
+		while (true) {
+			uint64_t pair;
+			{
+				std::unique_lock<std::mutex> guard(scheduleLock);
+				if (nextPair >= numberOfPairs) {
+					return;
+				}
+				pair = nextPair++;
+				// Admission control: wait until there is room for one more truncation. MemAvailable
+				// already excludes what the running checks use. If nothing is running we go anyway,
+				// since waiting would not free anything.
+				auto canStart = [&]() {
+					return running == 0 || availableMemory() >= memoryPerCheck;
+				};
+				while (!memoryFreed.wait_for(guard, std::chrono::milliseconds(ADMISSION_POLL_INTERVAL_MS), canStart)) {
+					// Intentionally left empty
+				}
+				running++;
+			}
+			auto checker = std::make_shared<StaminaModelChecker>();
+			checker->initialize(modelFile, propertiesVector);
+			checker->modelCheckProperty(
+				(*propertiesVector)[2 * pair]
+				, (*propertiesVector)[2 * pair + 1]
+				, *modelFile
+			);
+			std::lock_guard<std::mutex> guard(scheduleLock);
+			checkers[pair] = checker;
+			finished[pair] = true;
+			running--;
+			// Report everything which is done, in the order of the properties file
+			while (nextToReport < numberOfPairs && finished[nextToReport]) {
+				StaminaMessages::writeResults(checkers[nextToReport]->getResultInformation(), std::cout);
+				checkers[nextToReport] = nullptr;
+				nextToReport++;
+			}
+			memoryFreed.notify_all();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (uint16_t i = 0; i < numberOfThreads; i++) {
+		threads.emplace_back(worker);
+	}
+	for (auto & thread : threads) {
+		thread.join();
+	}
+}
+
+uint64_t
+Stamina::availableMemory() {
+	std::ifstream meminfo("/proc/meminfo");
+	std::string line;
+	while (std::getline(meminfo, line)) {
+		unsigned long long value;
+		if (sscanf(line.c_str(), "MemAvailable: %llu kB", &value) == 1) {
+			return static_cast<uint64_t>(value) << 10;
+		}
+	}
+	// We can't tell, so don't hold anything back
+	return UINT64_MAX;
+}
+
+uint64_t
+Stamina::estimateMemoryPerCheck(uint16_t numberOfThreads) {
+	if (Options::max_states != 0) {
+		return Options::max_states * ESTIMATED_BYTES_PER_STATE;
+	}
+	// Exploration is unbounded, so a truncation may take whatever it is given
+	if (Options::memory_cap != 0) {
+		return (Options::memory_cap << 20) / numberOfThreads;
+	}
+	uint64_t available = availableMemory();
+	if (available == UINT64_MAX) {
+		return 0;
+	}
+	return available / numberOfThreads;
+}
+
+void
+Stamina::writeMetrics() {
+	std::string method = "iterative";
+	if (Options::method == STAMINA_METHODS::PRIORITY_METHOD) {
+		method = "priority";
+	}
+	else if (Options::method == STAMINA_METHODS::RE_EXPLORING_METHOD) {
+		method = "re-exploring";
+	}
+	try {
+		util::Metrics::write(
+			Options::metrics_out
+			, method
+			, {
+				{"kappa", Options::kappa}
+				, {"reduce_kappa", Options::reduce_kappa}
+				, {"approx_factor", Options::approx_factor}
+				, {"prob_win", Options::prob_win}
+				, {"max_approx_count", static_cast<double>(Options::max_approx_count)}
+				, {"max_states", static_cast<double>(Options::max_states)}
+				, {"threads", static_cast<double>(Options::threads)}
+			}
+		);
+		StaminaMessages::good("Wrote metrics to " + Options::metrics_out);
+	}
+	catch (const std::exception& e) {
+		StaminaMessages::error("Cannot write metrics to " + Options::metrics_out + ":\n\t" + std::string(e.what()));
+	}
+}
+
 void
 Stamina::initialize() {
 	StaminaMessages::info("Stamina version is: " + std::to_string(VERSION_MAJOR) + "." + std::to_string(VERSION_MINOR));
@@ -46,6 +46,32 @@ namespace stamina {
          * Initializes Stamina
          * */
         void initialize();
+        /**
+         * Checks the property pairs on a pool of Options::property_threads threads, each with its own
+         * StaminaModelChecker. A pair is only started if there is enough free memory for one more
+         * truncation (see estimateMemoryPerCheck()), and results are written in the order of the
+         * properties file.
+         *
+         * @param numberOfPairs The number of (min, max) property pairs
+         * */
+        void runParallel(uint64_t numberOfPairs);
+        /**
+         * Gets the memory available to start new checks (MemAvailable in /proc/meminfo), in bytes
+         * */
+        static uint64_t availableMemory();
+        /**
+         * Estimates the memory one truncation may use: from Options::max_states if exploration is
+         * bounded, and otherwise an even share of the memory cap (or, without a cap, of the memory
+         * available before any check is started) between the threads.
+         *
+         * @param numberOfThreads The number of property pairs which may be checked at once
+         * */
+        static uint64_t estimateMemoryPerCheck(uint16_t numberOfThreads);
+        /**
+         * Writes the metrics of every property checked to Options::metrics_out, along with the
+         * parameters they were checked with
+         * */
+        void writeMetrics();
 
         /* Data Members */
         std::shared_ptr<StaminaModelChecker> modelChecker;
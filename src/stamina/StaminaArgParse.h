@@ -43,17 +43,19 @@ static struct argp_option options[] = {
 	, {"cuddMaxMem", 'C', "memory", 0,
 		"Maximum CUDD memory, in the same format as PRISM (default: 1g)"}
 	, {"export", 'e', "filename", 0,
-		"Export model to a (text) file"}
+		"Export the truncated model to PRISM's explicit files (filename.tra, .sta, .lab, and .srew/.trew if the model has rewards)"}
 	, {"exportPerimeterStates", 'S', "filename", 0,
 		"Export perimeter states to a file. Please provide a filename. This will append to the file if it is existing"}
 	, {"import", 'i', "filename", 0,
-		"Import model to a (text) file"}
+		"Check the properties on a truncated model exported with --export (filename.tra, .sta and .lab) rather than exploring the model"}
 	, {"property", 'p', "propname", 0,
 		"Specify a certain property to check in a model file that contains many"}
 	, {"const", 'c', "\"C1=VAL,C2=VAL,C3=VAL\"", 0,
 		"Comma separated values for constants"}
-	, {"exportTrans", 't', "filename", 0,
+	, {"exportTrans", 't', "filename", OPTION_ARG_OPTIONAL,
 		"Export the list of transitions and actions to a specified file name, or to trans.txt if no file name is specified.\nTransitions are exported in the format <Source State Index> <Destination State Index> <Action Label>"}
+	, {"exportTransBinary", 'b', 0, 0,
+		"Export transitions (--exportTrans) in binary: the action labels, followed by the source, destination and action label index of each transition (default: off)"}
 	/* Additional options. GNU argp shows args alphabetically */
 	, {"rankTransitions", 'T', 0, 0,
 		"Rank transitions before expanding (default: false)"}
@@ -67,6 +69,30 @@ static struct argp_option options[] = {
 		"Use the STAMINA 3.0 method (priority)"}
 	, {"reExploring", 'J', 0, 0,
 		"Use the STAMINA 2.0 method (the method in STAMINA/PRISM)"}
+	, {"threads", 'j', "int", 0,
+		"Number of threads to use for state space exploration with the iterative method (default: 1)"}
+	, {"spillBudget", 'B', "MB", 0,
+		"RAM (in MB) to use for state storage before spilling it to a scratch file on disk. 0 never spills (default: 0)"}
+	, {"spillDir", 'D', "directory", 0,
+		"Directory to create the scratch file for spilled state storage in (default: /tmp)"}
+	, {"sharedTruncation", 's', 0, 0,
+		"Explore a single truncated state space for all properties, refined until every property's window is small enough, rather than one for each property (default: off)"}
+	, {"compiledGenerator", 'G', 0, 0,
+		"Compile the model to native code (with the compiler in $CXX, or c++) for state space exploration. Falls back to STORM's generator (with a warning) if the model cannot be compiled, the compiler is missing or fails, or the compiled code gives different transitions than STORM's generator on the first states explored (default: off)"}
+	, {"propertyThreads", 'N', "int", 0,
+		"Number of property pairs to check at once. Fewer are checked at once if there is not enough free memory (default: 1)"}
+	, {"checkpoint", 'K', "filename", 0,
+		"Write checkpoints of the exploration (iterative method only) to a file, every --checkpointInterval seconds and on SIGTERM"}
+	, {"checkpointInterval", 'L', "seconds", 0,
+		"Seconds between checkpoints (default: 600)"}
+	, {"resume", 'U', 0, 0,
+		"Resume exploration from the file given with --checkpoint, if it holds a checkpoint of the same model and property (default: off)"}
+	, {"metricsOut", 'm', "filename", 0,
+		"Write metrics of each refinement iteration (states explored, hash probes, frontier and perimeter sizes, a histogram of perimeter reachability, build and check times) to a JSON file"}
+	, {"memoryCap", 'Q', "MB", 0,
+		"Most RAM (in MB) the builders may use. New blocks of state storage are spilled to disk (see --spillDir) once three quarters of it are in use, and STAMINA stops if it is exceeded. 0 means no cap (default: 0)"}
+	, {"perfCounters", 'H', 0, 0,
+		"Count cycles, instructions, LLC misses and branch misses (Linux only) while expanding states, interning states, building the transition matrix, labeling states and checking, and report them for each refinement iteration (default: off)"}
 	, { 0 }
 };
 
@@ -89,10 +115,23 @@ struct arguments {
 	std::string property;
 	std::string consts;
 	std::string export_trans;
+	bool export_trans_binary;
 	bool rank_transitions;
 	uint64_t max_iterations;
 	uint64_t max_states;
 	uint8_t method;
+	uint16_t threads;
+	uint64_t spill_budget;
+	std::string spill_dir;
+	uint16_t property_threads;
+	bool shared_truncation;
+	bool compiled_generator;
+	std::string checkpoint_file;
+	uint64_t checkpoint_interval;
+	bool resume;
+	std::string metrics_out;
+	uint64_t memory_cap;
+	bool perf_counters;
 };
 
 /**
@@ -153,7 +192,11 @@ parse_opt(int key, char * arg, struct argp_state * state) {
 			break;
 		// export transitions
 		case 't':
-			arguments->export_trans = std::string(arg);
+			arguments->export_trans = arg == nullptr ? "trans.txt" : std::string(arg);
+			break;
+		// export transitions in binary
+		case 'b':
+			arguments->export_trans_binary = true;
 			break;
 		// use rank transitions before expanding
 		case 'T':
@@ -175,6 +218,54 @@ parse_opt(int key, char * arg, struct argp_state * state) {
 		case 'J':
 			arguments->method = STAMINA_METHODS::RE_EXPLORING_METHOD;
 			break;
+		// number of exploration threads
+		case 'j':
+			arguments->threads = (uint16_t) atoi(arg);
+			break;
+		// RAM budget before spilling to disk
+		case 'B':
+			arguments->spill_budget = (uint64_t) atoll(arg);
+			break;
+		// directory for the spill file
+		case 'D':
+			arguments->spill_dir = std::string(arg);
+			break;
+		// number of property pairs to check at once
+		case 'N':
+			arguments->property_threads = (uint16_t) atoi(arg);
+			break;
+		// one truncation for all properties
+		case 's':
+			arguments->shared_truncation = true;
+			break;
+		// compile the model
+		case 'G':
+			arguments->compiled_generator = true;
+			break;
+		// checkpoint file
+		case 'K':
+			arguments->checkpoint_file = std::string(arg);
+			break;
+		// seconds between checkpoints
+		case 'L':
+			arguments->checkpoint_interval = (uint64_t) atoll(arg);
+			break;
+		// resume from the checkpoint
+		case 'U':
+			arguments->resume = true;
+			break;
+		// metrics file
+		case 'm':
+			arguments->metrics_out = std::string(arg);
+			break;
+		// memory cap
+		case 'Q':
+			arguments->memory_cap = (uint64_t) atoll(arg);
+			break;
+		// hardware counters
+		case 'H':
+			arguments->perf_counters = true;
+			break;
 		// model and properties file
 		case ARGP_KEY_ARG:
 			// get model file
@@ -1,6 +1,7 @@
 #include "StaminaMessages.h"
 
 #include "ANSIColors.h"
+#include "util/LogQueue.h"
 
 #include <stdlib.h>
 #include <iomanip>
@@ -8,47 +9,173 @@
 #include <string_view>
 #include <sstream>
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
 
 using namespace stamina;
 
+std::mutex StaminaMessages::messageLock;
+
+namespace {
+	/**
+	 * Writes the queued messages to std::cerr on a background thread, so that logging never waits on
+	 * the terminal. The thread is started by the first message and drains the queue before it is
+	 * joined at exit.
+	 * */
+	class MessageWriter {
+	public:
+		MessageWriter()
+			: pushed(0)
+			, written(0)
+			, sleeping(false)
+			, stopping(false)
+			, thread(&MessageWriter::run, this)
+		{
+			// Intentionally left empty
+		}
+		~MessageWriter() {
+			{
+				std::lock_guard<std::mutex> guard(wakeLock);
+				stopping = true;
+			}
+			wake.notify_one();
+			thread.join();
+		}
+		void
+		log(std::initializer_list<std::string_view> pieces) {
+			queue.push(pieces);
+			pushed.fetch_add(1);
+			// Only take the lock if the writer may be waiting for messages
+			if (sleeping.load()) {
+				std::lock_guard<std::mutex> guard(wakeLock);
+				wake.notify_one();
+			}
+		}
+		void
+		flush() {
+			uint64_t target = pushed.load();
+			while (written.load() < target) {
+				if (sleeping.load()) {
+					std::lock_guard<std::mutex> guard(wakeLock);
+					wake.notify_one();
+				}
+				std::this_thread::yield();
+			}
+		}
+	private:
+		void
+		run() {
+			std::string batch;
+			while (true) {
+				uint64_t drained = queue.drain([&batch](char const * text, uint32_t length) {
+					batch.append(text, length);
+				});
+				if (drained > 0) {
+					// One write per batch rather than one per message
+					std::cerr.write(batch.data(), batch.size());
+					std::cerr.flush();
+					batch.clear();
+					written.fetch_add(drained);
+					continue;
+				}
+				std::unique_lock<std::mutex> guard(wakeLock);
+				if (stopping && queue.empty()) {
+					break;
+				}
+				sleeping.store(true);
+				// Producers check sleeping after publishing, so either they notify or this sees their message.
+				// The timeout is only a safety net.
+				wake.wait_for(guard, std::chrono::milliseconds(100), [this] {
+					return stopping || written.load() < pushed.load();
+				});
+				sleeping.store(false);
+			}
+		}
+		stamina::util::LogQueue queue;
+		std::atomic<uint64_t> pushed;
+		std::atomic<uint64_t> written;
+		std::atomic<bool> sleeping;
+		// Guarded by wakeLock
+		bool stopping;
+		std::mutex wakeLock;
+		std::condition_variable wake;
+		std::thread thread;
+	};
+
+	MessageWriter &
+	messageWriter() {
+		static MessageWriter writer;
+		return writer;
+	}
+} // namespace
+
 void
-StaminaMessages::errorAndExit(std::string err, uint8_t err_num) {
-	std::cerr << BOLD(FRED("[ERROR]: "));
-	std::cerr << BOLD("STAMINA encountered the following error and will now exit: ") << std::endl;
-	std::cerr << '\t' << err << std::endl;
+StaminaMessages::errorAndExit(std::string const & err, uint8_t err_num) {
+	messageWriter().log({
+		BOLD(FRED("[ERROR]: "))
+		, BOLD("STAMINA encountered the following error and will now exit: ")
+		, "\n\t"
+		, err
+		, "\n"
+	});
+	flush();
 	exit(err_num);
 }
 
 void
-StaminaMessages::error(std::string err, uint8_t err_num) {
-	std::cerr << BOLD(FRED("[ERROR]: "));
-	std::cerr << BOLD("STAMINA encountered the following (possibly recoverable) error: ") << std::endl;
-	std::cerr << '\t' << err << std::endl;
+StaminaMessages::error(std::string const & err, uint8_t err_num) {
+	messageWriter().log({
+		BOLD(FRED("[ERROR]: "))
+		, BOLD("STAMINA encountered the following (possibly recoverable) error: ")
+		, "\n\t"
+		, err
+		, "\n"
+	});
 }
 
 void
-StaminaMessages::warning(std::string warn) {
-	std::cerr << BOLD(FYEL("[WARNING]: ")) << warn << std::endl;
+StaminaMessages::warning(std::string const & warn) {
+	if (STAMINA_LOG_LEVEL > STAMINA_LOG_LEVEL_WARNING) {
+		return;
+	}
+	messageWriter().log({BOLD(FYEL("[WARNING]: ")), warn, "\n"});
 }
 
 void
-StaminaMessages::info(std::string info) {
-	std::cerr << BOLD(FBLU("[INFO]: ")) << info << std::endl;
+StaminaMessages::info(std::string const & info) {
+	if (STAMINA_LOG_LEVEL > STAMINA_LOG_LEVEL_INFO) {
+		return;
+	}
+	messageWriter().log({BOLD(FBLU("[INFO]: ")), info, "\n"});
 }
 
 void
-StaminaMessages::good(std::string good) {
-	std::cerr << BOLD(FGRN("[MESSAGE]: ")) << good << std::endl;
+StaminaMessages::good(std::string const & good) {
+	if (STAMINA_LOG_LEVEL > STAMINA_LOG_LEVEL_INFO) {
+		return;
+	}
+	messageWriter().log({BOLD(FGRN("[MESSAGE]: ")), good, "\n"});
 }
 
 #ifdef DEBUG_PRINTS
-void StaminaMessages::debugPrint(std::string msg) {
+void StaminaMessages::debugPrint(std::string const & msg) {
+	std::lock_guard<std::mutex> guard(messageLock);
 	std::cout << BOLD(FMAG("[DEBUG MESSAGE]: ")) << msg << std::endl;
 }
 #endif
 
 void
-StaminaMessages::writeResults(ResultInformation resultInformation, std::ostream out) {
+StaminaMessages::flush() {
+	messageWriter().flush();
+}
+
+void
+StaminaMessages::writeResults(ResultInformation resultInformation, std::ostream & out) {
+	// Log messages about this property come before its results
+	flush();
+	std::lock_guard<std::mutex> guard(messageLock);
 	out.setf( std:: ios::floatfield );
 	out << std::fixed << std::setprecision(12);
 	out << horizontalSeparator << std::endl;
@@ -58,6 +185,6 @@ StaminaMessages::writeResults(ResultInformation resultInformation, std::ostream
 	out << "Probability Maximum: " << resultInformation.pMax << std::endl;
 	out << "Window: " << (resultInformation.pMax - resultInformation.pMin) << std::endl;
 	out << horizontalSeparator << std::endl;
-	out << "Model: " << resultInformation.numberStates << " states with " << resultInformation.numberInitial << " initial." << std::endl;
+	out << "Model: " << resultInformation.numberStates << " states with " << static_cast<uint32_t>(resultInformation.numberInitial) << " initial." << std::endl;
 	out << horizontalSeparator << std::endl;
 }
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 
 // #define DEBUG_PRINTS
 // #define DEBUG_PRINTS_VERBOSE
@@ -13,6 +14,22 @@
 	#define DEBUG_PRINTS
 #endif
 
+// Severity levels for STAMINA_LOG_LEVEL. Messages below STAMINA_LOG_LEVEL are compiled out.
+#define STAMINA_LOG_LEVEL_DEBUG 0
+#define STAMINA_LOG_LEVEL_INFO 1
+#define STAMINA_LOG_LEVEL_WARNING 2
+#define STAMINA_LOG_LEVEL_ERROR 3
+
+#ifndef STAMINA_LOG_LEVEL
+	#ifdef DEBUG_PRINTS
+		#define STAMINA_LOG_LEVEL STAMINA_LOG_LEVEL_DEBUG
+	#else
+		#define STAMINA_LOG_LEVEL STAMINA_LOG_LEVEL_INFO
+	#endif
+#elif STAMINA_LOG_LEVEL <= STAMINA_LOG_LEVEL_DEBUG && !defined(DEBUG_PRINTS)
+	#define DEBUG_PRINTS
+#endif
+
 // Efficient debug printing method to std::cout that can be easily turned off without having to get
 // rid of all instances of StaminaMessages::debugPrint("Some message") or whatever
 #ifdef DEBUG_PRINTS
@@ -25,6 +42,7 @@ namespace stamina {
         ERR_GENERAL = 1
         , ERR_SEVERE = 2
         , ERR_MEMORY_EXCEEDED = 137
+        , ERR_TERMINATED = 143
     };
 	/* All result information */
 	struct ResultInformation {
@@ -37,42 +55,71 @@ namespace stamina {
 	class StaminaMessages {
 	public:
 		/**
-		* Errors and exits program
+		* Errors and exits program. Any queued messages are written first.
 		* */
-		static void errorAndExit(std::string err, uint8_t err_num = STAMINA_ERRORS::ERR_GENERAL);
+		static void errorAndExit(std::string const & err, uint8_t err_num = STAMINA_ERRORS::ERR_GENERAL);
 		/**
 		* Errors without exiting
 		* */
-		static void error(std::string err, uint8_t err_num = STAMINA_ERRORS::ERR_GENERAL);
+		static void error(std::string const & err, uint8_t err_num = STAMINA_ERRORS::ERR_GENERAL);
 		/**
 		* Prints a warning
 		* */
-		static void warning(std::string warn);
+		static void warning(std::string const & warn);
 		/**
 		* Prints an info message
 		* */
-		static void info(std::string info);
+		static void info(std::string const & info);
 		/**
 		* Prints a (good) message (i.e., we finished)
 		* */
-		static void good(std::string good);
+		static void good(std::string const & good);
 #ifdef DEBUG_PRINTS
 		/**
 		* Prints a debugging message
 		* */
-		static void debugPrint(std::string msg);
+		static void debugPrint(std::string const & msg);
 #endif
-		static void writeResults(ResultInformation resultInformation, std::ostream out);
+		/**
+		* Writes the results of a property to a stream
+		* */
+		static void writeResults(ResultInformation resultInformation, std::ostream & out);
+		/**
+		* Blocks until every message logged so far has been written to std::cerr
+		* */
+		static void flush();
 	protected:
+		// Keeps results from different property threads from being interleaved
+		static std::mutex messageLock;
 		static constexpr char * horizontalSeparator =
 			"========================================================================================";
 	};
 } // namespace stamina
 
 /* Logging and debugging messages */
-#ifdef DEBUG_PRINTS
-	#define STAMINA_DEBUG_LOG(x)
+// Messages are formatted on the calling thread and written to std::cerr by a background thread. In
+// hot paths, use these rather than calling StaminaMessages directly: when a level is compiled out,
+// the argument (usually a string concatenation) is never evaluated.
+#if STAMINA_LOG_LEVEL <= STAMINA_LOG_LEVEL_DEBUG
+	#define STAMINA_LOG_DEBUG(x) ::stamina::StaminaMessages::debugPrint(x)
 #else
-
-#endif // DEBUG_PRINTS
+	#define STAMINA_LOG_DEBUG(x) ((void) 0)
+#endif
+#if STAMINA_LOG_LEVEL <= STAMINA_LOG_LEVEL_INFO
+	#define STAMINA_LOG_INFO(x) ::stamina::StaminaMessages::info(x)
+	#define STAMINA_LOG_GOOD(x) ::stamina::StaminaMessages::good(x)
+#else
+	#define STAMINA_LOG_INFO(x) ((void) 0)
+	#define STAMINA_LOG_GOOD(x) ((void) 0)
+#endif
+#if STAMINA_LOG_LEVEL <= STAMINA_LOG_LEVEL_WARNING
+	#define STAMINA_LOG_WARNING(x) ::stamina::StaminaMessages::warning(x)
+#else
+	#define STAMINA_LOG_WARNING(x) ((void) 0)
+#endif
+#if STAMINA_LOG_LEVEL <= STAMINA_LOG_LEVEL_ERROR
+	#define STAMINA_LOG_ERROR(x) ::stamina::StaminaMessages::error(x)
+#else
+	#define STAMINA_LOG_ERROR(x) ((void) 0)
+#endif
 #endif // STAMINA_MESSAGES_H
@@ -6,18 +6,27 @@
 #include "StaminaModelChecker.h"
 #include "ANSIColors.h"
 #include "StaminaMessages.h"
+#include "util/ExplicitModelWriter.h"
+#include "util/Metrics.h"
+#include "util/PerfCounters.h"
+#include "util/MemoryAccounting.h"
 
 #include "storm/builder/BuilderOptions.h"
 #include "storm/storage/expressions/BinaryRelationExpression.h"
 
+#include <algorithm>
+#include <cctype>
 #include <sstream>
 #include <stdio.h>
 #include <fstream>
 #include <chrono>
 #include <utility>
 #include <unordered_set>
+#include <mutex>
 
 #define USE_STAMINA_TRUNCATION
+// Relative precision for util::CtmcSolver (the same as STORM's default)
+#define CTMC_SOLVER_PRECISION 1e-6
 
 #ifndef USE_STAMINA_TRUNCATION
 	#include "ExplicitTruncatedModelBuilder.h"
@@ -27,55 +36,25 @@ namespace stamina {
 
 using namespace stamina::builder;
 
+// STORM's expression and generator setup is not thread-safe, so when several properties are checked
+// at once (see Stamina::run()), their generators and builders are created one at a time
+static std::mutex setupLock;
+
 StaminaModelChecker::StaminaModelChecker(
 	std::shared_ptr<storm::prism::Program> modulesFile
 	, std::shared_ptr<std::vector<storm::jani::Property>> propertiesVector
 ) : modulesFile(modulesFile)
 	, propertiesVector(propertiesVector)
+	, numberStates(0)
+	, numberInitial(0)
+	, importFailed(false)
 {
-	// Explicitly invoke model build
-	std::string iFilename = Options::import_filename;
-	if (iFilename != "") {
-		StaminaMessages::info("Trying to import files named like " + iFilename);
-		try {
-			std::string transFile = iFilename + ".tra";
-			std::string stateRewardsFile = iFilename + "srew";
-			std::string transRewardsFile = iFilename + ".trew";
-			std::string statesFile = iFilename + ".sta";
-			std::string labelsFile = iFilename + ".lab";
-			// TODO: load model from explicit files
-			StaminaMessages::warning("Importing model from explicit files not implemented yet!");
-		}
-		catch (const std::exception& e) {
-			std::stringstream ss;
-			ss << "Cannot import file: " << iFilename << '\n';
-			ss << BOLD("\tGot Error:") << e.what();
-			StaminaMessages::error(ss.str());
-		}
-	}
+	// The model in Options::import_filename is read when the first property is checked
 }
 
 StaminaModelChecker::~StaminaModelChecker() {
-	// Explicitly invoke model export
-	std::string oFilename = Options::export_filename;
-	if (oFilename != "") {
-		StaminaMessages::info("Attempting to export model to " + oFilename);
-		try {
-			std::string transFile = oFilename + ".tra";
-			std::string stateRewardsFile = oFilename + "srew";
-			std::string transRewardsFile = oFilename + ".trew";
-			std::string statesFile = oFilename + ".sta";
-			std::string labelsFile = oFilename + ".lab";
-			// TODO: export model to explicit files
-			StaminaMessages::warning("Exporting model to explicit files not implemented yet!");
-		}
-		catch (const std::exception& e) {
-			std::stringstream ss;
-			ss << "Cannot export file: " << oFilename << '\n';
-			ss << BOLD("\tGot Error:") << e.what();
-			StaminaMessages::error(ss.str());
-		}
-	}
+	// The model is exported in the background once it is checked (see startExport())
+	finishExport();
 }
 
 void
@@ -100,36 +79,24 @@ StaminaModelChecker::modelCheckProperty(
 	, storm::jani::Property propMax
 	, storm::prism::Program const& modulesFile
 ) {
+	// A model which was already truncated does not need to be explored again
+	if (Options::import_filename != "" && importModel(modulesFile)) {
+		checkImportedModel(propMin, propMax);
+		return nullptr;
+	}
 	// Create allocators for shared pointers
 	std::allocator<Result> allocatorResult;
-	auto options = BuilderOptions(*propMin.getFilter().getFormula());
-	// Create PrismNextStateGenerator. May need to create a NextStateGeneratorOptions for it if default is not working
-	auto generator = std::make_shared<storm::generator::PrismNextStateGenerator<double, uint32_t>>(modulesFile, options);
-
-	if (Options::method == STAMINA_METHODS::ITERATIVE_METHOD) {
-		// Create StaminaModelBuilder
-		auto builderPointer = std::make_shared<StaminaIterativeModelBuilder<double>> (generator, modulesFile, options);
-		builder = std::static_pointer_cast<StaminaModelBuilder<double>>(builderPointer);
-	}
-	else if (Options::method == STAMINA_METHODS::PRIORITY_METHOD) {
-		StaminaMessages::errorAndExit("Not fully implemented yet!");
-		// Create StaminaModelBuilder
-		// auto builderPointer = std::make_shared<StaminaPriorityModelBuilder<double>> (generator, modulesFile, options);
-		// builder = std::static_pointer_cast<StaminaModelBuilder<double>>(builderPointer);
-	}
-	else if (Options::method == STAMINA_METHODS::RE_EXPLORING_METHOD) {
-		auto builderPointer = std::make_shared<StaminaReExploringModelBuilder<double>> (generator, modulesFile, options);
-		builder = std::static_pointer_cast<StaminaModelBuilder<double>>(builderPointer);
-	}
-	else {
-		StaminaMessages::errorAndExit("Truncation method is invalid!");
-	}
+	std::unique_lock<std::mutex> setupGuard(setupLock);
+	createBuilder(BuilderOptions(*propMin.getFilter().getFormula()), modulesFile);
 
 	auto startTime = std::chrono::high_resolution_clock::now();
 	auto modelTime = startTime;
 	// Instantiate lower and upper results
 	min_results = std::allocate_shared<Result>(allocatorResult);
 	max_results = std::allocate_shared<Result>(allocatorResult);
+	// Solutions from earlier iterations are only meaningful for the same property and builder
+	solver = std::make_shared<util::CtmcSolver>(CTMC_SOLVER_PRECISION, Options::max_iterations);
+	previousSolutions.clear();
 
 	// Create number of refined iterations and reachability threshold
 	int numRefineIterations = 0;
@@ -151,6 +118,13 @@ StaminaModelChecker::modelCheckProperty(
 			builder->setPropertyFormula(propertyFormula, modulesFile);
 		}
 	}
+	setUpCheckpoint(filenameForProperty(Options::checkpoint_file, propMin));
+	setupGuard.unlock();
+	propertyName = propMin.getName();
+	// The misprediction factor is refined for each property separately (and may have been resumed)
+	double approxFactor = builder->getApproxFactor();
+	util::Metrics::Run metricsRun;
+	metricsRun.property = propertyName;
 
 	// While we should not terminate
 	// All versions of the STAMINA algorithm (except for the heuristic version use refinement iterations)
@@ -160,50 +134,74 @@ StaminaModelChecker::modelCheckProperty(
 		// Print out our current refinement iteration
 		StaminaMessages::info("Approximation [Refine Iterations: " + std::to_string(numRefineIterations) + ", kappa = " + std::to_string(reachThreshold) + "]");
 		// Reset the reachability threshold
-		reachThreshold = Options::kappa;
+		reachThreshold = builder->getLocalKappa();
+		util::Metrics::Iteration metricsIteration;
+		metricsIteration.refinementIteration = numRefineIterations;
+		metricsIteration.kappa = reachThreshold;
+		metricsIteration.approxFactor = approxFactor;
+		util::PerfCounters::Totals perfCountersBeforeBuild = getPerfCounterTotals();
+		auto buildStartTime = std::chrono::high_resolution_clock::now();
 
 		std::shared_ptr<CtmcModelChecker> checker = nullptr;
 		std::shared_ptr<storm::models::sparse::Ctmc<double, storm::models::sparse::StandardRewardModel<double>>> model;
 		model = builder->build()->template as<storm::models::sparse::Ctmc<double>>();
+		lastModel = model;
 
 
 		// Rebuild the initial state labels
+		numberStates = model->getNumberOfStates();
+		numberInitial = model->getInitialStates().getNumberOfSetBits();
 		labeling = &( model->getStateLabeling());
 		labeling->addLabel("(Absorbing = true)");
 		labeling->addLabelToState("(Absorbing = true)", 0);
 
-		std::cout << "Labeling:\n" << model->getStateLabeling() << std::endl;
-
 		checker = std::make_shared<CtmcModelChecker>(*model);
+		solver->setModel(model->getTransitionMatrix());
 
-		builder->setLocalKappaToGlobal();
 		modelTime = std::chrono::high_resolution_clock::now();
+		std::chrono::duration<double> buildTime = modelTime - buildStartTime;
+		metricsIteration.buildTime = buildTime.count();
 		// Instruct STORM to compute P_min and P_max
 		// We will need to get info from the terminal states
 		try {
-			auto result_lower = checker->check(
-				storm::modelchecker::CheckTask<>(*(propMin.getRawFormula()), true)
+			// Pmin and Pmax are solved together
+			auto results = checkProperties(
+				{propMin.getRawFormula().get(), propMax.getRawFormula().get()}
+				, checker
+				, *model->getInitialStates().begin()
+				, previousSolutions
 			);
-			min_results->result = result_lower->asExplicitQuantitativeCheckResult<double>()[*model->getInitialStates().begin()];
-			auto result_upper = checker->check(storm::modelchecker::CheckTask<>(*(propMax.getRawFormula()), true));
-			max_results->result = result_upper->asExplicitQuantitativeCheckResult<double>()[*model->getInitialStates().begin()];
+			min_results->result = results[0];
+			max_results->result = results[1];
 			builder->printStateSpaceInformation();
 			StaminaMessages::info(std::string("At this refine iteration, the following result values are found:\n") +
 				"\tMinimum Results: " + std::to_string(min_results->result) + "\n" +
 				"\tMaximum Results: " + std::to_string(max_results->result) + "\n"  +
-				"This gives us a window of " + std::to_string(max_results->result - min_results->result)
+				"This gives us a window of " + std::to_string(max_results->result - min_results->result) + "\n" +
+				"There are " + std::to_string(builder->getNumberOfPerimeterStates()) + " perimeter states"
 			);
 		}
 		catch (std::exception& e) {
 			StaminaMessages::errorAndExit(e.what());
 		}
+		reportPerfCounters(perfCountersBeforeBuild, metricsIteration);
+		reportMemory(metricsIteration);
+		if (Options::metrics_out != "") {
+			std::chrono::duration<double> checkTime = std::chrono::high_resolution_clock::now() - modelTime;
+			metricsIteration.checkTime = checkTime.count();
+			metricsIteration.solverSweeps = solver->getLastSweepCount();
+			metricsIteration.results = {min_results->result, max_results->result};
+			builder->recordMetrics(metricsIteration);
+			metricsRun.iterations.push_back(std::move(metricsIteration));
+		}
 		double percentOff = max_results->result - min_results->result;
 		percentOff *= (double) 4.0 / Options::prob_win;
 		// max percent off at 100%
 		if (percentOff > 1.0) {
 			percentOff = 1.0;
 		}
-		Options::approx_factor *= percentOff;
+		approxFactor *= percentOff;
+		builder->setApproxFactor(approxFactor);
 
 		// Increment the refinement count
 		if (Options::export_perimeter_states != "") {
@@ -213,11 +211,16 @@ StaminaModelChecker::modelCheckProperty(
 		// Increment number of refine iterations
 		++numRefineIterations;
 	}
+	startExport(filenameForProperty(Options::export_filename, propMin));
 
 	auto endTime = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double> timeTaken = endTime - startTime;
 	std::chrono::duration<double> timeTakenModel = modelTime - startTime;
 	std::chrono::duration<double> timeTakenCheck = endTime - modelTime;
+	if (Options::metrics_out != "") {
+		metricsRun.totalTime = timeTaken.count();
+		util::Metrics::addRun(std::move(metricsRun));
+	}
 	std::stringstream ss;
 	ss.setf( std::ios::floatfield );
 	ss << std::fixed << std::setprecision(12);
@@ -226,24 +229,464 @@ StaminaModelChecker::modelCheckProperty(
 	ss << "\tTime taken for model checking: " << timeTakenCheck.count() << " s\n";
 	ss << "\tTaken total time: " << timeTaken.count() << " s\n";
 	StaminaMessages::info(ss.str());
-
-	// Print results
-	std::stringstream resultInfo;
-	resultInfo.setf( std::ios::floatfield );
-	resultInfo << std::fixed << std::setprecision(12);
-	resultInfo << "Finished checking property: " << propMin.getName() << std::endl;
-	resultInfo << "\t" << BOLD(FMAG("Probability Minimum: ")) << min_results->result << std::endl;
-	resultInfo << "\t" << BOLD(FMAG("Probability Maximum: ")) << max_results->result << std::endl;
-	StaminaMessages::info(resultInfo.str());
+	// The results themselves are reported by the caller (in the order of the properties file)
 
 	// Export transitions to file if desired
+	printTransitionActions(filenameForProperty(Options::export_trans, propMin));
+
+	return nullptr;
+}
+
+std::vector<double>
+StaminaModelChecker::checkProperties(
+	std::vector<storm::logic::Formula const *> const & formulas
+	, std::shared_ptr<CtmcModelChecker> checker
+	, uint64_t initialState
+	, std::vector<std::vector<double>> & previousSolutions
+) {
+	util::PerfCounters::Scope scope(perfCounters, util::PerfCounters::CHECK);
+	std::vector<double> results(formulas.size());
+	previousSolutions.resize(formulas.size());
+	// Only P=? [ phi U psi ], P=? [ phi U<=t psi ] and P=? [ F psi ] are handled by our solver, and
+	// all of them are solved in the same pass
+	std::vector<util::CtmcSolver::UntilProblem> problems;
+	std::vector<uint64_t> solvedFormulas;
+	storm::logic::BooleanLiteralFormula trueFormula(true);
+	for (uint64_t index = 0; index < formulas.size(); ++index) {
+		auto const & formula = *formulas[index];
+		if (!formula.isProbabilityOperatorFormula() || formula.asProbabilityOperatorFormula().hasBound()) {
+			continue;
+		}
+		auto const & pathFormula = formula.asProbabilityOperatorFormula().getSubformula();
+		storm::logic::Formula const * left = nullptr;
+		storm::logic::Formula const * right = nullptr;
+		double timeBound = -1.0;
+		if (pathFormula.isUntilFormula()) {
+			left = &pathFormula.asUntilFormula().getLeftSubformula();
+			right = &pathFormula.asUntilFormula().getRightSubformula();
+		}
+		else if (pathFormula.isEventuallyFormula()) {
+			left = &trueFormula;
+			right = &pathFormula.asEventuallyFormula().getSubformula();
+		}
+		else if (pathFormula.isBoundedUntilFormula()) {
+			auto const & boundedUntil = pathFormula.asBoundedUntilFormula();
+			if (!boundedUntil.isMultiDimensional()
+				&& boundedUntil.getTimeBoundReference().isTimeBound()
+				&& !boundedUntil.hasLowerBound()
+				&& boundedUntil.hasUpperBound()
+			) {
+				left = &boundedUntil.getLeftSubformula();
+				right = &boundedUntil.getRightSubformula();
+				timeBound = boundedUntil.getUpperBound().evaluateAsDouble();
+			}
+		}
+		if (!left || !right) {
+			continue;
+		}
+		util::CtmcSolver::UntilProblem problem;
+		problem.phi = checker->check(storm::modelchecker::CheckTask<>(*left))->asExplicitQualitativeCheckResult().getTruthValuesVector();
+		problem.psi = checker->check(storm::modelchecker::CheckTask<>(*right))->asExplicitQualitativeCheckResult().getTruthValuesVector();
+		problem.timeBound = timeBound;
+		// Transient probabilities are not iterative, but the uniformization is reused
+		if (timeBound < 0.0) {
+			problem.initialGuess = solver->warmStart(previousSolutions[index], absorbingStateIndex);
+		}
+		problems.push_back(std::move(problem));
+		solvedFormulas.push_back(index);
+	}
+	if (!problems.empty()) {
+		auto solutions = solver->solve(problems);
+		for (uint64_t problem = 0; problem < problems.size(); ++problem) {
+			uint64_t index = solvedFormulas[problem];
+			previousSolutions[index] = std::move(solutions[problem]);
+			results[index] = previousSolutions[index][initialState];
+		}
+		StaminaMessages::info("Solved " + std::to_string(problems.size()) + " properties in " + std::to_string(solver->getLastSweepCount()) + " sweeps");
+	}
+	// Fall back to STORM's checker for everything else
+	for (uint64_t index = 0; index < formulas.size(); ++index) {
+		if (std::find(solvedFormulas.begin(), solvedFormulas.end(), index) != solvedFormulas.end()) {
+			continue;
+		}
+		previousSolutions[index].clear();
+		auto result = checker->check(storm::modelchecker::CheckTask<>(*formulas[index], true));
+		results[index] = result->asExplicitQuantitativeCheckResult<double>()[initialState];
+	}
+	return results;
+}
+
+std::vector<ResultInformation>
+StaminaModelChecker::modelCheckProperties(
+	std::vector<storm::jani::Property> const & properties
+	, storm::prism::Program const& modulesFile
+) {
+	uint64_t numberOfPairs = properties.size() / 2;
+	if (Options::import_filename != "" && importModel(modulesFile)) {
+		// Every pair is checked on the same imported model anyway
+		std::vector<ResultInformation> resultInformation;
+		for (uint64_t pair = 0; pair < numberOfPairs; pair++) {
+			checkImportedModel(properties[2 * pair], properties[2 * pair + 1]);
+			resultInformation.push_back(getResultInformation());
+		}
+		return resultInformation;
+	}
+	std::vector<storm::logic::Formula const *> formulas;
+	std::vector<std::shared_ptr<storm::logic::Formula const>> filterFormulas;
+	for (uint64_t i = 0; i < 2 * numberOfPairs; i++) {
+		formulas.push_back(properties[i].getRawFormula().get());
+		filterFormulas.push_back(properties[i].getFilter().getFormula());
+	}
+	// One exploration for all of the properties. The labels of every property are built on it, but
+	// no property is used to prune the exploration.
+	{
+		std::lock_guard<std::mutex> setupGuard(setupLock);
+		createBuilder(BuilderOptions(filterFormulas), modulesFile);
+		setUpCheckpoint(Options::checkpoint_file);
+	}
+	if (!Options::no_prop_refine) {
+		StaminaMessages::info("Property based refinement is only applied when checking each property against the shared state space");
+	}
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	solver = std::make_shared<util::CtmcSolver>(CTMC_SOLVER_PRECISION, Options::max_iterations);
+	previousSolutions.clear();
+	std::vector<double> results(formulas.size(), 0.0);
+	double approxFactor = builder->getApproxFactor();
+	int numRefineIterations = 0;
+	double largestWindow = 1.0;
+	util::Metrics::Run metricsRun;
+	for (uint64_t pair = 0; pair < numberOfPairs; pair++) {
+		metricsRun.property += (pair == 0 ? "" : ", ") + properties[2 * pair].getName();
+	}
+
+	while (numRefineIterations == 0
+		|| (largestWindow > Options::prob_win && numRefineIterations < Options::max_approx_count)
+	) {
+		StaminaMessages::info("Approximation [Refine Iterations: " + std::to_string(numRefineIterations) + ", kappa = " + std::to_string(builder->getLocalKappa()) + ", " + std::to_string(numberOfPairs) + " property pairs]");
+		util::Metrics::Iteration metricsIteration;
+		metricsIteration.refinementIteration = numRefineIterations;
+		metricsIteration.kappa = builder->getLocalKappa();
+		metricsIteration.approxFactor = approxFactor;
+		util::PerfCounters::Totals perfCountersBeforeBuild = getPerfCounterTotals();
+		auto buildStartTime = std::chrono::high_resolution_clock::now();
+		auto model = builder->build()->template as<storm::models::sparse::Ctmc<double>>();
+		lastModel = model;
+		numberStates = model->getNumberOfStates();
+		numberInitial = model->getInitialStates().getNumberOfSetBits();
+		labeling = &( model->getStateLabeling());
+		labeling->addLabel("(Absorbing = true)");
+		labeling->addLabelToState("(Absorbing = true)", 0);
+
+		auto checker = std::make_shared<CtmcModelChecker>(*model);
+		solver->setModel(model->getTransitionMatrix());
+		auto checkStartTime = std::chrono::high_resolution_clock::now();
+		std::chrono::duration<double> buildTime = checkStartTime - buildStartTime;
+		metricsIteration.buildTime = buildTime.count();
+		try {
+			// Every property is solved in the same pass, each starting from its last solution
+			results = checkProperties(
+				formulas
+				, checker
+				, *model->getInitialStates().begin()
+				, previousSolutions
+			);
+		}
+		catch (std::exception& e) {
+			StaminaMessages::errorAndExit(e.what());
+		}
+		reportPerfCounters(perfCountersBeforeBuild, metricsIteration);
+		reportMemory(metricsIteration);
+		if (Options::metrics_out != "") {
+			std::chrono::duration<double> checkTime = std::chrono::high_resolution_clock::now() - checkStartTime;
+			metricsIteration.checkTime = checkTime.count();
+			metricsIteration.solverSweeps = solver->getLastSweepCount();
+			metricsIteration.results = results;
+			builder->recordMetrics(metricsIteration);
+			metricsRun.iterations.push_back(std::move(metricsIteration));
+		}
+		largestWindow = 0.0;
+		for (uint64_t pair = 0; pair < numberOfPairs; pair++) {
+			largestWindow = std::max(largestWindow, results[2 * pair + 1] - results[2 * pair]);
+		}
+		builder->printStateSpaceInformation();
+		StaminaMessages::info("At this refine iteration, the largest window is " + std::to_string(largestWindow) + "\n"
+			+ "There are " + std::to_string(builder->getNumberOfPerimeterStates()) + " perimeter states"
+		);
+		// The misprediction factor is refined for the property which is furthest off
+		double percentOff = largestWindow * 4.0 / Options::prob_win;
+		if (percentOff > 1.0) {
+			percentOff = 1.0;
+		}
+		approxFactor *= percentOff;
+		builder->setApproxFactor(approxFactor);
+		if (Options::export_perimeter_states != "") {
+			writePerimeterStates(numRefineIterations);
+		}
+		++numRefineIterations;
+	}
+	startExport(Options::export_filename);
+	printTransitionActions(Options::export_trans);
+
+	std::chrono::duration<double> timeTaken = std::chrono::high_resolution_clock::now() - startTime;
+	if (Options::metrics_out != "") {
+		metricsRun.totalTime = timeTaken.count();
+		util::Metrics::addRun(std::move(metricsRun));
+	}
+	StaminaMessages::info("Checked " + std::to_string(numberOfPairs) + " property pairs on a shared state space in " + std::to_string(timeTaken.count()) + " s");
+
+	std::vector<ResultInformation> resultInformation(numberOfPairs);
+	for (uint64_t pair = 0; pair < numberOfPairs; pair++) {
+		resultInformation[pair].pMin = results[2 * pair];
+		resultInformation[pair].pMax = results[2 * pair + 1];
+		resultInformation[pair].numberStates = numberStates;
+		resultInformation[pair].numberInitial = numberInitial;
+		resultInformation[pair].property = properties[2 * pair].getName();
+	}
+	return resultInformation;
+}
+
+ResultInformation
+StaminaModelChecker::getResultInformation() const {
+	ResultInformation resultInformation;
+	resultInformation.pMin = min_results ? min_results->result : 0.0;
+	resultInformation.pMax = max_results ? max_results->result : 0.0;
+	resultInformation.numberStates = numberStates;
+	resultInformation.numberInitial = numberInitial;
+	resultInformation.property = propertyName;
+	return resultInformation;
+}
+
+void
+StaminaModelChecker::createBuilder(
+	BuilderOptions const & options
+	, storm::prism::Program const& modulesFile
+) {
+	// The builder keeps a reference to its options, so they are kept here
+	builderOptions.reset(new BuilderOptions(options));
 	if (Options::export_trans != "") {
-		StaminaMessages::info("Exporting transitions to file: " + Options::export_trans);
-		printTransitionActions(Options::export_trans);
-		StaminaMessages::good("Export Complete!");
+		// The actions of each state are needed to export transitions
+		builderOptions->setBuildChoiceLabels(true);
 	}
+	// Create PrismNextStateGenerator. May need to create a NextStateGeneratorOptions for it if default is not working
+	auto generator = CompiledNextStateGenerator<double, uint32_t>::create(modulesFile, *builderOptions);
 
-	return nullptr;
+	if (Options::method == STAMINA_METHODS::ITERATIVE_METHOD) {
+		// Create StaminaModelBuilder
+		auto builderPointer = std::make_shared<StaminaIterativeModelBuilder<double>> (generator, modulesFile, *builderOptions);
+		builder = std::static_pointer_cast<StaminaModelBuilder<double>>(builderPointer);
+	}
+	else if (Options::method == STAMINA_METHODS::PRIORITY_METHOD) {
+		// Create StaminaModelBuilder
+		auto builderPointer = std::make_shared<StaminaPriorityModelBuilder<double>> (generator, modulesFile, *builderOptions);
+		builder = std::static_pointer_cast<StaminaModelBuilder<double>>(builderPointer);
+	}
+	else if (Options::method == STAMINA_METHODS::RE_EXPLORING_METHOD) {
+		auto builderPointer = std::make_shared<StaminaReExploringModelBuilder<double>> (generator, modulesFile, *builderOptions);
+		builder = std::static_pointer_cast<StaminaModelBuilder<double>>(builderPointer);
+	}
+	else {
+		StaminaMessages::errorAndExit("Truncation method is invalid!");
+	}
+}
+
+bool
+StaminaModelChecker::importModel(storm::prism::Program const& modulesFile) {
+	if (importedModel || importFailed) {
+		return !importFailed;
+	}
+	std::string filename = Options::import_filename;
+	StaminaMessages::info("Importing model from " + filename + ".tra, .sta and .lab");
+	auto startTime = std::chrono::high_resolution_clock::now();
+	try {
+		{
+			// Only used for where each variable is in a state
+			std::lock_guard<std::mutex> setupGuard(setupLock);
+			importGenerator = std::make_shared<storm::generator::PrismNextStateGenerator<double, uint32_t>>(
+				modulesFile
+				, storm::generator::NextStateGeneratorOptions()
+			);
+		}
+		importReader = std::make_unique<util::ExplicitModelReader>(
+			filename
+			, importGenerator->getVariableInformation()
+			, std::max<uint16_t>(std::thread::hardware_concurrency(), 1)
+		);
+		auto transitionMatrix = importReader->readTransitions();
+		uint64_t numberOfStates = transitionMatrix.getRowCount();
+		importReader->readStates(numberOfStates);
+		auto stateLabeling = importReader->readLabels(numberOfStates);
+		if (!stateLabeling.containsLabel("(Absorbing = true)")) {
+			stateLabeling.addLabel("(Absorbing = true)");
+			stateLabeling.addLabelToState("(Absorbing = true)", 0);
+		}
+		storm::storage::sparse::ModelComponents<double, storm::models::sparse::StandardRewardModel<double>> modelComponents(
+			std::move(transitionMatrix)
+			, std::move(stateLabeling)
+			, std::unordered_map<std::string, storm::models::sparse::StandardRewardModel<double>>()
+			, true // Rates
+		);
+		importedModel = std::make_shared<storm::models::sparse::Ctmc<double>>(std::move(modelComponents));
+	}
+	catch (const std::exception& e) {
+		std::stringstream ss;
+		ss << "Cannot import file: " << filename << '\n';
+		ss << BOLD("\tGot Error:") << e.what() << '\n';
+		ss << "The model will be explored instead.";
+		StaminaMessages::error(ss.str());
+		importFailed = true;
+		importReader.reset();
+		importGenerator.reset();
+		return false;
+	}
+	std::chrono::duration<double> timeTaken = std::chrono::high_resolution_clock::now() - startTime;
+	StaminaMessages::good(
+		"Imported " + std::to_string(importedModel->getNumberOfStates()) + " states and "
+		+ std::to_string(importedModel->getNumberOfTransitions()) + " transitions in "
+		+ std::to_string(timeTaken.count()) + " s"
+	);
+	return true;
+}
+
+void
+StaminaModelChecker::checkImportedModel(
+	storm::jani::Property const & propMin
+	, storm::jani::Property const & propMax
+) {
+	auto startTime = std::chrono::high_resolution_clock::now();
+	std::allocator<Result> allocatorResult;
+	min_results = std::allocate_shared<Result>(allocatorResult);
+	max_results = std::allocate_shared<Result>(allocatorResult);
+	propertyName = propMin.getName();
+	numberStates = importedModel->getNumberOfStates();
+	numberInitial = importedModel->getInitialStates().getNumberOfSetBits();
+	// The exported labels only cover the properties the model was truncated for
+	for (auto const & formula : {propMin.getRawFormula(), propMax.getRawFormula()}) {
+		for (auto const & atomicExpression : formula->getAtomicExpressionFormulas()) {
+			std::string label = atomicExpression->getExpression().toString();
+			if (!importedModel->getStateLabeling().containsLabel(label)) {
+				try {
+					importedModel->getStateLabeling().addLabel(label, importReader->getStatesSatisfying(atomicExpression->getExpression()));
+				}
+				catch (std::exception& e) {
+					StaminaMessages::errorAndExit("Cannot evaluate " + label + " on the imported model: " + e.what());
+				}
+			}
+		}
+	}
+
+	solver = std::make_shared<util::CtmcSolver>(CTMC_SOLVER_PRECISION, Options::max_iterations);
+	previousSolutions.clear();
+	auto checker = std::make_shared<CtmcModelChecker>(*importedModel);
+	solver->setModel(importedModel->getTransitionMatrix());
+	try {
+		auto results = checkProperties(
+			{propMin.getRawFormula().get(), propMax.getRawFormula().get()}
+			, checker
+			, *importedModel->getInitialStates().begin()
+			, previousSolutions
+		);
+		min_results->result = results[0];
+		max_results->result = results[1];
+	}
+	catch (std::exception& e) {
+		StaminaMessages::errorAndExit(e.what());
+	}
+
+	std::chrono::duration<double> timeTaken = std::chrono::high_resolution_clock::now() - startTime;
+	StaminaMessages::info("Finished checking property on the imported model: " + propMin.getName() + " (" + std::to_string(timeTaken.count()) + " s)");
+}
+
+void
+StaminaModelChecker::setUpCheckpoint(std::string const & filename) {
+	if (Options::checkpoint_file == "") {
+		return;
+	}
+	if (Options::resume) {
+		builder->resumeFromCheckpoint(filename);
+	}
+	builder->setCheckpointFile(filename);
+}
+
+util::PerfCounters::Totals
+StaminaModelChecker::getPerfCounterTotals() const {
+	util::PerfCounters::Totals totals = perfCounters.getTotals();
+	if (builder) {
+		totals += builder->getPerfCounters().getTotals();
+	}
+	return totals;
+}
+
+void
+StaminaModelChecker::reportPerfCounters(util::PerfCounters::Totals const & before, util::Metrics::Iteration & metricsIteration) {
+	if (!util::PerfCounters::isEnabled()) {
+		return;
+	}
+	util::PerfCounters::Totals counted = getPerfCounterTotals();
+	counted -= before;
+	StaminaMessages::info("Hardware counters for this refinement iteration:\n" + counted.toString());
+	metricsIteration.hasPerfCounters = true;
+	metricsIteration.perfCounters = counted;
+}
+
+void
+StaminaModelChecker::reportMemory(util::Metrics::Iteration & metricsIteration) {
+	util::MemoryAccounting::Usage usage = builder->accountMemory();
+	StaminaMessages::info("Memory used by the builder at the end of this refinement iteration:\n" + usage.toString());
+	metricsIteration.memory = usage;
+}
+
+std::string
+StaminaModelChecker::filenameForProperty(std::string const & filename, storm::jani::Property const & property) const {
+	if (filename == "" || !propertiesVector || propertiesVector->size() <= 2) {
+		return filename;
+	}
+	std::string suffix = property.getName();
+	std::replace_if(suffix.begin(), suffix.end(), [](unsigned char c) { return !std::isalnum(c); }, '_');
+	return filename + "_" + suffix;
+}
+
+void
+StaminaModelChecker::startExport(std::string const & filename) {
+	if (Options::export_filename == "" || !lastModel) {
+		return;
+	}
+	// Only one export at a time, since they may be to the same files
+	finishExport();
+	StaminaMessages::info("Exporting model to " + filename + ".tra, .sta and .lab in the background");
+	// The export keeps the builder (which owns the states) and the model alive until it is done, even
+	// if the next property replaces them
+	auto model = lastModel;
+	auto exportBuilder = builder;
+	exportThread = std::thread([model, exportBuilder, filename]() {
+		auto startTime = std::chrono::high_resolution_clock::now();
+		try {
+			util::ExplicitModelWriter<double, uint32_t> writer(
+				model
+				, exportBuilder->getStateStorage()
+				, exportBuilder->getVariableInformation()
+			);
+			writer.write(filename);
+			std::chrono::duration<double> timeTaken = std::chrono::high_resolution_clock::now() - startTime;
+			StaminaMessages::good("Exported model to " + filename + " in " + std::to_string(timeTaken.count()) + " s");
+		}
+		catch (const std::exception& e) {
+			std::stringstream ss;
+			ss << "Cannot export file: " << filename << '\n';
+			ss << BOLD("\tGot Error:") << e.what();
+			StaminaMessages::error(ss.str());
+		}
+	});
+}
+
+void
+StaminaModelChecker::finishExport() {
+	if (exportThread.joinable()) {
+		exportThread.join();
+	}
+	if (transitionExportThread.joinable()) {
+		transitionExportThread.join();
+	}
 }
 
 bool
@@ -279,7 +722,27 @@ StaminaModelChecker::writePerimeterStates(int numRefineIteration) {
 
 void
 StaminaModelChecker::printTransitionActions(std::string filename) {
-	StaminaMessages::warning("This feature (StaminaModelChecker::printTransitionActions()) has not been implemented yet");
+	if (filename == "" || !lastModel) {
+		return;
+	}
+	if (transitionExportThread.joinable()) {
+		transitionExportThread.join();
+	}
+	StaminaMessages::info("Exporting transitions to " + filename + " in the background");
+	// Like startExport(), this keeps the model and the builder (which owns the actions) alive
+	auto model = lastModel;
+	auto exportBuilder = builder;
+	transitionExportThread = std::thread([model, exportBuilder, filename]() {
+		auto startTime = std::chrono::high_resolution_clock::now();
+		try {
+			exportBuilder->getChoiceLabels().write(model->getTransitionMatrix(), filename, Options::export_trans_binary);
+			std::chrono::duration<double> timeTaken = std::chrono::high_resolution_clock::now() - startTime;
+			StaminaMessages::good("Exported transitions to " + filename + " in " + std::to_string(timeTaken.count()) + " s");
+		}
+		catch (const std::exception& e) {
+			StaminaMessages::error("Cannot export transitions to " + filename + ":\n\t" + std::string(e.what()));
+		}
+	});
 }
 
 void
@@ -2,13 +2,18 @@
 #define STAMINA_MODEL_CHECKER_H
 
 #include "Options.h"
+#include "StaminaMessages.h"
 #include "builder/StaminaModelBuilder.h"
 #include "builder/StaminaIterativeModelBuilder.h"
-// #include "builder/StaminaPriorityModelBuilder.h"
+#include "builder/StaminaPriorityModelBuilder.h"
 #include "builder/StaminaReExploringModelBuilder.h"
+#include "util/CtmcSolver.h"
+#include "util/ExplicitModelReader.h"
+#include "util/PerfCounters.h"
 
 #include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_set>
 
 #include "__storm_needed_for_checker.h"
@@ -54,6 +59,26 @@ namespace stamina {
 			, storm::jani::Property propMax
 			, storm::prism::Program const& modulesFile
 		);
+		/**
+		 * Model checks all of the property pairs on a single truncated state space, which is refined
+		 * until the window of every pair is within Options::prob_win. All properties are solved
+		 * together in each refinement iteration. Property based refinement does not prune the shared
+		 * exploration; each property only constrains its own check on it.
+		 *
+		 * @param properties The properties, as (min, max) pairs
+		 * @param modulesFile The modules file to work with
+		 * @return The results for each pair, in order
+		 * */
+		std::vector<ResultInformation> modelCheckProperties(
+			std::vector<storm::jani::Property> const & properties
+			, storm::prism::Program const& modulesFile
+		);
+		/**
+		 * Gets the results of the last property checked by modelCheckProperty()
+		 *
+		 * @return The result information
+		 * */
+		ResultInformation getResultInformation() const;
 	private:
 		/**
 		 * Result subclass (no private members since is a private subclass)
@@ -87,6 +112,98 @@ namespace stamina {
 			std::string explanation;
 
 		};
+		/**
+		 * Checks properties on the model of the current refinement iteration. Until properties are
+		 * all solved together by our own solver, starting from their solutions in the last iteration.
+		 * Everything else is passed on to STORM.
+		 *
+		 * @param formulas The formulas to check
+		 * @param checker STORM's checker for the current model. Also used for state subformulas
+		 * @param initialState The initial state of the model
+		 * @param previousSolutions The solution of each formula in the last iteration. Replaced with
+		 * the solutions in this iteration
+		 * @return The result for the initial state, for each formula
+		 * */
+		std::vector<double> checkProperties(
+			std::vector<storm::logic::Formula const *> const & formulas
+			, std::shared_ptr<CtmcModelChecker> checker
+			, uint64_t initialState
+			, std::vector<std::vector<double>> & previousSolutions
+		);
+		/**
+		 * Reads the model in Options::import_filename (once) into importedModel
+		 *
+		 * @param modulesFile The modules file the model was built from
+		 * @return Whether or not the model could be read
+		 * */
+		bool importModel(storm::prism::Program const& modulesFile);
+		/**
+		 * Checks a property pair on importedModel, rather than exploring and truncating the model.
+		 * Expressions in the properties which are not labels in the imported files are evaluated
+		 * over the imported states.
+		 *
+		 * @param propMin The property for the lower bound
+		 * @param propMax The property for the upper bound
+		 * */
+		void checkImportedModel(storm::jani::Property const & propMin, storm::jani::Property const & propMax);
+		/**
+		 * Creates the generator and the builder for the truncation method in Options
+		 *
+		 * @param options The builder options (which decide the labels which are built)
+		 * @param modulesFile The modules file to work with
+		 * */
+		void createBuilder(
+			storm::builder::BuilderOptions const & options
+			, storm::prism::Program const& modulesFile
+		);
+		/**
+		 * Sets up checkpoints of the builder's exploration, if Options::checkpoint_file is set, and
+		 * resumes from the checkpoint if Options::resume is set. Must be called before the first build.
+		 *
+		 * @param filename The checkpoint file
+		 * */
+		void setUpCheckpoint(std::string const & filename);
+		/**
+		 * Gets the file for something written about a single property. When several properties are
+		 * checked one at a time, each gets its own file (filename_<property name>), since they would
+		 * otherwise all write to the same one.
+		 *
+		 * @param filename The file given in Options
+		 * @param property The property
+		 * @return The file for the property
+		 * */
+		std::string filenameForProperty(std::string const & filename, storm::jani::Property const & property) const;
+		/**
+		 * Gets the hardware counters of the builder and of checking, added together
+		 *
+		 * @return Everything counted so far, by phase
+		 * */
+		util::PerfCounters::Totals getPerfCounterTotals() const;
+		/**
+		 * Reports what the hardware counters counted in a refinement iteration, if they are enabled
+		 *
+		 * @param before What getPerfCounterTotals() returned before the iteration's build
+		 * @param metricsIteration The metrics of the iteration, which get the counts
+		 * */
+		void reportPerfCounters(util::PerfCounters::Totals const & before, util::Metrics::Iteration & metricsIteration);
+		/**
+		 * Reports the memory used by each part of the builder at the end of a refinement iteration (and
+		 * stops if the memory cap is exceeded)
+		 *
+		 * @param metricsIteration The metrics of the iteration, which get the memory used
+		 * */
+		void reportMemory(util::Metrics::Iteration & metricsIteration);
+		/**
+		 * Starts exporting the last model built (lastModel) to explicit files in the background, if
+		 * Options::export_filename is set. Waits for any export which is still running first.
+		 *
+		 * @param filename The filename to export to, without an extension
+		 * */
+		void startExport(std::string const & filename);
+		/**
+		 * Waits for the export started by startExport() (if any) to finish
+		 * */
+		void finishExport();
 		/**
 		 * Whether or not to terminate model check
 		 *
@@ -98,7 +215,10 @@ namespace stamina {
 		 * */
 		void writePerimeterStates(int numRefineIteration);
 		/**
-		 * Prints all of the transition actions to a file.
+		 * Starts exporting the transitions of the last model built (lastModel), with the action of each,
+		 * to a file in the background. Does nothing if the filename is empty.
+		 *
+		 * @param filename The file to export to
 		 * */
 		void printTransitionActions(std::string filename);
 		/**
@@ -115,11 +235,32 @@ namespace stamina {
 		std::shared_ptr<StaminaModelChecker::Result> min_results;
 		std::shared_ptr<StaminaModelChecker::Result> max_results;
 		std::shared_ptr<StaminaModelBuilder<double>> builder;
+		// The model from the last refinement iteration, for export
+		std::shared_ptr<storm::models::sparse::Ctmc<double>> lastModel;
+		std::thread exportThread;
+		std::thread transitionExportThread;
+		// The options the builder was created with, which it keeps a reference to
+		std::unique_ptr<storm::builder::BuilderOptions> builderOptions;
+		// The model from Options::import_filename, the generator which knows its variables, and the
+		// reader which holds its states
+		std::shared_ptr<storm::models::sparse::Ctmc<double>> importedModel;
+		std::shared_ptr<storm::generator::PrismNextStateGenerator<double, uint32_t>> importGenerator;
+		std::unique_ptr<util::ExplicitModelReader> importReader;
+		std::shared_ptr<util::CtmcSolver> solver;
+		std::vector<std::vector<double>> previousSolutions;
 		std::shared_ptr<storm::prism::Program> modulesFile;
 		std::shared_ptr<std::vector<storm::jani::Property>> propertiesVector;
 		storm::expressions::ExpressionManager expressionManager;
 		storm::models::sparse::StateLabeling * labeling;
 		std::string preUntilLabel;
+		// Information about the last property checked, for getResultInformation()
+		std::string propertyName;
+		uint64_t numberStates;
+		uint64_t numberInitial;
+		// Whether reading Options::import_filename failed, in which case the model is explored
+		bool importFailed;
+		// Hardware counters for checkProperties() (the builder keeps its own)
+		util::PerfCounters perfCounters;
 	};
 
 }
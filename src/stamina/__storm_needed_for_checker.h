@@ -12,6 +12,7 @@
 #include "storm/storage/jani/Property.h"
 #include "storm/modelchecker/results/CheckResult.h"
 #include "storm/modelchecker/results/ExplicitQuantitativeCheckResult.h"
+#include "storm/modelchecker/results/ExplicitQualitativeCheckResult.h"
 #include "storm/utility/initialize.h"
 #include "storm-parsers/api/properties.h"
 #include "storm/models/sparse/Ctmc.h"
@@ -26,6 +27,7 @@
 #include "storm/storage/expressions/UnaryBooleanFunctionExpression.h"
 #include "storm/storage/expressions/BinaryBooleanFunctionExpression.h"
 #include "storm/logic/Formula.h"
+#include "storm/logic/Formulas.h"
 #include "storm/storage/prism/Constant.h"
 #include "storm/settings/SettingsManager.h"
 #include "storm/storage/expressions/Valuation.h"
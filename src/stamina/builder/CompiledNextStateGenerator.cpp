@@ -0,0 +1,477 @@
+#include "CompiledNextStateGenerator.h"
+
+#include "../Options.h"
+#include "../StaminaMessages.h"
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "storm/storage/BitVectorHashMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+// Number of states (found breadth-first from the initial states) on which the compiled code is
+// checked against PrismNextStateGenerator before it is used
+#define COMPILED_GENERATOR_CHECK_STATES 1000
+// Relative difference allowed between the rates computed by the compiled code and by STORM
+#define COMPILED_GENERATOR_RATE_TOLERANCE 1e-12
+
+// Code at the start of every generated program
+#define GENERATED_PREAMBLE \
+	"#include <cstdint>\n" \
+	"#include <cmath>\n" \
+	"static inline uint64_t mask(uint64_t width) { return width >= 64 ? ~0ULL : ((1ULL << width) - 1); }\n" \
+	"// Bit 0 of a CompressedState is the most significant bit of its first word\n" \
+	"static inline uint64_t getBits(uint64_t const * s, uint64_t offset, uint64_t width) {\n" \
+	"\tuint64_t word = offset >> 6, shift = offset & 63;\n" \
+	"\tif (shift + width <= 64) { return (s[word] >> (64 - shift - width)) & mask(width); }\n" \
+	"\tuint64_t low = shift + width - 64;\n" \
+	"\treturn ((s[word] & mask(64 - shift)) << low) | (s[word + 1] >> (64 - low));\n" \
+	"}\n" \
+	"static inline void setBits(uint64_t * s, uint64_t offset, uint64_t width, uint64_t value) {\n" \
+	"\tuint64_t word = offset >> 6, shift = offset & 63;\n" \
+	"\tif (shift + width <= 64) {\n" \
+	"\t\tuint64_t at = 64 - shift - width;\n" \
+	"\t\ts[word] = (s[word] & ~(mask(width) << at)) | ((value & mask(width)) << at);\n" \
+	"\t\treturn;\n" \
+	"\t}\n" \
+	"\tuint64_t low = shift + width - 64;\n" \
+	"\ts[word] = (s[word] & ~mask(64 - shift)) | ((value >> low) & mask(64 - shift));\n" \
+	"\ts[word + 1] = (s[word + 1] & mask(64 - low)) | ((value & mask(low)) << (64 - low));\n" \
+	"}\n"
+
+namespace stamina {
+namespace builder {
+
+template <typename ValueType, typename StateType>
+std::shared_ptr<typename CompiledNextStateGenerator<ValueType, StateType>::BaseGenerator>
+CompiledNextStateGenerator<ValueType, StateType>::create(
+	storm::prism::Program const & program
+	, storm::generator::NextStateGeneratorOptions const & options
+) {
+	if (Options::compiled_generator) {
+		return std::make_shared<CompiledNextStateGenerator<ValueType, StateType>>(program, options);
+	}
+	return std::make_shared<BaseGenerator>(program, options);
+}
+
+template <typename ValueType, typename StateType>
+CompiledNextStateGenerator<ValueType, StateType>::CompiledNextStateGenerator(
+	storm::prism::Program const & program
+	, storm::generator::NextStateGeneratorOptions const & options
+) : BaseGenerator(program, options)
+	, expandFunction(nullptr)
+	, capacity(0)
+{
+	if (!canCompile()) {
+		StaminaMessages::warning("This model cannot be compiled (only CTMCs without rewards, choice labels or terminal states can be). Using STORM's generator.");
+		return;
+	}
+	try {
+		expandFunction = compile(generateSource());
+	}
+	catch (std::exception const & e) {
+		StaminaMessages::warning("Could not compile the model, so STORM's generator will be used:\n\t" + std::string(e.what()));
+		expandFunction = nullptr;
+		return;
+	}
+	if (!matchesBaseGenerator()) {
+		expandFunction = nullptr;
+	}
+}
+
+template <typename ValueType, typename StateType>
+bool
+CompiledNextStateGenerator<ValueType, StateType>::isCompiled() const {
+	return expandFunction != nullptr;
+}
+
+template <typename ValueType, typename StateType>
+storm::generator::StateBehavior<ValueType, StateType>
+CompiledNextStateGenerator<ValueType, StateType>::expand(StateToIdCallback const & stateToIdCallback) {
+	if (!expandFunction) {
+		return BaseGenerator::expand(stateToIdCallback);
+	}
+	storm::generator::CompressedState const & state = *this->state;
+	uint64_t numberOfBits = state.size();
+	uint64_t words = (numberOfBits + 63) >> 6;
+	packedState.resize(words);
+	for (uint64_t word = 0; word < words; ++word) {
+		uint64_t width = std::min<uint64_t>(64, numberOfBits - (word << 6));
+		packedState[word] = state.getAsInt(word << 6, width) << (64 - width);
+	}
+	int64_t numberOfSuccessors = expandFunction(packedState.data(), successors.data(), rates.data(), capacity);
+	if (numberOfSuccessors > capacity) {
+		// Grow the buffers to fit and expand again
+		capacity = numberOfSuccessors * 2;
+		successors.resize(capacity * words);
+		rates.resize(capacity);
+		numberOfSuccessors = expandFunction(packedState.data(), successors.data(), rates.data(), capacity);
+	}
+	if (numberOfSuccessors < 0) {
+		// Let STORM deal with (and report) this state
+		return BaseGenerator::expand(stateToIdCallback);
+	}
+	storm::generator::StateBehavior<ValueType, StateType> result;
+	if (numberOfSuccessors > 0) {
+		storm::generator::Choice<ValueType, StateType> choice(0);
+		storm::generator::CompressedState successor(numberOfBits);
+		for (int64_t i = 0; i < numberOfSuccessors; ++i) {
+			uint64_t const * packedSuccessor = successors.data() + i * words;
+			for (uint64_t word = 0; word < words; ++word) {
+				uint64_t width = std::min<uint64_t>(64, numberOfBits - (word << 6));
+				successor.setFromInt(word << 6, width, packedSuccessor[word] >> (64 - width));
+			}
+			choice.addProbability(stateToIdCallback(successor), rates[i]);
+		}
+		result.addChoice(std::move(choice));
+	}
+	result.setExpanded();
+	return result;
+}
+
+template <typename ValueType, typename StateType>
+bool
+CompiledNextStateGenerator<ValueType, StateType>::matchesBaseGenerator() {
+	storm::storage::BitVectorHashMap<StateType> stateToId(this->getStateSize(), 1024);
+	std::vector<storm::generator::CompressedState> states;
+	StateToIdCallback addState = [&](storm::generator::CompressedState const & state) {
+		StateType newId = states.size();
+		StateType id = stateToId.findOrAdd(state, newId);
+		if (id == newId) {
+			states.push_back(state);
+		}
+		return id;
+	};
+	// The total rate to each successor
+	auto getTransitions = [](storm::generator::StateBehavior<ValueType, StateType> const & behavior) {
+		std::map<StateType, ValueType> transitions;
+		for (auto const & choice : behavior) {
+			for (auto const & stateAndRate : choice) {
+				transitions[stateAndRate.first] += stateAndRate.second;
+			}
+		}
+		return transitions;
+	};
+	this->getInitialStates(addState);
+	for (uint64_t index = 0; index < states.size() && index < COMPILED_GENERATOR_CHECK_STATES; ++index) {
+		// The generator keeps a pointer to the loaded state, and addState() may move states
+		storm::generator::CompressedState state = states[index];
+		this->load(state);
+		auto expected = getTransitions(BaseGenerator::expand(addState));
+		auto actual = getTransitions(expand(addState));
+		bool matches = expected.size() == actual.size();
+		for (auto expectedIt = expected.begin(), actualIt = actual.begin(); matches && expectedIt != expected.end(); ++expectedIt, ++actualIt) {
+			double tolerance = COMPILED_GENERATOR_RATE_TOLERANCE * std::max(std::fabs(expectedIt->second), std::fabs(actualIt->second));
+			matches = expectedIt->first == actualIt->first
+				&& std::fabs(expectedIt->second - actualIt->second) <= tolerance;
+		}
+		if (!matches) {
+			StaminaMessages::warning("The compiled model does not give the same transitions as STORM's generator (in state "
+				+ std::to_string(index) + " of the exploration), so STORM's generator will be used");
+			return false;
+		}
+	}
+	return true;
+}
+
+template <typename ValueType, typename StateType>
+bool
+CompiledNextStateGenerator<ValueType, StateType>::canCompile() const {
+	return this->program.getModelType() == storm::prism::Program::ModelType::CTMC
+		&& this->getNumberOfRewardModels() == 0
+		&& !this->options.isBuildChoiceLabelsSet()
+		&& !this->options.isBuildChoiceOriginsSet()
+		&& this->terminalStates.empty();
+}
+
+template <typename ValueType, typename StateType>
+std::string
+CompiledNextStateGenerator<ValueType, StateType>::generateSource() {
+	auto const & variableInformation = this->variableInformation;
+	uint64_t words = (variableInformation.getTotalBitOffset(true) + 63) >> 6;
+	std::stringstream source;
+	source << GENERATED_PREAMBLE;
+	source << "extern \"C\" int64_t stamina_expand(uint64_t const * s, uint64_t * successors, double * rates, int64_t capacity) {\n";
+	source << "\tconst uint64_t words = " << words << ";\n";
+	source << "\tint64_t count = 0;\n";
+	source << "\tuint64_t t[" << words << "];\n";
+	// Read all of the variables. The compiler drops the ones which are not used.
+	uint64_t variableIndex = 0;
+	for (auto const & booleanVariable : variableInformation.booleanVariables) {
+		VariableLocation location{true, booleanVariable.bitOffset, 1, 0, 1, "b" + std::to_string(variableIndex++)};
+		variableLocations[booleanVariable.variable.getName()] = location;
+		source << "\tconst bool " << location.cppName << " = getBits(s, " << location.bitOffset << ", 1);\n";
+	}
+	for (auto const & integerVariable : variableInformation.integerVariables) {
+		VariableLocation location{
+			false
+			, integerVariable.bitOffset
+			, integerVariable.bitWidth
+			, integerVariable.lowerBound
+			, integerVariable.upperBound
+			, "v" + std::to_string(variableIndex++)
+		};
+		variableLocations[integerVariable.variable.getName()] = location;
+		source << "\tconst int64_t " << location.cppName << " = " << location.lowerBound << "LL + (int64_t) getBits(s, "
+			<< location.bitOffset << ", " << location.bitWidth << ");\n";
+	}
+	// Adds the successor in t, with rate
+	source << "#define EMIT(rate) { if (count < capacity) { for (uint64_t w = 0; w < words; ++w) { successors[count * words + w] = t[w]; } rates[count] = (rate); } ++count; }\n";
+
+	auto const & program = this->program;
+	auto const & modules = program.getModules();
+	// Unsynchronized commands each give their own transitions
+	for (auto const & module : modules) {
+		for (auto const & command : module.getCommands()) {
+			if (command.isLabeled()) {
+				continue;
+			}
+			source << "\tif (" << expressionToCpp(command.getGuardExpression()) << ") {\n";
+			for (auto const & update : command.getUpdates()) {
+				source << "\t\t{\n";
+				source << "\t\t\tconst double rate = " << expressionToCpp(update.getLikelihoodExpression()) << ";\n";
+				source << "\t\t\tif (rate != 0) {\n";
+				source << "\t\t\t\tfor (uint64_t w = 0; w < words; ++w) { t[w] = s[w]; }\n";
+				source << assignmentsToCpp(update, "\t\t\t\t");
+				source << "\t\t\t\tEMIT(rate)\n";
+				source << "\t\t\t}\n";
+				source << "\t\t}\n";
+			}
+			source << "\t}\n";
+		}
+	}
+	// Synchronized commands: one command of each module with the action must be enabled, and the
+	// rate is the product of the rates of the updates of each module
+	for (auto const & actionIndex : program.getSynchronizingActionIndices()) {
+		auto const & moduleIndices = program.getModuleIndicesByActionIndex(actionIndex);
+		std::string action = "a" + std::to_string(actionIndex);
+		source << "\t{\n";
+		source << "\t\t// Action " << program.getActionName(actionIndex) << "\n";
+		std::vector<std::string> moduleNames;
+		for (auto const & moduleIndex : moduleIndices) {
+			auto const & module = modules[moduleIndex];
+			std::string name = action + "m" + std::to_string(moduleIndex);
+			moduleNames.push_back(name);
+			uint64_t numberOfUpdates = 0;
+			for (auto const & commandIndex : module.getCommandIndicesByActionIndex(actionIndex)) {
+				numberOfUpdates += module.getCommand(commandIndex).getNumberOfUpdates();
+			}
+			source << "\t\tdouble " << name << "Rate[" << std::max<uint64_t>(numberOfUpdates, 1) << "];\n";
+			source << "\t\tuint32_t " << name << "Update[" << std::max<uint64_t>(numberOfUpdates, 1) << "];\n";
+			source << "\t\tuint32_t " << name << "Count = 0;\n";
+			uint64_t updateId = 0;
+			for (auto const & commandIndex : module.getCommandIndicesByActionIndex(actionIndex)) {
+				auto const & command = module.getCommand(commandIndex);
+				source << "\t\tif (" << expressionToCpp(command.getGuardExpression()) << ") {\n";
+				for (auto const & update : command.getUpdates()) {
+					source << "\t\t\t" << name << "Rate[" << name << "Count] = " << expressionToCpp(update.getLikelihoodExpression()) << ";\n";
+					source << "\t\t\t" << name << "Update[" << name << "Count++] = " << updateId++ << ";\n";
+				}
+				source << "\t\t}\n";
+			}
+		}
+		// Every combination of enabled updates
+		std::string indent = "\t\t";
+		std::string rate = "1.0";
+		for (auto const & name : moduleNames) {
+			source << indent << "for (uint32_t " << name << "I = 0; " << name << "I < " << name << "Count; ++" << name << "I) {\n";
+			indent += "\t";
+			rate += " * " + name + "Rate[" + name + "I]";
+		}
+		source << indent << "const double rate = " << rate << ";\n";
+		source << indent << "if (rate != 0) {\n";
+		source << indent << "\tfor (uint64_t w = 0; w < words; ++w) { t[w] = s[w]; }\n";
+		auto name = moduleNames.begin();
+		for (auto const & moduleIndex : moduleIndices) {
+			auto const & module = modules[moduleIndex];
+			source << indent << "\tswitch (" << *name << "Update[" << *name << "I]) {\n";
+			uint64_t updateId = 0;
+			for (auto const & commandIndex : module.getCommandIndicesByActionIndex(actionIndex)) {
+				for (auto const & update : module.getCommand(commandIndex).getUpdates()) {
+					source << indent << "\t\tcase " << updateId++ << ":\n";
+					source << assignmentsToCpp(update, indent + "\t\t\t");
+					source << indent << "\t\t\tbreak;\n";
+				}
+			}
+			source << indent << "\t}\n";
+			++name;
+		}
+		source << indent << "\tEMIT(rate)\n";
+		source << indent << "}\n";
+		for (uint64_t i = 0; i < moduleNames.size(); ++i) {
+			indent.pop_back();
+			source << indent << "}\n";
+		}
+		source << "\t}\n";
+	}
+	source << "\treturn count;\n";
+	source << "}\n";
+	return source.str();
+}
+
+template <typename ValueType, typename StateType>
+std::string
+CompiledNextStateGenerator<ValueType, StateType>::assignmentsToCpp(
+	storm::prism::Update const & update
+	, std::string const & indent
+) const {
+	std::stringstream code;
+	for (auto const & assignment : update.getAssignments()) {
+		auto location = variableLocations.find(assignment.getVariable().getName());
+		if (location == variableLocations.end()) {
+			throw std::runtime_error("Unknown variable " + assignment.getVariable().getName());
+		}
+		auto const & variable = location->second;
+		std::string value = expressionToCpp(assignment.getExpression());
+		if (variable.isBoolean) {
+			code << indent << "setBits(t, " << variable.bitOffset << ", 1, (" << value << ") ? 1 : 0);\n";
+		}
+		else {
+			code << indent << "{\n";
+			code << indent << "\tconst int64_t value = " << value << ";\n";
+			// Out of bounds. PrismNextStateGenerator reports the error.
+			code << indent << "\tif (value < " << variable.lowerBound << "LL || value > " << variable.upperBound << "LL) { return -1; }\n";
+			code << indent << "\tsetBits(t, " << variable.bitOffset << ", " << variable.bitWidth << ", (uint64_t) (value - " << variable.lowerBound << "LL));\n";
+			code << indent << "}\n";
+		}
+	}
+	return code.str();
+}
+
+template <typename ValueType, typename StateType>
+std::string
+CompiledNextStateGenerator<ValueType, StateType>::expressionToCpp(storm::expressions::Expression const & expression) const {
+	using storm::expressions::OperatorType;
+	if (expression.isLiteral()) {
+		std::stringstream literal;
+		if (expression.hasBooleanType()) {
+			literal << (expression.evaluateAsBool() ? "true" : "false");
+		}
+		else if (expression.hasIntegerType()) {
+			literal << expression.evaluateAsInt() << "LL";
+		}
+		else {
+			literal << std::setprecision(std::numeric_limits<double>::max_digits10) << expression.evaluateAsDouble();
+			// Keep it a double in C++
+			if (literal.str().find_first_of(".en") == std::string::npos) {
+				literal << ".0";
+			}
+		}
+		return literal.str();
+	}
+	if (expression.isVariable()) {
+		auto location = variableLocations.find(expression.getIdentifier());
+		if (location == variableLocations.end()) {
+			throw std::runtime_error("Unknown variable or undefined constant " + expression.getIdentifier());
+		}
+		return location->second.cppName;
+	}
+	if (!expression.isFunctionApplication()) {
+		throw std::runtime_error("Cannot compile expression " + expression.toString());
+	}
+	std::vector<std::string> operands;
+	for (uint64_t i = 0; i < expression.getNumberOfOperands(); ++i) {
+		operands.push_back("(" + expressionToCpp(expression.getOperand(i)) + ")");
+	}
+	switch (expression.getOperator()) {
+		case OperatorType::And: return operands[0] + " && " + operands[1];
+		case OperatorType::Or: return operands[0] + " || " + operands[1];
+		case OperatorType::Xor: return operands[0] + " != " + operands[1];
+		case OperatorType::Implies: return "!" + operands[0] + " || " + operands[1];
+		case OperatorType::Iff: return operands[0] + " == " + operands[1];
+		case OperatorType::Plus: return operands[0] + " + " + operands[1];
+		case OperatorType::Minus:
+			if (operands.size() == 1) {
+				return "-" + operands[0];
+			}
+			return operands[0] + " - " + operands[1];
+		case OperatorType::Times: return operands[0] + " * " + operands[1];
+		// Division is always real in PRISM
+		case OperatorType::Divide: return "(double) " + operands[0] + " / (double) " + operands[1];
+		case OperatorType::Min: return "(" + operands[0] + " < " + operands[1] + " ? " + operands[0] + " : " + operands[1] + ")";
+		case OperatorType::Max: return "(" + operands[0] + " > " + operands[1] + " ? " + operands[0] + " : " + operands[1] + ")";
+		case OperatorType::Power:
+			if (expression.hasIntegerType()) {
+				return "(int64_t) std::pow((double) " + operands[0] + ", (double) " + operands[1] + ")";
+			}
+			return "std::pow((double) " + operands[0] + ", (double) " + operands[1] + ")";
+		case OperatorType::Modulo: return operands[0] + " % " + operands[1];
+		case OperatorType::Equal: return operands[0] + " == " + operands[1];
+		case OperatorType::NotEqual: return operands[0] + " != " + operands[1];
+		case OperatorType::Less: return operands[0] + " < " + operands[1];
+		case OperatorType::LessOrEqual: return operands[0] + " <= " + operands[1];
+		case OperatorType::Greater: return operands[0] + " > " + operands[1];
+		case OperatorType::GreaterOrEqual: return operands[0] + " >= " + operands[1];
+		case OperatorType::Not: return "!" + operands[0];
+		case OperatorType::Floor: return "(int64_t) std::floor(" + operands[0] + ")";
+		case OperatorType::Ceil: return "(int64_t) std::ceil(" + operands[0] + ")";
+		case OperatorType::Ite: return operands[0] + " ? " + operands[1] + " : " + operands[2];
+		default:
+			throw std::runtime_error("Cannot compile expression " + expression.toString());
+	}
+}
+
+template <typename ValueType, typename StateType>
+typename CompiledNextStateGenerator<ValueType, StateType>::ExpandFunction
+CompiledNextStateGenerator<ValueType, StateType>::compile(std::string const & source) {
+	std::lock_guard<std::mutex> guard(compileLock);
+	auto cached = compiled.find(source);
+	if (cached != compiled.end()) {
+		return cached->second;
+	}
+	char directory[] = "/tmp/stamina-generator-XXXXXX";
+	if (mkdtemp(directory) == nullptr) {
+		throw std::runtime_error("Could not create a directory to compile in");
+	}
+	std::string sourceFile = std::string(directory) + "/generator.cpp";
+	std::string libraryFile = std::string(directory) + "/generator.so";
+	std::string logFile = std::string(directory) + "/compile.log";
+	{
+		std::ofstream out(sourceFile);
+		out << source;
+	}
+	char const * compiler = getenv("CXX");
+	std::string command = std::string(compiler ? compiler : "c++")
+		+ " -O2 -shared -fPIC -o " + libraryFile + " " + sourceFile + " > " + logFile + " 2>&1";
+	StaminaMessages::info("Compiling the model: " + command);
+	int status = system(command.c_str());
+	std::string log;
+	{
+		std::ifstream in(logFile);
+		std::stringstream contents;
+		contents << in.rdbuf();
+		log = contents.str();
+	}
+	void * library = status == 0 ? dlopen(libraryFile.c_str(), RTLD_NOW | RTLD_LOCAL) : nullptr;
+	// The library stays loaded after its file is gone
+	unlink(sourceFile.c_str());
+	unlink(libraryFile.c_str());
+	unlink(logFile.c_str());
+	rmdir(directory);
+	if (status != 0) {
+		throw std::runtime_error("The compiler failed:\n" + log);
+	}
+	if (library == nullptr) {
+		throw std::runtime_error("Could not load the compiled model: " + std::string(dlerror()));
+	}
+	auto function = reinterpret_cast<ExpandFunction>(dlsym(library, "stamina_expand"));
+	if (function == nullptr) {
+		throw std::runtime_error("The compiled model has no expand function");
+	}
+	compiled[source] = function;
+	StaminaMessages::good("Compiled the model");
+	return function;
+}
+
+// Forward declare
+template class CompiledNextStateGenerator<double, uint32_t>;
+
+} // namespace builder
+} // namespace stamina
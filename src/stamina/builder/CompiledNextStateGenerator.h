@@ -0,0 +1,134 @@
+/**
+* Compiled next-state generator for PRISM programs
+*
+* PrismNextStateGenerator::expand() interprets every guard, rate and update through STORM's
+* expression evaluator for every state. This generator translates the (constant and formula
+* substituted) program to C++, compiles it into a shared library with the system compiler, and loads
+* it with dlopen(). The compiled expand works directly on the packed bits of the CompressedState: the
+* bit offset and width of each variable are constants in the generated code.
+*
+* Only CTMCs without reward models, choice labels, choice origins or terminal states are compiled. If
+* anything else is needed, or the program cannot be translated or compiled, the generator falls back
+* to PrismNextStateGenerator. States the compiled code cannot handle (such as updates which go out of
+* the bounds of a variable) are also handed to PrismNextStateGenerator, so errors are reported by
+* STORM as usual.
+*
+* Falling back only costs speed: the model is the same either way. The compiler is $CXX (or c++ if it
+* is not set), and if it is missing or fails, a warning is printed and PrismNextStateGenerator is used.
+* Before the compiled code is used, it is checked against PrismNextStateGenerator on the first states
+* of a breadth-first exploration, and if any successor or rate differs it is not used either.
+*
+* Compiled programs are cached, so the per-thread generators of the iterative builder only compile
+* once.
+* */
+#ifndef STAMINA_BUILDER_COMPILEDNEXTSTATEGENERATOR_H
+#define STAMINA_BUILDER_COMPILEDNEXTSTATEGENERATOR_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "__storm_needed_for_builder.h"
+
+namespace stamina {
+	namespace builder {
+		template <typename ValueType, typename StateType = uint32_t>
+		class CompiledNextStateGenerator : public storm::generator::PrismNextStateGenerator<ValueType, StateType> {
+		public:
+			typedef storm::generator::PrismNextStateGenerator<ValueType, StateType> BaseGenerator;
+			typedef typename BaseGenerator::StateToIdCallback StateToIdCallback;
+			/**
+			* Signature of the compiled expand function. Writes the packed successors of a state to
+			* successors and their rates to rates, up to capacity of them.
+			*
+			* @return The number of successors (which may be more than capacity), or -1 if the state
+			* must be expanded by PrismNextStateGenerator
+			* */
+			typedef int64_t (*ExpandFunction)(uint64_t const * state, uint64_t * successors, double * rates, int64_t capacity);
+			/**
+			* Creates the generator used by the builders: a CompiledNextStateGenerator if
+			* Options::compiled_generator is set, otherwise a PrismNextStateGenerator
+			*
+			* @param program The (modified) PRISM program
+			* @param options The generator options
+			* */
+			static std::shared_ptr<BaseGenerator> create(
+				storm::prism::Program const & program
+				, storm::generator::NextStateGeneratorOptions const & options
+			);
+			/**
+			* Constructor. Compiles the program, or sets up the fallback if it cannot be compiled.
+			*
+			* @param program The (modified) PRISM program
+			* @param options The generator options
+			* */
+			CompiledNextStateGenerator(
+				storm::prism::Program const & program
+				, storm::generator::NextStateGeneratorOptions const & options
+			);
+			/**
+			* Expands the loaded state with the compiled code. All transitions go in a single choice,
+			* as PrismNextStateGenerator does for CTMCs.
+			* */
+			virtual storm::generator::StateBehavior<ValueType, StateType> expand(StateToIdCallback const & stateToIdCallback) override;
+			/**
+			* Whether or not the program was compiled (rather than falling back)
+			* */
+			bool isCompiled() const;
+		private:
+			/**
+			* Whether or not this program and these options can be compiled
+			* */
+			bool canCompile() const;
+			/**
+			* Checks that the compiled code gives the same successors and rates as PrismNextStateGenerator
+			* on the first COMPILED_GENERATOR_CHECK_STATES states found breadth-first from the initial
+			* states. Prints a warning if not.
+			*
+			* @return Whether they match
+			* */
+			bool matchesBaseGenerator();
+			/**
+			* Translates the program to C++
+			* */
+			std::string generateSource();
+			/**
+			* Translates an expression to a C++ expression over the variables read from the state
+			* */
+			std::string expressionToCpp(storm::expressions::Expression const & expression) const;
+			/**
+			* Translates the assignments of an update to code which writes them to the successor t
+			* */
+			std::string assignmentsToCpp(storm::prism::Update const & update, std::string const & indent) const;
+			/**
+			* Compiles the source and loads the expand function from it (or from the cache)
+			* */
+			static ExpandFunction compile(std::string const & source);
+			/* Where each variable is in the state, by name */
+			struct VariableLocation {
+				bool isBoolean;
+				uint64_t bitOffset;
+				uint64_t bitWidth;
+				int64_t lowerBound;
+				int64_t upperBound;
+				std::string cppName;
+			};
+			std::unordered_map<std::string, VariableLocation> variableLocations;
+			ExpandFunction expandFunction;
+			// Buffers for the compiled code, reused between states
+			std::vector<uint64_t> packedState;
+			std::vector<uint64_t> successors;
+			std::vector<double> rates;
+			int64_t capacity;
+			// Compiled programs, by source
+			inline static std::mutex compileLock;
+			inline static std::map<std::string, ExpandFunction> compiled;
+		};
+	} // namespace builder
+} // namespace stamina
+
+#endif // STAMINA_BUILDER_COMPILEDNEXTSTATEGENERATOR_H
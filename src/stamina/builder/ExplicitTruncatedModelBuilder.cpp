@@ -173,7 +173,7 @@ void ExplicitTruncatedModelBuilder<ValueType, RewardModelType, StateType>::build
         }
 
 //         if (currentIndex % 10 == 0) {
-            StaminaMessages::info("Exploring state with id " + std::to_string(currentIndex) + ".");
+            STAMINA_LOG_INFO("Exploring state with id " + std::to_string(currentIndex) + ".");
 //         }
 
         generator->load(currentState);
@@ -1,8 +1,12 @@
+#include "ModelBuilderMutex.h"
+
 namespace stamina {
 namespace builder {
 
 template <typename StateType>
-ModelBuilderMutex<StateType>::ModelBuilderMutex()
+ModelBuilderMutex<StateType>::ModelBuilderMutex(uint8_t stripeExponent)
+	: stateStripes(1 << stripeExponent)
+	, stripeMask((1 << stripeExponent) - 1)
 {
 	// Intentionally left empty
 }
@@ -23,10 +27,31 @@ ModelBuilderMutex<StateType>::setStateInUse(StateType stateId, bool inUse) {
 		inUseStates.insert(stateId);
 	}
 	else {
-		inUseStates.remove(stateId);
+		inUseStates.erase(stateId);
 	}
 }
 
+template <typename StateType>
+std::mutex &
+ModelBuilderMutex<StateType>::stateMutex(StateType stateId) {
+	return stateStripes[stateId & stripeMask];
+}
+
+template <typename StateType>
+std::shared_mutex &
+ModelBuilderMutex<StateType>::storageMutex() {
+	return storage;
+}
+
+template <typename StateType>
+std::mutex &
+ModelBuilderMutex<StateType>::outputMutex() {
+	return output;
+}
+
+// Forward declare
+template class ModelBuilderMutex<uint32_t>;
+
 } // namespace builder
 } // namespace stamina
 
@@ -6,18 +6,61 @@
 #include <shared_mutex>
 #include <thread>
 #include <unordered_set>
+#include <vector>
 
+/**
+ * Synchronization primitives shared by the exploration threads of a model builder.
+ *
+ * There are three kinds of locks:
+ * 	1. A reader/writer lock on the state storage (the state to ID map, the stateMap and the
+ * 	memory pool). Lookups of existing states take it shared, insertions take it exclusively.
+ * 	2. A set of striped mutexes which guard the per-state data (pi, terminal, etc.) of the
+ * 	ProbabilityStates. Stripes are chosen by state index so two threads only contend on a state
+ * 	if they touch states which share a stripe.
+ * 	3. An output mutex which guards everything the threads write to in order (the transitions,
+ * 	reward model builders and choice information).
+ * */
 namespace stamina {
 	namespace builder {
 		template <typename StateType = uint32_t>
 		class ModelBuilderMutex {
 		public:
-			ModelBuilderMutex();
+			/**
+			 * Constructor
+			 *
+			 * @param stripeExponent Exponent on 2 of the number of per-state mutexes
+			 * */
+			ModelBuilderMutex(uint8_t stripeExponent = 10); // 2 ^ 10
+			/**
+			 * Whether or not a state is currently being expanded by a thread
+			 * */
 			bool stateIsInUse(StateType stateId);
+			/**
+			 * Marks a state as being (or no longer being) expanded by a thread
+			 * */
 			void setStateInUse(StateType stateId, bool inUse = true);
+			/**
+			 * Gets the mutex which guards the per-state data of a particular state
+			 *
+			 * @param stateId The index of the state
+			 * @return The mutex for the stripe this state falls into
+			 * */
+			std::mutex & stateMutex(StateType stateId);
+			/**
+			 * Gets the reader/writer lock for the state storage
+			 * */
+			std::shared_mutex & storageMutex();
+			/**
+			 * Gets the mutex for the ordered outputs of the model builder
+			 * */
+			std::mutex & outputMutex();
 		protected:
 			std::unordered_set<StateType> inUseStates; // In theory, this should never exceed close to 1e3 states even on very strongly connected models
 			std::shared_mutex write;
+			std::shared_mutex storage;
+			std::mutex output;
+			std::vector<std::mutex> stateStripes;
+			const uint32_t stripeMask;
 		};
 	} // namespace builder
 } // namespace stamina
@@ -38,14 +38,14 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::StaminaIter
 template <typename ValueType, typename RewardModelType, typename StateType>
 void
 StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatrices(
-	storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-	, std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
+	std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
 	, StateAndChoiceInformationBuilder& stateAndChoiceInformationBuilder
 	, boost::optional<storm::storage::BitVector>& markovianChoices
 	, boost::optional<storm::storage::sparse::StateValuationsBuilder>& stateValuationsBuilder
 ) {
 	fresh = false;
 	numberTransitions = 0;
+	explorationMetrics.iterations++;
 	// Builds model
 	// Initialize building state valuations (if necessary)
 	if (stateAndChoiceInformationBuilder.isBuildStateValuations()) {
@@ -60,12 +60,17 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 		, this
 		, std::placeholders::_1
 	);
+	// Successors of expanded states are collected and then interned together
+	std::function<StateType (CompressedState const&)> successorBatchCallback = std::bind(
+		&StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::addToSuccessorBatch
+		, this
+		, std::placeholders::_1
+	);
 
 	if (firstIteration) {
 		// Create absorbing state
 		this->setUpAbsorbingState(
-			transitionMatrixBuilder
-			, rewardModelBuilders
+			rewardModelBuilders
 			, stateAndChoiceInformationBuilder
 			, markovianChoices
 			, stateValuationsBuilder
@@ -80,6 +85,10 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 		currentRow = 1;
 		firstIteration = false;
 	}
+	else if (this->resumedMidIteration) {
+		// The checkpoint was written partway through this iteration, so statesToExplore is where it was
+		this->resumedMidIteration = false;
+	}
 	else {
 		// Flush the previously early-terminated states into statesToExplore FIRST
 		flushStatesTerminated();
@@ -93,14 +102,29 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 	CompressedState currentState;
 
 	isInit = false;
+	if (Options::threads > 1) {
+		// Empties statesToExplore, so the serial loop below does nothing
+		exploreInParallel(rewardModelBuilders, stateAndChoiceInformationBuilder);
+	}
 	// Perform a search through the model.
 	while (!statesToExplore.empty()) {
-		auto currentProbabilityStatePair = statesToExplore.front();
-		currentProbabilityState = statesToExplore.front().first;
-		currentState = statesToExplore.front().second;
-		statesToExplore.pop_front();
+		// Stop early so that a checkpoint can be written (see buildModelComponents())
+		if (util::CheckpointFile::terminationRequested()) {
+			break;
+		}
+		// Evaluated in batches, so this must happen before the state is popped
+		bool propertyHoldsAtCurrentState = this->propertyHoldsAtFront();
 		// Get the first state in the queue.
-		currentIndex = currentProbabilityState->index;
+		explorationMetrics.noteFrontierSize(statesToExplore.size());
+		currentIndex = statesToExplore.front();
+		statesToExplore.pop_front();
+		explorationMetrics.statesDequeued++;
+		if (explorationMetrics.statesDequeued % MEMORY_CHECK_FREQUENCY == 0 && util::MemoryAccounting::getCap() != 0) {
+			this->accountMemory();
+		}
+		currentProbabilityState = stateMap.get(currentIndex);
+		// Reuses the memory of currentState
+		stateIdMap.getState(currentIndex, currentState);
 		if (currentIndex == 0) {
 			StaminaMessages::errorAndExit("Dequeued artificial absorbing state!");
 		}
@@ -109,7 +133,7 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 		// Set our state variable in the class
 
 		if (currentIndex % MSG_FREQUENCY == 0) {
-			StaminaMessages::info("Exploring state with id " + std::to_string(currentIndex) + ".");
+			STAMINA_LOG_INFO("Exploring state with id " + std::to_string(currentIndex) + ".");
 		}
 
 		if (stateAndChoiceInformationBuilder.isBuildStateValuations()) {
@@ -119,30 +143,26 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 		// Load state for us to use
 		generator->load(currentState);
 
-		if (propertyExpression != nullptr) {
-			storm::expressions::SimpleValuation valuation = generator->currentStateToSimpleValuation();
-			bool evaluationAtCurrentState = propertyExpression->evaluateAsBool(&valuation);
-			// If the property does not hold at the current state, make it absorbing in the
-			// state graph and do not explore its successors
-			if (!evaluationAtCurrentState) {
-				transitionMatrixBuilder.addNextValue(currentRow, currentIndex, 1.0);
-				// We treat this state as terminal even though it is also absorbing and does not
-				// go to our artificial absorbing state
-				currentProbabilityState->terminal = true;
-				numberTerminal++;
-				// Do NOT place this in the deque of states we should start with next iteration
-				continue;
-			}
+		// If the property does not hold at the current state, make it absorbing in the
+		// state graph and do not explore its successors
+		if (!propertyHoldsAtCurrentState) {
+			transitionStore.clearRow(currentIndex);
+			this->createTransition(currentIndex, currentIndex, 1.0);
+			// We treat this state as terminal even though it is also absorbing and does not
+			// go to our artificial absorbing state
+			currentProbabilityState.setTerminal(true);
+			// Do NOT place this in the deque of states we should start with next iteration
+			continue;
 		}
 
 		// Add the state rewards to the corresponding reward models.
 		// Do not explore if state is terminal and its reachability probability is less than kappa
-		if (currentProbabilityState->isTerminal() && currentProbabilityState->getPi() < localKappa) {
+		if (currentProbabilityState.isTerminal() && currentProbabilityState.getPi() < localKappa) {
 			// Do not connect to absorbing yet
 			// Place this in statesTerminatedLastIteration
-			if ( !currentProbabilityState->wasPutInTerminalQueue ) {
-				statesTerminatedLastIteration.emplace_back(currentProbabilityStatePair);
-				currentProbabilityState->wasPutInTerminalQueue = true;
+			if ( !currentProbabilityState.wasPutInTerminalQueue() ) {
+				statesTerminatedLastIteration.push_back(currentIndex);
+				currentProbabilityState.setPutInTerminalQueue(true);
 				++currentRow;
 				++currentRowGroup;
 			}
@@ -151,8 +171,18 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 
 		// We assume that if we make it here, our state is either nonterminal, or its reachability probability
 		// is greater than kappa
+		if (currentProbabilityState.isNew()) {
+			// Drop the transitions to absorbing from when this was a perimeter state
+			transitionStore.clearRow(currentIndex);
+		}
 		// Expand (explore next states)
-		storm::generator::StateBehavior<ValueType, StateType> behavior = generator->expand(stateToIdCallback);
+		successorBatch.clear();
+		storm::generator::StateBehavior<ValueType, StateType> behavior;
+		{
+			util::PerfCounters::Scope scope(perfCounters, util::PerfCounters::EXPAND);
+			behavior = generator->expand(successorBatchCallback);
+		}
+		this->resolveSuccessorBatch();
 
 		auto stateRewardIt = behavior.getStateRewards().begin();
 		for (auto& rewardModelBuilder : rewardModelBuilders) {
@@ -164,12 +194,12 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 		// If there is no behavior, we have an error.
 		if (behavior.empty()) {
 			// Make absorbing
-			transitionMatrixBuilder.addNextValue(currentRow, currentIndex, 1.0);
+			this->createTransition(currentIndex, currentIndex, 1.0);
 			continue;
 			// StaminaMessages::warn("Behavior for state " + std::to_string(currentIndex) + " was empty!");
 		}
 
-		bool shouldEnqueueAll = currentProbabilityState->getPi() == 0.0;
+		bool shouldEnqueueAll = currentProbabilityState.getPi() == 0.0;
 		// Now add all choices.
 		bool firstChoiceOfState = true;
 		for (auto const& choice : behavior) {
@@ -182,6 +212,7 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 					stateAndChoiceInformationBuilder.addChoiceLabel(label, currentRow);
 
 				}
+				this->choiceLabels.setLabels(currentIndex, choice.getLabels());
 			}
 			if (stateAndChoiceInformationBuilder.isBuildChoiceOrigins() && choice.hasOriginData()) {
 				stateAndChoiceInformationBuilder.addChoiceOriginData(choice.getOriginData(), currentRow);
@@ -195,8 +226,8 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 			double totalRate = 0.0;
 			if (!shouldEnqueueAll && isCtmc) {
 				for (auto const & stateProbabilityPair : choice) {
-					if (stateProbabilityPair.first == 0) {
-						StaminaMessages::warning("Transition to absorbing state from API!!!");
+					if (successorBatch.resolve(stateProbabilityPair.first) == 0) {
+						STAMINA_LOG_WARNING("Transition to absorbing state from API!!!");
 						continue;
 					}
 					totalRate += stateProbabilityPair.second;
@@ -204,7 +235,7 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 			}
 			// Add the probabilistic behavior to the matrix.
 			for (auto const& stateProbabilityPair : choice) {
-				StateType sPrime = stateProbabilityPair.first;
+				StateType sPrime = successorBatch.resolve(stateProbabilityPair.first);
 				if (sPrime == 0) {
 					continue;
 				}
@@ -215,12 +246,12 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 				// greater than zero
 
 				auto nextProbabilityState = stateMap.get(sPrime);
-				if (nextProbabilityState != nullptr) {
+				if (nextProbabilityState) {
 					if (!shouldEnqueueAll) {
-						nextProbabilityState->addToPi(currentProbabilityState->getPi() * probability);
+						nextProbabilityState.addToPi(currentProbabilityState.getPi() * probability);
 					}
 
-					if (currentProbabilityState->isNew) {
+					if (currentProbabilityState.isNew()) {
 						this->createTransition(currentIndex, sPrime, stateProbabilityPair.second);
 						numberTransitions++;
 					}
@@ -231,13 +262,10 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 			firstChoiceOfState = false;
 		}
 
-		currentProbabilityState->isNew = false;
+		currentProbabilityState.setNew(false);
 
-		if (currentProbabilityState->isTerminal() && numberTerminal > 0) {
-			numberTerminal--;
-		}
-		currentProbabilityState->setTerminal(false);
-		currentProbabilityState->setPi(0.0);
+		currentProbabilityState.setTerminal(false);
+		currentProbabilityState.setPi(0.0);
 
 		++currentRowGroup;
 
@@ -249,7 +277,7 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 			if (static_cast<uint64_t>(durationSinceLastMessage) >= generator->getOptions().getShowProgressDelay()) {
 				auto statesPerSecond = numberOfExploredStatesSinceLastMessage / durationSinceLastMessage;
 				auto durationSinceStart = std::chrono::duration_cast<std::chrono::seconds>(now - timeOfStart).count();
-				StaminaMessages::info(
+				STAMINA_LOG_INFO(
 					"Explored " + std::to_string(numberOfExploredStatesSinceLastMessage) + " states in " + std::to_string(durationSinceStart) + " seconds (currently " + std::to_string(statesPerSecond) + " states per second)."
 				);
 				timeOfLastMessage = std::chrono::high_resolution_clock::now();
@@ -258,52 +286,41 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildMatric
 		}
 
 	}
-	iteration++;
-	numberStates = stateStorage.stateToId.size(); // numberOfExploredStates;
+	// An iteration which was stopped early is finished after resuming from a checkpoint
+	if (statesToExplore.empty()) {
+		iteration++;
+	}
+	numberStates = stateIdMap.size(); // numberOfExploredStates;
 
 // 	std::cout << "State space truncation finished for this iteration. Explored " << numberStates << " states. pi = " << accumulateProbabilities() << std::endl;
 }
 
 template <typename ValueType, typename RewardModelType, typename StateType>
 StateType
-StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::getOrAddStateIndex(CompressedState const& state) {
-	StateType actualIndex;
-	StateType newIndex = static_cast<StateType>(stateStorage.getNumberOfStates());
-	if (stateStorage.stateToId.contains(state)) {
-		actualIndex = stateStorage.stateToId.getValue(state);
-	}
-	else {
-		// Create new index just in case we need it
-		actualIndex = newIndex;
-	}
-
+StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::processStateIndex(
+	CompressedState const& state
+	, StateType actualIndex
+	, bool wasAdded
+) {
 	auto nextState = stateMap.get(actualIndex);
-	bool stateIsExisting = nextState != nullptr;
+	bool stateIsExisting = static_cast<bool>(nextState);
 
-	stateStorage.stateToId.findOrAdd(state, actualIndex);
 	// Handle conditional enqueuing
 	if (isInit) {
 		if (!stateIsExisting) {
 			// Create a ProbabilityState for each individual state
-			ProbabilityState * initProbabilityState = memoryPool.allocate();
-			*initProbabilityState = ProbabilityState(
+			ProbabilityState initProbabilityState = stateMap.emplace(
 				actualIndex
 				, 1.0
 				, true
+				, iteration
 			);
-			numberTerminal++;
-			stateMap.put(actualIndex, initProbabilityState);
-			statesToExplore.push_back(std::make_pair(initProbabilityState, state));
-			initProbabilityState->iterationLastSeen = iteration;
+			statesToExplore.push_back(initProbabilityState.index);
 		}
 		else {
-			ProbabilityState * initProbabilityState = nextState;
-			stateMap.put(actualIndex, initProbabilityState);
-			statesToExplore.push_back(std::make_pair(initProbabilityState, state));
-			initProbabilityState->iterationLastSeen = iteration;
-		}
-		if (actualIndex == newIndex) {
-			stateRemapping.get().push_back(storm::utility::zero<StateType>());
+			ProbabilityState initProbabilityState = nextState;
+			statesToExplore.push_back(initProbabilityState.index);
+			initProbabilityState.setIterationLastSeen(iteration);
 		}
 		return actualIndex;
 	}
@@ -312,14 +329,14 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::getOrAddSta
 
 	// This bit handles the non-initial states
 	// The previous state has reachability of 0
-	if (currentProbabilityState->getPi() == 0) {
+	if (currentProbabilityState.getPi() == 0) {
 		if (stateIsExisting) {
 			// Don't rehash if we've already called find()
-			ProbabilityState * nextProbabilityState = nextState;
-			if (nextProbabilityState->iterationLastSeen != iteration) {
-				nextProbabilityState->iterationLastSeen = iteration;
+			ProbabilityState nextProbabilityState = nextState;
+			if (nextProbabilityState.getIterationLastSeen() != iteration) {
+				nextProbabilityState.setIterationLastSeen(iteration);
 				// Enqueue
-				statesToExplore.push_back(std::make_pair(nextProbabilityState, state));
+				statesToExplore.push_back(nextProbabilityState.index);
 				enqueued = true;
 			}
 		}
@@ -331,34 +348,354 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::getOrAddSta
 	else {
 		if (stateIsExisting) {
 			// Don't rehash if we've already called find()
-			ProbabilityState * nextProbabilityState = nextState;
+			ProbabilityState nextProbabilityState = nextState;
 			// auto emplaced = exploredStates.emplace(actualIndex);
-			if (nextProbabilityState->iterationLastSeen != iteration) {
-				nextProbabilityState->iterationLastSeen = iteration;
+			if (nextProbabilityState.getIterationLastSeen() != iteration) {
+				nextProbabilityState.setIterationLastSeen(iteration);
 				// Enqueue
-				statesToExplore.push_back(std::make_pair(nextProbabilityState, state));
+				statesToExplore.push_back(nextProbabilityState.index);
 				enqueued = true;
 			}
 		}
 		else {
 			// This state has not been seen so create a new ProbabilityState
-			ProbabilityState * nextProbabilityState = memoryPool.allocate();
-			*nextProbabilityState = ProbabilityState(
+			ProbabilityState nextProbabilityState = stateMap.emplace(
 				actualIndex
 				, 0.0
 				, true
+				, iteration
 			);
-			stateMap.put(actualIndex, nextProbabilityState);
-			nextProbabilityState->iterationLastSeen = iteration;
 			// exploredStates.emplace(actualIndex);
-			statesToExplore.push_back(std::make_pair(nextProbabilityState, state));
+			statesToExplore.push_back(nextProbabilityState.index);
 			enqueued = true;
-			numberTerminal++;
 		}
 	}
 	return actualIndex;
 }
 
+template <typename ValueType, typename RewardModelType, typename StateType>
+void
+StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::exploreInParallel(
+	std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
+	, StateAndChoiceInformationBuilder& stateAndChoiceInformationBuilder
+) {
+	uint16_t numberOfThreads = Options::threads;
+	// The generator holds the currently loaded state, so each worker needs its own. These are
+	// created here (rather than in the workers) so that they are only created once
+	while (workerGenerators.size() < numberOfThreads) {
+		workerGenerators.push_back(
+			CompiledNextStateGenerator<ValueType, StateType>::create(modulesFile, this->options)
+		);
+	}
+	workerQueues.clear();
+	for (uint16_t i = 0; i < numberOfThreads; ++i) {
+		workerQueues.push_back(std::make_shared<threads::WorkStealingQueue<FrontierEntry>>());
+	}
+	// Deal the current frontier out to the workers. Its size is only sampled here, since the workers
+	// each have their own part of it
+	explorationMetrics.noteFrontierSize(statesToExplore.size());
+	pendingStates = statesToExplore.size();
+	uint16_t queueIndex = 0;
+	while (!statesToExplore.empty()) {
+		workerQueues[queueIndex]->push(statesToExplore.front());
+		statesToExplore.pop_front();
+		queueIndex = (queueIndex + 1) % numberOfThreads;
+	}
+	std::vector<std::thread> workers;
+	for (uint16_t i = 0; i < numberOfThreads; ++i) {
+		workers.emplace_back(
+			&StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::explorationWorker
+			, this
+			, i
+			, std::ref(rewardModelBuilders)
+			, std::ref(stateAndChoiceInformationBuilder)
+		);
+	}
+	for (auto & worker : workers) {
+		worker.join();
+	}
+	// The workers do not check the memory cap themselves
+	if (util::MemoryAccounting::getCap() != 0) {
+		this->accountMemory();
+	}
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+void
+StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::explorationWorker(
+	uint16_t threadIndex
+	, std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
+	, StateAndChoiceInformationBuilder& stateAndChoiceInformationBuilder
+) {
+	auto localGenerator = workerGenerators[threadIndex];
+	auto & localQueue = *workerQueues[threadIndex];
+	uint64_t localNumberTransitions = 0;
+	uint64_t localStatesDequeued = 0;
+	// Successors are collected while expanding, and interned all at once afterwards
+	typename util::ConcurrentStateStorage<StateType>::Batch localBatch(localGenerator->getStateSize());
+	std::function<StateType (CompressedState const&)> successorBatchCallback = [&](CompressedState const& state) {
+		return localBatch.add(state);
+	};
+	std::vector<std::pair<StateType, ValueType>> localTransitions;
+
+	FrontierEntry currentEntry;
+	// Reused for the bits of every state this worker explores
+	CompressedState currentState;
+	while (true) {
+		if (!localQueue.pop(currentEntry) && !stealWork(threadIndex, currentEntry)) {
+			// Other workers may still enqueue states
+			if (pendingStates == 0) {
+				break;
+			}
+			std::this_thread::yield();
+			continue;
+		}
+		StateType currentIndex = currentEntry;
+		++localStatesDequeued;
+		// States are created before they are enqueued, and their data never moves
+		ProbabilityState probabilityState = stateMap.get(currentIndex);
+		if (currentIndex == 0) {
+			StaminaMessages::errorAndExit("Dequeued artificial absorbing state!");
+		}
+
+		if (currentIndex % MSG_FREQUENCY == 0) {
+			STAMINA_LOG_INFO("Exploring state with id " + std::to_string(currentIndex) + ".");
+		}
+
+		// Load state for us to use
+		stateIdMap.getState(currentIndex, currentState);
+		localGenerator->load(currentState);
+
+		if (stateAndChoiceInformationBuilder.isBuildStateValuations()) {
+			std::lock_guard<std::mutex> lock(builderMutex.outputMutex());
+			localGenerator->addStateValuation(currentIndex, stateAndChoiceInformationBuilder.stateValuationsBuilder());
+		}
+
+		// If the property does not hold at the current state, make it absorbing in the
+		// state graph and do not explore its successors
+		if (!this->propertyHolds(currentState)) {
+			{
+				std::lock_guard<std::mutex> lock(builderMutex.outputMutex());
+				transitionStore.clearRow(currentIndex);
+				this->createTransition(currentIndex, currentIndex, 1.0);
+			}
+			{
+				std::lock_guard<std::mutex> lock(builderMutex.stateMutex(currentIndex));
+				probabilityState.setTerminal(true);
+			}
+			--pendingStates;
+			continue;
+		}
+
+		// Take a snapshot of the state's data. Other workers may add to pi while we expand, so
+		// afterwards we only subtract what we have propagated rather than setting pi to zero.
+		double pi;
+		bool isTerminal;
+		bool isNew;
+		bool terminateState = false;
+		bool putInTerminalQueue = false;
+		{
+			std::lock_guard<std::mutex> lock(builderMutex.stateMutex(currentIndex));
+			pi = probabilityState.getPi();
+			isTerminal = probabilityState.isTerminal();
+			isNew = probabilityState.isNew();
+			// Do not explore if state is terminal and its reachability probability is less than kappa
+			if (isTerminal && pi < localKappa) {
+				terminateState = true;
+				putInTerminalQueue = !probabilityState.wasPutInTerminalQueue();
+				probabilityState.setPutInTerminalQueue(true);
+			}
+		}
+		if (terminateState) {
+			if (putInTerminalQueue) {
+				std::lock_guard<std::mutex> lock(builderMutex.outputMutex());
+				statesTerminatedLastIteration.push_back(currentIndex);
+				++currentRow;
+				++currentRowGroup;
+			}
+			--pendingStates;
+			continue;
+		}
+
+		if (isNew) {
+			// Drop the transitions to absorbing from when this was a perimeter state
+			std::lock_guard<std::mutex> lock(builderMutex.outputMutex());
+			transitionStore.clearRow(currentIndex);
+		}
+		// Expand (explore next states)
+		localBatch.clear();
+		storm::generator::StateBehavior<ValueType, StateType> behavior;
+		{
+			util::PerfCounters::Scope scope(perfCounters, util::PerfCounters::EXPAND);
+			behavior = localGenerator->expand(successorBatchCallback);
+		}
+		resolveSuccessorBatchConcurrent(localBatch, pi, localQueue);
+
+		if (!rewardModelBuilders.empty()) {
+			std::lock_guard<std::mutex> lock(builderMutex.outputMutex());
+			auto stateRewardIt = behavior.getStateRewards().begin();
+			for (auto& rewardModelBuilder : rewardModelBuilders) {
+				if (rewardModelBuilder.hasStateRewards()) {
+					rewardModelBuilder.addStateReward(*stateRewardIt);
+				}
+				++stateRewardIt;
+			}
+		}
+		// If there is no behavior, we have an error.
+		if (behavior.empty()) {
+			// Make absorbing
+			std::lock_guard<std::mutex> lock(builderMutex.outputMutex());
+			this->createTransition(currentIndex, currentIndex, 1.0);
+			--pendingStates;
+			continue;
+		}
+
+		bool shouldEnqueueAll = pi == 0.0;
+		bool firstChoiceOfState = true;
+		for (auto const& choice : behavior) {
+			if (!firstChoiceOfState) {
+				StaminaMessages::errorAndExit("Model was not deterministic!");
+			}
+			// Rows of the final transition matrix are the state indecies
+			if (stateAndChoiceInformationBuilder.isBuildChoiceLabels() && choice.hasLabels()) {
+				std::lock_guard<std::mutex> lock(builderMutex.outputMutex());
+				for (auto const& label : choice.getLabels()) {
+					stateAndChoiceInformationBuilder.addChoiceLabel(label, currentIndex);
+				}
+				this->choiceLabels.setLabels(currentIndex, choice.getLabels());
+			}
+			if (stateAndChoiceInformationBuilder.isBuildChoiceOrigins() && choice.hasOriginData()) {
+				std::lock_guard<std::mutex> lock(builderMutex.outputMutex());
+				stateAndChoiceInformationBuilder.addChoiceOriginData(choice.getOriginData(), currentIndex);
+			}
+
+			double totalRate = 0.0;
+			if (!shouldEnqueueAll && isCtmc) {
+				for (auto const & stateProbabilityPair : choice) {
+					if (localBatch.resolve(stateProbabilityPair.first) == 0) {
+						continue;
+					}
+					totalRate += stateProbabilityPair.second;
+				}
+			}
+			for (auto const& stateProbabilityPair : choice) {
+				StateType sPrime = localBatch.resolve(stateProbabilityPair.first);
+				if (sPrime == 0) {
+					continue;
+				}
+				double probability = isCtmc ? stateProbabilityPair.second / totalRate : stateProbabilityPair.second;
+				ProbabilityState nextProbabilityState;
+				{
+					std::shared_lock<std::shared_mutex> lock(builderMutex.storageMutex());
+					nextProbabilityState = stateMap.get(sPrime);
+				}
+				if (nextProbabilityState) {
+					if (!shouldEnqueueAll) {
+						std::lock_guard<std::mutex> lock(builderMutex.stateMutex(sPrime));
+						nextProbabilityState.addToPi(pi * probability);
+					}
+					if (isNew) {
+						localTransitions.emplace_back(sPrime, stateProbabilityPair.second);
+					}
+				}
+			}
+			firstChoiceOfState = false;
+		}
+
+		if (!localTransitions.empty()) {
+			std::lock_guard<std::mutex> lock(builderMutex.outputMutex());
+			for (auto const& transition : localTransitions) {
+				this->createTransition(currentIndex, transition.first, transition.second);
+			}
+			localNumberTransitions += localTransitions.size();
+			localTransitions.clear();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(builderMutex.stateMutex(currentIndex));
+			probabilityState.setNew(false);
+			probabilityState.setTerminal(false);
+			// Whatever was added to pi during expansion stays for the next time this state is explored
+			probabilityState.addToPi(-pi);
+		}
+		--pendingStates;
+	}
+
+	std::lock_guard<std::shared_mutex> lock(builderMutex.storageMutex());
+	numberTransitions += localNumberTransitions;
+	explorationMetrics.statesDequeued += localStatesDequeued;
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+bool
+StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::stealWork(uint16_t threadIndex, FrontierEntry & entry) {
+	uint16_t numberOfThreads = workerQueues.size();
+	for (uint16_t offset = 1; offset < numberOfThreads; ++offset) {
+		if (workerQueues[(threadIndex + offset) % numberOfThreads]->steal(entry)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+void
+StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::resolveSuccessorBatchConcurrent(
+	typename util::ConcurrentStateStorage<StateType>::Batch & batch
+	, double fromPi
+	, threads::WorkStealingQueue<FrontierEntry> & localQueue
+) {
+	util::PerfCounters::Scope scope(perfCounters, util::PerfCounters::INTERN);
+	// stateIdMap is thread-safe on its own, so interning does not need the storage lock
+	stateIdMap.findOrAdd(batch);
+	for (uint64_t provisionalId = 0; provisionalId < batch.size(); ++provisionalId) {
+		batch.setResolved(provisionalId, registerStateConcurrent(batch.getId(provisionalId), fromPi, localQueue));
+	}
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+StateType
+StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::registerStateConcurrent(
+	StateType actualIndex
+	, double fromPi
+	, threads::WorkStealingQueue<FrontierEntry> & localQueue
+) {
+	ProbabilityState nextState;
+	{
+		// Most successors already exist, so try to find them without blocking the other workers
+		std::shared_lock<std::shared_mutex> lock(builderMutex.storageMutex());
+		nextState = stateMap.get(actualIndex);
+	}
+	if (!nextState) {
+		std::lock_guard<std::shared_mutex> lock(builderMutex.storageMutex());
+		// Another worker may have created it since we released the shared lock
+		nextState = stateMap.get(actualIndex);
+		if (!nextState) {
+			// Like the serial version, states first reached from a state with reachability 0 are
+			// not registered
+			if (fromPi == 0) {
+				return 0;
+			}
+			nextState = stateMap.emplace(
+				actualIndex
+				, 0.0
+				, true
+				, iteration
+			);
+			++pendingStates;
+			localQueue.push(nextState.index);
+			return actualIndex;
+		}
+	}
+	std::lock_guard<std::mutex> lock(builderMutex.stateMutex(actualIndex));
+	if (nextState.getIterationLastSeen() != iteration) {
+		nextState.setIterationLastSeen(iteration);
+		++pendingStates;
+		localQueue.push(nextState.index);
+	}
+	return actualIndex;
+}
+
 template <typename ValueType, typename RewardModelType, typename StateType>
 storm::storage::sparse::ModelComponents<ValueType, RewardModelType>
 StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildModelComponents() {
@@ -389,44 +726,45 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildModelC
 
 	StateSpaceInformation::setVariableInformation(generator->getVariableInformation());
 
-	// Allocator and deleters
-	std::allocator<storm::storage::SparseMatrixBuilder<ValueType>> alloc;
-	std::default_delete<storm::storage::SparseMatrixBuilder<ValueType>> del;
-
-	// Component builders
-	storm::storage::SparseMatrixBuilder<ValueType> transitionMatrixBuilder(
-			0
-			, 0
-			, 0
-			, false
-			, false // All models are deterministic
-			, 0
-		);
 	double piHat = 1.0;
 	int innerLoopCount = 0;
+	if (this->resumed) {
+		// Carry on from the iteration the checkpoint was written in
+		piHat = this->resumedPiHat;
+		this->resumed = false;
+	}
 
 	// Continuously decrement kappa
-	while (piHat >= Options::prob_win / Options::approx_factor) {
+	while (piHat >= Options::prob_win / approxFactor) {
 		// Builds matrices and truncates state space
 		buildMatrices(
-			transitionMatrixBuilder
-			, rewardModelBuilders
+			rewardModelBuilders
 			, stateAndChoiceInformationBuilder
 			, markovianStates
 			, stateValuationsBuilder
 		);
+		if (util::CheckpointFile::terminationRequested() && !statesToExplore.empty()) {
+			// Exploration was stopped partway through the iteration
+			this->writeCheckpoint(piHat, true);
+			StaminaMessages::errorAndExit("Stopped by SIGTERM. Run again with --resume to carry on from the checkpoint.", STAMINA_ERRORS::ERR_TERMINATED);
+		}
 
 		piHat = this->accumulateProbabilities();
 		innerLoopCount++;
+		if (this->checkpointDue()) {
+			this->writeCheckpoint(piHat, false);
+			if (util::CheckpointFile::terminationRequested()) {
+				StaminaMessages::errorAndExit("Stopped by SIGTERM. Run again with --resume to carry on from the checkpoint.", STAMINA_ERRORS::ERR_TERMINATED);
+			}
+		}
 	}
 
 	// No remapping is necessary
-	connectAllTerminalStatesToAbsorbing(transitionMatrixBuilder);
-	this->flushToTransitionMatrix(transitionMatrixBuilder);
+	connectAllTerminalStatesToAbsorbing();
 
 	// Using the information from buildMatrices, initialize the model components
 	storm::storage::sparse::ModelComponents<ValueType, RewardModelType> modelComponents(
-		transitionMatrixBuilder.build(0, transitionMatrixBuilder.getCurrentRowGroupCount())
+		this->buildTransitionMatrix()
 		, this->buildStateLabeling()
 		, std::unordered_map<std::string, RewardModelType>()
 		, !generator->isDiscreteTimeModel()
@@ -443,11 +781,11 @@ StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::buildModelC
 	}
 	if (generator->isPartiallyObservable()) {
 		std::vector<uint32_t> classes;
-		classes.resize(stateStorage.getNumberOfStates());
+		classes.resize(stateIdMap.size());
 		std::unordered_map<uint32_t, std::vector<std::pair<std::vector<std::string>, uint32_t>>> observationActions;
-		for (auto const& bitVectorIndexPair : stateStorage.stateToId) {
-			uint32_t varObservation = generator->observabilityClass(bitVectorIndexPair.first);
-			classes[bitVectorIndexPair.second] = varObservation;
+		for (StateType id = 0; id < stateIdMap.size(); ++id) {
+			uint32_t varObservation = generator->observabilityClass(stateIdMap.getState(id));
+			classes[id] = varObservation;
 		}
 
 		modelComponents.observabilityClasses = classes;
@@ -462,39 +800,41 @@ template <typename ValueType, typename RewardModelType, typename StateType>
 void
 StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::flushStatesTerminated() {
 	while (!statesTerminatedLastIteration.empty()) {
-		auto probabilityStatePair = statesTerminatedLastIteration.front();
-		statesToExplore.emplace_back(probabilityStatePair);
-		probabilityStatePair.first->wasPutInTerminalQueue = false;
+		StateType terminatedIndex = statesTerminatedLastIteration.front();
+		statesToExplore.push_back(terminatedIndex);
+		stateMap.get(terminatedIndex).setPutInTerminalQueue(false);
 		statesTerminatedLastIteration.pop_front();
 	}
 }
 
 template <typename ValueType, typename RewardModelType, typename StateType>
 void
-StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::connectAllTerminalStatesToAbsorbing(
-	storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-) {
+StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::connectAllTerminalStatesToAbsorbing() {
 	// The perimeter states require a second custom stateToIdCallback which does not enqueue or
-	// register new states
-	while (!statesTerminatedLastIteration.empty()) {
-		auto currentProbabilityState = statesTerminatedLastIteration.front().first;
-		auto state = statesTerminatedLastIteration.front().second;
-// 		std::cerr << "Connecting state to absorbing" << StateSpaceInformation::stateToString(currentProbabilityState->state, currentProbabilityState->getPi()) << std::endl;
-		statesTerminatedLastIteration.pop_front();
-		// If the state is not marked as terminal, we've already connected it to absorbing
-		if (!currentProbabilityState->isTerminal()) {
+	// register new states. The perimeter states stay in statesTerminatedLastIteration (and stay
+	// terminal) so that the next call to build() picks up where this one left off.
+	CompressedState terminalState;
+	for (uint64_t i = 0; i < statesTerminatedLastIteration.size(); i++) {
+		StateType terminalIndex = statesTerminatedLastIteration[i];
+		// If the state is not marked as terminal, it has been explored since
+		if (!stateMap.get(terminalIndex).isTerminal()) {
 			continue;
 		}
+		stateIdMap.getState(terminalIndex, terminalState);
 		this->connectTerminalStatesToAbsorbing(
-			transitionMatrixBuilder
-			, state
-			, currentProbabilityState->index
+			terminalState
+			, terminalIndex
 			, this->terminalStateToIdCallback
 		);
-		currentProbabilityState->setTerminal(false);
 	}
 }
 
+template <typename ValueType, typename RewardModelType, typename StateType>
+util::RingBuffer<StateType> *
+StaminaIterativeModelBuilder<ValueType, RewardModelType, StateType>::getStatesTerminated() {
+	return &statesTerminatedLastIteration;
+}
+
 template class StaminaIterativeModelBuilder<double, storm::models::sparse::StandardRewardModel<double>, uint32_t>;
 
 } // namespace builder
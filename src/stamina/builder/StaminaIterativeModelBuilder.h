@@ -8,6 +8,11 @@
  * */
 
 #include "StaminaModelBuilder.h"
+#include "ModelBuilderMutex.h"
+#include "threads/WorkStealingQueue.h"
+
+#include <atomic>
+#include <thread>
 
 namespace stamina {
 	namespace builder {
@@ -15,6 +20,8 @@ namespace stamina {
 		class StaminaIterativeModelBuilder : public StaminaModelBuilder<ValueType, RewardModelType, StateType> {
 		public:
 			typedef typename StaminaModelBuilder<ValueType, RewardModelType, StateType>::ProbabilityState ProbabilityState;
+			// The worker queues hold state IDs, like statesToExplore
+			typedef StateType FrontierEntry;
 			/**
 			* Constructs a StaminaIterativeModelBuilder with a given storm::generator::PrismNextStateGenerator. Invokes super's constructor
 			*
@@ -38,27 +45,26 @@ namespace stamina {
 			/**
 			* Builds transition matrix of truncated state space for the given program.
 			*
-			* @param transitionMatrixBuilder The builder of the transition matrix.
 			* @param rewardModelBuilders The builders for the selected reward models.
 			* @param choiceInformationBuilder The builder for the requested information of the choices
 			* @param markovianChoices is set to a bit vector storing whether a choice is Markovian (is only set if the model type requires this information).
 			* @param stateValuationsBuilder if not boost::none, we insert valuations for the corresponding states
 			* */
 			void buildMatrices(
-				storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-				, std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
+				std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
 				, StateAndChoiceInformationBuilder& choiceInformationBuilder
 				, boost::optional<storm::storage::BitVector>& markovianChoices
 				, boost::optional<storm::storage::sparse::StateValuationsBuilder>& stateValuationsBuilder
 			) override;
 			/**
-			* Gets the state ID of a current state, or adds it to the internal state storage. Performs state exploration
-			* and state space truncation from that state.
+			* Performs state exploration and state space truncation from a state once it has been given an id.
 			*
-			* @param state Pointer to the state we are looking it
-			* @return A pair with the state id and whether or not it was already discovered
+			* @param state The state
+			* @param actualIndex The id of the state in stateIdMap
+			* @param wasAdded Whether the state was added to stateIdMap when it was looked up
+			* @return The state id, or 0 if the state should not be registered
 			* */
-			StateType getOrAddStateIndex(CompressedState const& state) override;
+			StateType processStateIndex(CompressedState const& state, StateType actualIndex, bool wasAdded) override;
 			/**
 			* Explores state space and truncates the model
 			*
@@ -72,10 +78,11 @@ namespace stamina {
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::expressionManager;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::propertyFormula;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::stateStorage;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::stateIdMap;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::successorBatch;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::transitionStore;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::generator;
-			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::memoryPool;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::statesToExplore;
-			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::stateRemapping;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::stateMap;
 			// Options for next state generators
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::options;
@@ -89,13 +96,20 @@ namespace stamina {
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::iteration;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::firstIteration;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::localKappa;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::approxFactor;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::isCtmc;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::formulaMatchesExpression;
-			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::numberTerminal;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::numberStates;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::numberTransitions;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::currentRowGroup;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::currentRow;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::explorationMetrics;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::perfCounters;
+		protected:
+			/**
+			 * Gets statesTerminatedLastIteration, so that it is saved in checkpoints
+			 * */
+			util::RingBuffer<StateType> * getStatesTerminated() override;
 		private:
 			/**
 			 * Flushes the states terminated into statesToExplore
@@ -104,13 +118,79 @@ namespace stamina {
 			/**
 			 * Connects all states which are terminal
 			 * */
-			void connectAllTerminalStatesToAbsorbing(storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder);
+			void connectAllTerminalStatesToAbsorbing();
+			/**
+			 * Explores everything in statesToExplore (and everything it enqueues) using Options::threads
+			 * worker threads. Each worker has its own PrismNextStateGenerator and queue, and steals work
+			 * from the other workers when its own queue is empty.
+			 *
+			 * @param rewardModelBuilders The builders for the selected reward models.
+			 * @param stateAndChoiceInformationBuilder The builder for the requested information of the choices
+			 * */
+			void exploreInParallel(
+				std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
+				, StateAndChoiceInformationBuilder& stateAndChoiceInformationBuilder
+			);
+			/**
+			 * The loop run by each worker thread in exploreInParallel()
+			 *
+			 * @param threadIndex Which worker this is
+			 * @param rewardModelBuilders The builders for the selected reward models.
+			 * @param stateAndChoiceInformationBuilder The builder for the requested information of the choices
+			 * */
+			void explorationWorker(
+				uint16_t threadIndex
+				, std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
+				, StateAndChoiceInformationBuilder& stateAndChoiceInformationBuilder
+			);
+			/**
+			 * Takes a state from the back of another worker's queue
+			 *
+			 * @param threadIndex The worker which is stealing
+			 * @param entry Where to put the stolen state
+			 * @return Whether or not anything could be stolen
+			 * */
+			bool stealWork(uint16_t threadIndex, FrontierEntry & entry);
+			/**
+			 * Thread-safe equivalent of resolveSuccessorBatch() for the exploration workers. Interns all of
+			 * the successors in a worker's batch at once, then registers each of them with
+			 * registerStateConcurrent().
+			 *
+			 * @param batch The successors of the state being expanded
+			 * @param fromPi The reachability probability of the state being expanded
+			 * @param localQueue The queue of the calling worker, where newly enqueued states are put
+			 * */
+			void resolveSuccessorBatchConcurrent(
+				typename util::ConcurrentStateStorage<StateType>::Batch & batch
+				, double fromPi
+				, threads::WorkStealingQueue<FrontierEntry> & localQueue
+			);
+			/**
+			 * Thread-safe equivalent of processStateIndex() for the exploration workers. Rather than reading
+			 * currentProbabilityState, the reachability of the state being expanded is passed in.
+			 *
+			 * @param actualIndex The id of the (interned) state
+			 * @param fromPi The reachability probability of the state being expanded
+			 * @param localQueue The queue of the calling worker, where newly enqueued states are put
+			 * @return The state id, or 0 if the state should not be registered
+			 * */
+			StateType registerStateConcurrent(
+				StateType actualIndex
+				, double fromPi
+				, threads::WorkStealingQueue<FrontierEntry> & localQueue
+			);
 			// Dynamic programming improvement: we keep an ordered set of the states terminated
 			// during the previous iteration (in an order that prevents needing to use a remapping
 			// vector for state indecies.
-			std::deque<std::pair<ProbabilityState *, CompressedState>> statesTerminatedLastIteration;
+			util::RingBuffer<StateType> statesTerminatedLastIteration;
 			uint64_t numberOfExploredStates;
 			uint64_t numberOfExploredStatesSinceLastMessage;
+			// Multithreaded exploration (only used if Options::threads > 1)
+			ModelBuilderMutex<StateType> builderMutex;
+			std::vector<std::shared_ptr<storm::generator::PrismNextStateGenerator<ValueType, StateType>>> workerGenerators;
+			std::vector<std::shared_ptr<threads::WorkStealingQueue<FrontierEntry>>> workerQueues;
+			// States which have been enqueued but not yet finished by any worker
+			std::atomic<uint64_t> pendingStates;
 		};
 		// "Custom" deleter (which actually is not custom) to allow for polymorphic shared pointers
 		template<typename ValueType, typename RewardModelType = storm::models::sparse::StandardRewardModel<ValueType>, typename StateType = uint32_t>
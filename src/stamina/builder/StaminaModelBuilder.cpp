@@ -7,8 +7,10 @@
 #include "../StaminaMessages.h"
 #include "../StateSpaceInformation.h"
 
+#include <algorithm>
 #include <functional>
 #include <sstream>
+#include <stdexcept>
 
 namespace stamina {
 namespace builder {
@@ -20,17 +22,24 @@ StaminaModelBuilder<ValueType, RewardModelType, StateType>::StaminaModelBuilder(
 	, storm::generator::NextStateGeneratorOptions const & options
 ) : generator(generator)
 	, stateStorage(*(new storm::storage::sparse::StateStorage<StateType>(generator->getStateSize())))
+	, stateIdMap(generator->getStateSize())
+	, successorBatch(generator->getStateSize())
 	, absorbingWasSetUp(false)
 	, fresh(true)
 	, firstIteration(true)
 	, localKappa(Options::kappa)
-	, numberTerminal(0)
+	, approxFactor(Options::approx_factor)
 	, iteration(0)
 	, propertyExpression(nullptr)
+	, frontierPredicateNext(0)
 	, formulaMatchesExpression(true)
-	, stateRemapping(std::vector<uint_fast64_t>())
 	, modulesFile(modulesFile)
 	, options(options)
+	, resumed(false)
+	, resumedMidIteration(false)
+	, resumedPiHat(1.0)
+	, hashLookupsBeforeBuild(0)
+	, hashProbesBeforeBuild(0)
 	, terminalStateToIdCallback(
 		std::bind(
 			&StaminaModelBuilder<ValueType, RewardModelType, StateType>::getStateIndexOrAbsorbing
@@ -46,7 +55,7 @@ StaminaModelBuilder<ValueType, RewardModelType, StateType>::StaminaModelBuilder(
 	storm::prism::Program const& program
 	, storm::generator::NextStateGeneratorOptions const& generatorOptions
 ) : StaminaModelBuilder( // Invoke other constructor
-	std::make_shared<storm::generator::PrismNextStateGenerator<ValueType, StateType>>(program, generatorOptions)
+	CompiledNextStateGenerator<ValueType, StateType>::create(program, generatorOptions)
 	, program
 	, generatorOptions
 )
@@ -54,19 +63,31 @@ StaminaModelBuilder<ValueType, RewardModelType, StateType>::StaminaModelBuilder(
 	// Intentionally left empty
 }
 
+template <typename ValueType, typename RewardModelType, typename StateType>
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::~StaminaModelBuilder() {
+	util::MemoryAccounting::forget(this);
+}
+
 template <typename ValueType, typename RewardModelType, typename StateType>
 std::shared_ptr<storm::models::sparse::Model<ValueType, RewardModelType>>
 StaminaModelBuilder<ValueType, RewardModelType, StateType>::build() {
+	// The metrics only cover this build
+	explorationMetrics = util::Metrics::Exploration();
+	hashLookupsBeforeBuild = stateIdMap.getNumberOfLookups();
+	hashProbesBeforeBuild = stateIdMap.getNumberOfProbes();
 	try {
 		switch (generator->getModelType()) {
 			// Only supports CTMC models.
 			case storm::generator::ModelType::CTMC:
 				isCtmc = true;
-				return storm::utility::builder::buildModelFromComponents(storm::models::ModelType::Ctmc, buildModelComponents());
+				// Kept so that the next call to build() only has to apply what changed
+				previousModel = storm::utility::builder::buildModelFromComponents(storm::models::ModelType::Ctmc, buildModelComponents());
+				return previousModel;
 			case storm::generator::ModelType::DTMC:
 				isCtmc = false;
 				StaminaMessages::warning("This model is a DTMC. If you are using this in the STAMINA program, currently, only CTMCs are supported. You may get an error in checking.");
-				return storm::utility::builder::buildModelFromComponents(storm::models::ModelType::Dtmc, buildModelComponents());
+				previousModel = storm::utility::builder::buildModelFromComponents(storm::models::ModelType::Dtmc, buildModelComponents());
+				return previousModel;
 			case storm::generator::ModelType::MDP:
 			case storm::generator::ModelType::POMDP:
 			case storm::generator::ModelType::MA:
@@ -92,138 +113,155 @@ StaminaModelBuilder<ValueType, RewardModelType, StateType>::getPerimeterStates()
 	return perimeterStates;
 }
 
+template <typename ValueType, typename RewardModelType, typename StateType>
+uint64_t
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::getNumberOfPerimeterStates() const {
+	return stateMap.getNumberTerminal();
+}
+
 template <typename ValueType, typename RewardModelType, typename StateType>
 StateType
 StaminaModelBuilder<ValueType, RewardModelType, StateType>::getOrAddStateIndex(CompressedState const& state) {
-	StateType actualIndex;
-	StateType newIndex = static_cast<StateType>(stateStorage.getNumberOfStates());
-	if (stateStorage.stateToId.contains(state)) {
-		actualIndex = stateStorage.stateToId.getValue(state);
-	}
-	else {
-		// Create new index just in case we need it
-		actualIndex = newIndex;
-	}
-
-	auto nextState = stateMap.get(actualIndex);
+	util::PerfCounters::Scope scope(perfCounters, util::PerfCounters::INTERN);
+	// Hashes the state only once, and hands out the next index if it is new
+	std::pair<StateType, bool> indexAndWasAdded = stateIdMap.findOrAdd(state);
+	return processStateIndex(state, indexAndWasAdded.first, indexAndWasAdded.second);
+}
 
-	stateStorage.stateToId.findOrAdd(state, actualIndex);
+template <typename ValueType, typename RewardModelType, typename StateType>
+StateType
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::addToSuccessorBatch(CompressedState const& state) {
+	return successorBatch.add(state);
+}
 
+template <typename ValueType, typename RewardModelType, typename StateType>
+StateType
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::processStateIndex(
+	CompressedState const& state
+	, StateType actualIndex
+	, bool wasAdded
+) {
 	return actualIndex;
 }
 
+template <typename ValueType, typename RewardModelType, typename StateType>
+void
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::resolveSuccessorBatch() {
+	util::PerfCounters::Scope scope(perfCounters, util::PerfCounters::INTERN);
+	stateIdMap.findOrAdd(successorBatch);
+	for (uint64_t provisionalId = 0; provisionalId < successorBatch.size(); ++provisionalId) {
+		successorBatch.setResolved(
+			provisionalId
+			, processStateIndex(
+				successorBatch.getState(provisionalId)
+				, successorBatch.getId(provisionalId)
+				, successorBatch.wasAdded(provisionalId)
+			)
+		);
+	}
+}
+
 template <typename ValueType, typename RewardModelType, typename StateType>
 StateType
 StaminaModelBuilder<ValueType, RewardModelType, StateType>::getStateIndexOrAbsorbing(CompressedState const& state) {
-	if (stateStorage.stateToId.contains(state)) {
-		return stateStorage.stateToId.getValue(state);
+	StateType actualIndex;
+	if (stateIdMap.find(state, actualIndex)) {
+		return actualIndex;
 	}
 	// This state should not exist yet and should point to the absorbing state
 	return 0;
 }
 
 template <typename ValueType, typename RewardModelType, typename StateType>
-void
-StaminaModelBuilder<ValueType, RewardModelType, StateType>::flushToTransitionMatrix(storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder) {
-	for (StateType row = 0; row < transitionsToAdd.size(); ++row) {
-		if (transitionsToAdd[row].empty()) {
-			// This state is deadlock
-			transitionMatrixBuilder.addNextValue(row, row, 1);
-		}
-		else {
-			for (TransitionInfo tInfo : transitionsToAdd[row]) {
-				transitionMatrixBuilder.addNextValue(row, tInfo.to, tInfo.transition);
-			}
-		}
+storm::storage::SparseMatrix<ValueType>
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::buildTransitionMatrix() {
+	util::PerfCounters::Scope scope(perfCounters, util::PerfCounters::TRANSITION_MATRIX);
+	// States which were registered but never connected to anything still need a row
+	uint64_t numberOfRows = std::max<uint64_t>(stateIdMap.size(), transitionStore.getNumberOfRows());
+	if (previousModel) {
+		// Only the rows which changed since the last build are rebuilt
+		return transitionStore.buildMatrix(numberOfRows, &previousModel->getTransitionMatrix());
 	}
+	return transitionStore.buildMatrix(numberOfRows);
 }
 
 template <typename ValueType, typename RewardModelType, typename StateType>
 void
 StaminaModelBuilder<ValueType, RewardModelType, StateType>::createTransition(StateType from, StateType to, ValueType probability) {
-	TransitionInfo tInfo(to, probability);
-	// Create an element for both from and to
-	while (transitionsToAdd.size() <= std::max(from, to)) {
-		transitionsToAdd.push_back(std::vector<TransitionInfo>());
-	}
-	transitionsToAdd[from].push_back(tInfo);
+	transitionStore.addTransition(from, to, probability);
 }
 
 
 template <typename ValueType, typename RewardModelType, typename StateType>
 void
-StaminaModelBuilder<ValueType, RewardModelType, StateType>::remapStates(storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder) {
-
-	// State Remapping
-	std::vector<uint_fast64_t> const& remapping = stateRemapping.get();
-
-	if (remapping.size() < numberStates) {
-		StaminaMessages::warning(
-			std::string("Remapping vector and number of explored states do not match sizes!")
-			+ "\n\tVector Size: " + std::to_string(remapping.size())
-			+ "\n\tNumber of states: " + std::to_string(numberStates)
-		);
-	}
-	else {
-		StaminaMessages::info(
-			std::string("Remapping vector and number of explored states match.")
-			+ "\n\tVector Size: " + std::to_string(remapping.size())
-			+ "\n\tNumber of states: " + std::to_string(numberStates)
-		);
-	}
-
-	// According to the STORM Folks, this is what needs to be done
-	// in order to use the state remapping:
-
-	// Fix the transition matrix with the new entries
-	transitionMatrixBuilder.replaceColumns(remapping, 0);
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::printStateSpaceInformation() {
+	StaminaMessages::info("Finished state space truncation.\n\tExplored " + std::to_string(numberStates) + " states in total.\n\tGot " + std::to_string(numberTransitions) + " transitions.");
+}
 
-    // Fix the initial state indecies
-    // (not sure if we need to do this since our initial state indecies are fine)
-	std::vector<StateType> newInitialStateIndices(this->stateStorage.initialStateIndices.size());
-	std::transform(
-		this->stateStorage.initialStateIndices.begin()
-		, this->stateStorage.initialStateIndices.end()
-		, newInitialStateIndices.begin()
-		, [&remapping](StateType const& state) {
-			return remapping[state];
-		}
-	);
-	std::sort(newInitialStateIndices.begin(), newInitialStateIndices.end());
-	this->stateStorage.initialStateIndices = std::move(newInitialStateIndices);
 
-	// Remap stateStorage.stateToId
-	this->stateStorage.stateToId.remap(
-		[&remapping](StateType const& state) {
-			return remapping[state];
-		}
-	);
 
-	this->generator->remapStateIds(
-		[&remapping](StateType const& state) {
-			return remapping[state];
-		}
-	);
+template <typename ValueType, typename RewardModelType, typename StateType>
+util::ConcurrentStateStorage<StateType> const &
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::getStateStorage() const {
+	return stateIdMap;
 }
 
 template <typename ValueType, typename RewardModelType, typename StateType>
-void
-StaminaModelBuilder<ValueType, RewardModelType, StateType>::printStateSpaceInformation() {
-	StaminaMessages::info("Finished state space truncation.\n\tExplored " + std::to_string(numberStates) + " states in total.\n\tGot " + std::to_string(numberTransitions) + " transitions.");
+storm::generator::VariableInformation const &
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::getVariableInformation() const {
+	return generator->getVariableInformation();
 }
 
-
+template <typename ValueType, typename RewardModelType, typename StateType>
+util::ChoiceLabelTable const &
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::getChoiceLabels() const {
+	return choiceLabels;
+}
 
 template <typename ValueType, typename RewardModelType, typename StateType>
 storm::models::sparse::StateLabeling
 StaminaModelBuilder<ValueType, RewardModelType, StateType>::buildStateLabeling() {
-	return generator->label(stateStorage, stateStorage.initialStateIndices, stateStorage.deadlockStateIndices);
+	util::PerfCounters::Scope scope(perfCounters, util::PerfCounters::LABELING);
+	// The labels of a state never change, so only the states added since the last call are labeled.
+	// The generator labels states through storm's StateStorage, so those states are put in a
+	// temporary one, with their ids shifted down to start at 0.
+	uint64_t numberOfLabeledStates = previousLabeling ? previousLabeling->getNumberOfItems() : 0;
+	uint64_t numberOfStates = stateIdMap.size();
+	storm::storage::sparse::StateStorage<StateType> newStates(generator->getStateSize());
+	for (uint64_t id = numberOfLabeledStates; id < numberOfStates; ++id) {
+		newStates.stateToId.findOrAdd(stateIdMap.getState(id), id - numberOfLabeledStates);
+	}
+	std::vector<StateType> newInitialStates;
+	for (StateType id : stateStorage.initialStateIndices) {
+		if (id >= numberOfLabeledStates) { newInitialStates.push_back(id - numberOfLabeledStates); }
+	}
+	std::vector<StateType> newDeadlockStates;
+	for (StateType id : stateStorage.deadlockStateIndices) {
+		if (id >= numberOfLabeledStates) { newDeadlockStates.push_back(id - numberOfLabeledStates); }
+	}
+	storm::models::sparse::StateLabeling newLabeling = generator->label(newStates, newInitialStates, newDeadlockStates);
+	// Merge with the labeling from last time
+	storm::models::sparse::StateLabeling labeling(numberOfStates);
+	for (auto const & label : newLabeling.getLabels()) {
+		storm::storage::BitVector statesWithLabel(numberOfStates);
+		if (previousLabeling && previousLabeling->containsLabel(label)) {
+			for (auto id : previousLabeling->getStates(label)) {
+				statesWithLabel.set(id);
+			}
+		}
+		for (auto id : newLabeling.getStates(label)) {
+			statesWithLabel.set(id + numberOfLabeledStates);
+		}
+		labeling.addLabel(label, std::move(statesWithLabel));
+	}
+	previousLabeling = labeling;
+	return labeling;
 }
 
 template <typename ValueType, typename RewardModelType, typename StateType>
 double
 StaminaModelBuilder<ValueType, RewardModelType, StateType>::accumulateProbabilities() {
-	double totalProbability = numberTerminal * localKappa;
+	double totalProbability = stateMap.getNumberTerminal() * localKappa;
 	// Reduce kappa
 	localKappa /= Options::reduce_kappa;
 	return totalProbability;
@@ -232,8 +270,7 @@ StaminaModelBuilder<ValueType, RewardModelType, StateType>::accumulateProbabilit
 template <typename ValueType, typename RewardModelType, typename StateType>
 void
 StaminaModelBuilder<ValueType, RewardModelType, StateType>::setUpAbsorbingState(
-	storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-	, std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
+	std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
 	, StateAndChoiceInformationBuilder& choiceInformationBuilder
 	, boost::optional<storm::storage::BitVector>& markovianChoices
 	, boost::optional<storm::storage::sparse::StateValuationsBuilder>& stateValuationsBuilder
@@ -242,7 +279,6 @@ StaminaModelBuilder<ValueType, RewardModelType, StateType>::setUpAbsorbingState(
 		return;
 	}
 	if (firstIteration) {
-		stateRemapping.get().push_back(storm::utility::zero<StateType>());
 		this->absorbingState = CompressedState(generator->getVariableInformation().getTotalBitOffset(true)); // CompressedState(64);
 		bool gotVar = false;
 		for (auto variable : generator->getVariableInformation().booleanVariables) {
@@ -261,14 +297,11 @@ StaminaModelBuilder<ValueType, RewardModelType, StateType>::setUpAbsorbingState(
 		// Add index 0 to deadlockstateindecies because the absorbing state is in deadlock
 		stateStorage.deadlockStateIndices.push_back(0);
 		// Check if state is already registered
-		std::pair<StateType, std::size_t> actualIndexPair = stateStorage.stateToId.findOrAddAndGetBucket(absorbingState, 0);
-
-		StateType actualIndex = actualIndexPair.first;
+		StateType actualIndex = stateIdMap.findOrAdd(absorbingState).first;
 		if (actualIndex != 0) {
 			StaminaMessages::errorAndExit("Absorbing state should be index 0! Got " + std::to_string(actualIndex));
 		}
 		absorbingWasSetUp = true;
-		// transitionMatrixBuilder.addNextValue(0, 0, storm::utility::one<ValueType>());
 		// This state shall be Markovian (to not introduce Zeno behavior)
 		if (choiceInformationBuilder.isBuildMarkovianStates()) {
 			choiceInformationBuilder.addMarkovianState(0);
@@ -285,7 +318,6 @@ StaminaModelBuilder<ValueType, RewardModelType, StateType>::reset() {
 	statesToExplore.clear(); // = StatePriorityQueue();
 	// exploredStates.clear(); // States explored in our current iteration
 	// API reset
-	// if (stateRemapping) { stateRemapping->clear(); }
 	// stateStorage = storm::storage::sparse::StateStorage<StateType>(generator->getStateSize());
 	absorbingWasSetUp = false;
 }
@@ -299,29 +331,346 @@ StaminaModelBuilder<ValueType, RewardModelType, StateType>::setGenerator(
 	this->generator = generator;
 }
 
+template <typename ValueType, typename RewardModelType, typename StateType>
+double
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::getLocalKappa() const {
+	return localKappa;
+}
+
 template <typename ValueType, typename RewardModelType, typename StateType>
 void
-StaminaModelBuilder<ValueType, RewardModelType, StateType>::setLocalKappaToGlobal() {
-	Options::kappa = localKappa;
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::setApproxFactor(double approxFactor) {
+	this->approxFactor = approxFactor;
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+double
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::getApproxFactor() const {
+	return approxFactor;
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+util::RingBuffer<StateType> *
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::getStatesTerminated() {
+	return nullptr;
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+uint64_t
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::getFrontierSizeInBytes() {
+	util::RingBuffer<StateType> * statesTerminated = getStatesTerminated();
+	return statesToExplore.getSizeInBytes() + (statesTerminated ? statesTerminated->getSizeInBytes() : 0);
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+void
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::setCheckpointFile(std::string const & filename) {
+	if (getStatesTerminated() == nullptr) {
+		StaminaMessages::warning("Checkpoints are only supported by the iterative method. No checkpoints will be written.");
+		return;
+	}
+	checkpointFile = filename;
+	lastCheckpoint = std::chrono::steady_clock::now();
+	util::CheckpointFile::installTerminationHandler();
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+bool
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::checkpointDue() const {
+	if (checkpointFile == "") {
+		return false;
+	}
+	return util::CheckpointFile::terminationRequested()
+		|| std::chrono::steady_clock::now() - lastCheckpoint >= std::chrono::seconds(Options::checkpoint_interval);
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+std::string
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::checkpointLayout() const {
+	std::stringstream layout;
+	layout << stateIdMap.getBitsPerState() << ';';
+	for (auto const & booleanVariable : generator->getVariableInformation().booleanVariables) {
+		layout << booleanVariable.variable.getName() << '@' << booleanVariable.bitOffset << ';';
+	}
+	for (auto const & integerVariable : generator->getVariableInformation().integerVariables) {
+		layout << integerVariable.variable.getName() << '@' << integerVariable.bitOffset
+			<< ':' << integerVariable.bitWidth << '+' << integerVariable.lowerBound << ';';
+	}
+	if (propertyFormula) {
+		layout << propertyFormula->toString();
+	}
+	return layout.str();
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+void
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::writeCheckpoint(double piHat, bool midIteration) {
+	util::RingBuffer<StateType> * statesTerminated = getStatesTerminated();
+	if (checkpointFile == "" || statesTerminated == nullptr) {
+		return;
+	}
+	typedef util::ProbabilityStateArray<StateType> StateArray;
+	auto startTime = std::chrono::high_resolution_clock::now();
+	try {
+		util::CheckpointFile::Writer out(checkpointFile);
+		std::string layout = checkpointLayout();
+		out.writeSection(CHECKPOINT_LAYOUT, layout.data(), layout.size());
+		uint64_t numberOfStates = stateIdMap.size();
+		uint64_t numberOfRows = std::max<uint64_t>(numberOfStates, transitionStore.getNumberOfRows());
+		CheckpointScalars scalars = {
+			numberOfStates
+			, numberOfRows
+			, numberStates
+			, numberTransitions
+			, currentRowGroup
+			, currentRow
+			, iteration
+			, midIteration
+			, localKappa
+			, approxFactor
+			, piHat
+		};
+		out.writeSection(CHECKPOINT_SCALARS, &scalars, 1);
+		// States in order of ID, so that they get the same IDs when they are added back
+		uint64_t wordsPerState = (stateIdMap.getBitsPerState() + 63) >> 6;
+		out.beginSection(CHECKPOINT_STATES, numberOfStates * wordsPerState * sizeof(uint64_t));
+		for (uint64_t id = 0; id < numberOfStates; ++id) {
+			out.write(stateIdMap.getWords(id), wordsPerState * sizeof(uint64_t));
+		}
+		out.beginSection(CHECKPOINT_PI, numberOfStates * sizeof(double));
+		for (uint64_t id = 0; id < numberOfStates; ++id) {
+			auto probabilityState = stateMap.get(id);
+			double pi = probabilityState ? probabilityState.getPi() : 0.0;
+			out.write(&pi, sizeof(pi));
+		}
+		out.beginSection(CHECKPOINT_ITERATION_LAST_SEEN, numberOfStates);
+		for (uint64_t id = 0; id < numberOfStates; ++id) {
+			auto probabilityState = stateMap.get(id);
+			uint8_t iterationLastSeen = probabilityState ? probabilityState.getIterationLastSeen() : 0;
+			out.write(&iterationLastSeen, 1);
+		}
+		out.beginSection(CHECKPOINT_FLAGS, numberOfStates);
+		for (uint64_t id = 0; id < numberOfStates; ++id) {
+			auto probabilityState = stateMap.get(id);
+			uint8_t flags = 0;
+			if (probabilityState) {
+				flags = static_cast<uint8_t>(
+					(1 << StateArray::EXISTS)
+					| (probabilityState.isTerminal() << StateArray::TERMINAL)
+					| (probabilityState.isNew() << StateArray::NEW)
+					| (probabilityState.isAssignedInRemapping() << StateArray::ASSIGNED_IN_REMAPPING)
+					| (probabilityState.wasPutInTerminalQueue() << StateArray::PUT_IN_TERMINAL_QUEUE)
+				);
+			}
+			out.write(&flags, 1);
+		}
+		out.beginSection(CHECKPOINT_STATES_TO_EXPLORE, statesToExplore.size() * sizeof(StateType));
+		for (uint64_t i = 0; i < statesToExplore.size(); ++i) {
+			StateType id = statesToExplore[i];
+			out.write(&id, sizeof(id));
+		}
+		out.beginSection(CHECKPOINT_STATES_TERMINATED, statesTerminated->size() * sizeof(StateType));
+		for (uint64_t i = 0; i < statesTerminated->size(); ++i) {
+			StateType id = (*statesTerminated)[i];
+			out.write(&id, sizeof(id));
+		}
+		out.writeSection(CHECKPOINT_INITIAL_STATES, stateStorage.initialStateIndices.data(), stateStorage.initialStateIndices.size());
+		out.writeSection(CHECKPOINT_DEADLOCK_STATES, stateStorage.deadlockStateIndices.data(), stateStorage.deadlockStateIndices.size());
+		// The transitions are those of the matrix which would be built now, so they are counted first
+		storm::storage::SparseMatrix<ValueType> const * previousMatrix = previousModel ? &previousModel->getTransitionMatrix() : nullptr;
+		std::vector<uint64_t> rowIndications(numberOfRows + 1, 0);
+		transitionStore.forEachTransition(numberOfRows, previousMatrix, [&rowIndications](StateType row, StateType column, ValueType value) {
+			rowIndications[row + 1]++;
+		});
+		for (uint64_t row = 0; row < numberOfRows; ++row) {
+			rowIndications[row + 1] += rowIndications[row];
+		}
+		out.writeSection(CHECKPOINT_ROW_INDICATIONS, rowIndications.data(), rowIndications.size());
+		out.beginSection(CHECKPOINT_TRANSITIONS, rowIndications.back() * sizeof(CheckpointTransition));
+		transitionStore.forEachTransition(numberOfRows, previousMatrix, [&out](StateType row, StateType column, ValueType value) {
+			CheckpointTransition transition = {column, static_cast<double>(value)};
+			out.write(&transition, sizeof(transition));
+		});
+		out.close();
+		std::chrono::duration<double> timeTaken = std::chrono::high_resolution_clock::now() - startTime;
+		StaminaMessages::info("Wrote checkpoint of " + std::to_string(numberOfStates) + " states to " + checkpointFile + " in " + std::to_string(timeTaken.count()) + " s");
+	}
+	catch (std::exception const & e) {
+		StaminaMessages::error("Could not write checkpoint to " + checkpointFile + ":\n\t" + std::string(e.what()));
+	}
+	lastCheckpoint = std::chrono::steady_clock::now();
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+bool
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::resumeFromCheckpoint(std::string const & filename) {
+	util::RingBuffer<StateType> * statesTerminated = getStatesTerminated();
+	if (statesTerminated == nullptr) {
+		StaminaMessages::warning("Checkpoints are only supported by the iterative method. Exploring from the initial state.");
+		return false;
+	}
+	if (!fresh || stateIdMap.size() != 0) {
+		StaminaMessages::warning("Cannot resume from a checkpoint after exploring. Ignoring " + filename + ".");
+		return false;
+	}
+	typedef util::ProbabilityStateArray<StateType> StateArray;
+	auto startTime = std::chrono::high_resolution_clock::now();
+	// The mapped file is only read from, so it is checked completely before anything is restored
+	std::unique_ptr<util::CheckpointFile::Reader> in;
+	CheckpointScalars scalars;
+	uint64_t wordsPerState = (stateIdMap.getBitsPerState() + 63) >> 6;
+	uint64_t const * words;
+	double const * pi;
+	uint8_t const * iterationLastSeen;
+	uint8_t const * flags;
+	StateType const * toExplore;
+	StateType const * terminated;
+	StateType const * initialStates;
+	StateType const * deadlockStates;
+	uint64_t const * rowIndications;
+	CheckpointTransition const * transitions;
+	uint64_t numberToExplore, numberTerminated, numberInitial, numberDeadlock, numberOfTransitions;
+	try {
+		in.reset(new util::CheckpointFile::Reader(filename));
+		uint64_t count;
+		char const * layout = in->getSection<char>(CHECKPOINT_LAYOUT, count);
+		if (std::string(layout, count) != checkpointLayout()) {
+			throw std::runtime_error(filename + " is a checkpoint of a different model or property");
+		}
+		CheckpointScalars const * scalarsInFile = in->getSection<CheckpointScalars>(CHECKPOINT_SCALARS, count);
+		if (count != 1) {
+			throw std::runtime_error(filename + " is malformed");
+		}
+		scalars = *scalarsInFile;
+		uint64_t numberOfStates = scalars.numberOfStates;
+		// Whether or not a section has exactly the expected number of items
+		auto expect = [&](uint64_t actual, uint64_t expected) {
+			if (actual != expected) {
+				throw std::runtime_error(filename + " is malformed");
+			}
+		};
+		// Whether or not every state ID in a section is a state in the checkpoint
+		auto expectStates = [&](StateType const * ids, uint64_t number) {
+			for (uint64_t i = 0; i < number; ++i) {
+				expect(ids[i] < numberOfStates, true);
+			}
+		};
+		if (numberOfStates == 0 || scalars.numberOfRows < numberOfStates) {
+			throw std::runtime_error(filename + " is malformed");
+		}
+		words = in->getSection<uint64_t>(CHECKPOINT_STATES, count);
+		expect(count, numberOfStates * wordsPerState);
+		pi = in->getSection<double>(CHECKPOINT_PI, count);
+		expect(count, numberOfStates);
+		iterationLastSeen = in->getSection<uint8_t>(CHECKPOINT_ITERATION_LAST_SEEN, count);
+		expect(count, numberOfStates);
+		flags = in->getSection<uint8_t>(CHECKPOINT_FLAGS, count);
+		expect(count, numberOfStates);
+		toExplore = in->getSection<StateType>(CHECKPOINT_STATES_TO_EXPLORE, numberToExplore);
+		expectStates(toExplore, numberToExplore);
+		terminated = in->getSection<StateType>(CHECKPOINT_STATES_TERMINATED, numberTerminated);
+		expectStates(terminated, numberTerminated);
+		initialStates = in->getSection<StateType>(CHECKPOINT_INITIAL_STATES, numberInitial);
+		expectStates(initialStates, numberInitial);
+		deadlockStates = in->getSection<StateType>(CHECKPOINT_DEADLOCK_STATES, numberDeadlock);
+		expectStates(deadlockStates, numberDeadlock);
+		rowIndications = in->getSection<uint64_t>(CHECKPOINT_ROW_INDICATIONS, count);
+		expect(count, scalars.numberOfRows + 1);
+		transitions = in->getSection<CheckpointTransition>(CHECKPOINT_TRANSITIONS, numberOfTransitions);
+		expect(rowIndications[0], 0);
+		for (uint64_t row = 0; row < scalars.numberOfRows; ++row) {
+			expect(rowIndications[row] <= rowIndications[row + 1], true);
+		}
+		expect(rowIndications[scalars.numberOfRows], numberOfTransitions);
+		for (uint64_t i = 0; i < numberOfTransitions; ++i) {
+			expect(transitions[i].column < scalars.numberOfRows, true);
+		}
+	}
+	catch (std::exception const & e) {
+		StaminaMessages::warning("Cannot resume from checkpoint. Exploring from the initial state.\n\t" + std::string(e.what()));
+		return false;
+	}
+	// States are added back in order of ID, so they get the IDs they had
+	uint64_t bitsPerState = stateIdMap.getBitsPerState();
+	CompressedState state(bitsPerState);
+	for (uint64_t id = 0; id < scalars.numberOfStates; ++id) {
+		uint64_t const * stateWords = words + id * wordsPerState;
+		for (uint64_t i = 0; i < wordsPerState; ++i) {
+			state.setFromInt(i * 64, std::min<uint64_t>(64, bitsPerState - i * 64), stateWords[i]);
+		}
+		std::pair<StateType, bool> indexAndWasAdded = stateIdMap.findOrAdd(state);
+		if (indexAndWasAdded.first != id || !indexAndWasAdded.second) {
+			StaminaMessages::errorAndExit("Checkpoint " + filename + " has state " + std::to_string(id) + " more than once!");
+		}
+		if (!((flags[id] >> StateArray::EXISTS) & 1)) {
+			continue;
+		}
+		auto probabilityState = stateMap.emplace(id, pi[id], (flags[id] >> StateArray::TERMINAL) & 1, iterationLastSeen[id]);
+		probabilityState.setNew((flags[id] >> StateArray::NEW) & 1);
+		probabilityState.setAssignedInRemapping((flags[id] >> StateArray::ASSIGNED_IN_REMAPPING) & 1);
+		probabilityState.setPutInTerminalQueue((flags[id] >> StateArray::PUT_IN_TERMINAL_QUEUE) & 1);
+	}
+	statesToExplore.clear();
+	for (uint64_t i = 0; i < numberToExplore; ++i) {
+		statesToExplore.push_back(toExplore[i]);
+	}
+	statesTerminated->clear();
+	for (uint64_t i = 0; i < numberTerminated; ++i) {
+		statesTerminated->push_back(terminated[i]);
+	}
+	stateStorage.initialStateIndices.assign(initialStates, initialStates + numberInitial);
+	stateStorage.deadlockStateIndices.assign(deadlockStates, deadlockStates + numberDeadlock);
+	for (uint64_t row = 0; row < scalars.numberOfRows; ++row) {
+		for (uint64_t i = rowIndications[row]; i < rowIndications[row + 1]; ++i) {
+			createTransition(row, transitions[i].column, transitions[i].value);
+		}
+	}
+	numberStates = scalars.numberStates;
+	numberTransitions = scalars.numberTransitions;
+	currentRowGroup = scalars.currentRowGroup;
+	currentRow = scalars.currentRow;
+	iteration = scalars.iteration;
+	localKappa = scalars.localKappa;
+	approxFactor = scalars.approxFactor;
+	// The absorbing state (always state 0) and the initial states were set up by the first iteration
+	absorbingState = stateIdMap.getState(0);
+	absorbingWasSetUp = true;
+	firstIteration = false;
+	fresh = false;
+	resumed = true;
+	resumedMidIteration = scalars.midIteration;
+	resumedPiHat = scalars.piHat;
+	std::chrono::duration<double> timeTaken = std::chrono::high_resolution_clock::now() - startTime;
+	StaminaMessages::good("Resumed " + std::to_string(scalars.numberOfStates) + " states from checkpoint " + filename + " in " + std::to_string(timeTaken.count()) + " s");
+	return true;
 }
 
 template <typename ValueType, typename RewardModelType, typename StateType>
 void
 StaminaModelBuilder<ValueType, RewardModelType, StateType>::connectTerminalStatesToAbsorbing(
-	storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-	, CompressedState & terminalState
+	CompressedState & terminalState
 	, StateType stateId
 	, std::function<StateType (CompressedState const&)> stateToIdCallback
 ) {
 	bool addedValue = false;
 	generator->load(terminalState);
-	storm::generator::StateBehavior<ValueType, StateType> behavior = generator->expand(stateToIdCallback);
+	storm::generator::StateBehavior<ValueType, StateType> behavior;
+	{
+		util::PerfCounters::Scope scope(perfCounters, util::PerfCounters::EXPAND);
+		behavior = generator->expand(stateToIdCallback);
+	}
 	// If there is no behavior, we have an error.
 	if (behavior.empty()) {
 		StaminaMessages::warning("Behavior for perimeter state was empty!");
 		return;
 	}
+	// The state may have been connected in a previous call to build(), and the states it can
+	// reach may have changed since
+	transitionStore.clearRow(stateId);
 	for (auto const& choice : behavior) {
+		if (generator->getOptions().isBuildChoiceLabelsSet() && choice.hasLabels()) {
+			choiceLabels.setLabels(stateId, choice.getLabels());
+		}
 		double totalRateToAbsorbing = 0;
 		for (auto const& stateProbabilityPair : choice) {
 			if (stateProbabilityPair.first != 0) {
@@ -341,10 +690,65 @@ StaminaModelBuilder<ValueType, RewardModelType, StateType>::connectTerminalState
 	}
 }
 
+template <typename ValueType, typename RewardModelType, typename StateType>
+void
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::recordMetrics(util::Metrics::Iteration & iteration) {
+	iteration.exploration = explorationMetrics;
+	iteration.numberOfStates = stateIdMap.size();
+	iteration.numberOfTransitions = previousModel ? previousModel->getNumberOfTransitions() : numberTransitions;
+	iteration.hashLookups = stateIdMap.getNumberOfLookups() - hashLookupsBeforeBuild;
+	iteration.hashProbes = stateIdMap.getNumberOfProbes() - hashProbesBeforeBuild;
+	for (StateType perimeterState : stateMap.getPerimeterStates()) {
+		iteration.addPerimeterState(stateMap.get(perimeterState).getPi());
+	}
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+util::MemoryAccounting::Usage
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::accountMemory() {
+	util::MemoryAccounting::Usage usage;
+	usage.bytes[util::MemoryAccounting::STATE_STORAGE] = stateIdMap.getSizeInBytes();
+	usage.bytes[util::MemoryAccounting::PROBABILITY_STATES] = stateMap.getSizeInBytes();
+	usage.bytes[util::MemoryAccounting::TRANSITIONS] = transitionStore.getSizeInBytes();
+	usage.bytes[util::MemoryAccounting::FRONTIER] = getFrontierSizeInBytes();
+	uint64_t labelingAndRewards = choiceLabels.getSizeInBytes();
+	if (previousLabeling) {
+		for (auto const & label : previousLabeling->getLabels()) {
+			labelingAndRewards += previousLabeling->getStates(label).getSizeInBytes();
+		}
+	}
+	if (previousModel) {
+		for (auto const & nameAndRewardModel : previousModel->getRewardModels()) {
+			RewardModelType const & rewardModel = nameAndRewardModel.second;
+			if (rewardModel.hasStateRewards()) {
+				labelingAndRewards += rewardModel.getStateRewardVector().capacity() * sizeof(ValueType);
+			}
+			if (rewardModel.hasStateActionRewards()) {
+				labelingAndRewards += rewardModel.getStateActionRewardVector().capacity() * sizeof(ValueType);
+			}
+		}
+		usage.bytes[util::MemoryAccounting::TRANSITION_MATRIX] = previousModel->getTransitionMatrix().getSizeInMemory();
+	}
+	usage.bytes[util::MemoryAccounting::LABELING_AND_REWARDS] = labelingAndRewards;
+	if (util::MemoryAccounting::record(this, usage)) {
+		StaminaMessages::errorAndExit(
+			"The memory cap of " + std::to_string(util::MemoryAccounting::getCap() >> 20) + " MB was exceeded. This builder is using:\n" + usage.toString()
+			, STAMINA_ERRORS::ERR_MEMORY_EXCEEDED
+		);
+	}
+	return usage;
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+util::PerfCounters const &
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::getPerfCounters() const {
+	return perfCounters;
+}
+
 template <typename ValueType, typename RewardModelType, typename StateType>
 storm::expressions::Expression *
 StaminaModelBuilder<ValueType, RewardModelType, StateType>::getPropertyExpression() {
-	return propertyExpression;
+	return propertyExpression.get();
 }
 
 template <typename ValueType, typename RewardModelType, typename StateType>
@@ -365,18 +769,59 @@ StaminaModelBuilder<ValueType, RewardModelType, StateType>::loadPropertyExpressi
 		return;
 	}
 	// If we are called here, we assume that Options::no_prop_refine is false
-	std::shared_ptr<storm::expressions::Expression> pExpression(
-		// Invoke copy constructor
-		new storm::expressions::Expression(
-			propertyFormula->toExpression(
-				// Expression manager
-				*(this->expressionManager)
-			)
+	propertyExpression = std::make_shared<storm::expressions::Expression>(
+		propertyFormula->toExpression(
+			// Expression manager
+			*(this->expressionManager)
 		)
 	);
+	try {
+		propertyPredicate.reset(new util::StatePredicate(
+			*propertyExpression
+			, generator->getVariableInformation()
+			, stateIdMap.getBitsPerState()
+		));
+	}
+	catch (std::exception const & e) {
+		StaminaMessages::warning("Property based refinement is off since the property cannot be compiled:\n\t" + std::string(e.what()));
+		propertyPredicate.reset();
+	}
+	frontierPredicateIds.clear();
+	frontierPredicateResults.clear();
+	frontierPredicateNext = 0;
 	formulaMatchesExpression = true;
 }
 
+template <typename ValueType, typename RewardModelType, typename StateType>
+bool
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::propertyHolds(CompressedState const & state) const {
+	return !propertyPredicate || propertyPredicate->evaluate(state);
+}
+
+template <typename ValueType, typename RewardModelType, typename StateType>
+bool
+StaminaModelBuilder<ValueType, RewardModelType, StateType>::propertyHoldsAtFront() {
+	if (!propertyPredicate) {
+		return true;
+	}
+	// The frontier may have been rebuilt since the last batch
+	if (frontierPredicateNext >= frontierPredicateIds.size()
+		|| frontierPredicateIds[frontierPredicateNext] != statesToExplore.front()
+	) {
+		uint64_t count = std::min<uint64_t>(PREDICATE_BATCH_SIZE, statesToExplore.size());
+		frontierPredicateIds.resize(count);
+		frontierPredicateResults.resize(count);
+		std::vector<uint64_t const *> words(count);
+		for (uint64_t i = 0; i < count; ++i) {
+			frontierPredicateIds[i] = statesToExplore[i];
+			words[i] = stateIdMap.getWords(statesToExplore[i]);
+		}
+		propertyPredicate->evaluate(words.data(), count, frontierPredicateResults.data());
+		frontierPredicateNext = 0;
+	}
+	return frontierPredicateResults[frontierPredicateNext++];
+}
+
 
 // Explicitly instantiate the class.
 template class StaminaModelBuilder<double, storm::models::sparse::StandardRewardModel<double>, uint32_t>;
@@ -14,20 +14,35 @@
 #include <queue>
 #include <cstdint>
 #include <functional>
+#include <chrono>
+#include <string>
 
 #include "../Options.h"
 #include "../StaminaMessages.h"
-#include "../util/StateIndexArray.h"
-#include "../util/StateMemoryPool.h"
+#include "../util/ProbabilityStateArray.h"
+#include "../util/RingBuffer.h"
+#include "../util/ConcurrentStateStorage.h"
+#include "../util/TransitionStore.h"
+#include "../util/StatePredicate.h"
+#include "../util/CheckpointFile.h"
+#include "../util/ChoiceLabelTable.h"
+#include "../util/Metrics.h"
+#include "../util/PerfCounters.h"
+#include "../util/MemoryAccounting.h"
 
 #include <boost/functional/hash.hpp>
 #include <boost/container/flat_map.hpp>
 #include <boost/variant.hpp>
 
 #include "__storm_needed_for_builder.h"
+#include "CompiledNextStateGenerator.h"
 
 // Frequency for info/debug messages in terms of number of states explored.
 #define MSG_FREQUENCY 100000
+// Number of frontier states to evaluate the property predicate for at once
+#define PREDICATE_BATCH_SIZE 256
+// Number of states dequeued between checks of the memory cap (if there is one)
+#define MEMORY_CHECK_FREQUENCY 65536
 // #define MSG_FREQUENCY 4000
 
 namespace stamina {
@@ -43,119 +58,15 @@ namespace stamina {
 		template<typename ValueType, typename RewardModelType = storm::models::sparse::StandardRewardModel<ValueType>, typename StateType = uint32_t>
 		class StaminaModelBuilder {
 		public:
-// 			struct
-			/* Sub-class for states with probabilities */
-			class ProbabilityState {
-			public:
-				StateType index;
-				bool assignedInRemapping;
-				uint8_t iterationLastSeen;
-				bool isNew;
-				bool wasPutInTerminalQueue;
-// 				ProbabilityState() : { /* Intentionally left empty */ }
-				ProbabilityState(
-					StateType index = 0
-					, double pi = 0.0
-					, bool terminal = true
-					, uint8_t iterationLastSeen = 0
-				) : index(index)
-					, pi(pi)
-					, terminal(terminal)
-					, assignedInRemapping(false)
-					, iterationLastSeen(iterationLastSeen)
-					, isNew(true)
-					, wasPutInTerminalQueue(false)
-				{
-					// Intentionally left empty
-				}
-				// Copy constructor
-				ProbabilityState(const ProbabilityState & other)
-					: index(other.index)
-					, pi(other.pi)
-					, terminal(other.terminal)
-					, assignedInRemapping(other.assignedInRemapping)
-					, isNew(other.isNew)
-				{
-					// Intentionally left empty
-				}
-
-				double getPi() {
-					return pi;
-				}
-				void addToPi(double add) {
-					pi += add;
-				}
-				void setPi(double pi) {
-					this->pi = pi;
-				}
-				bool isTerminal() {
-					return terminal;
-				}
-				void setTerminal(bool term) {
-					terminal = term;
-				}
-				inline bool operator==(const ProbabilityState & rhs) const {
-					return index == rhs.index;
-				}
-				inline bool operator>=(const ProbabilityState & rhs) const {
-					return index >= rhs.index;
-				}
-				inline bool operator<=(const ProbabilityState & rhs) const {
-					return index <= rhs.index;
-				}
-				inline bool operator>(const ProbabilityState & rhs) const {
-					return index > rhs.index;
-				}
-				inline bool operator<(const ProbabilityState & rhs) const {
-					return index < rhs.index;
-				}
-				double pi;
-				bool terminal;
-
-			};
+			/* Handle to the reachability and flags of a state, which are stored in stateMap */
+			typedef typename util::ProbabilityStateArray<StateType>::ProbabilityState ProbabilityState;
 			struct ProbabilityStateComparison {
 				bool operator() (
-					const ProbabilityState * first
-					, const ProbabilityState * second
-				) const {
-					// Create a max heap on the reachability probability
-					return first->pi < second->pi;
-				}
-			};
-
-			class ProbabilityStatePair {
-			public:
-				ProbabilityState * first;
-				CompressedState second;
-			};
-
-			struct ProbabilityStatePairComparison {
-				bool operator() (
-					const ProbabilityStatePair first
-					, const ProbabilityStatePair second
+					const ProbabilityState & first
+					, const ProbabilityState & second
 				) const {
 					// Create a max heap on the reachability probability
-					return first.first->pi < second.first->pi;
-				}
-			};
-
-			/**
-			 * A basic struct for out of order transitions to insert into the transition matrix.
-			 * This is faster than using the remapping and std::sort in the STORM API
-			 * */
-			class TransitionInfo {
-			public:
-				TransitionInfo(StateType to, ValueType transition) :
-					to(to), transition(transition) { /* Intentionally left empty */ }
-				StateType to;
-				ValueType transition;
-			};
-			struct TransitionInfoComparison {
-				bool operator() (
-					const TransitionInfo * first
-					, const TransitionInfo * second
-				) const {
-					return first->to > second->to;
+					return first.getPi() < second.getPi();
 				}
 			};
 
@@ -180,6 +91,10 @@ namespace stamina {
 				, storm::generator::NextStateGeneratorOptions const& generatorOptions
 			);
 			/**
+			* Destructor. Stops accounting for the memory of this builder.
+			* */
+			virtual ~StaminaModelBuilder();
+			/**
 			* Creates a model with a truncated state space for the program provided during construction. State space
 			* is truncated during this method using the STAMINA II truncation method described by Riley Roberts and Zhen
 			* Zhang, and corresponding to the same algorithm used in the Java version of STAMINA.
@@ -213,10 +128,76 @@ namespace stamina {
 			*/
 			std::vector<StateType> getPerimeterStates();
 			/**
-			* Sets the value of &kappa; in Options to what we have stored locally here
+			* Gets the number of perimeter states. This is kept up to date as states are explored, so it
+			* is O(1)
+			* */
+			uint64_t getNumberOfPerimeterStates() const;
+			/**
+			* Gets the value of &kappa; this builder is currently using. Each builder has its own, so that
+			* several properties can be checked at once.
+			* */
+			double getLocalKappa() const;
+			/**
+			* Sets the misprediction factor used for this builder's termination condition (initially
+			* Options::approx_factor)
+			* */
+			void setApproxFactor(double approxFactor);
+			/**
+			* Gets the misprediction factor used for this builder's termination condition
+			* */
+			double getApproxFactor() const;
+			/**
+			* Sets the file to write checkpoints of the exploration to. A checkpoint is written every
+			* Options::checkpoint_interval seconds (between iterations) and when the process gets SIGTERM.
+			* Only builders which keep the states terminated in the last iteration support checkpoints.
+			*
+			* @param filename The checkpoint file
+			* */
+			void setCheckpointFile(std::string const & filename);
+			/**
+			* Restores the exploration from a checkpoint written by writeCheckpoint(), so that the next call
+			* to build() carries on where the checkpoint left off. Must be called before the first call to
+			* build(), and after setPropertyFormula(), if it is called at all.
+			*
+			* @param filename The checkpoint file
+			* @return Whether or not the checkpoint was restored. If not, exploration starts from scratch.
 			* */
-			void setLocalKappaToGlobal();
+			bool resumeFromCheckpoint(std::string const & filename);
 			void printStateSpaceInformation();
+			/**
+			* Gets the states explored so far. The ID of each state is its row in the transition matrix
+			* of the model returned by build().
+			* */
+			util::ConcurrentStateStorage<StateType> const & getStateStorage() const;
+			/**
+			* Gets where each variable is in the states of getStateStorage()
+			* */
+			storm::generator::VariableInformation const & getVariableInformation() const;
+			/**
+			* Gets the action labels of the choice of each state explored so far. These are only recorded
+			* if the generator options build choice labels.
+			* */
+			util::ChoiceLabelTable const & getChoiceLabels() const;
+			/**
+			* Fills in what is known about the last call to build() (the exploration counters, the size of
+			* the model, the state hash table and the perimeter) for util::Metrics
+			*
+			* @param iteration The metrics of the refinement iteration which called build()
+			* */
+			void recordMetrics(util::Metrics::Iteration & iteration);
+			/**
+			* Gets the hardware counters of every build so far, by phase. Nothing is counted unless
+			* util::PerfCounters::enable() was called.
+			* */
+			util::PerfCounters const & getPerfCounters() const;
+			/**
+			* Measures the memory used by each part of the builder and records it with util::MemoryAccounting.
+			* Exits (with ERR_MEMORY_EXCEEDED) if the builders are using more than the memory cap. Must not be
+			* called while states are explored in parallel.
+			*
+			* @return What each part of the builder is using
+			* */
+			util::MemoryAccounting::Usage accountMemory();
 			storm::expressions::Expression * getPropertyExpression();
 			/**
 			* Sets the property formula for state space truncation optimization. Does not load
@@ -230,63 +211,152 @@ namespace stamina {
 				, const storm::prism::Program & modulesFile
 			);
 			/**
-			* Applies the remapping in the state remapping vector to the transition matrix
-			*
-			* @param transitionMatrixBuilder The transition matrix to apply it to.
-			* */
-			void remapStates(storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder);
-			/**
 			* Gets the state ID of a current state, or adds it to the internal state storage. Performs state exploration
 			* and state space truncation from that state.
 			*
 			* @param state Pointer to the state we are looking it
 			* @return A pair with the state id and whether or not it was already discovered
 			* */
-			virtual StateType getOrAddStateIndex(CompressedState const& state);
+			StateType getOrAddStateIndex(CompressedState const& state);
+			/**
+			* Puts a successor of the state being expanded into successorBatch. This is used as the callback for
+			* expand() so that all of the successors of a state can be interned at once by resolveSuccessorBatch().
+			*
+			* @param state The successor state
+			* @return A provisional state id, which must be translated with successorBatch.resolve()
+			* */
+			StateType addToSuccessorBatch(CompressedState const& state);
 			/**
 			* Alterate state ID grabber. Returns state ID if exists. If it does not, returns the absorbing state
 			* This is used as an alternative callback function for terminal (perimeter) states
 			* */
 			StateType getStateIndexOrAbsorbing(CompressedState const& state);
 		protected:
+			/* Tags of the sections in a checkpoint */
+			enum CheckpointSection : uint64_t {
+				CHECKPOINT_LAYOUT = 1
+				, CHECKPOINT_SCALARS
+				, CHECKPOINT_STATES
+				, CHECKPOINT_PI
+				, CHECKPOINT_ITERATION_LAST_SEEN
+				, CHECKPOINT_FLAGS
+				, CHECKPOINT_STATES_TO_EXPLORE
+				, CHECKPOINT_STATES_TERMINATED
+				, CHECKPOINT_INITIAL_STATES
+				, CHECKPOINT_DEADLOCK_STATES
+				, CHECKPOINT_ROW_INDICATIONS
+				, CHECKPOINT_TRANSITIONS
+			};
+			/* Everything in a checkpoint which is not an array */
+			struct CheckpointScalars {
+				uint64_t numberOfStates;
+				uint64_t numberOfRows;
+				uint64_t numberStates;
+				uint64_t numberTransitions;
+				uint64_t currentRowGroup;
+				uint64_t currentRow;
+				uint64_t iteration;
+				uint64_t midIteration;
+				double localKappa;
+				double approxFactor;
+				double piHat;
+			};
+			/* A transition in a checkpoint. Its row is given by the row indications. */
+			struct CheckpointTransition {
+				uint64_t column;
+				double value;
+			};
+			/**
+			* Performs state exploration and state space truncation from a state once it has been given an id. The
+			* default implementation does nothing.
+			*
+			* @param state The state
+			* @param actualIndex The id of the state in stateIdMap
+			* @param wasAdded Whether the state was added to stateIdMap when it was looked up
+			* @return The state id, or 0 if the state should not be registered
+			* */
+			virtual StateType processStateIndex(CompressedState const& state, StateType actualIndex, bool wasAdded);
 			/**
-			* Creates and loads the property expression from the formula
+			* Interns all states in successorBatch, then calls processStateIndex() on each of them in the
+			* order that the generator produced them
+			* */
+			void resolveSuccessorBatch();
+			/**
+			* Creates and loads the property expression from the formula, and compiles it into
+			* propertyPredicate
 			* */
 			void loadPropertyExpressionFromFormula();
 			/**
+			* Whether or not the property expression holds in a state (always true without property based
+			* refinement). May be called from multiple threads at once.
+			* */
+			bool propertyHolds(CompressedState const & state) const;
+			/**
+			* Whether or not the property expression holds in the state at the front of statesToExplore.
+			* Must be called right before that state is popped. The predicate is evaluated for the next
+			* PREDICATE_BATCH_SIZE states of the frontier at once, straight from stateIdMap.
+			* */
+			bool propertyHoldsAtFront();
+			/**
+			* Gets the queue of states terminated in the last iteration, which is saved in checkpoints along
+			* with statesToExplore. Builders without one (which is the default) do not support checkpoints.
+			* */
+			virtual util::RingBuffer<StateType> * getStatesTerminated();
+			/**
+			* Gets the bytes used by the frontier: statesToExplore, getStatesTerminated() and whatever else a
+			* builder queues states in
+			* */
+			virtual uint64_t getFrontierSizeInBytes();
+			/**
+			* Whether or not a checkpoint should be written now, since the checkpoint interval has passed or
+			* SIGTERM was caught
+			* */
+			bool checkpointDue() const;
+			/**
+			* Writes everything explored so far to the checkpoint file. Errors are reported, but exploration
+			* carries on.
+			*
+			* @param piHat The reachability of the perimeter, which decides whether to carry on exploring
+			* @param midIteration Whether the current iteration was cut short, in which case it is finished
+			* (rather than the next one started) after resuming
+			* */
+			void writeCheckpoint(double piHat, bool midIteration);
+			/**
+			* Describes the variables of the program and the property, so that a checkpoint is only resumed
+			* by the same model and property
+			* */
+			std::string checkpointLayout() const;
+			/**
 			* Connects all terminal states to the absorbing state
 			* */
 			void connectTerminalStatesToAbsorbing(
-				storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-				, CompressedState & terminalState
+				CompressedState & terminalState
 				, StateType stateId
 				, std::function<StateType (CompressedState const&)> stateToIdCallback
 			);
 			/**
 			* Builds transition matrix of truncated state space for the given program.
 			*
-			* @param transitionMatrixBuilder The builder of the transition matrix.
 			* @param rewardModelBuilders The builders for the selected reward models.
 			* @param choiceInformationBuilder The builder for the requested information of the choices
 			* @param markovianChoices is set to a bit vector storing whether a choice is Markovian (is only set if the model type requires this information).
 			* @param stateValuationsBuilder if not boost::none, we insert valuations for the corresponding states
 			* */
 			virtual void buildMatrices(
-				storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-				, std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
+				std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
 				, StateAndChoiceInformationBuilder& choiceInformationBuilder
 				, boost::optional<storm::storage::BitVector>& markovianChoices
 				, boost::optional<storm::storage::sparse::StateValuationsBuilder>& stateValuationsBuilder
 			) = 0;
 			/**
-			 * Flushes the elements in transitionsToAdd into the transition matrix
+			 * Builds the transition matrix from the transitions in transitionStore. Has one row for every
+			 * state in stateIdMap.
 			 *
-			 * @param transitionMatrixBuilder The transition matrix builder
+			 * @return The transition matrix
 			 * */
-			void flushToTransitionMatrix(storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder);
+			storm::storage::SparseMatrix<ValueType> buildTransitionMatrix();
 			/**
-			 * Inserts a TransitionInfo into transitionsToAdd. This method must NOT be called
-			 * after flushToTransitionMatrix has cleared transitionsToAdd
+			 * Adds a transition to transitionStore
 			 * */
 			void createTransition(StateType from, StateType to, ValueType probability);
 			/**
@@ -296,7 +366,8 @@ namespace stamina {
 			* */
 			virtual storm::storage::sparse::ModelComponents<ValueType, RewardModelType> buildModelComponents() = 0;
 			/**
-			* Builds state labeling for our program
+			* Builds state labeling for our program. Only states which were added since the last call are
+			* labeled; the rest of the labeling is reused.
 			*
 			* @return State labeling for our program
 			* */
@@ -305,8 +376,7 @@ namespace stamina {
 			* Sets up the initial state in the transition matrix
 			* */
 			void setUpAbsorbingState(
-				storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-				, std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
+				std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
 				, StateAndChoiceInformationBuilder& choiceInformationBuilder
 				, boost::optional<storm::storage::BitVector>& markovianChoices
 				, boost::optional<storm::storage::sparse::StateValuationsBuilder>& stateValuationsBuilder
@@ -314,23 +384,37 @@ namespace stamina {
 
 			/* Data Members */
 			std::function<StateType (CompressedState const&)> terminalStateToIdCallback;
-			storm::expressions::Expression * propertyExpression;
+			std::shared_ptr<storm::expressions::Expression> propertyExpression;
+			// propertyExpression, compiled. Property based refinement is off if this is null.
+			std::unique_ptr<util::StatePredicate> propertyPredicate;
+			// Results of propertyPredicate for the states at the front of statesToExplore
+			std::vector<StateType> frontierPredicateIds;
+			std::vector<uint8_t> frontierPredicateResults;
+			uint64_t frontierPredicateNext;
 			storm::expressions::ExpressionManager * expressionManager;
 			std::shared_ptr<const storm::logic::Formula> propertyFormula;
 			storm::storage::sparse::StateStorage<StateType>& stateStorage;
+			// Maps states to their indices. Only synced into stateStorage when labeling
+			util::ConcurrentStateStorage<StateType> stateIdMap;
+			// Successors of the state currently being expanded
+			typename util::ConcurrentStateStorage<StateType>::Batch successorBatch;
 			std::shared_ptr<storm::generator::PrismNextStateGenerator<ValueType, StateType>> generator;
-			util::StateMemoryPool<ProbabilityState> memoryPool;
-			// StatePriorityQueue statesToExplore;
-			std::deque<std::pair<ProbabilityState *, CompressedState> > statesToExplore;
-			boost::optional<std::vector<uint_fast64_t>> stateRemapping;
-			util::StateIndexArray<StateType, ProbabilityState> stateMap;
+			// IDs of the states to explore. Their bits are read back from stateIdMap when they are explored
+			util::RingBuffer<StateType> statesToExplore;
+			// Reachability and flags of each state, indexed by state ID
+			util::ProbabilityStateArray<StateType> stateMap;
 			// Transitions which we must add
-			std::vector<std::vector<TransitionInfo>> transitionsToAdd;
+			util::TransitionStore<ValueType, StateType> transitionStore;
+			// Action labels of the choice of each state, for exporting transitions
+			util::ChoiceLabelTable choiceLabels;
+			// The model and labeling from the last call to build(), which the next one builds on
+			std::shared_ptr<storm::models::sparse::Model<ValueType, RewardModelType>> previousModel;
+			boost::optional<storm::models::sparse::StateLabeling> previousLabeling;
 			// Options for next state generators
 			storm::generator::NextStateGeneratorOptions const & options;
 			// The model builder must have access to this to create a fresh next state generator each iteration
 			storm::prism::Program const& modulesFile;
-			ProbabilityState * currentProbabilityState;
+			ProbabilityState currentProbabilityState;
 			CompressedState absorbingState;
 			bool absorbingWasSetUp;
 			bool isInit;
@@ -338,13 +422,26 @@ namespace stamina {
 			uint8_t iteration;
 			bool firstIteration;
 			double localKappa;
+			double approxFactor;
 			bool isCtmc;
 			bool formulaMatchesExpression;
-			uint64_t numberTerminal;
 			uint64_t numberStates;
 			uint64_t numberTransitions;
 			uint_fast64_t currentRowGroup;
 			uint_fast64_t currentRow;
+			// Where checkpoints are written (empty if they are not), and when the last one was written
+			std::string checkpointFile;
+			std::chrono::steady_clock::time_point lastCheckpoint;
+			// Set by resumeFromCheckpoint(), until the exploration has picked up where the checkpoint left off
+			bool resumed;
+			bool resumedMidIteration;
+			double resumedPiHat;
+			// Counters for recordMetrics(), reset by build()
+			util::Metrics::Exploration explorationMetrics;
+			uint64_t hashLookupsBeforeBuild;
+			uint64_t hashProbesBeforeBuild;
+			// Hardware counters for each phase (--perfCounters)
+			util::PerfCounters perfCounters;
 
 		};
 
@@ -37,92 +37,26 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::StaminaPrior
 
 template<typename ValueType, typename RewardModelType, typename StateType>
 StateType
-StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::getOrAddStateIndex(CompressedState const& state) {
-	StateType actualIndex;
-	StateType newIndex = static_cast<StateType>(stateStorage.getNumberOfStates());
-	if (stateStorage.stateToId.contains(state)) {
-		actualIndex = stateStorage.stateToId.getValue(state);
-	}
-	else {
-		// Create new index just in case we need it
-		actualIndex = newIndex;
-	}
-
-	auto nextState = stateMap.get(actualIndex);
-	bool stateIsExisting = nextState != nullptr;
-
-	stateStorage.stateToId.findOrAdd(state, actualIndex);
-	// Handle conditional enqueuing
-	if (isInit) {
-		if (!stateIsExisting) {
-			// Create a ProbabilityState for each individual state
-			ProbabilityState * initProbabilityState = memoryPool.allocate();
-			*initProbabilityState = ProbabilityState(
-				actualIndex
-				, 1.0
-				, true
-			);
-			numberTerminal++;
-			stateMap.put(actualIndex, initProbabilityState);
-			statePriorityQueue.push(initProbabilityState);
-			initProbabilityState->iterationLastSeen = iteration;
-		}
-		else {
-			StaminaMessages::errorAndExit("Initial state should not exist yet, but does!");
-		}
-		if (actualIndex == newIndex) {
-			stateRemapping.get().push_back(storm::utility::zero<StateType>());
-		}
+StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::processStateIndex(
+	CompressedState const& state
+	, StateType actualIndex
+	, bool wasAdded
+) {
+	if (stateMap.contains(actualIndex)) {
+		// The state is already in the heap (or has been explored), and its priority is raised
+		// by buildMatrices() once the reachability is known
 		return actualIndex;
 	}
-
-	bool enqueued = false;
-
-	// This bit handles the non-initial states
-	// The previous state has reachability of 0
-	if (currentProbabilityState->getPi() == 0) {
-		if (stateIsExisting) {
-			// Don't rehash if we've already called find()
-			ProbabilityState * nextProbabilityState = nextState;
-			if (nextProbabilityState->iterationLastSeen != iteration) {
-				nextProbabilityState->iterationLastSeen = iteration;
-				// Enqueue
-				statePriorityQueue.push(nextProbabilityState);
-				enqueued = true;
-			}
-		}
-		else {
-			// State does not exist yet in this iteration
-			return 0;
-		}
-	}
-	else {
-		if (stateIsExisting) {
-			// Don't rehash if we've already called find()
-			ProbabilityState * nextProbabilityState = nextState;
-			// auto emplaced = exploredStates.emplace(actualIndex);
-			if (nextProbabilityState->iterationLastSeen != iteration) {
-				nextProbabilityState->iterationLastSeen = iteration;
-				// Enqueue
-				statePriorityQueue.push(nextProbabilityState);
-				enqueued = true;
-			}
-		}
-		else {
-			// This state has not been seen so create a new ProbabilityState
-			ProbabilityState * nextProbabilityState = memoryPool.allocate();
-			*nextProbabilityState = ProbabilityState(
-				actualIndex
-				, 0.0
-				, true
-			);
-			stateMap.put(actualIndex, nextProbabilityState);
-			nextProbabilityState->iterationLastSeen = iteration;
-			// exploredStates.emplace(actualIndex);
-			statePriorityQueue.push(nextProbabilityState);
-			enqueued = true;
-			numberTerminal++;
-		}
+	// Every state starts out on the perimeter. Initial states get all of the reachability
+	ProbabilityState nextProbabilityState = stateMap.emplace(
+		actualIndex
+		, isInit ? 1.0 : 0.0
+		, true
+		, iteration
+	);
+	statePriorityQueue.push(nextProbabilityState);
+	if (isInit) {
+		piHat += nextProbabilityState.getPi();
 	}
 	return actualIndex;
 }
@@ -131,7 +65,6 @@ template <typename ValueType, typename RewardModelType, typename StateType>
 storm::storage::sparse::ModelComponents<ValueType, RewardModelType>
 StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildModelComponents() {
 	StaminaMessages::info("Using STAMINA 3.0 Algorithm");
-// 	StaminaMessages::errorAndExit("STAMINA 3.0 is not yet implemented!");
 	// Is this model deterministic? (I.e., is there only one choice per state?)
 	bool deterministic = generator->isDeterministicModel();
 
@@ -158,40 +91,20 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildModelCo
 
 	StateSpaceInformation::setVariableInformation(generator->getVariableInformation());
 
-	// Allocator and deleters
-	std::allocator<storm::storage::SparseMatrixBuilder<ValueType>> alloc;
-	std::default_delete<storm::storage::SparseMatrixBuilder<ValueType>> del;
-
-	// Component builders
-	storm::storage::SparseMatrixBuilder<ValueType> transitionMatrixBuilder(
-			0
-			, 0
-			, 0
-			, false
-			, false // All models are deterministic
-			, 0
-		);
 	// Builds matrices and truncates state space
 	buildMatrices(
-		transitionMatrixBuilder
-		, rewardModelBuilders
+		rewardModelBuilders
 		, stateAndChoiceInformationBuilder
 		, markovianStates
 		, stateValuationsBuilder
 	);
 
-// 	StaminaMessages::errorAndExit("Exit");
-
 	// No remapping is necessary
-	connectAllTerminalStatesToAbsorbing(transitionMatrixBuilder);
-	this->flushToTransitionMatrix(transitionMatrixBuilder);
-
-	generator = std::make_shared<storm::generator::PrismNextStateGenerator<ValueType, StateType>>(modulesFile, this->options);
-	this->setGenerator(generator);
+	connectAllTerminalStatesToAbsorbing();
 
 	// Using the information from buildMatrices, initialize the model components
 	storm::storage::sparse::ModelComponents<ValueType, RewardModelType> modelComponents(
-		transitionMatrixBuilder.build(0, transitionMatrixBuilder.getCurrentRowGroupCount())
+		this->buildTransitionMatrix()
 		, this->buildStateLabeling()
 		, std::unordered_map<std::string, RewardModelType>()
 		, !generator->isDiscreteTimeModel()
@@ -208,11 +121,11 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildModelCo
 	}
 	if (generator->isPartiallyObservable()) {
 		std::vector<uint32_t> classes;
-		classes.resize(stateStorage.getNumberOfStates());
+		classes.resize(stateIdMap.size());
 		std::unordered_map<uint32_t, std::vector<std::pair<std::vector<std::string>, uint32_t>>> observationActions;
-		for (auto const& bitVectorIndexPair : stateStorage.stateToId) {
-			uint32_t varObservation = generator->observabilityClass(bitVectorIndexPair.first);
-			classes[bitVectorIndexPair.second] = varObservation;
+		for (StateType id = 0; id < stateIdMap.size(); ++id) {
+			uint32_t varObservation = generator->observabilityClass(stateIdMap.getState(id));
+			classes[id] = varObservation;
 		}
 
 		modelComponents.observabilityClasses = classes;
@@ -226,14 +139,14 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildModelCo
 template <typename ValueType, typename RewardModelType, typename StateType>
 void
 StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildMatrices(
-	storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-	, std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
+	std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
 	, StateAndChoiceInformationBuilder& stateAndChoiceInformationBuilder
 	, boost::optional<storm::storage::BitVector>& markovianChoices
 	, boost::optional<storm::storage::sparse::StateValuationsBuilder>& stateValuationsBuilder
 ) {
-	piHat = 1.0;
+	fresh = false;
 	numberTransitions = 0;
+	explorationMetrics.iterations++;
 	// Builds model
 	// Initialize building state valuations (if necessary)
 	if (stateAndChoiceInformationBuilder.isBuildStateValuations()) {
@@ -248,23 +161,40 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildMatrice
 		, this
 		, std::placeholders::_1
 	);
-
-	// Create absorbing state
-	this->setUpAbsorbingState(
-		transitionMatrixBuilder
-		, rewardModelBuilders
-		, stateAndChoiceInformationBuilder
-		, markovianChoices
-		, stateValuationsBuilder
+	// Successors of expanded states are collected and then interned together
+	std::function<StateType (CompressedState const&)> successorBatchCallback = std::bind(
+		&StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::addToSuccessorBatch
+		, this
+		, std::placeholders::_1
 	);
-	isInit = true;
-	// Let the generator create all initial states.
-	this->stateStorage.initialStateIndices = generator->getInitialStates(stateToIdCallback);
-	if (this->stateStorage.initialStateIndices.empty()) {
-		StaminaMessages::errorAndExit("Initial states are empty!");
+
+	if (firstIteration) {
+		// Create absorbing state
+		this->setUpAbsorbingState(
+			rewardModelBuilders
+			, stateAndChoiceInformationBuilder
+			, markovianChoices
+			, stateValuationsBuilder
+		);
+		piHat = 0.0;
+		isInit = true;
+		// Let the generator create all initial states.
+		this->stateStorage.initialStateIndices = generator->getInitialStates(stateToIdCallback);
+		if (this->stateStorage.initialStateIndices.empty()) {
+			StaminaMessages::errorAndExit("Initial states are empty!");
+		}
+		currentRowGroup = 1;
+		currentRow = 1;
+		// We stop exploring once the reachability of the perimeter is small enough to give a window
+		// within our target
+		targetPiHat = Options::prob_win / approxFactor;
+		firstIteration = false;
+	}
+	else {
+		// The window was not met with the last model, so continue from the same heap with a
+		// tighter target
+		targetPiHat /= Options::reduce_kappa;
 	}
-	currentRowGroup = 1;
-	currentRow = 1;
 	numberOfExploredStates = 0;
 	numberOfExploredStatesSinceLastMessage = 0;
 
@@ -275,20 +205,31 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildMatrice
 	CompressedState currentState;
 
 	isInit = false;
-	// Perform a search through the model.
-	do {
-		currentProbabilityState = statesToExplore.top().first;
-		currentState = statesToExplore.top().second;
+	// Explore the perimeter state with the highest reachability until the perimeter reachability
+	// drops below the target
+	while (!statePriorityQueue.empty() && piHat > targetPiHat) {
+		if (Options::max_states != 0 && stateIdMap.size() >= Options::max_states) {
+			StaminaMessages::warning("Reached the maximum number of states with a perimeter reachability of " + std::to_string(piHat));
+			break;
+		}
+		explorationMetrics.noteFrontierSize(statePriorityQueue.size());
+		currentProbabilityState = statePriorityQueue.top();
 		statePriorityQueue.pop();
-		// Get the first state in the queue.
-		currentIndex = currentProbabilityState->index;
-		currentState = currentProbabilityState->state();
+		explorationMetrics.statesDequeued++;
+		if (explorationMetrics.statesDequeued % MEMORY_CHECK_FREQUENCY == 0 && util::MemoryAccounting::getCap() != 0) {
+			this->accountMemory();
+		}
+		currentIndex = currentProbabilityState.index;
+		currentState = stateIdMap.getState(currentIndex);
 		if (currentIndex == 0) {
 			StaminaMessages::errorAndExit("Dequeued artificial absorbing state!");
 		}
+		// The state leaves the perimeter whether or not it is expanded
+		piHat -= currentProbabilityState.getPi();
+		currentProbabilityState.setTerminal(false);
 
 		if (currentIndex % MSG_FREQUENCY == 0) {
-			StaminaMessages::info("Exploring state with id " + std::to_string(currentIndex) + ".");
+			STAMINA_LOG_INFO("Exploring state with id " + std::to_string(currentIndex) + ".");
 		}
 
 		if (stateAndChoiceInformationBuilder.isBuildStateValuations()) {
@@ -298,26 +239,27 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildMatrice
 		// Load state for us to use
 		generator->load(currentState);
 
-		if (propertyExpression != nullptr) {
-			storm::expressions::SimpleValuation valuation = generator->currentStateToSimpleValuation();
-			bool evaluationAtCurrentState = propertyExpression->evaluateAsBool(&valuation);
-			// If the property does not hold at the current state, make it absorbing in the
-			// state graph and do not explore its successors
-			if (!evaluationAtCurrentState) {
-				transitionMatrixBuilder.addNextValue(currentRow, currentIndex, 1.0);
-				// We treat this state as terminal even though it is also absorbing and does not
-				// go to our artificial absorbing state
-				currentProbabilityState->terminal = true;
-				numberTerminal++;
-				// Do NOT place this in the deque of states we should start with next iteration
-				continue;
-			}
+		// If the property does not hold at the current state, make it absorbing in the
+		// state graph and do not explore its successors
+		if (!this->propertyHolds(currentState)) {
+			transitionStore.clearRow(currentIndex);
+			this->createTransition(currentIndex, currentIndex, 1.0);
+			currentProbabilityState.setNew(false);
+			continue;
 		}
 
-		// We assume that if we make it here, our state is either nonterminal, or its reachability probability
-		// is greater than kappa
+		if (currentProbabilityState.isNew()) {
+			// Drop the transitions to absorbing from when this was a perimeter state
+			transitionStore.clearRow(currentIndex);
+		}
 		// Expand (explore next states)
-		storm::generator::StateBehavior<ValueType, StateType> behavior = generator->expand(stateToIdCallback);
+		successorBatch.clear();
+		storm::generator::StateBehavior<ValueType, StateType> behavior;
+		{
+			util::PerfCounters::Scope scope(perfCounters, util::PerfCounters::EXPAND);
+			behavior = generator->expand(successorBatchCallback);
+		}
+		this->resolveSuccessorBatch();
 
 		auto stateRewardIt = behavior.getStateRewards().begin();
 		for (auto& rewardModelBuilder : rewardModelBuilders) {
@@ -329,11 +271,11 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildMatrice
 		// If there is no behavior, we have an error.
 		if (behavior.empty()) {
 			// Make absorbing
-			transitionMatrixBuilder.addNextValue(currentRow, currentIndex, 1.0);
+			this->createTransition(currentIndex, currentIndex, 1.0);
+			currentProbabilityState.setNew(false);
 			continue;
 		}
 
-		bool shouldEnqueueAll = currentProbabilityState->getPi() == 0.0;
 		// Now add all choices.
 		bool firstChoiceOfState = true;
 		for (auto const& choice : behavior) {
@@ -346,6 +288,7 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildMatrice
 					stateAndChoiceInformationBuilder.addChoiceLabel(label, currentRow);
 
 				}
+				this->choiceLabels.setLabels(currentIndex, choice.getLabels());
 			}
 			if (stateAndChoiceInformationBuilder.isBuildChoiceOrigins() && choice.hasOriginData()) {
 				stateAndChoiceInformationBuilder.addChoiceOriginData(choice.getOriginData(), currentRow);
@@ -357,10 +300,10 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildMatrice
 			}
 
 			double totalRate = 0.0;
-			if (!shouldEnqueueAll && isCtmc) {
+			if (isCtmc) {
 				for (auto const & stateProbabilityPair : choice) {
-					if (stateProbabilityPair.first == 0) {
-						StaminaMessages::warning("Transition to absorbing state from API!!!");
+					if (successorBatch.resolve(stateProbabilityPair.first) == 0) {
+						STAMINA_LOG_WARNING("Transition to absorbing state from API!!!");
 						continue;
 					}
 					totalRate += stateProbabilityPair.second;
@@ -368,30 +311,22 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildMatrice
 			}
 			// Add the probabilistic behavior to the matrix.
 			for (auto const& stateProbabilityPair : choice) {
-				StateType sPrime = stateProbabilityPair.first;
+				StateType sPrime = successorBatch.resolve(stateProbabilityPair.first);
 				if (sPrime == 0) {
 					continue;
 				}
 				double probability = isCtmc ? stateProbabilityPair.second / totalRate : stateProbabilityPair.second;
-				// Enqueue S is handled in stateToIdCallback
-				// Update transition probability only if we should enqueue all
-				// These are next states where the previous state has a reachability
-				// greater than zero
-
 				auto nextProbabilityState = stateMap.get(sPrime);
-				if (nextProbabilityState != nullptr) {
-					if (!shouldEnqueueAll) {
-						double piToAdd = currentProbabilityState->getPi() * probability;
-						nextProbabilityState->addToPi(piToAdd);
-						if (nextProbabilityState->isTerminal()) {
-							std::cout << "Adding " << piToAdd << " to pi" << std::endl;
-							piHat += piToAdd;
-							std::cout << "Now piHat is " << piHat << std::endl;
-						}
+				if (nextProbabilityState) {
+					// Move reachability from this state to its successors. Only successors still on the
+					// perimeter count towards piHat, and they move up in the heap in place.
+					double piToAdd = currentProbabilityState.getPi() * probability;
+					nextProbabilityState.addToPi(piToAdd);
+					if (nextProbabilityState.isTerminal()) {
+						piHat += piToAdd;
+						statePriorityQueue.update(nextProbabilityState);
 					}
-
-
-					if (currentProbabilityState->isNew) {
+					if (currentProbabilityState.isNew()) {
 						this->createTransition(currentIndex, sPrime, stateProbabilityPair.second);
 						numberTransitions++;
 					}
@@ -402,17 +337,8 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildMatrice
 			firstChoiceOfState = false;
 		}
 
-		currentProbabilityState->isNew = false;
-
-		if (currentProbabilityState->isTerminal() && numberTerminal > 0) {
-			numberTerminal--;
-			std::cout << "Before editing piHat, it is " << piHat << std::endl;
-			std::cout << "Subtracting " << currentProbabilityState->getPi() <<  " from piHat" << std::endl;
-			piHat -= currentProbabilityState->getPi();
-			std::cout << "Now piHat is " << piHat << std::endl;
-		}
-		currentProbabilityState->setTerminal(false);
-		currentProbabilityState->setPi(0.0);
+		currentProbabilityState.setNew(false);
+		currentProbabilityState.setPi(0.0);
 
 		++currentRowGroup;
 
@@ -425,18 +351,16 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildMatrice
 			if (static_cast<uint64_t>(durationSinceLastMessage) >= generator->getOptions().getShowProgressDelay()) {
 				auto statesPerSecond = numberOfExploredStatesSinceLastMessage / durationSinceLastMessage;
 				auto durationSinceStart = std::chrono::duration_cast<std::chrono::seconds>(now - timeOfStart).count();
-				StaminaMessages::info(
+				STAMINA_LOG_INFO(
 					"Explored " + std::to_string(numberOfExploredStates) + " states in " + std::to_string(durationSinceStart) + " seconds (currently " + std::to_string(statesPerSecond) + " states per second)."
 				);
 				timeOfLastMessage = std::chrono::high_resolution_clock::now();
 				numberOfExploredStatesSinceLastMessage = 0;
 			}
 		}
-		std::cout << piHat << " >=? " << Options::prob_win / Options::approx_factor << std::endl;
-		std::cout << "statePriorityQueue size is " << statePriorityQueue.size() << std::endl;
-		std::cout << "At this iteration, piHat = " << piHat << " and numberTerminal is " << numberTerminal << std::endl;
-	} while (!statePriorityQueue.empty() && (piHat > Options::prob_win) / Options::approx_factor);
-	numberStates = numberOfExploredStates;
+	}
+	iteration++;
+	numberStates = stateIdMap.size();
 
 	this->printStateSpaceInformation();
 	StaminaMessages::info("Perimeter reachability is " + std::to_string(piHat));
@@ -444,22 +368,25 @@ StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::buildMatrice
 
 template <typename ValueType, typename RewardModelType, typename StateType>
 void
-StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::connectAllTerminalStatesToAbsorbing(
-	storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-) {
-	auto terminalStates = stateMap.getPerimeterStates();
-	for (auto terminalStateIndex : terminalStates) {
-		auto terminalState = stateMap.get(terminalStateIndex);
-		// connect to absorbing
+StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::connectAllTerminalStatesToAbsorbing() {
+	// Every state left in the heap is on the perimeter. They stay in the heap so that the next
+	// call to build() can continue exploring from them.
+	for (auto terminalProbabilityState : statePriorityQueue.getStates()) {
+		CompressedState terminalState = stateIdMap.getState(terminalProbabilityState.index);
 		this->connectTerminalStatesToAbsorbing(
-			transitionMatrixBuilder
-			, terminalState->state()
-			, terminalState->index
+			terminalState
+			, terminalProbabilityState.index
 			, this->terminalStateToIdCallback
 		);
 	}
 }
 
+template <typename ValueType, typename RewardModelType, typename StateType>
+uint64_t
+StaminaPriorityModelBuilder<ValueType, RewardModelType, StateType>::getFrontierSizeInBytes() {
+	return StaminaModelBuilder<ValueType, RewardModelType, StateType>::getFrontierSizeInBytes() + statePriorityQueue.getSizeInBytes();
+}
+
 template class StaminaPriorityModelBuilder<double, storm::models::sparse::StandardRewardModel<double>, uint32_t>;
 
 } // namespace builder
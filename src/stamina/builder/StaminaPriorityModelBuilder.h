@@ -9,6 +9,7 @@
  * */
 
 #include "StaminaModelBuilder.h"
+#include "../util/IndexedPriorityQueue.h"
 
 namespace stamina {
 	namespace builder {
@@ -37,13 +38,14 @@ namespace stamina {
 				, storm::generator::NextStateGeneratorOptions const& generatorOptions = storm::generator::NextStateGeneratorOptions()
 			);
 			/**
-			* Gets the state ID of a current state, or adds it to the internal state storage. Performs state exploration
-			* and state space truncation from that state.
+			* Registers a state once it has been given an id. New states are put on the perimeter (in the heap).
 			*
-			* @param state Pointer to the state we are looking it
-			* @return A pair with the state id and whether or not it was already discovered
+			* @param state The state
+			* @param actualIndex The id of the state in stateIdMap
+			* @param wasAdded Whether the state was added to stateIdMap when it was looked up
+			* @return The state id, or 0 if the state should not be registered
 			* */
-			StateType getOrAddStateIndex(CompressedState const& state) override;
+			StateType processStateIndex(CompressedState const& state, StateType actualIndex, bool wasAdded) override;
 			/**
 			* Explores state space and truncates the model
 			*
@@ -53,15 +55,13 @@ namespace stamina {
 			/**
 			* Builds transition matrix of truncated state space for the given program.
 			*
-			* @param transitionMatrixBuilder The builder of the transition matrix.
 			* @param rewardModelBuilders The builders for the selected reward models.
 			* @param choiceInformationBuilder The builder for the requested information of the choices
 			* @param markovianChoices is set to a bit vector storing whether a choice is Markovian (is only set if the model type requires this information).
 			* @param stateValuationsBuilder if not boost::none, we insert valuations for the corresponding states
 			* */
 			void buildMatrices(
-				storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-				, std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
+				std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
 				, StateAndChoiceInformationBuilder& choiceInformationBuilder
 				, boost::optional<storm::storage::BitVector>& markovianChoices
 				, boost::optional<storm::storage::sparse::StateValuationsBuilder>& stateValuationsBuilder
@@ -73,10 +73,11 @@ namespace stamina {
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::expressionManager;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::propertyFormula;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::stateStorage;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::stateIdMap;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::successorBatch;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::transitionStore;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::generator;
-			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::memoryPool;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::statesToExplore;
-			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::stateRemapping;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::stateMap;
 			// Options for next state generators
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::options;
@@ -90,27 +91,38 @@ namespace stamina {
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::iteration;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::firstIteration;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::localKappa;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::approxFactor;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::isCtmc;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::formulaMatchesExpression;
-			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::numberTerminal;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::numberStates;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::numberTransitions;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::currentRowGroup;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::currentRow;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::explorationMetrics;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::perfCounters;
+		protected:
+			/**
+			 * Adds statePriorityQueue to the frontier
+			 * */
+			uint64_t getFrontierSizeInBytes() override;
 		private:
 			/**
 			 * Connects all states which are terminal
 			 * */
-			void connectAllTerminalStatesToAbsorbing(storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder);
+			void connectAllTerminalStatesToAbsorbing();
 			/* Data members */
-			std::priority_queue<
-				typename StaminaModelBuilder<ValueType, RewardModelType, StateType>::ProbabilityStatePair
-				, typename StaminaModelBuilder<ValueType, RewardModelType, StateType>::ProbabilityStatePair
-				, typename StaminaModelBuilder<ValueType, RewardModelType, StateType>::ProbabilityStatePairComparison
+			// Perimeter states, ordered by their reachability. Each state is in the heap at most once.
+			util::IndexedPriorityQueue<
+				StateType
+				, ProbabilityState
+				, typename StaminaModelBuilder<ValueType, RewardModelType, StateType>::ProbabilityStateComparison
 			> statePriorityQueue;
 			uint64_t numberOfExploredStates;
 			uint64_t numberOfExploredStatesSinceLastMessage;
+			// Total reachability of the states in statePriorityQueue
 			double piHat;
+			// Exploration stops once piHat is at or below this
+			double targetPiHat;
 		};
 	}
 }
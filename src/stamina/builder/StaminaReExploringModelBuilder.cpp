@@ -38,14 +38,14 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::StaminaRe
 template <typename ValueType, typename RewardModelType, typename StateType>
 void
 StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatrices(
-	storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-	, std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
+	std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
 	, StateAndChoiceInformationBuilder& stateAndChoiceInformationBuilder
 	, boost::optional<storm::storage::BitVector>& markovianChoices
 	, boost::optional<storm::storage::sparse::StateValuationsBuilder>& stateValuationsBuilder
 ) {
 	fresh = false;
 	numberTransitions = 0;
+	explorationMetrics.iterations++;
 	// Builds model
 	// Initialize building state valuations (if necessary)
 	if (stateAndChoiceInformationBuilder.isBuildStateValuations()) {
@@ -61,10 +61,15 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatr
 		, this
 		, std::placeholders::_1
 	);
+	// Successors of expanded states are collected and then interned together
+	std::function<StateType (CompressedState const&)> successorBatchCallback = std::bind(
+		&StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::addToSuccessorBatch
+		, this
+		, std::placeholders::_1
+	);
 	// Create absorbing state
 	this->setUpAbsorbingState(
-		transitionMatrixBuilder
-		, rewardModelBuilders
+		rewardModelBuilders
 		, stateAndChoiceInformationBuilder
 		, markovianChoices
 		, stateValuationsBuilder
@@ -92,12 +97,19 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatr
 	isInit = false;
 	// Perform a search through the model.
 	while (!statesToExplore.empty()) {
-		auto currentProbabilityStatePair = statesToExplore.front();
-		currentProbabilityState = statesToExplore.front().first;
-		currentState = statesToExplore.front().second;
-		statesToExplore.pop_front();
+		// Evaluated in batches, so this must happen before the state is popped
+		bool propertyHoldsAtCurrentState = this->propertyHoldsAtFront();
 		// Get the first state in the queue.
-		currentIndex = currentProbabilityState->index;
+		explorationMetrics.noteFrontierSize(statesToExplore.size());
+		currentIndex = statesToExplore.front();
+		statesToExplore.pop_front();
+		explorationMetrics.statesDequeued++;
+		if (explorationMetrics.statesDequeued % MEMORY_CHECK_FREQUENCY == 0 && util::MemoryAccounting::getCap() != 0) {
+			this->accountMemory();
+		}
+		currentProbabilityState = stateMap.get(currentIndex);
+		// Reuses the memory of currentState
+		stateIdMap.getState(currentIndex, currentState);
 
 		if (currentIndex == 0) {
 			StaminaMessages::errorAndExit("Dequeued artificial absorbing state!");
@@ -107,7 +119,7 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatr
 		// Set our state variable in the class
 
 		if (currentIndex % MSG_FREQUENCY == 0) {
-			StaminaMessages::info("Exploring state with id " + std::to_string(currentIndex) + ".");
+			STAMINA_LOG_INFO("Exploring state with id " + std::to_string(currentIndex) + ".");
 		}
 
 		if (stateAndChoiceInformationBuilder.isBuildStateValuations()) {
@@ -117,27 +129,22 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatr
 		// Load state for us to use
 		generator->load(currentState);
 
-		if (propertyExpression != nullptr) {
-			storm::expressions::SimpleValuation valuation = generator->currentStateToSimpleValuation();
-			bool evaluationAtCurrentState = propertyExpression->evaluateAsBool(&valuation);
-			// If the property does not hold at the current state, make it absorbing in the
-			// state graph and do not explore its successors
-			if (!evaluationAtCurrentState) {
-				this->createTransition(currentRow, currentIndex, 1.0);
-				// We treat this state as terminal even though it is also absorbing and does not
-				// go to our artificial absorbing state
-				currentProbabilityState->terminal = true;
-				numberTerminal++;
-				// Do NOT place this in the deque of states we should start with next iteration
-				continue;
-			}
+		// If the property does not hold at the current state, make it absorbing in the
+		// state graph and do not explore its successors
+		if (!propertyHoldsAtCurrentState) {
+			this->createTransition(currentIndex, currentIndex, 1.0);
+			// We treat this state as terminal even though it is also absorbing and does not
+			// go to our artificial absorbing state
+			currentProbabilityState.setTerminal(true);
+			// Do NOT place this in the deque of states we should start with next iteration
+			continue;
 		}
 
 		// Add the state rewards to the corresponding reward models.
 		// Do not explore if state is terminal and its reachability probability is less than kappa
-		if (currentProbabilityState->isTerminal() && currentProbabilityState->getPi() < localKappa) {
+		if (currentProbabilityState.isTerminal() && currentProbabilityState.getPi() < localKappa) {
 			// Do not connect to absorbing yet--only connect at the end
-			statesTerminatedLastIteration.push_back(currentProbabilityStatePair);
+			statesTerminatedLastIteration.push_back(currentIndex);
 			++numberOfExploredStates;
 			++currentRow;
 			++currentRowGroup;
@@ -146,8 +153,18 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatr
 
 		// We assume that if we make it here, our state is either nonterminal, or its reachability probability
 		// is greater than kappa
+		if (currentProbabilityState.isNew()) {
+			// Drop the transitions to absorbing from when this was a perimeter state
+			transitionStore.clearRow(currentIndex);
+		}
 		// Expand (explore next states)
-		storm::generator::StateBehavior<ValueType, StateType> behavior = generator->expand(stateToIdCallback);
+		successorBatch.clear();
+		storm::generator::StateBehavior<ValueType, StateType> behavior;
+		{
+			util::PerfCounters::Scope scope(perfCounters, util::PerfCounters::EXPAND);
+			behavior = generator->expand(successorBatchCallback);
+		}
+		this->resolveSuccessorBatch();
 
 		auto stateRewardIt = behavior.getStateRewards().begin();
 		for (auto& rewardModelBuilder : rewardModelBuilders) {
@@ -159,12 +176,12 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatr
 		// If there is no behavior, we have an error.
 		if (behavior.empty()) {
 			// Make absorbing
-			this->createTransition(currentRow, currentIndex, 1.0);
+			this->createTransition(currentIndex, currentIndex, 1.0);
 			continue;
 			// StaminaMessages::warn("Behavior for state " + std::to_string(currentIndex) + " was empty!");
 		}
 
-		bool shouldEnqueueAll = currentProbabilityState->getPi() == 0.0;
+		bool shouldEnqueueAll = currentProbabilityState.getPi() == 0.0;
 		// Now add all choices.
 		bool firstChoiceOfState = true;
 		for (auto const& choice : behavior) {
@@ -177,6 +194,7 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatr
 					stateAndChoiceInformationBuilder.addChoiceLabel(label, currentRow);
 
 				}
+				this->choiceLabels.setLabels(currentIndex, choice.getLabels());
 			}
 			if (stateAndChoiceInformationBuilder.isBuildChoiceOrigins() && choice.hasOriginData()) {
 				stateAndChoiceInformationBuilder.addChoiceOriginData(choice.getOriginData(), currentRow);
@@ -190,8 +208,8 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatr
 			double totalRate = 0.0;
 			if (!shouldEnqueueAll && isCtmc) {
 				for (auto const & stateProbabilityPair : choice) {
-					if (stateProbabilityPair.first == 0) {
-						StaminaMessages::warning("Transition to absorbing state from API!!!");
+					if (successorBatch.resolve(stateProbabilityPair.first) == 0) {
+						STAMINA_LOG_WARNING("Transition to absorbing state from API!!!");
 						continue;
 					}
 					totalRate += stateProbabilityPair.second;
@@ -199,7 +217,7 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatr
 			}
 			// Add the probabilistic behavior to the matrix.
 			for (auto const& stateProbabilityPair : choice) {
-				StateType sPrime = stateProbabilityPair.first;
+				StateType sPrime = successorBatch.resolve(stateProbabilityPair.first);
 				if (sPrime == 0) {
 					continue;
 				}
@@ -210,12 +228,12 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatr
 				// greater than zero
 
 				auto nextProbabilityState = stateMap.get(sPrime);
-				if (nextProbabilityState != nullptr) {
+				if (nextProbabilityState) {
 					if (!shouldEnqueueAll) {
-						nextProbabilityState->addToPi(currentProbabilityState->getPi() * probability);
+						nextProbabilityState.addToPi(currentProbabilityState.getPi() * probability);
 					}
 
-					if (currentProbabilityState->isNew) {
+					if (currentProbabilityState.isNew()) {
 						this->createTransition(currentIndex, sPrime, stateProbabilityPair.second);
 						numberTransitions++;
 					}
@@ -227,12 +245,9 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatr
 			}
 			firstChoiceOfState = false;
 		}
-		currentProbabilityState->isNew = false;
-		if (currentProbabilityState->isTerminal() && numberTerminal > 0) {
-			numberTerminal--;
-		}
-		currentProbabilityState->setTerminal(false);
-		currentProbabilityState->setPi(0.0);
+		currentProbabilityState.setNew(false);
+		currentProbabilityState.setTerminal(false);
+		currentProbabilityState.setPi(0.0);
 
 		if (currentRow >= currentRowGroup) {
 			++currentRowGroup;
@@ -247,7 +262,7 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatr
 			if (static_cast<uint64_t>(durationSinceLastMessage) >= generator->getOptions().getShowProgressDelay()) {
 				auto statesPerSecond = numberOfExploredStatesSinceLastMessage / durationSinceLastMessage;
 				auto durationSinceStart = std::chrono::duration_cast<std::chrono::seconds>(now - timeOfStart).count();
-				StaminaMessages::info(
+				STAMINA_LOG_INFO(
 					"Explored " + std::to_string(numberOfExploredStates) + " states in " + std::to_string(durationSinceStart) + " seconds (currently " + std::to_string(statesPerSecond) + " states per second)."
 				);
 				timeOfLastMessage = std::chrono::high_resolution_clock::now();
@@ -264,44 +279,30 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMatr
 
 template <typename ValueType, typename RewardModelType, typename StateType>
 StateType
-StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::getOrAddStateIndex(CompressedState const& state) {
-	StateType actualIndex;
-	StateType newIndex = static_cast<StateType>(stateStorage.getNumberOfStates());
-	if (stateStorage.stateToId.contains(state)) {
-		actualIndex = stateStorage.stateToId.getValue(state);
-	}
-	else {
-		// Create new index just in case we need it
-		actualIndex = newIndex;
-	}
-
+StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::processStateIndex(
+	CompressedState const& state
+	, StateType actualIndex
+	, bool wasAdded
+) {
 	auto nextState = stateMap.get(actualIndex);
-	bool stateIsExisting = nextState != nullptr;
+	bool stateIsExisting = static_cast<bool>(nextState);
 
-	stateStorage.stateToId.findOrAdd(state, actualIndex);
 	// Handle conditional enqueuing
 	if (isInit) {
 		if (!stateIsExisting) {
 			// Create a ProbabilityState for each individual state
-			ProbabilityState * initProbabilityState = memoryPool.allocate();
-			*initProbabilityState = ProbabilityState(
+			ProbabilityState initProbabilityState = stateMap.emplace(
 				actualIndex
 				, 1.0
 				, true
+				, iteration
 			);
-			numberTerminal++;
-			stateMap.put(actualIndex, initProbabilityState);
-			statesToExplore.emplace_back(std::make_pair(initProbabilityState, state));
-			initProbabilityState->iterationLastSeen = iteration;
+			statesToExplore.push_back(initProbabilityState.index);
 		}
 		else {
-			ProbabilityState * initProbabilityState = nextState;
-			stateMap.put(actualIndex, initProbabilityState);
-			statesToExplore.push_back(std::make_pair(initProbabilityState, state));
-			initProbabilityState->iterationLastSeen = iteration;
-		}
-		if (actualIndex == newIndex) {
-			stateRemapping.get().push_back(storm::utility::zero<StateType>());
+			ProbabilityState initProbabilityState = nextState;
+			statesToExplore.push_back(initProbabilityState.index);
+			initProbabilityState.setIterationLastSeen(iteration);
 		}
 		return actualIndex;
 	}
@@ -310,14 +311,14 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::getOrAddS
 
 	// This bit handles the non-initial states
 	// The previous state has reachability of 0
-	if (currentProbabilityState->getPi() == 0) {
+	if (currentProbabilityState.getPi() == 0) {
 		if (stateIsExisting) {
 			// Don't rehash if we've already called find()
-			ProbabilityState * nextProbabilityState = nextState;
-			if (nextProbabilityState->iterationLastSeen != iteration) {
-				nextProbabilityState->iterationLastSeen = iteration;
+			ProbabilityState nextProbabilityState = nextState;
+			if (nextProbabilityState.getIterationLastSeen() != iteration) {
+				nextProbabilityState.setIterationLastSeen(iteration);
 				// Enqueue
-				statesToExplore.push_back(std::make_pair(nextProbabilityState, state));
+				statesToExplore.push_back(nextProbabilityState.index);
 				enqueued = true;
 			}
 		}
@@ -329,29 +330,26 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::getOrAddS
 	else {
 		if (stateIsExisting) {
 			// Don't rehash if we've already called find()
-			ProbabilityState * nextProbabilityState = nextState;
+			ProbabilityState nextProbabilityState = nextState;
 			// auto emplaced = exploredStates.emplace(actualIndex);
-			if (nextProbabilityState->iterationLastSeen != iteration) {
-				nextProbabilityState->iterationLastSeen = iteration;
+			if (nextProbabilityState.getIterationLastSeen() != iteration) {
+				nextProbabilityState.setIterationLastSeen(iteration);
 				// Enqueue
-				statesToExplore.push_back(std::make_pair(nextProbabilityState, state));
+				statesToExplore.push_back(nextProbabilityState.index);
 				enqueued = true;
 			}
 		}
 		else {
 			// This state has not been seen so create a new ProbabilityState
-			ProbabilityState * nextProbabilityState = memoryPool.allocate();
-			*nextProbabilityState = ProbabilityState(
+			ProbabilityState nextProbabilityState = stateMap.emplace(
 				actualIndex
 				, 0.0
 				, true
+				, iteration
 			);
-			stateMap.put(actualIndex, nextProbabilityState);
-			nextProbabilityState->iterationLastSeen = iteration;
 			// exploredStates.emplace(actualIndex);
-			statesToExplore.push_back(std::make_pair(nextProbabilityState, state));
+			statesToExplore.push_back(nextProbabilityState.index);
 			enqueued = true;
-			numberTerminal++;
 		}
 	}
 	return actualIndex;
@@ -387,26 +385,15 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMode
 
 	StateSpaceInformation::setVariableInformation(generator->getVariableInformation());
 
-	// Component builders
-	storm::storage::SparseMatrixBuilder<ValueType> transitionMatrixBuilder(
-			0
-			, 0
-			, 0
-			, false
-			, false // All models are deterministic
-			, 0
-		);
-
 	double piHat = 1.0;
 	int innerLoopCount = 0;
 
 	// Continuously decrement kappa
-	while (piHat >= Options::prob_win / Options::approx_factor) {
+	while (piHat >= Options::prob_win / approxFactor) {
 		statesTerminatedLastIteration.clear();
 		// Builds matrices and truncates state space
 		buildMatrices(
-			transitionMatrixBuilder
-			, rewardModelBuilders
+			rewardModelBuilders
 			, stateAndChoiceInformationBuilder
 			, markovianStates
 			, stateValuationsBuilder
@@ -421,12 +408,11 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMode
 	this->printStateSpaceInformation();
 
 	// No remapping is necessary
-	connectAllTerminalStatesToAbsorbing(transitionMatrixBuilder);
-	this->flushToTransitionMatrix(transitionMatrixBuilder);
+	connectAllTerminalStatesToAbsorbing();
 
 	// Using the information from buildMatrices, initialize the model components
 	storm::storage::sparse::ModelComponents<ValueType, RewardModelType> modelComponents(
-		transitionMatrixBuilder.build(0, transitionMatrixBuilder.getCurrentRowGroupCount())
+		this->buildTransitionMatrix()
 		, this->buildStateLabeling()
 		, std::unordered_map<std::string, RewardModelType>()
 		, !generator->isDiscreteTimeModel()
@@ -443,11 +429,11 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMode
 	}
 	if (generator->isPartiallyObservable()) {
 		std::vector<uint32_t> classes;
-		classes.resize(stateStorage.getNumberOfStates());
+		classes.resize(stateIdMap.size());
 		std::unordered_map<uint32_t, std::vector<std::pair<std::vector<std::string>, uint32_t>>> observationActions;
-		for (auto const& bitVectorIndexPair : stateStorage.stateToId) {
-			uint32_t varObservation = generator->observabilityClass(bitVectorIndexPair.first);
-			classes[bitVectorIndexPair.second] = varObservation;
+		for (StateType id = 0; id < stateIdMap.size(); ++id) {
+			uint32_t varObservation = generator->observabilityClass(stateIdMap.getState(id));
+			classes[id] = varObservation;
 		}
 
 		modelComponents.observabilityClasses = classes;
@@ -460,27 +446,31 @@ StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::buildMode
 
 template <typename ValueType, typename RewardModelType, typename StateType>
 void
-StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::connectAllTerminalStatesToAbsorbing(
-	storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-) {
+StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::connectAllTerminalStatesToAbsorbing() {
 // 	std::cout << "connecting all terminal states to absorbing" << std::endl;
 // 	std::cout << "The number of states to connect is " << statesTerminatedLastIteration.size() << "." << std::endl;
 	// The perimeter states require a second custom stateToIdCallback which does not enqueue or
 	// register new states
+	CompressedState state;
 	while (!statesTerminatedLastIteration.empty()) {
-		auto currentProbabilityState = statesTerminatedLastIteration.front().first;
-		auto state = statesTerminatedLastIteration.front().second;
-// 		std::cout << "Connecting state " << StateSpaceInformation::stateToString(currentProbabilityState->state, 0) << " to terminal" << std::endl;
+		StateType terminalIndex = statesTerminatedLastIteration.front();
+		stateIdMap.getState(terminalIndex, state);
+// 		std::cout << "Connecting state " << StateSpaceInformation::stateToString(state, 0) << " to terminal" << std::endl;
 		this->connectTerminalStatesToAbsorbing(
-			transitionMatrixBuilder
-			, state
-			, currentProbabilityState->index
+			state
+			, terminalIndex
 			, this->terminalStateToIdCallback
 		);
 		statesTerminatedLastIteration.pop_front();
 	}
 }
 
+template <typename ValueType, typename RewardModelType, typename StateType>
+uint64_t
+StaminaReExploringModelBuilder<ValueType, RewardModelType, StateType>::getFrontierSizeInBytes() {
+	return StaminaModelBuilder<ValueType, RewardModelType, StateType>::getFrontierSizeInBytes() + statesTerminatedLastIteration.getSizeInBytes();
+}
+
 template class StaminaReExploringModelBuilder<double, storm::models::sparse::StandardRewardModel<double>, uint32_t>;
 
 } // namespace builder
@@ -40,27 +40,26 @@ namespace stamina {
 			/**
 			* Builds transition matrix of truncated state space for the given program.
 			*
-			* @param transitionMatrixBuilder The builder of the transition matrix.
 			* @param rewardModelBuilders The builders for the selected reward models.
 			* @param choiceInformationBuilder The builder for the requested information of the choices
 			* @param markovianChoices is set to a bit vector storing whether a choice is Markovian (is only set if the model type requires this information).
 			* @param stateValuationsBuilder if not boost::none, we insert valuations for the corresponding states
 			* */
 			void buildMatrices(
-				storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder
-				, std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
+				std::vector<RewardModelBuilder<typename RewardModelType::ValueType>>& rewardModelBuilders
 				, StateAndChoiceInformationBuilder& choiceInformationBuilder
 				, boost::optional<storm::storage::BitVector>& markovianChoices
 				, boost::optional<storm::storage::sparse::StateValuationsBuilder>& stateValuationsBuilder
 			) override;
 			/**
-			* Gets the state ID of a current state, or adds it to the internal state storage. Performs state exploration
-			* and state space truncation from that state.
+			* Performs state exploration and state space truncation from a state once it has been given an id.
 			*
-			* @param state Pointer to the state we are looking it
-			* @return A pair with the state id and whether or not it was already discovered
+			* @param state The state
+			* @param actualIndex The id of the state in stateIdMap
+			* @param wasAdded Whether the state was added to stateIdMap when it was looked up
+			* @return The state id, or 0 if the state should not be registered
 			* */
-			StateType getOrAddStateIndex(CompressedState const& state) override;
+			StateType processStateIndex(CompressedState const& state, StateType actualIndex, bool wasAdded) override;
 			/**
 			* Explores state space and truncates the model
 			*
@@ -74,10 +73,11 @@ namespace stamina {
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::expressionManager;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::propertyFormula;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::stateStorage;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::stateIdMap;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::successorBatch;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::transitionStore;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::generator;
-			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::memoryPool;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::statesToExplore;
-			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::stateRemapping;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::stateMap;
 			// Options for next state generators
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::options;
@@ -91,22 +91,29 @@ namespace stamina {
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::iteration;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::firstIteration;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::localKappa;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::approxFactor;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::isCtmc;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::formulaMatchesExpression;
-			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::numberTerminal;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::numberStates;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::numberTransitions;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::currentRowGroup;
 			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::currentRow;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::explorationMetrics;
+			using StaminaModelBuilder<ValueType, RewardModelType, StateType>::perfCounters;
+		protected:
+			/**
+			 * Adds statesTerminatedLastIteration to the frontier
+			 * */
+			uint64_t getFrontierSizeInBytes() override;
 		private:
 			/**
 			 * Connects all states which are terminal
 			 * */
-			void connectAllTerminalStatesToAbsorbing(storm::storage::SparseMatrixBuilder<ValueType>& transitionMatrixBuilder);
+			void connectAllTerminalStatesToAbsorbing();
 			// Dynamic programming improvement: we keep an ordered set of the states terminated
 			// during the previous iteration (in an order that prevents needing to use a remapping
 			// vector for state indecies.
-			std::deque<std::pair<ProbabilityState *, CompressedState>> statesTerminatedLastIteration;
+			util::RingBuffer<StateType> statesTerminatedLastIteration;
 			uint64_t numberOfExploredStates;
 			uint64_t numberOfExploredStatesSinceLastMessage;
 		};
@@ -0,0 +1,50 @@
+#include "WorkStealingQueue.h"
+
+namespace stamina {
+namespace builder {
+namespace threads {
+
+template <typename T>
+void
+WorkStealingQueue<T>::push(T item) {
+	std::lock_guard<std::mutex> guard(lock);
+	items.emplace_back(std::move(item));
+}
+
+template <typename T>
+bool
+WorkStealingQueue<T>::pop(T & item) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (items.empty()) {
+		return false;
+	}
+	item = std::move(items.front());
+	items.pop_front();
+	return true;
+}
+
+template <typename T>
+bool
+WorkStealingQueue<T>::steal(T & item) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (items.empty()) {
+		return false;
+	}
+	item = std::move(items.back());
+	items.pop_back();
+	return true;
+}
+
+template <typename T>
+bool
+WorkStealingQueue<T>::empty() {
+	std::lock_guard<std::mutex> guard(lock);
+	return items.empty();
+}
+
+// Forward declare
+template class WorkStealingQueue<uint32_t>;
+
+} // namespace threads
+} // namespace builder
+} // namespace stamina
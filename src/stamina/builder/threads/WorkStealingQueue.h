@@ -0,0 +1,54 @@
+#ifndef STAMINA_BUILDER_THREADS_WORKSTEALINGQUEUE_H
+#define STAMINA_BUILDER_THREADS_WORKSTEALINGQUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <cstdint>
+
+/**
+ * Per-thread queue of states to explore.
+ *
+ * The owning thread takes work from the front (so that, like the serial builders, each thread
+ * explores in breadth-first order) while other threads steal from the back once their own queues
+ * run dry. Each queue has its own lock, so unless a thread is stealing, the only thread touching
+ * a queue is its owner and the lock is uncontended.
+ * */
+namespace stamina {
+	namespace builder {
+		namespace threads {
+			template <typename T>
+			class WorkStealingQueue {
+			public:
+				/**
+				 * Adds an item to the back of the queue
+				 *
+				 * @param item The item to add
+				 * */
+				void push(T item);
+				/**
+				 * Takes an item off the front of the queue. Used by the owning thread
+				 *
+				 * @param item Where to put the item
+				 * @return Whether or not there was an item to take
+				 * */
+				bool pop(T & item);
+				/**
+				 * Takes an item off the back of the queue. Used by threads which do not own the queue
+				 *
+				 * @param item Where to put the item
+				 * @return Whether or not there was an item to steal
+				 * */
+				bool steal(T & item);
+				/**
+				 * Whether or not this queue is empty
+				 * */
+				bool empty();
+			private:
+				std::deque<T> items;
+				std::mutex lock;
+			};
+		} // namespace threads
+	} // namespace builder
+} // namespace stamina
+
+#endif // STAMINA_BUILDER_THREADS_WORKSTEALINGQUEUE_H
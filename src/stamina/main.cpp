@@ -13,10 +13,23 @@ set_default_values(struct arguments * arguments) {
 	arguments->max_approx_count = 10;
 	arguments->no_prop_refine = false;
 	arguments->cudd_max_mem = "1g";
-	arguments->export_trans = "trans.txt";
+	arguments->export_trans = "";
+	arguments->export_trans_binary = false;
 	arguments->rank_transitions = false;
 	arguments->max_iterations = 10000;
+	arguments->max_states = 2000000;
 	arguments->method = STAMINA_METHODS::ITERATIVE_METHOD;
+	arguments->threads = 1;
+	arguments->spill_budget = 0;
+	arguments->spill_dir = "/tmp";
+	arguments->property_threads = 1;
+	arguments->shared_truncation = false;
+	arguments->compiled_generator = false;
+	arguments->checkpoint_interval = 600;
+	arguments->resume = false;
+	arguments->metrics_out = "";
+	arguments->memory_cap = 0;
+	arguments->perf_counters = false;
 }
 
 /**
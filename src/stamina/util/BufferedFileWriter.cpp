@@ -0,0 +1,166 @@
+#include "BufferedFileWriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Longest a formatted number can be (a double with 17 significant digits and an exponent)
+#define MAX_NUMBER_LENGTH 32
+
+/**
+ * Implementation for BufferedFileWriter methods
+ * */
+
+namespace stamina {
+	namespace util {
+		BufferedFileWriter::BufferedFileWriter(std::string const & filename, uint64_t bufferSize)
+			: filename(filename)
+			, bufferSize(std::max<uint64_t>(bufferSize, MAX_NUMBER_LENGTH))
+			, active(0)
+			, position(0)
+			, writing(1)
+			, writingSize(0)
+			, pending(false)
+			, closing(false)
+			, error(0)
+		{
+			fileDescriptor = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if (fileDescriptor < 0) {
+				throw std::runtime_error("Could not open " + filename + " for writing: " + std::strerror(errno));
+			}
+			buffers[0].reset(new char[this->bufferSize]);
+			buffers[1].reset(new char[this->bufferSize]);
+			ioThread = std::thread(&BufferedFileWriter::writeLoop, this);
+		}
+
+		BufferedFileWriter::~BufferedFileWriter() {
+			try {
+				close();
+			}
+			catch (std::exception const &) {
+				// Errors can only be reported by calling close()
+			}
+		}
+
+		void
+		BufferedFileWriter::write(char const * characters, uint64_t length) {
+			while (length > 0) {
+				if (position == bufferSize) { swapBuffers(); }
+				uint64_t chunk = std::min(length, bufferSize - position);
+				std::memcpy(buffers[active].get() + position, characters, chunk);
+				position += chunk;
+				characters += chunk;
+				length -= chunk;
+			}
+		}
+
+		void
+		BufferedFileWriter::writeUnsigned(uint64_t value) {
+			reserve(MAX_NUMBER_LENGTH);
+			char * start = buffers[active].get() + position;
+			position = std::to_chars(start, start + MAX_NUMBER_LENGTH, value).ptr - buffers[active].get();
+		}
+
+		void
+		BufferedFileWriter::writeSigned(int64_t value) {
+			reserve(MAX_NUMBER_LENGTH);
+			char * start = buffers[active].get() + position;
+			position = std::to_chars(start, start + MAX_NUMBER_LENGTH, value).ptr - buffers[active].get();
+		}
+
+		void
+		BufferedFileWriter::writeDouble(double value) {
+			reserve(MAX_NUMBER_LENGTH);
+			char * start = buffers[active].get() + position;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+			position = std::to_chars(start, start + MAX_NUMBER_LENGTH, value).ptr - buffers[active].get();
+#else
+			// Older standard libraries can only convert integers with std::to_chars
+			position += std::snprintf(start, MAX_NUMBER_LENGTH, "%.17g", value);
+#endif
+		}
+
+		void
+		BufferedFileWriter::close() {
+			if (fileDescriptor < 0) {
+				return;
+			}
+			{
+				// Hand over what is left (unless writing has already failed), then wait for it
+				std::unique_lock<std::mutex> guard(lock);
+				changed.wait(guard, [this]() { return !pending; });
+				if (error == 0 && position > 0) {
+					writing = active;
+					writingSize = position;
+					pending = true;
+					position = 0;
+					changed.notify_all();
+					changed.wait(guard, [this]() { return !pending; });
+				}
+				closing = true;
+			}
+			changed.notify_all();
+			ioThread.join();
+			int closeResult = ::close(fileDescriptor);
+			fileDescriptor = -1;
+			if (error == 0 && closeResult != 0) {
+				error = errno;
+			}
+			if (error != 0) {
+				throw std::runtime_error("Could not write to " + filename + ": " + std::strerror(error));
+			}
+		}
+
+		void
+		BufferedFileWriter::swapBuffers() {
+			std::unique_lock<std::mutex> guard(lock);
+			changed.wait(guard, [this]() { return !pending; });
+			if (error != 0) {
+				throw std::runtime_error("Could not write to " + filename + ": " + std::strerror(error));
+			}
+			writing = active;
+			writingSize = position;
+			pending = true;
+			active ^= 1;
+			position = 0;
+			guard.unlock();
+			changed.notify_all();
+		}
+
+		void
+		BufferedFileWriter::writeLoop() {
+			std::unique_lock<std::mutex> guard(lock);
+			while (true) {
+				changed.wait(guard, [this]() { return pending || closing; });
+				if (!pending) {
+					return;
+				}
+				char const * data = buffers[writing].get();
+				uint64_t remaining = writingSize;
+				guard.unlock();
+				int writeError = 0;
+				while (remaining > 0) {
+					ssize_t written = ::write(fileDescriptor, data, remaining);
+					if (written < 0) {
+						if (errno == EINTR) { continue; }
+						writeError = errno;
+						break;
+					}
+					data += written;
+					remaining -= written;
+				}
+				guard.lock();
+				if (error == 0) {
+					error = writeError;
+				}
+				pending = false;
+				changed.notify_all();
+			}
+		}
+	} // namespace util
+} // namespace stamina
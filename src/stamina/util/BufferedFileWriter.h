@@ -0,0 +1,113 @@
+#ifndef STAMINA_UTIL_BUFFEREDFILEWRITER_H
+#define STAMINA_UTIL_BUFFEREDFILEWRITER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Size of each of the two buffers of a BufferedFileWriter (4 MiB)
+#define WRITER_BUFFER_SIZE (1ULL << 22)
+
+/**
+ * Write-only text file for exporting large models.
+ *
+ * Numbers and strings are formatted straight into one of two large buffers, so nothing is allocated
+ * per line. When a buffer is full, it is handed to a background thread which writes it to the file
+ * with write(2), while the other buffer is filled. This means formatting and disk I/O overlap.
+ *
+ * Errors (opening or writing the file) are thrown as std::runtime_error. Write errors are only noticed
+ * by the next buffer swap or by close(). Not thread-safe: a writer should only be used by one thread.
+ * */
+namespace stamina {
+	namespace util {
+		class BufferedFileWriter {
+		public:
+			/**
+			 * Constructor. Creates (or truncates) the file.
+			 *
+			 * @param filename The file to write to
+			 * @param bufferSize The size of each buffer
+			 * */
+			BufferedFileWriter(std::string const & filename, uint64_t bufferSize = WRITER_BUFFER_SIZE);
+			/**
+			 * Destructor. Closes the file if close() was not called, ignoring any errors.
+			 * */
+			~BufferedFileWriter();
+			/**
+			 * Writes a single character
+			 * */
+			void write(char c) {
+				if (position == bufferSize) { swapBuffers(); }
+				buffers[active][position++] = c;
+			}
+			/**
+			 * Writes some characters
+			 * */
+			void write(char const * characters, uint64_t length);
+			/**
+			 * Writes a null-terminated string
+			 * */
+			void write(char const * characters) { write(characters, std::strlen(characters)); }
+			/**
+			 * Writes a string
+			 * */
+			void write(std::string const & str) { write(str.data(), str.size()); }
+			/**
+			 * Writes an unsigned integer in decimal
+			 * */
+			void writeUnsigned(uint64_t value);
+			/**
+			 * Writes a signed integer in decimal
+			 * */
+			void writeSigned(int64_t value);
+			/**
+			 * Writes a double in the shortest form which reads back as the same value
+			 * */
+			void writeDouble(double value);
+			/**
+			 * Writes everything which is still buffered, waits for it to reach the file, and closes the
+			 * file. Throws if anything could not be written.
+			 * */
+			void close();
+		private:
+			/**
+			 * Makes sure there are at least some bytes free in the active buffer
+			 * */
+			void reserve(uint64_t bytes) {
+				if (position + bytes > bufferSize) { swapBuffers(); }
+			}
+			/**
+			 * Hands the active buffer to the I/O thread (once it is done with the other one), and
+			 * starts filling the other buffer
+			 * */
+			void swapBuffers();
+			/**
+			 * Loop for the I/O thread
+			 * */
+			void writeLoop();
+			std::string filename;
+			int fileDescriptor;
+			uint64_t bufferSize;
+			std::unique_ptr<char[]> buffers[2];
+			// The buffer being filled, and how much of it is used
+			uint8_t active;
+			uint64_t position;
+			// The buffer the I/O thread is writing (if pending)
+			uint8_t writing;
+			uint64_t writingSize;
+			bool pending;
+			bool closing;
+			// errno of the first failed write, or 0
+			int error;
+			std::mutex lock;
+			std::condition_variable changed;
+			std::thread ioThread;
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_BUFFEREDFILEWRITER_H
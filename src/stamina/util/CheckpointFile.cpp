@@ -0,0 +1,153 @@
+#include "CheckpointFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+
+// Magic number at the start of every checkpoint ("STAMCKPT")
+#define CHECKPOINT_MAGIC 0x54504b434d415453ULL
+
+/**
+ * Implementation for CheckpointFile methods
+ * */
+
+namespace stamina {
+	namespace util {
+		/* Header of the file and of each section */
+		struct CheckpointHeader {
+			uint64_t magic;
+			uint64_t version;
+		};
+		struct SectionHeader {
+			uint64_t tag;
+			uint64_t bytes;
+		};
+
+		static std::atomic<bool> terminationFlag(false);
+
+		/**
+		 * Only sets terminationFlag, since that is all that is safe to do in a signal handler
+		 * */
+		static void
+		handleTermination(int /* signal */) {
+			terminationFlag.store(true, std::memory_order_relaxed);
+		}
+
+		/**
+		 * The number of bytes needed to pad a length to a multiple of 8
+		 * */
+		static uint64_t
+		paddingFor(uint64_t bytes) {
+			return (8 - (bytes & 7)) & 7;
+		}
+
+		CheckpointFile::Writer::Writer(std::string const & filename)
+			: filename(filename)
+			, temporaryFilename(filename + ".tmp")
+			, out(temporaryFilename)
+			, sectionRemaining(0)
+			, sectionBytes(0)
+		{
+			CheckpointHeader header = {CHECKPOINT_MAGIC, CHECKPOINT_VERSION};
+			out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+		}
+
+		void
+		CheckpointFile::Writer::beginSection(uint64_t tag, uint64_t bytes) {
+			if (sectionRemaining != 0) {
+				throw std::runtime_error("Section of " + filename + " started before the last one was finished");
+			}
+			SectionHeader header = {tag, bytes};
+			out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+			sectionRemaining = bytes;
+			sectionBytes = bytes;
+			if (bytes == 0) {
+				endSection();
+			}
+		}
+
+		void
+		CheckpointFile::Writer::write(void const * data, uint64_t bytes) {
+			if (bytes > sectionRemaining) {
+				throw std::runtime_error("Section of " + filename + " is longer than it was declared to be");
+			}
+			out.write(static_cast<char const *>(data), bytes);
+			sectionRemaining -= bytes;
+			if (sectionRemaining == 0) {
+				endSection();
+			}
+		}
+
+		void
+		CheckpointFile::Writer::endSection() {
+			static const char zeros[8] = {0};
+			out.write(zeros, paddingFor(sectionBytes));
+		}
+
+		void
+		CheckpointFile::Writer::close() {
+			if (sectionRemaining != 0) {
+				throw std::runtime_error("Last section of " + filename + " was not finished");
+			}
+			out.close();
+			if (std::rename(temporaryFilename.c_str(), filename.c_str()) != 0) {
+				throw std::runtime_error("Could not move " + temporaryFilename + " to " + filename + ": " + std::strerror(errno));
+			}
+		}
+
+		CheckpointFile::Reader::Reader(std::string const & filename)
+			: file(filename)
+		{
+			if (file.size() < sizeof(CheckpointHeader)) {
+				file.malformed(file.begin());
+			}
+			CheckpointHeader header;
+			std::memcpy(&header, file.begin(), sizeof(header));
+			if (header.magic != CHECKPOINT_MAGIC) {
+				throw std::runtime_error(filename + " is not a checkpoint");
+			}
+			if (header.version != CHECKPOINT_VERSION) {
+				throw std::runtime_error(filename + " is a checkpoint of version " + std::to_string(header.version)
+					+ ", but only version " + std::to_string(CHECKPOINT_VERSION) + " can be read");
+			}
+			char const * position = file.begin() + sizeof(header);
+			while (position < file.end()) {
+				SectionHeader section;
+				if (static_cast<uint64_t>(file.end() - position) < sizeof(section)) {
+					file.malformed(position);
+				}
+				std::memcpy(&section, position, sizeof(section));
+				position += sizeof(section);
+				if (section.bytes > static_cast<uint64_t>(file.end() - position)) {
+					file.malformed(position);
+				}
+				sections[section.tag] = std::make_pair(position, section.bytes);
+				position += std::min<uint64_t>(section.bytes + paddingFor(section.bytes), file.end() - position);
+			}
+		}
+
+		bool
+		CheckpointFile::Reader::hasSection(uint64_t tag) const {
+			return sections.find(tag) != sections.end();
+		}
+
+		void
+		CheckpointFile::installTerminationHandler() {
+			struct sigaction action;
+			std::memset(&action, 0, sizeof(action));
+			action.sa_handler = &handleTermination;
+			sigemptyset(&action.sa_mask);
+			// A second SIGTERM is handled as usual
+			action.sa_flags = SA_RESETHAND;
+			sigaction(SIGTERM, &action, nullptr);
+		}
+
+		bool
+		CheckpointFile::terminationRequested() {
+			return terminationFlag.load(std::memory_order_relaxed);
+		}
+	} // namespace util
+} // namespace stamina
@@ -0,0 +1,132 @@
+#ifndef STAMINA_UTIL_CHECKPOINTFILE_H
+#define STAMINA_UTIL_CHECKPOINTFILE_H
+
+#include "BufferedFileWriter.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// Version of the checkpoint format. Checkpoints with any other version are not read.
+#define CHECKPOINT_VERSION 1
+
+/**
+ * Binary file of tagged sections, used to checkpoint the exploration of a model so that it can be
+ * resumed after the process is stopped.
+ *
+ * The file is a magic number and version, followed by sections. Each section is a tag, its length in
+ * bytes, and that many bytes of raw (native-endian) data, padded to a multiple of 8 bytes. Since every
+ * section starts on an 8 byte boundary, the Reader maps the file and hands out typed pointers straight
+ * into it rather than parsing anything. What the tags mean is up to whoever writes the file.
+ *
+ * The Writer writes to a temporary file and renames it over the checkpoint once it is closed, so a
+ * checkpoint is never left half written. Errors are thrown as std::runtime_error.
+ *
+ * This also handles SIGTERM: once installTerminationHandler() is called, a SIGTERM only sets a flag
+ * (see terminationRequested()), so that the exploration can write a checkpoint and exit. A second
+ * SIGTERM stops the process as usual.
+ * */
+namespace stamina {
+	namespace util {
+		class CheckpointFile {
+		public:
+			class Writer {
+			public:
+				/**
+				 * Constructor. Creates the temporary file and writes the header.
+				 *
+				 * @param filename The checkpoint file
+				 * */
+				Writer(std::string const & filename);
+				/**
+				 * Writes a section in one go
+				 *
+				 * @param tag The tag of the section
+				 * @param data The data
+				 * @param count The number of items in data
+				 * */
+				template <typename T>
+				void writeSection(uint64_t tag, T const * data, uint64_t count) {
+					beginSection(tag, count * sizeof(T));
+					write(data, count * sizeof(T));
+				}
+				/**
+				 * Starts a section whose data is written with one or more calls to write()
+				 *
+				 * @param tag The tag of the section
+				 * @param bytes The total length of the data
+				 * */
+				void beginSection(uint64_t tag, uint64_t bytes);
+				/**
+				 * Writes data for the current section
+				 * */
+				void write(void const * data, uint64_t bytes);
+				/**
+				 * Finishes the file and moves it over the checkpoint
+				 * */
+				void close();
+			private:
+				/**
+				 * Pads the current section once all of its data has been written
+				 * */
+				void endSection();
+				std::string filename;
+				std::string temporaryFilename;
+				BufferedFileWriter out;
+				// Bytes of the current section which are still to be written, and its total length
+				uint64_t sectionRemaining;
+				uint64_t sectionBytes;
+			};
+			class Reader {
+			public:
+				/**
+				 * Constructor. Maps the file and finds all of its sections.
+				 *
+				 * @param filename The checkpoint file
+				 * */
+				Reader(std::string const & filename);
+				/**
+				 * Whether or not the file has a section
+				 * */
+				bool hasSection(uint64_t tag) const;
+				/**
+				 * Gets the data of a section, which stays valid for as long as the reader exists. Throws
+				 * if the section is missing or its length is not a multiple of sizeof(T).
+				 *
+				 * @param tag The tag of the section
+				 * @param count Set to the number of items in the section
+				 * @return The items
+				 * */
+				template <typename T>
+				T const * getSection(uint64_t tag, uint64_t & count) const {
+					auto section = sections.find(tag);
+					if (section == sections.end()) {
+						throw std::runtime_error(file.filename + " does not have section " + std::to_string(tag));
+					}
+					if (section->second.second % sizeof(T) != 0) {
+						file.malformed(section->second.first);
+					}
+					count = section->second.second / sizeof(T);
+					return reinterpret_cast<T const *>(section->second.first);
+				}
+			private:
+				MappedFile file;
+				// The data and length of each section, by tag
+				std::map<uint64_t, std::pair<char const *, uint64_t>> sections;
+			};
+			/**
+			 * Catches SIGTERM from now on, so that terminationRequested() can be checked instead
+			 * */
+			static void installTerminationHandler();
+			/**
+			 * Whether or not a SIGTERM has been caught
+			 * */
+			static bool terminationRequested();
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_CHECKPOINTFILE_H
@@ -0,0 +1,104 @@
+#include "ChoiceLabelTable.h"
+#include "BufferedFileWriter.h"
+
+#include <limits>
+#include <stdexcept>
+
+// Magic number at the start of a binary export
+#define TRANSITION_EXPORT_MAGIC "STAMTRAN"
+
+/**
+ * Implementation for ChoiceLabelTable methods
+ * */
+
+namespace stamina {
+	namespace util {
+		ChoiceLabelTable::ChoiceLabelTable() {
+			ids[std::set<std::string>()] = 0;
+			names.push_back(NO_CHOICE_LABEL);
+		}
+
+		void
+		ChoiceLabelTable::setLabels(uint64_t state, std::set<std::string> const & labels) {
+			std::lock_guard<std::mutex> guard(lock);
+			auto id = ids.find(labels);
+			if (id == ids.end()) {
+				std::string name;
+				for (auto const & label : labels) {
+					if (!name.empty()) { name += ','; }
+					name += label;
+				}
+				id = ids.emplace(labels, static_cast<uint32_t>(names.size())).first;
+				names.push_back(name);
+			}
+			if (stateLabels.size() <= state) {
+				stateLabels.resize(state + 1, 0);
+			}
+			stateLabels[state] = id->second;
+		}
+
+		uint32_t
+		ChoiceLabelTable::getLabelId(uint64_t state) const {
+			std::lock_guard<std::mutex> guard(lock);
+			return state < stateLabels.size() ? stateLabels[state] : 0;
+		}
+
+		uint64_t
+		ChoiceLabelTable::getSizeInBytes() const {
+			std::lock_guard<std::mutex> guard(lock);
+			uint64_t bytes = stateLabels.capacity() * sizeof(uint32_t) + names.capacity() * sizeof(std::string);
+			for (std::string const & name : names) {
+				bytes += name.capacity();
+			}
+			return bytes;
+		}
+
+		void
+		ChoiceLabelTable::write(
+			storm::storage::SparseMatrix<double> const & matrix
+			, std::string const & filename
+			, bool binary
+		) const {
+			std::lock_guard<std::mutex> guard(lock);
+			BufferedFileWriter out(filename);
+			uint64_t numberOfRows = matrix.getRowCount();
+			if (binary) {
+				if (numberOfRows > std::numeric_limits<uint32_t>::max()) {
+					throw std::runtime_error("Too many states to export transitions in binary");
+				}
+				out.write(TRANSITION_EXPORT_MAGIC);
+				uint64_t numberOfNames = names.size();
+				out.write(reinterpret_cast<char const *>(&numberOfNames), sizeof(numberOfNames));
+				for (auto const & name : names) {
+					uint64_t length = name.size();
+					out.write(reinterpret_cast<char const *>(&length), sizeof(length));
+					out.write(name);
+				}
+				uint64_t numberOfTransitions = matrix.getEntryCount();
+				out.write(reinterpret_cast<char const *>(&numberOfTransitions), sizeof(numberOfTransitions));
+			}
+			for (uint64_t row = 0; row < numberOfRows; ++row) {
+				uint32_t labelId = row < stateLabels.size() ? stateLabels[row] : 0;
+				for (auto const & entry : matrix.getRow(row)) {
+					if (binary) {
+						uint32_t transition[3] = {
+							static_cast<uint32_t>(row)
+							, static_cast<uint32_t>(entry.getColumn())
+							, labelId
+						};
+						out.write(reinterpret_cast<char const *>(transition), sizeof(transition));
+					}
+					else {
+						out.writeUnsigned(row);
+						out.write(' ');
+						out.writeUnsigned(entry.getColumn());
+						out.write(' ');
+						out.write(names[labelId]);
+						out.write('\n');
+					}
+				}
+			}
+			out.close();
+		}
+	} // namespace util
+} // namespace stamina
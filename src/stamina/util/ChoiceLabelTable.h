@@ -0,0 +1,87 @@
+#ifndef STAMINA_UTIL_CHOICELABELTABLE_H
+#define STAMINA_UTIL_CHOICELABELTABLE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "storm/storage/SparseMatrix.h"
+
+// Name of the action of a choice without any labels
+#define NO_CHOICE_LABEL "-"
+
+/**
+ * The action labels of the choice of each state, for exporting transitions with their actions
+ * (--exportTrans).
+ *
+ * Since there are only a few distinct sets of labels in a model, each set is interned once and
+ * states only keep the (4 byte) ID of theirs. ID 0 is the empty set, which every state starts with.
+ * The labels of a state are set as it is explored, so setLabels() may be called by several
+ * exploration threads at once.
+ *
+ * The transitions are exported by streaming over the rows of the transition matrix, as either text
+ * ("<source> <destination> <action>" lines) or binary: "STAMTRAN", the number of actions, the length
+ * and name of each action, the number of transitions, and then each transition as three native-endian
+ * uint32_t (source, destination and action ID). All integers before the transitions are uint64_t.
+ * Errors are thrown as std::runtime_error.
+ * */
+namespace stamina {
+	namespace util {
+		class ChoiceLabelTable {
+		public:
+			/**
+			 * Constructor
+			 * */
+			ChoiceLabelTable();
+			/**
+			 * Sets the labels of the choice of a state
+			 *
+			 * @param state The state ID
+			 * @param labels The labels of its choice
+			 * */
+			void setLabels(uint64_t state, std::set<std::string> const & labels);
+			/**
+			 * Gets the ID of the labels of a state (0 if it has none)
+			 * */
+			uint32_t getLabelId(uint64_t state) const;
+			/**
+			 * Gets the name of a set of labels, which is the labels separated by commas (or NO_CHOICE_LABEL
+			 * if there are none)
+			 * */
+			std::string const & getName(uint32_t id) const { return names[id]; }
+			/**
+			 * The number of distinct sets of labels, including the empty one
+			 * */
+			uint64_t getNumberOfLabels() const { return names.size(); }
+			/**
+			 * The bytes used by the label ID of each state and the names of the sets of labels. The sets
+			 * themselves (one copy of each) are left out.
+			 * */
+			uint64_t getSizeInBytes() const;
+			/**
+			 * Writes each transition of a matrix with the action of its row. Must not be called while
+			 * labels are still being set.
+			 *
+			 * @param matrix The transition matrix, whose rows are state IDs
+			 * @param filename The file to write
+			 * @param binary Whether to write the binary format rather than text
+			 * */
+			void write(
+				storm::storage::SparseMatrix<double> const & matrix
+				, std::string const & filename
+				, bool binary
+			) const;
+		private:
+			mutable std::mutex lock;
+			std::map<std::set<std::string>, uint32_t> ids;
+			std::vector<std::string> names;
+			// The ID of the labels of each state
+			std::vector<uint32_t> stateLabels;
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_CHOICELABELTABLE_H
@@ -0,0 +1,422 @@
+#include "ConcurrentStateStorage.h"
+#include "SpillFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+/**
+ * Implementation for ConcurrentStateStorage methods
+ * */
+
+// Constants for the 64-bit MurmurHash2-style mixing
+#define HASH_MULTIPLIER 0xc6a4a7935bd1e995ULL
+#define HASH_SHIFT 47
+#define HASH_SEED 0x9e3779b97f4a7c15ULL
+
+namespace stamina {
+	namespace util {
+		template <typename StateType>
+		ConcurrentStateStorage<StateType>::Batch::Batch(uint64_t bitsPerState)
+			: bitsPerState(bitsPerState)
+			, wordsPerState(std::max<uint64_t>(1, (bitsPerState + 63) / 64))
+			, count(0)
+		{
+			// Intentionally left empty
+		}
+
+		template <typename StateType>
+		StateType
+		ConcurrentStateStorage<StateType>::Batch::add(CompressedState const& state) {
+			if (words.size() < (count + 1) * wordsPerState) {
+				words.resize((count + 1) * wordsPerState * 2);
+			}
+			uint64_t * stateWords = words.data() + count * wordsPerState;
+			stateToWords(state, bitsPerState, stateWords);
+			// Batches are only as big as the number of successors of a state, so a linear scan is
+			// cheaper than hashing here. The first word almost always tells states apart.
+			for (uint64_t i = 0; i < count; ++i) {
+				uint64_t const * otherWords = words.data() + i * wordsPerState;
+				if (otherWords[0] == stateWords[0]
+					&& std::memcmp(otherWords, stateWords, wordsPerState * sizeof(uint64_t)) == 0
+				) {
+					return static_cast<StateType>(i);
+				}
+			}
+			if (states.size() <= count) {
+				states.push_back(state);
+			}
+			else {
+				states[count] = state;
+			}
+			return static_cast<StateType>(count++);
+		}
+
+		template <typename StateType>
+		void
+		ConcurrentStateStorage<StateType>::Batch::clear() {
+			count = 0;
+		}
+
+		template <typename StateType>
+		ConcurrentStateStorage<StateType>::ConcurrentStateStorage(
+			uint64_t bitsPerState
+			, uint8_t shardExponent
+			, uint8_t blockSizeExponent
+		) : bitsPerState(bitsPerState)
+			, wordsPerState(std::max<uint64_t>(1, (bitsPerState + 63) / 64))
+			, shardExponent(shardExponent)
+			, blockSizeExponent(blockSizeExponent)
+			, blockSize(1ULL << blockSizeExponent)
+			, maxNumberOfBlocks((static_cast<uint64_t>(EMPTY_SLOT) >> blockSizeExponent) + 1)
+			, shards(new Shard[1ULL << shardExponent])
+			, blocks(new std::atomic<uint64_t *>[maxNumberOfBlocks])
+			, numberOfStates(0)
+		{
+			for (uint64_t i = 0; i < maxNumberOfBlocks; i++) {
+				blocks[i].store(nullptr, std::memory_order_relaxed);
+			}
+			for (uint64_t i = 0; i < (1ULL << shardExponent); i++) {
+				resetShard(shards[i]);
+			}
+		}
+
+		template <typename StateType>
+		ConcurrentStateStorage<StateType>::~ConcurrentStateStorage() {
+			for (uint64_t i = 0; i < maxNumberOfBlocks; i++) {
+				uint64_t * block = blocks[i].load(std::memory_order_relaxed);
+				SpillFile::free(block, blockSize * wordsPerState * sizeof(uint64_t));
+			}
+		}
+
+		template <typename StateType>
+		std::pair<StateType, bool>
+		ConcurrentStateStorage<StateType>::findOrAdd(CompressedState const& state) {
+			thread_local std::vector<uint64_t> words;
+			words.resize(wordsPerState);
+			stateToWords(state, bitsPerState, words.data());
+			return findOrAddHashed(words.data(), hashWords(words.data()));
+		}
+
+		template <typename StateType>
+		void
+		ConcurrentStateStorage<StateType>::findOrAdd(Batch & batch) {
+			batch.hashes.resize(batch.count);
+			batch.ids.resize(batch.count);
+			batch.added.resize(batch.count);
+			batch.resolvedIds.resize(batch.count);
+			hashWordsBatch(batch.words.data(), batch.count, batch.hashes.data());
+			// Start pulling in the first slot each state will probe so that the cache misses overlap
+			// rather than happening one after another
+			for (uint64_t i = 0; i < batch.count; ++i) {
+				Shard & shard = shardFor(batch.hashes[i]);
+				Slot * slots = shard.slotsHint.load(std::memory_order_relaxed);
+				uint64_t mask = shard.maskHint.load(std::memory_order_relaxed);
+				__builtin_prefetch(slots + (batch.hashes[i] & mask));
+			}
+			for (uint64_t i = 0; i < batch.count; ++i) {
+				std::pair<StateType, bool> result = findOrAddHashed(
+					batch.words.data() + i * wordsPerState
+					, batch.hashes[i]
+				);
+				batch.ids[i] = result.first;
+				batch.added[i] = result.second;
+				batch.resolvedIds[i] = result.first;
+			}
+		}
+
+		template <typename StateType>
+		bool
+		ConcurrentStateStorage<StateType>::find(CompressedState const& state, StateType & id) {
+			thread_local std::vector<uint64_t> words;
+			words.resize(wordsPerState);
+			stateToWords(state, bitsPerState, words.data());
+			uint64_t hash = hashWords(words.data());
+			Shard & shard = shardFor(hash);
+			std::lock_guard<std::mutex> guard(shard.lock);
+			uint64_t index = probe(shard, words.data(), hash);
+			if (shard.slots[index].id == EMPTY_SLOT) {
+				return false;
+			}
+			id = shard.slots[index].id;
+			return true;
+		}
+
+		template <typename StateType>
+		bool
+		ConcurrentStateStorage<StateType>::contains(CompressedState const& state) {
+			StateType id;
+			return find(state, id);
+		}
+
+		template <typename StateType>
+		CompressedState
+		ConcurrentStateStorage<StateType>::getState(StateType id) const {
+			CompressedState state(bitsPerState);
+			getState(id, state);
+			return state;
+		}
+
+		template <typename StateType>
+		void
+		ConcurrentStateStorage<StateType>::getState(StateType id, CompressedState & state) const {
+			if (state.size() != bitsPerState) {
+				state = CompressedState(bitsPerState);
+			}
+			uint64_t const * words = wordsForId(id);
+			for (uint64_t i = 0; i * 64 < bitsPerState; i++) {
+				uint64_t bits = std::min<uint64_t>(64, bitsPerState - i * 64);
+				state.setFromInt(i * 64, bits, words[i]);
+			}
+		}
+
+		template <typename StateType>
+		uint64_t const *
+		ConcurrentStateStorage<StateType>::getWords(StateType id) const {
+			return wordsForId(id);
+		}
+
+		template <typename StateType>
+		uint64_t
+		ConcurrentStateStorage<StateType>::size() const {
+			return numberOfStates.load();
+		}
+
+		template <typename StateType>
+		uint64_t
+		ConcurrentStateStorage<StateType>::getBitsPerState() const {
+			return bitsPerState;
+		}
+
+		template <typename StateType>
+		uint64_t
+		ConcurrentStateStorage<StateType>::getSizeInBytes() {
+			uint64_t bytes = (1ULL << shardExponent) * sizeof(Shard) + maxNumberOfBlocks * sizeof(std::atomic<uint64_t *>);
+			for (uint64_t i = 0; i < (1ULL << shardExponent); i++) {
+				std::lock_guard<std::mutex> guard(shards[i].lock);
+				bytes += shards[i].slots.capacity() * sizeof(Slot);
+			}
+			for (uint64_t i = 0; i < maxNumberOfBlocks; i++) {
+				if (blocks[i].load(std::memory_order_acquire) != nullptr) {
+					bytes += blockSize * wordsPerState * sizeof(uint64_t);
+				}
+			}
+			return bytes;
+		}
+
+		template <typename StateType>
+		void
+		ConcurrentStateStorage<StateType>::clear() {
+			for (uint64_t i = 0; i < maxNumberOfBlocks; i++) {
+				uint64_t * block = blocks[i].exchange(nullptr);
+				SpillFile::free(block, blockSize * wordsPerState * sizeof(uint64_t));
+			}
+			for (uint64_t i = 0; i < (1ULL << shardExponent); i++) {
+				std::lock_guard<std::mutex> guard(shards[i].lock);
+				resetShard(shards[i]);
+			}
+			numberOfStates = 0;
+		}
+
+		template <typename StateType>
+		uint64_t
+		ConcurrentStateStorage<StateType>::getNumberOfProbes() {
+			uint64_t probes = 0;
+			for (uint64_t i = 0; i < (1ULL << shardExponent); i++) {
+				std::lock_guard<std::mutex> guard(shards[i].lock);
+				probes += shards[i].probes;
+			}
+			return probes;
+		}
+
+		template <typename StateType>
+		uint64_t
+		ConcurrentStateStorage<StateType>::getNumberOfLookups() {
+			uint64_t lookups = 0;
+			for (uint64_t i = 0; i < (1ULL << shardExponent); i++) {
+				std::lock_guard<std::mutex> guard(shards[i].lock);
+				lookups += shards[i].lookups;
+			}
+			return lookups;
+		}
+
+		template <typename StateType>
+		void
+		ConcurrentStateStorage<StateType>::stateToWords(
+			CompressedState const& state
+			, uint64_t bitsPerState
+			, uint64_t * words
+		) {
+			words[0] = 0;
+			for (uint64_t i = 0; i * 64 < bitsPerState; i++) {
+				uint64_t bits = std::min<uint64_t>(64, bitsPerState - i * 64);
+				words[i] = state.getAsInt(i * 64, bits);
+			}
+		}
+
+		template <typename StateType>
+		uint64_t
+		ConcurrentStateStorage<StateType>::hashWords(uint64_t const * words) const {
+			uint64_t h = HASH_SEED ^ (wordsPerState * HASH_MULTIPLIER);
+			for (uint64_t i = 0; i < wordsPerState; i++) {
+				uint64_t k = words[i];
+				k *= HASH_MULTIPLIER;
+				k ^= k >> HASH_SHIFT;
+				k *= HASH_MULTIPLIER;
+				h ^= k;
+				h *= HASH_MULTIPLIER;
+			}
+			h ^= h >> HASH_SHIFT;
+			h *= HASH_MULTIPLIER;
+			h ^= h >> HASH_SHIFT;
+			return h;
+		}
+
+		template <typename StateType>
+		void
+		ConcurrentStateStorage<StateType>::hashWordsBatch(
+			uint64_t const * words
+			, uint64_t count
+			, uint64_t * hashes
+		) const {
+			const uint64_t lanes = 4;
+			uint64_t first = 0;
+			for (; first + lanes <= count; first += lanes) {
+				uint64_t h[lanes];
+				for (uint64_t lane = 0; lane < lanes; lane++) {
+					h[lane] = HASH_SEED ^ (wordsPerState * HASH_MULTIPLIER);
+				}
+				for (uint64_t i = 0; i < wordsPerState; i++) {
+					// Same arithmetic as hashWords(), on word i of four different states
+					for (uint64_t lane = 0; lane < lanes; lane++) {
+						uint64_t k = words[(first + lane) * wordsPerState + i];
+						k *= HASH_MULTIPLIER;
+						k ^= k >> HASH_SHIFT;
+						k *= HASH_MULTIPLIER;
+						h[lane] ^= k;
+						h[lane] *= HASH_MULTIPLIER;
+					}
+				}
+				for (uint64_t lane = 0; lane < lanes; lane++) {
+					h[lane] ^= h[lane] >> HASH_SHIFT;
+					h[lane] *= HASH_MULTIPLIER;
+					h[lane] ^= h[lane] >> HASH_SHIFT;
+					hashes[first + lane] = h[lane];
+				}
+			}
+			// Whatever is left over
+			for (; first < count; first++) {
+				hashes[first] = hashWords(words + first * wordsPerState);
+			}
+		}
+
+		template <typename StateType>
+		typename ConcurrentStateStorage<StateType>::Shard &
+		ConcurrentStateStorage<StateType>::shardFor(uint64_t hash) const {
+			return shards[shardExponent == 0 ? 0 : hash >> (64 - shardExponent)];
+		}
+
+		template <typename StateType>
+		std::pair<StateType, bool>
+		ConcurrentStateStorage<StateType>::findOrAddHashed(uint64_t const * words, uint64_t hash) {
+			Shard & shard = shardFor(hash);
+			std::lock_guard<std::mutex> guard(shard.lock);
+			uint64_t index = probe(shard, words, hash);
+			if (shard.slots[index].id != EMPTY_SLOT) {
+				return std::make_pair(shard.slots[index].id, false);
+			}
+			// The ID is taken while holding the shard lock so no other thread can add this state
+			StateType id = static_cast<StateType>(numberOfStates.fetch_add(1));
+			ensureBlockExists(id);
+			std::memcpy(wordsForId(id), words, wordsPerState * sizeof(uint64_t));
+			shard.slots[index] = Slot{hash, id};
+			shard.count++;
+			// Keep the load factor below 0.7
+			if (shard.count * 10 > shard.slots.size() * 7) {
+				grow(shard);
+			}
+			return std::make_pair(id, true);
+		}
+
+		template <typename StateType>
+		uint64_t *
+		ConcurrentStateStorage<StateType>::wordsForId(StateType id) const {
+			uint64_t * block = blocks[id >> blockSizeExponent].load(std::memory_order_acquire);
+			return block + (id & (blockSize - 1)) * wordsPerState;
+		}
+
+		template <typename StateType>
+		uint64_t
+		ConcurrentStateStorage<StateType>::probe(Shard & shard, uint64_t const * words, uint64_t hash) const {
+			uint64_t mask = shard.slots.size() - 1;
+			uint64_t index = hash & mask;
+			shard.lookups++;
+			while (true) {
+				shard.probes++;
+				Slot const & slot = shard.slots[index];
+				if (slot.id == EMPTY_SLOT) {
+					return index;
+				}
+				// Only touch the arena if the full hashes match
+				if (slot.hash == hash
+					&& std::memcmp(wordsForId(slot.id), words, wordsPerState * sizeof(uint64_t)) == 0
+				) {
+					return index;
+				}
+				index = (index + 1) & mask;
+			}
+		}
+
+		template <typename StateType>
+		void
+		ConcurrentStateStorage<StateType>::grow(Shard & shard) {
+			std::vector<Slot> oldSlots(shard.slots.size() * 2, Slot{0, EMPTY_SLOT});
+			oldSlots.swap(shard.slots);
+			uint64_t mask = shard.slots.size() - 1;
+			for (Slot const & slot : oldSlots) {
+				if (slot.id == EMPTY_SLOT) { continue; }
+				// The hash is cached in the slot, so the state itself is never read here
+				uint64_t index = slot.hash & mask;
+				while (shard.slots[index].id != EMPTY_SLOT) {
+					index = (index + 1) & mask;
+				}
+				shard.slots[index] = slot;
+			}
+			shard.slotsHint.store(shard.slots.data(), std::memory_order_relaxed);
+			shard.maskHint.store(mask, std::memory_order_relaxed);
+		}
+
+		template <typename StateType>
+		void
+		ConcurrentStateStorage<StateType>::resetShard(Shard & shard) {
+			shard.slots.assign(INITIAL_SHARD_CAPACITY, Slot{0, EMPTY_SLOT});
+			shard.count = 0;
+			shard.probes = 0;
+			shard.lookups = 0;
+			shard.slotsHint.store(shard.slots.data(), std::memory_order_relaxed);
+			shard.maskHint.store(shard.slots.size() - 1, std::memory_order_relaxed);
+		}
+
+		template <typename StateType>
+		void
+		ConcurrentStateStorage<StateType>::ensureBlockExists(StateType id) {
+			uint64_t blockIndex = id >> blockSizeExponent;
+			if (blocks[blockIndex].load(std::memory_order_acquire) != nullptr) {
+				return;
+			}
+			std::lock_guard<std::mutex> guard(blockLock);
+			if (blocks[blockIndex].load(std::memory_order_relaxed) == nullptr) {
+				uint64_t bytes = blockSize * wordsPerState * sizeof(uint64_t);
+				blocks[blockIndex].store(static_cast<uint64_t *>(SpillFile::allocate(bytes)), std::memory_order_release);
+				// IDs are handed out in order, so nothing is written to the blocks behind the newest two
+				// any more. They are still read (on lookups whose hash matches, and when states are read
+				// back), but only a page at a time, so spilled ones need not stay resident as a whole.
+				if (blockIndex >= 2) {
+					SpillFile::releasePages(blocks[blockIndex - 2].load(std::memory_order_relaxed), bytes);
+				}
+			}
+		}
+
+		// Forward declare
+		template class ConcurrentStateStorage<uint32_t>;
+	}
+}
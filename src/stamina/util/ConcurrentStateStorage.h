@@ -0,0 +1,266 @@
+#ifndef STAMINA_UTIL_CONCURRENTSTATESTORAGE_H
+#define STAMINA_UTIL_CONCURRENTSTATESTORAGE_H
+
+#include "../StateSpaceInformation.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * Thread-safe replacement for the state to ID map in storm::storage::sparse::StateStorage.
+ *
+ * The table is split into shards (chosen by the top bits of the state's hash), each of which is an
+ * open addressing table guarded by its own mutex, so two threads only ever contend if they are
+ * interning states which fall in the same shard. The slots of the table only hold a piece of the
+ * hash and the state ID. The bits of the states themselves are kept in a separate arena indexed by
+ * state ID, which means that:
+ * 	1. IDs are handed out densely (0, 1, 2, ...) in the order states are added
+ * 	2. The bits of a state can be retrieved from its ID without a reverse lookup
+ * 	3. A state is only hashed once per findOrAdd(), rather than in contains(), getValue() and then
+ * 	findOrAdd() as with storm::storage::BitVectorHashMap
+ *
+ * Each slot also caches the full hash of its state, so growing a shard never rehashes a state. Arena
+ * blocks come from SpillFile, so they are moved to disk once the RAM budget is used up, and spilled
+ * blocks which are no longer written are dropped from the resident set.
+ * */
+namespace stamina {
+	namespace util {
+		template <typename StateType>
+		class ConcurrentStateStorage {
+		public:
+			/**
+			 * All of the successors of a single state, which are interned together. While the generator
+			 * expands a state, add() hands out provisional IDs (the position of the state in the batch).
+			 * Once the expansion is done, ConcurrentStateStorage::findOrAdd(Batch&) hashes all of the
+			 * states at once, prefetches their slots, and then looks them up.
+			 * */
+			class Batch {
+			public:
+				/**
+				 * Constructor
+				 *
+				 * @param bitsPerState The number of bits in each (compressed) state
+				 * */
+				Batch(uint64_t bitsPerState);
+				/**
+				 * Adds a state to the batch if it is not already in it.
+				 *
+				 * @param state The state to add
+				 * @return The provisional ID of the state
+				 * */
+				StateType add(CompressedState const& state);
+				/**
+				 * Empties the batch without freeing its memory
+				 * */
+				void clear();
+				/**
+				 * The number of distinct states in the batch
+				 * */
+				uint64_t size() const { return count; }
+				/**
+				 * Gets a state which was added to the batch
+				 * */
+				CompressedState const & getState(uint64_t provisionalId) const { return states[provisionalId]; }
+				/**
+				 * Gets the ID in the storage of a state (only valid after it has been interned)
+				 * */
+				StateType getId(uint64_t provisionalId) const { return ids[provisionalId]; }
+				/**
+				 * Whether the state was added to the storage when the batch was interned
+				 * */
+				bool wasAdded(uint64_t provisionalId) const { return added[provisionalId]; }
+				/**
+				 * Sets what a provisional ID should be translated to by resolve()
+				 * */
+				void setResolved(uint64_t provisionalId, StateType id) { resolvedIds[provisionalId] = id; }
+				/**
+				 * Translates a provisional ID into the ID it was resolved to
+				 * */
+				StateType resolve(StateType provisionalId) const { return resolvedIds[provisionalId]; }
+			private:
+				friend class ConcurrentStateStorage<StateType>;
+				uint64_t bitsPerState;
+				uint64_t wordsPerState;
+				uint64_t count;
+				std::vector<CompressedState> states;
+				std::vector<uint64_t> words;
+				std::vector<uint64_t> hashes;
+				std::vector<StateType> ids;
+				std::vector<uint8_t> added;
+				std::vector<StateType> resolvedIds;
+			};
+			/**
+			 * Constructor
+			 *
+			 * @param bitsPerState The number of bits in each (compressed) state
+			 * @param shardExponent Exponent on 2 of the number of shards
+			 * @param blockSizeExponent Exponent on 2 of the number of states in each arena block
+			 * */
+			ConcurrentStateStorage(
+				uint64_t bitsPerState
+				, uint8_t shardExponent = 6 // 2 ^ 6
+				, uint8_t blockSizeExponent = 16 // 2 ^ 16
+			);
+			/**
+			 * Destructor. Frees the arena
+			 * */
+			~ConcurrentStateStorage();
+			/**
+			 * Gets the ID of a state, adding it with the next available ID if it does not exist yet.
+			 * May be called from multiple threads at once.
+			 *
+			 * @param state The state to find or add
+			 * @return The ID of the state and whether or not it was added by this call
+			 * */
+			std::pair<StateType, bool> findOrAdd(CompressedState const& state);
+			/**
+			 * Interns every state in a batch. Afterwards, Batch::getId() and Batch::wasAdded() give the
+			 * result for each state. May be called from multiple threads at once (with different batches).
+			 *
+			 * @param batch The batch to intern
+			 * */
+			void findOrAdd(Batch & batch);
+			/**
+			 * Gets the ID of a state without adding it. May be called from multiple threads at once.
+			 *
+			 * @param state The state to find
+			 * @param id Set to the ID of the state if it exists
+			 * @return Whether or not the state exists
+			 * */
+			bool find(CompressedState const& state, StateType & id);
+			/**
+			 * Whether or not a state exists in the storage
+			 * */
+			bool contains(CompressedState const& state);
+			/**
+			 * Gets a copy of the state with a particular ID
+			 *
+			 * @param id The ID of the state (must have been handed out by findOrAdd())
+			 * @return The state
+			 * */
+			CompressedState getState(StateType id) const;
+			/**
+			 * Copies the state with a particular ID into an existing state, which avoids allocating a new
+			 * one when states are read back over and over (e.g., from the frontier)
+			 *
+			 * @param id The ID of the state (must have been handed out by findOrAdd())
+			 * @param state Set to the state
+			 * */
+			void getState(StateType id, CompressedState & state) const;
+			/**
+			 * Gets the packed words of a state in the arena, without copying it. Each word holds 64 bits
+			 * (the first bit of the state is the most significant bit of the first word), except for the
+			 * last, which holds the rest of the bits in its lowest bits.
+			 *
+			 * @param id The ID of the state (must have been handed out by findOrAdd())
+			 * @return The words of the state, which stay valid until clear()
+			 * */
+			uint64_t const * getWords(StateType id) const;
+			/**
+			 * The number of states in the storage
+			 * */
+			uint64_t size() const;
+			/**
+			 * The number of bits in each state
+			 * */
+			uint64_t getBitsPerState() const;
+			/**
+			 * The bytes used by the slots of every shard and by the arena (including blocks which were
+			 * spilled to disk). May be called while states are being added.
+			 * */
+			uint64_t getSizeInBytes();
+			/**
+			 * Removes all states and frees the arena
+			 * */
+			void clear();
+			/**
+			 * The total number of slots which have been looked at while probing. Divide by the number of
+			 * lookups to get the average probe length.
+			 * */
+			uint64_t getNumberOfProbes();
+			/**
+			 * The total number of lookups (both find() and findOrAdd())
+			 * */
+			uint64_t getNumberOfLookups();
+		protected:
+			/* A slot in the hash table. An id of EMPTY_SLOT means the slot is not used */
+			struct Slot {
+				uint64_t hash;
+				StateType id;
+			};
+			struct Shard {
+				std::mutex lock;
+				std::vector<Slot> slots;
+				uint64_t count;
+				uint64_t probes;
+				uint64_t lookups;
+				// Copies of slots.data() and the mask for prefetching without the lock. These may be
+				// stale, but prefetching a stale address is harmless.
+				std::atomic<Slot *> slotsHint;
+				std::atomic<uint64_t> maskHint;
+			};
+			/**
+			 * Copies the bits of a state into an array of 64-bit words
+			 * */
+			static void stateToWords(CompressedState const& state, uint64_t bitsPerState, uint64_t * words);
+			/**
+			 * Hashes a state which has been converted into words
+			 * */
+			uint64_t hashWords(uint64_t const * words) const;
+			/**
+			 * Hashes several states (stored back to back) at once, giving the same result as hashWords()
+			 * on each. Four states are hashed in lockstep so the compiler can vectorize the mixing.
+			 * */
+			void hashWordsBatch(uint64_t const * words, uint64_t count, uint64_t * hashes) const;
+			/**
+			 * The shard a hash belongs to
+			 * */
+			Shard & shardFor(uint64_t hash) const;
+			/**
+			 * Finds or adds a state which has already been hashed. Locks the shard.
+			 * */
+			std::pair<StateType, bool> findOrAddHashed(uint64_t const * words, uint64_t hash);
+			/**
+			 * Gets the words for a particular state in the arena
+			 * */
+			uint64_t * wordsForId(StateType id) const;
+			/**
+			 * Finds the slot a state is in, or the empty slot it would go in. Shard must be locked.
+			 *
+			 * @return The index of the slot
+			 * */
+			uint64_t probe(Shard & shard, uint64_t const * words, uint64_t hash) const;
+			/**
+			 * Doubles the number of slots in a shard. Shard must be locked.
+			 * */
+			void grow(Shard & shard);
+			/**
+			 * Sets a shard back to its initial (empty) capacity
+			 * */
+			void resetShard(Shard & shard);
+			/**
+			 * Makes sure the arena block which holds a particular ID has been allocated
+			 * */
+			void ensureBlockExists(StateType id);
+		private:
+			static const StateType EMPTY_SLOT = static_cast<StateType>(-1);
+			static const uint32_t INITIAL_SHARD_CAPACITY = 1024;
+			const uint64_t bitsPerState;
+			const uint64_t wordsPerState;
+			const uint8_t shardExponent;
+			const uint8_t blockSizeExponent;
+			const uint64_t blockSize;
+			const uint64_t maxNumberOfBlocks;
+			std::unique_ptr<Shard[]> shards;
+			std::unique_ptr<std::atomic<uint64_t *>[]> blocks;
+			std::mutex blockLock;
+			std::atomic<uint64_t> numberOfStates;
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_CONCURRENTSTATESTORAGE_H
@@ -0,0 +1,372 @@
+#include "CtmcSolver.h"
+#include "../StaminaMessages.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+
+// Factor the uniformization rate is set above the largest exit rate
+#define UNIFORMIZATION_RATE_FACTOR 1.02
+
+/**
+ * Implementation for CtmcSolver methods
+ * */
+
+namespace stamina {
+	namespace util {
+		CtmcSolver::CtmcSolver(double precision, uint64_t maxIterations)
+			: precision(precision)
+			, maxIterations(maxIterations)
+			, lastSweepCount(0)
+			, uniformizationRate(0.0)
+		{
+			// Intentionally left empty
+		}
+
+		void
+		CtmcSolver::setModel(storm::storage::SparseMatrix<double> const & rateMatrix) {
+			uint64_t numberOfStates = rateMatrix.getRowCount();
+			rowStarts.clear();
+			columns.clear();
+			rates.clear();
+			rowStarts.reserve(numberOfStates + 1);
+			columns.reserve(rateMatrix.getEntryCount());
+			rates.reserve(rateMatrix.getEntryCount());
+			exitRates.assign(numberOfStates, 0.0);
+			selfLoopRates.assign(numberOfStates, 0.0);
+			transposeRowStarts.assign(numberOfStates + 1, 0);
+
+			rowStarts.push_back(0);
+			for (uint64_t row = 0; row < numberOfStates; ++row) {
+				for (auto const & entry : rateMatrix.getRow(row)) {
+					// Zero rates (e.g., a perimeter state with no successors outside the model has a
+					// zero rate to the absorbing state) are not edges
+					if (entry.getValue() == 0.0) {
+						continue;
+					}
+					uint64_t column = entry.getColumn();
+					columns.push_back(column);
+					rates.push_back(entry.getValue());
+					exitRates[row] += entry.getValue();
+					if (column == row) {
+						selfLoopRates[row] += entry.getValue();
+					}
+					++transposeRowStarts[column + 1];
+				}
+				rowStarts.push_back(columns.size());
+			}
+
+			// The transpose is only used to find predecessors, so it does not need values
+			for (uint64_t column = 0; column < numberOfStates; ++column) {
+				transposeRowStarts[column + 1] += transposeRowStarts[column];
+			}
+			transposeColumns.resize(columns.size());
+			std::vector<uint64_t> fill(transposeRowStarts.begin(), transposeRowStarts.end() - 1);
+			for (uint64_t row = 0; row < numberOfStates; ++row) {
+				for (uint64_t entry = rowStarts[row]; entry < rowStarts[row + 1]; ++entry) {
+					transposeColumns[fill[columns[entry]]++] = row;
+				}
+			}
+		}
+
+		uint64_t
+		CtmcSolver::getNumberOfStates() const {
+			return exitRates.size();
+		}
+
+		std::vector<double>
+		CtmcSolver::warmStart(
+			std::vector<double> const & previous
+			, uint64_t absorbingState
+		) const {
+			double seed = absorbingState < previous.size() ? previous[absorbingState] : 0.0;
+			std::vector<double> guess(getNumberOfStates(), seed);
+			std::copy_n(previous.begin(), std::min(previous.size(), guess.size()), guess.begin());
+			return guess;
+		}
+
+		std::vector<std::vector<double>>
+		CtmcSolver::solve(std::vector<UntilProblem> const & problems) {
+			uint64_t numberOfStates = getNumberOfStates();
+			std::vector<std::vector<double>> results(problems.size());
+			// Unbounded and time-bounded properties are solved in separate groups
+			std::vector<uint64_t> unbounded;
+			std::vector<uint64_t> bounded;
+			for (uint64_t problem = 0; problem < problems.size(); ++problem) {
+				if (problems[problem].timeBound < 0.0) {
+					unbounded.push_back(problem);
+				}
+				else {
+					bounded.push_back(problem);
+				}
+			}
+			lastSweepCount = 0;
+			for (auto group : {&unbounded, &bounded}) {
+				if (group->empty()) {
+					continue;
+				}
+				uint64_t numberOfColumns = group->size();
+				std::vector<double> values(numberOfStates * numberOfColumns, 0.0);
+				std::vector<std::vector<bool>> maybe;
+				std::vector<double> timeBounds;
+				for (uint64_t column = 0; column < numberOfColumns; ++column) {
+					auto const & problem = problems[(*group)[column]];
+					maybe.push_back(findMaybeStates(problem.phi, problem.psi));
+					if (problem.timeBound == 0.0) {
+						// Only psi states satisfy phi U<=0 psi
+						maybe.back().assign(numberOfStates, false);
+					}
+					timeBounds.push_back(problem.timeBound);
+					for (uint64_t state = 0; state < numberOfStates; ++state) {
+						if (problem.psi.get(state)) {
+							values[state * numberOfColumns + column] = 1.0;
+						}
+						else if (maybe[column][state] && state < problem.initialGuess.size()) {
+							values[state * numberOfColumns + column] = std::min(std::max(problem.initialGuess[state], 0.0), 1.0);
+						}
+					}
+				}
+				if (group == &unbounded) {
+					solveUntilColumns(values, maybe);
+				}
+				else {
+					solveBoundedUntilColumns(values, maybe, timeBounds);
+				}
+				for (uint64_t column = 0; column < numberOfColumns; ++column) {
+					auto & result = results[(*group)[column]];
+					result.resize(numberOfStates);
+					for (uint64_t state = 0; state < numberOfStates; ++state) {
+						result[state] = values[state * numberOfColumns + column];
+					}
+				}
+			}
+			return results;
+		}
+
+		uint64_t
+		CtmcSolver::getLastSweepCount() const {
+			return lastSweepCount;
+		}
+
+		std::vector<bool>
+		CtmcSolver::findMaybeStates(
+			storm::storage::BitVector const & phi
+			, storm::storage::BitVector const & psi
+		) const {
+			uint64_t numberOfStates = getNumberOfStates();
+			std::vector<bool> reachesPsi(numberOfStates, false);
+			std::deque<uint64_t> queue;
+			for (uint64_t state = 0; state < numberOfStates; ++state) {
+				if (psi.get(state)) {
+					reachesPsi[state] = true;
+					queue.push_back(state);
+				}
+			}
+			// Backwards search through phi states
+			while (!queue.empty()) {
+				uint64_t state = queue.front();
+				queue.pop_front();
+				for (uint64_t entry = transposeRowStarts[state]; entry < transposeRowStarts[state + 1]; ++entry) {
+					uint64_t predecessor = transposeColumns[entry];
+					if (!reachesPsi[predecessor] && phi.get(predecessor)) {
+						reachesPsi[predecessor] = true;
+						queue.push_back(predecessor);
+					}
+				}
+			}
+			for (uint64_t state = 0; state < numberOfStates; ++state) {
+				// A state which can only loop back to itself never reaches psi, and has no embedded
+				// DTMC row to iterate on
+				if (psi.get(state) || exitRates[state] - selfLoopRates[state] <= 0.0) {
+					reachesPsi[state] = false;
+				}
+			}
+			return reachesPsi;
+		}
+
+		void
+		CtmcSolver::solveUntilColumns(
+			std::vector<double> & values
+			, std::vector<std::vector<bool>> const & maybe
+		) {
+			uint64_t numberOfColumns = maybe.size();
+			std::vector<uint64_t> maybeStates;
+			for (uint64_t state = 0; state < getNumberOfStates(); ++state) {
+				for (auto const & columnMaybe : maybe) {
+					if (columnMaybe[state]) {
+						maybeStates.push_back(state);
+						break;
+					}
+				}
+			}
+
+			// Gauss-Seidel on the embedded DTMC. Self-loops do not change the embedded DTMC, so they
+			// are taken out of the exit rate. Each row is read once per sweep for all columns.
+			std::vector<double> sums(numberOfColumns);
+			uint64_t sweeps = 0;
+			bool converged = maybeStates.empty();
+			while (!converged && sweeps < maxIterations) {
+				converged = true;
+				++sweeps;
+				for (uint64_t state : maybeStates) {
+					std::fill(sums.begin(), sums.end(), 0.0);
+					for (uint64_t entry = rowStarts[state]; entry < rowStarts[state + 1]; ++entry) {
+						uint64_t column = columns[entry];
+						if (column == state) {
+							continue;
+						}
+						double rate = rates[entry];
+						double const * successorValues = &values[column * numberOfColumns];
+						for (uint64_t c = 0; c < numberOfColumns; ++c) {
+							sums[c] += rate * successorValues[c];
+						}
+					}
+					double loopFreeExitRate = exitRates[state] - selfLoopRates[state];
+					double * stateValues = &values[state * numberOfColumns];
+					for (uint64_t c = 0; c < numberOfColumns; ++c) {
+						if (!maybe[c][state]) {
+							continue;
+						}
+						double newValue = sums[c] / loopFreeExitRate;
+						// Written so that a NaN is never taken as converged
+						if (!(std::fabs(newValue - stateValues[c]) <= precision * newValue)) {
+							converged = false;
+						}
+						stateValues[c] = newValue;
+					}
+				}
+			}
+			lastSweepCount += sweeps;
+			if (!converged) {
+				StaminaMessages::warning("Gauss-Seidel did not converge after " + std::to_string(sweeps) + " iterations");
+			}
+		}
+
+		void
+		CtmcSolver::solveBoundedUntilColumns(
+			std::vector<double> & values
+			, std::vector<std::vector<bool>> const & maybe
+			, std::vector<double> const & timeBounds
+		) {
+			uint64_t numberOfColumns = maybe.size();
+			std::vector<uint64_t> maybeStates;
+			double maxExitRate = 0.0;
+			for (uint64_t state = 0; state < getNumberOfStates(); ++state) {
+				for (auto const & columnMaybe : maybe) {
+					if (columnMaybe[state]) {
+						maybeStates.push_back(state);
+						maxExitRate = std::max(maxExitRate, exitRates[state]);
+						break;
+					}
+				}
+			}
+			if (maybeStates.empty()) {
+				return;
+			}
+
+			// Keep the uniformization rate (and with it the Poisson weights) from the last solve, unless
+			// a state now has a larger exit rate
+			if (uniformizationRate < maxExitRate) {
+				uniformizationRate = maxExitRate * UNIFORMIZATION_RATE_FACTOR;
+				poissonWeights.clear();
+			}
+			std::vector<PoissonWeights const *> columnWeights;
+			uint64_t right = 0;
+			for (double timeBound : timeBounds) {
+				columnWeights.push_back(&getPoissonWeights(timeBound));
+				right = std::max(right, columnWeights.back()->left + columnWeights.back()->weights.size() - 1);
+			}
+
+			// States other than the maybe states are absorbing in the uniformized DTMC, so their values
+			// never change
+			std::vector<double> current(values);
+			std::vector<double> next(values);
+			std::vector<double> stepWeights(numberOfColumns);
+			std::vector<double> sums(numberOfColumns);
+			for (uint64_t state : maybeStates) {
+				for (uint64_t c = 0; c < numberOfColumns; ++c) {
+					if (maybe[c][state]) {
+						values[state * numberOfColumns + c] = 0.0;
+					}
+				}
+			}
+			for (uint64_t step = 0; step <= right; ++step) {
+				for (uint64_t c = 0; c < numberOfColumns; ++c) {
+					auto const & weights = *columnWeights[c];
+					bool inWindow = step >= weights.left && step - weights.left < weights.weights.size();
+					stepWeights[c] = inWindow ? weights.weights[step - weights.left] : 0.0;
+				}
+				for (uint64_t state : maybeStates) {
+					for (uint64_t c = 0; c < numberOfColumns; ++c) {
+						if (maybe[c][state]) {
+							values[state * numberOfColumns + c] += stepWeights[c] * current[state * numberOfColumns + c];
+						}
+					}
+				}
+				if (step == right) {
+					break;
+				}
+				++lastSweepCount;
+				for (uint64_t state : maybeStates) {
+					std::fill(sums.begin(), sums.end(), 0.0);
+					for (uint64_t entry = rowStarts[state]; entry < rowStarts[state + 1]; ++entry) {
+						double rate = rates[entry];
+						double const * successorValues = &current[columns[entry] * numberOfColumns];
+						for (uint64_t c = 0; c < numberOfColumns; ++c) {
+							sums[c] += rate * successorValues[c];
+						}
+					}
+					for (uint64_t c = 0; c < numberOfColumns; ++c) {
+						if (maybe[c][state]) {
+							double value = current[state * numberOfColumns + c];
+							next[state * numberOfColumns + c] = value + (sums[c] - exitRates[state] * value) / uniformizationRate;
+						}
+					}
+				}
+				std::swap(current, next);
+			}
+		}
+
+		CtmcSolver::PoissonWeights const &
+		CtmcSolver::getPoissonWeights(double timeBound) {
+			auto cached = poissonWeights.find(timeBound);
+			if (cached != poissonWeights.end()) {
+				return cached->second;
+			}
+			PoissonWeights & poisson = poissonWeights[timeBound];
+			double lambda = uniformizationRate * timeBound;
+			uint64_t mode = static_cast<uint64_t>(std::floor(lambda));
+			// Weights are computed relative to the weight of the mode to avoid underflow (as in the
+			// Fox-Glynn algorithm), and normalized afterwards. The cutoff is well below the precision,
+			// since the weight of the mode is around 1 / sqrt(2 * pi * lambda).
+			double cutoff = precision * 1e-3;
+			std::vector<double> leftWeights;
+			double weight = 1.0;
+			double total = 1.0;
+			for (uint64_t k = mode; k > 0; --k) {
+				weight *= k / lambda;
+				if (weight < cutoff) {
+					break;
+				}
+				leftWeights.push_back(weight);
+				total += weight;
+			}
+			poisson.left = mode - leftWeights.size();
+			poisson.weights.assign(leftWeights.rbegin(), leftWeights.rend());
+			poisson.weights.push_back(1.0);
+			weight = 1.0;
+			for (uint64_t k = mode + 1; ; ++k) {
+				weight *= lambda / k;
+				if (weight < cutoff) {
+					break;
+				}
+				poisson.weights.push_back(weight);
+				total += weight;
+			}
+			for (double & w : poisson.weights) {
+				w /= total;
+			}
+			return poisson;
+		}
+	}
+}
@@ -0,0 +1,149 @@
+#ifndef STAMINA_UTIL_CTMCSOLVER_H
+#define STAMINA_UTIL_CTMCSOLVER_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "storm/storage/BitVector.h"
+#include "storm/storage/SparseMatrix.h"
+
+/**
+ * Numerical solver for (time-bounded) until properties on the CTMCs built by STAMINA.
+ *
+ * Between refinement iterations, the truncated model only grows: state IDs are never reassigned, and
+ * new states are appended after the old ones. This solver takes advantage of that. Unbounded until
+ * properties are solved with Gauss-Seidel on the embedded DTMC, starting from the solution of the
+ * last iteration (see warmStart()), and time-bounded until properties are solved with uniformization,
+ * reusing the uniformization rate and Poisson weights from the last iteration when they still fit.
+ *
+ * All properties checked on a model (at least the Pmin and Pmax versions of a property, which only
+ * differ in the absorbing state) are solved together, as columns of a multi-vector iteration.
+ * */
+namespace stamina {
+	namespace util {
+		class CtmcSolver {
+		public:
+			/* A single until property to solve */
+			struct UntilProblem {
+				// The states satisfying the left subformula
+				storm::storage::BitVector phi;
+				// The states satisfying the right subformula
+				storm::storage::BitVector psi;
+				// The time bound, or a negative value for unbounded until
+				double timeBound;
+				// The values to start from for unbounded until (see warmStart()). Values of states which
+				// satisfy psi, or do not reach psi at all, are ignored. If empty, starts from 0.
+				std::vector<double> initialGuess;
+			};
+			/**
+			 * Constructor
+			 *
+			 * @param precision Relative precision at which Gauss-Seidel stops, and the mass of the
+			 * Poisson distribution allowed to be truncated during uniformization
+			 * @param maxIterations The maximum number of sweeps for Gauss-Seidel
+			 * */
+			CtmcSolver(double precision, uint64_t maxIterations);
+			/**
+			 * Loads the rate matrix of the model to solve. Exit rates are the row sums of the matrix.
+			 *
+			 * @param rateMatrix The rate matrix of the CTMC
+			 * */
+			void setModel(storm::storage::SparseMatrix<double> const & rateMatrix);
+			/**
+			 * The number of states in the model which is currently loaded
+			 * */
+			uint64_t getNumberOfStates() const;
+			/**
+			 * Maps the solution of a property in the last iteration onto the states of the current
+			 * model. Since state IDs are stable, old states keep their value. New states were
+			 * represented by the absorbing state in the last model, so they are seeded with its value.
+			 *
+			 * @param previous The solution from the last iteration (may be empty)
+			 * @param absorbingState The index of the absorbing state
+			 * @return An initial guess for the current model
+			 * */
+			std::vector<double> warmStart(
+				std::vector<double> const & previous
+				, uint64_t absorbingState
+			) const;
+			/**
+			 * Computes the probabilities of several until properties at once. The properties are
+			 * stored as columns of one matrix, so that each sweep over the rate matrix serves all of
+			 * them. Unbounded properties (phi U psi) are solved together with Gauss-Seidel on the
+			 * embedded DTMC, and time-bounded properties (phi U<=t psi) together with uniformization,
+			 * even if their time bounds differ.
+			 *
+			 * @param problems The properties to solve
+			 * @return The probability for each state, for each property (in the same order)
+			 * */
+			std::vector<std::vector<double>> solve(std::vector<UntilProblem> const & problems);
+			/**
+			 * The number of matrix sweeps done by the last solve
+			 * */
+			uint64_t getLastSweepCount() const;
+		private:
+			/* Poisson weights for a single time bound */
+			struct PoissonWeights {
+				// The first step with a weight
+				uint64_t left;
+				std::vector<double> weights;
+			};
+			/**
+			 * Finds the states which satisfy phi but not psi, and which can reach psi through phi states.
+			 * All other states have a probability of exactly 0 or 1.
+			 * */
+			std::vector<bool> findMaybeStates(
+				storm::storage::BitVector const & phi
+				, storm::storage::BitVector const & psi
+			) const;
+			/**
+			 * Runs Gauss-Seidel for a group of unbounded properties. The values for all properties are
+			 * interleaved, so the value of state s for column c is at s * numberOfColumns + c.
+			 *
+			 * @param values Initial values (with psi states at 1), replaced by the solution
+			 * @param maybe For each column, whether each state is a maybe state
+			 * */
+			void solveUntilColumns(
+				std::vector<double> & values
+				, std::vector<std::vector<bool>> const & maybe
+			);
+			/**
+			 * Runs uniformization for a group of time-bounded properties, in the same layout as
+			 * solveUntilColumns().
+			 *
+			 * @param values Values of psi states (1) and all others (0), replaced by the solution
+			 * @param maybe For each column, whether each state is a maybe state
+			 * @param timeBounds The time bound for each column
+			 * */
+			void solveBoundedUntilColumns(
+				std::vector<double> & values
+				, std::vector<std::vector<bool>> const & maybe
+				, std::vector<double> const & timeBounds
+			);
+			/**
+			 * Gets the Poisson weights for a time bound at the current uniformization rate, computing
+			 * them if they are not cached
+			 * */
+			PoissonWeights const & getPoissonWeights(double timeBound);
+			/* Data Members */
+			double precision;
+			uint64_t maxIterations;
+			uint64_t lastSweepCount;
+			// The rate matrix, in CSR form, and its transpose (without values)
+			std::vector<uint64_t> rowStarts;
+			std::vector<uint64_t> columns;
+			std::vector<double> rates;
+			std::vector<uint64_t> transposeRowStarts;
+			std::vector<uint64_t> transposeColumns;
+			std::vector<double> exitRates;
+			// Self-loop rate of each state
+			std::vector<double> selfLoopRates;
+			// Uniformization setup, kept across solves (and refinement iterations)
+			double uniformizationRate;
+			std::map<double, PoissonWeights> poissonWeights;
+		};
+	}
+}
+
+#endif // STAMINA_UTIL_CTMCSOLVER_H
@@ -0,0 +1,455 @@
+#include "ExplicitModelReader.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+// Number of states to evaluate a StatePredicate for at once
+#define READER_PREDICATE_BATCH_SIZE 1024
+
+/**
+ * Implementation for ExplicitModelReader methods
+ * */
+
+namespace stamina {
+	namespace util {
+		/**
+		 * Skips spaces and tabs (and carriage returns, for files written on Windows)
+		 * */
+		static char const *
+		skipSpaces(char const * position, char const * end) {
+			while (position < end && (*position == ' ' || *position == '\t' || *position == '\r')) { ++position; }
+			return position;
+		}
+
+		/**
+		 * Moves to the start of the next line
+		 * */
+		static char const *
+		nextLine(char const * position, char const * end) {
+			position = static_cast<char const *>(std::memchr(position, '\n', end - position));
+			return position == nullptr ? end : position + 1;
+		}
+
+		/**
+		 * Parses an integer after any spaces. Calls file.malformed() if there is none.
+		 * */
+		template <typename IntegerType>
+		static char const *
+		parseInteger(MappedFile const & file, char const * position, char const * end, IntegerType & value) {
+			position = skipSpaces(position, end);
+			auto result = std::from_chars(position, end, value);
+			if (result.ec != std::errc()) {
+				file.malformed(position);
+			}
+			return result.ptr;
+		}
+
+		/**
+		 * Parses a double after any spaces. Calls file.malformed() if there is none.
+		 * */
+		static char const *
+		parseDouble(MappedFile const & file, char const * position, char const * end, double & value) {
+			position = skipSpaces(position, end);
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+			auto result = std::from_chars(position, end, value);
+			if (result.ec != std::errc()) {
+				file.malformed(position);
+			}
+			return result.ptr;
+#else
+			// The file is not null-terminated, so strtod() gets a copy of the number
+			char number[64];
+			uint64_t length = 0;
+			while (position + length < end && length + 1 < sizeof(number) && std::strchr("0123456789+-.eE", position[length]) != nullptr) {
+				number[length] = position[length];
+				++length;
+			}
+			number[length] = '\0';
+			char * numberEnd;
+			value = std::strtod(number, &numberEnd);
+			if (numberEnd == number) {
+				file.malformed(position);
+			}
+			return position + (numberEnd - number);
+#endif
+		}
+
+		/**
+		 * Whether the rest of a line is blank
+		 * */
+		static bool
+		isBlank(char const * position, char const * end) {
+			position = skipSpaces(position, end);
+			return position == end || *position == '\n';
+		}
+
+		/**
+		 * Splits some lines into (up to) a number of chunks of about the same size, each of which starts
+		 * at the start of a line
+		 *
+		 * @return The boundaries of the chunks (one more than the number of chunks)
+		 * */
+		static std::vector<char const *>
+		splitLines(char const * begin, char const * end, uint16_t parts) {
+			std::vector<char const *> boundaries = {begin};
+			uint64_t chunkSize = (end - begin) / std::max<uint16_t>(parts, 1) + 1;
+			while (boundaries.back() < end) {
+				char const * next = boundaries.back() + chunkSize;
+				boundaries.push_back(next >= end ? end : nextLine(next, end));
+			}
+			if (boundaries.size() == 1) {
+				boundaries.push_back(end);
+			}
+			return boundaries;
+		}
+
+		/**
+		 * Calls a function for each chunk on its own thread, and rethrows the first error any of them
+		 * threw
+		 * */
+		static void
+		forEachChunk(std::vector<char const *> const & boundaries, std::function<void(char const *, char const *)> function) {
+			std::vector<std::exception_ptr> errors(boundaries.size() - 1);
+			std::vector<std::thread> threads;
+			for (uint64_t i = 0; i + 1 < boundaries.size(); ++i) {
+				threads.emplace_back([&, i]() {
+					try {
+						function(boundaries[i], boundaries[i + 1]);
+					}
+					catch (...) {
+						errors[i] = std::current_exception();
+					}
+				});
+			}
+			for (auto & thread : threads) {
+				thread.join();
+			}
+			for (auto const & error : errors) {
+				if (error) {
+					std::rethrow_exception(error);
+				}
+			}
+		}
+
+		ExplicitModelReader::ExplicitModelReader(
+			std::string const & filename
+			, storm::generator::VariableInformation const & variableInformation
+			, uint16_t numberOfThreads
+		) : filename(filename)
+			, variableInformation(variableInformation)
+			, numberOfThreads(std::max<uint16_t>(numberOfThreads, 1))
+			, numberOfStates(0)
+		{
+			bitsPerState = variableInformation.getTotalBitOffset(true);
+			wordsPerState = (bitsPerState + 63) >> 6;
+			bitsPerState = wordsPerState << 6;
+		}
+
+		storm::storage::SparseMatrix<double>
+		ExplicitModelReader::readTransitions() {
+			typedef storm::storage::MatrixEntry<uint_fast64_t, double> Entry;
+			MappedFile file(filename + ".tra");
+			char const * end = file.end();
+			// Header: <number of states> <number of transitions>
+			uint64_t numberOfRows;
+			uint64_t numberOfEntries;
+			char const * position = parseInteger(file, file.begin(), end, numberOfRows);
+			parseInteger(file, position, end, numberOfEntries);
+			auto boundaries = splitLines(nextLine(position, end), end, numberOfThreads);
+
+			// First pass: count the entries of each row
+			std::unique_ptr<std::atomic<uint64_t>[]> counts(new std::atomic<uint64_t>[numberOfRows]);
+			for (uint64_t row = 0; row < numberOfRows; ++row) {
+				counts[row].store(0, std::memory_order_relaxed);
+			}
+			forEachChunk(boundaries, [&](char const * position, char const * end) {
+				for (; position < end; position = nextLine(position, end)) {
+					if (isBlank(position, end)) { continue; }
+					uint64_t row;
+					char const * rowEnd = parseInteger(file, position, end, row);
+					if (row >= numberOfRows) {
+						file.malformed(rowEnd);
+					}
+					counts[row].fetch_add(1, std::memory_order_relaxed);
+				}
+			});
+			std::vector<uint_fast64_t> rowIndications(numberOfRows + 1, 0);
+			for (uint64_t row = 0; row < numberOfRows; ++row) {
+				rowIndications[row + 1] = rowIndications[row] + counts[row].load(std::memory_order_relaxed);
+				// From here on, counts is where the next entry of each row goes
+				counts[row].store(rowIndications[row], std::memory_order_relaxed);
+			}
+			if (rowIndications[numberOfRows] != numberOfEntries) {
+				throw std::runtime_error(
+					file.filename + " should have " + std::to_string(numberOfEntries) + " transitions, but has "
+					+ std::to_string(rowIndications[numberOfRows])
+				);
+			}
+
+			// Second pass: put every entry in its place
+			std::vector<Entry> columnsAndValues(numberOfEntries);
+			forEachChunk(boundaries, [&](char const * position, char const * end) {
+				for (; position < end; position = nextLine(position, end)) {
+					if (isBlank(position, end)) { continue; }
+					uint64_t row;
+					uint64_t column;
+					double value;
+					char const * next = parseInteger(file, position, end, row);
+					next = parseInteger(file, next, end, column);
+					next = parseDouble(file, next, end, value);
+					if (column >= numberOfRows || !isBlank(next, end)) {
+						file.malformed(position);
+					}
+					columnsAndValues[counts[row].fetch_add(1, std::memory_order_relaxed)] = Entry(column, value);
+				}
+			});
+
+			// Rows which were split between threads may be out of order. Transitions to the same column
+			// are summed, as in TransitionStore.
+			std::vector<uint64_t> rowSizes(numberOfRows);
+			std::atomic<bool> merged(false);
+			std::vector<std::thread> threads;
+			uint64_t rowsPerThread = numberOfRows / numberOfThreads + 1;
+			for (uint64_t firstRow = 0; firstRow < numberOfRows; firstRow += rowsPerThread) {
+				threads.emplace_back([&, firstRow]() {
+					uint64_t lastRow = std::min(firstRow + rowsPerThread, numberOfRows);
+					for (uint64_t row = firstRow; row < lastRow; ++row) {
+						auto begin = columnsAndValues.begin() + rowIndications[row];
+						auto end = columnsAndValues.begin() + rowIndications[row + 1];
+						rowSizes[row] = end - begin;
+						auto byColumn = [](Entry const & first, Entry const & second) {
+							return first.getColumn() < second.getColumn();
+						};
+						if (std::is_sorted(begin, end, byColumn) && std::adjacent_find(begin, end, [](Entry const & first, Entry const & second) {
+							return first.getColumn() == second.getColumn();
+						}) == end) {
+							continue;
+						}
+						std::sort(begin, end, byColumn);
+						auto last = begin;
+						for (auto it = begin + 1; it != end; ++it) {
+							if (it->getColumn() == last->getColumn()) {
+								last->setValue(last->getValue() + it->getValue());
+							}
+							else {
+								*(++last) = *it;
+							}
+						}
+						rowSizes[row] = last + 1 - begin;
+						if (last + 1 != end) {
+							merged.store(true, std::memory_order_relaxed);
+						}
+					}
+				});
+			}
+			for (auto & thread : threads) {
+				thread.join();
+			}
+			if (merged.load()) {
+				// Close the gaps left by merged entries
+				uint64_t next = 0;
+				for (uint64_t row = 0; row < numberOfRows; ++row) {
+					uint64_t start = rowIndications[row];
+					rowIndications[row] = next;
+					std::move(columnsAndValues.begin() + start, columnsAndValues.begin() + start + rowSizes[row], columnsAndValues.begin() + next);
+					next += rowSizes[row];
+				}
+				rowIndications[numberOfRows] = next;
+				columnsAndValues.resize(next);
+			}
+			return storm::storage::SparseMatrix<double>(
+				numberOfRows
+				, std::move(rowIndications)
+				, std::move(columnsAndValues)
+				, boost::none // All models are deterministic
+			);
+		}
+
+		void
+		ExplicitModelReader::readStates(uint64_t numberOfStates) {
+			MappedFile file(filename + ".sta");
+			char const * end = file.end();
+			// Header: (<variable>,<variable>,...)
+			struct Variable {
+				uint64_t bitOffset;
+				uint64_t bitWidth;
+				int64_t lowerBound;
+				bool isBoolean;
+			};
+			std::vector<Variable> variables;
+			char const * position = skipSpaces(file.begin(), end);
+			if (position == end || *position != '(') {
+				file.malformed(position);
+			}
+			while (position < end && *position != ')') {
+				char const * nameStart = ++position;
+				while (position < end && *position != ',' && *position != ')' && *position != '\n') { ++position; }
+				if (position == end || *position == '\n') {
+					file.malformed(nameStart);
+				}
+				std::string name(nameStart, position);
+				bool found = false;
+				for (auto const & booleanVariable : variableInformation.booleanVariables) {
+					if (booleanVariable.variable.getName() == name) {
+						variables.push_back({booleanVariable.bitOffset, 1, 0, true});
+						found = true;
+					}
+				}
+				for (auto const & integerVariable : variableInformation.integerVariables) {
+					if (integerVariable.variable.getName() == name) {
+						variables.push_back({
+							integerVariable.bitOffset
+							, integerVariable.bitWidth
+							, static_cast<int64_t>(integerVariable.lowerBound)
+							, false
+						});
+						found = true;
+					}
+				}
+				if (!found) {
+					throw std::runtime_error("Variable " + name + " in " + file.filename + " is not in the model");
+				}
+			}
+			uint64_t numberOfVariables = variableInformation.booleanVariables.size() + variableInformation.integerVariables.size();
+			if (variables.size() != numberOfVariables) {
+				throw std::runtime_error(file.filename + " does not have every variable of the model");
+			}
+
+			this->numberOfStates = numberOfStates;
+			stateWords.assign(numberOfStates * wordsPerState, 0);
+			auto boundaries = splitLines(nextLine(position, end), end, numberOfThreads);
+			// Lines: <state>:(<value>,<value>,...)
+			forEachChunk(boundaries, [&](char const * position, char const * end) {
+				for (; position < end; position = nextLine(position, end)) {
+					if (isBlank(position, end)) { continue; }
+					uint64_t state;
+					char const * next = parseInteger(file, position, end, state);
+					if (state >= numberOfStates || next + 1 >= end || next[0] != ':' || next[1] != '(') {
+						file.malformed(position);
+					}
+					next += 2;
+					uint64_t * words = stateWords.data() + state * wordsPerState;
+					for (uint64_t i = 0; i < variables.size(); ++i) {
+						if (i > 0) {
+							if (next == end || *next != ',') { file.malformed(position); }
+							++next;
+						}
+						Variable const & variable = variables[i];
+						uint64_t value;
+						if (variable.isBoolean) {
+							if (end - next >= 4 && std::memcmp(next, "true", 4) == 0) {
+								value = 1;
+								next += 4;
+							}
+							else if (end - next >= 5 && std::memcmp(next, "false", 5) == 0) {
+								value = 0;
+								next += 5;
+							}
+							else {
+								file.malformed(position);
+							}
+						}
+						else {
+							int64_t integer;
+							next = parseInteger(file, next, end, integer);
+							value = static_cast<uint64_t>(integer - variable.lowerBound);
+							if (variable.bitWidth < 64 && (value >> variable.bitWidth) != 0) {
+								file.malformed(position);
+							}
+						}
+						// The first bit of a state is the most significant bit of its first word
+						uint64_t word = variable.bitOffset >> 6;
+						uint64_t bit = variable.bitOffset & 63;
+						if (bit + variable.bitWidth <= 64) {
+							words[word] |= value << (64 - bit - variable.bitWidth);
+						}
+						else {
+							uint64_t lowBits = bit + variable.bitWidth - 64;
+							words[word] |= value >> lowBits;
+							words[word + 1] |= value << (64 - lowBits);
+						}
+					}
+					if (next == end || *next != ')') {
+						file.malformed(position);
+					}
+				}
+			});
+		}
+
+		storm::models::sparse::StateLabeling
+		ExplicitModelReader::readLabels(uint64_t numberOfStates) {
+			MappedFile file(filename + ".lab");
+			char const * end = file.end();
+			// Header: <index>="<label>" <index>="<label>" ...
+			std::vector<std::string> labels;
+			char const * position = file.begin();
+			while (!isBlank(position, end)) {
+				uint64_t index;
+				position = parseInteger(file, position, end, index);
+				if (index != labels.size() || end - position < 2 || position[0] != '=' || position[1] != '"') {
+					file.malformed(position);
+				}
+				char const * labelStart = position + 2;
+				position = static_cast<char const *>(std::memchr(labelStart, '"', end - labelStart));
+				if (position == nullptr) {
+					file.malformed(labelStart);
+				}
+				labels.emplace_back(labelStart, position);
+				++position;
+			}
+			std::vector<storm::storage::BitVector> statesWithLabel(labels.size(), storm::storage::BitVector(numberOfStates));
+			// Lines: <state>: <index> <index> ... Labels are only a small part of the model, so they are
+			// not worth splitting between threads.
+			for (position = nextLine(position, end); position < end; position = nextLine(position, end)) {
+				if (isBlank(position, end)) { continue; }
+				uint64_t state;
+				char const * next = parseInteger(file, position, end, state);
+				if (state >= numberOfStates || next == end || *next != ':') {
+					file.malformed(position);
+				}
+				++next;
+				while (!isBlank(next, end)) {
+					uint64_t index;
+					next = parseInteger(file, next, end, index);
+					if (index >= labels.size()) {
+						file.malformed(position);
+					}
+					statesWithLabel[index].set(state);
+				}
+			}
+			storm::models::sparse::StateLabeling labeling(numberOfStates);
+			for (uint64_t i = 0; i < labels.size(); ++i) {
+				labeling.addLabel(labels[i], std::move(statesWithLabel[i]));
+			}
+			return labeling;
+		}
+
+		storm::storage::BitVector
+		ExplicitModelReader::getStatesSatisfying(storm::expressions::Expression const & expression) const {
+			StatePredicate predicate(expression, variableInformation, bitsPerState);
+			storm::storage::BitVector states(numberOfStates);
+			std::vector<uint64_t const *> words(READER_PREDICATE_BATCH_SIZE);
+			std::vector<uint8_t> results(READER_PREDICATE_BATCH_SIZE);
+			for (uint64_t first = 0; first < numberOfStates; first += READER_PREDICATE_BATCH_SIZE) {
+				uint64_t count = std::min<uint64_t>(READER_PREDICATE_BATCH_SIZE, numberOfStates - first);
+				for (uint64_t i = 0; i < count; ++i) {
+					words[i] = stateWords.data() + (first + i) * wordsPerState;
+				}
+				predicate.evaluate(words.data(), count, results.data());
+				for (uint64_t i = 0; i < count; ++i) {
+					if (results[i]) { states.set(first + i); }
+				}
+			}
+			return states;
+		}
+	} // namespace util
+} // namespace stamina
@@ -0,0 +1,83 @@
+#ifndef STAMINA_UTIL_EXPLICITMODELREADER_H
+#define STAMINA_UTIL_EXPLICITMODELREADER_H
+
+#include "StatePredicate.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "storm/generator/VariableInformation.h"
+#include "storm/models/sparse/StateLabeling.h"
+#include "storm/storage/BitVector.h"
+#include "storm/storage/SparseMatrix.h"
+
+/**
+ * Reads a model from PRISM's explicit files (as written by ExplicitModelWriter), so that new
+ * properties can be checked against a model which was already truncated without exploring it again.
+ *
+ * Each file is memory-mapped and split into one chunk of lines per thread. The transitions are parsed
+ * twice: once to count the entries of each row, and once to put each entry straight into its place in
+ * the CSR arrays handed to storm::storage::SparseMatrix. States are packed into one flat array of words
+ * (in the same layout as ConcurrentStateStorage::getWords()), so expressions which are not labels in
+ * the .lab file can be evaluated with a StatePredicate. Nothing is allocated per line.
+ *
+ * Errors (missing files, malformed lines, variables which are not in the model) are thrown as
+ * std::runtime_error.
+ * */
+namespace stamina {
+	namespace util {
+		class ExplicitModelReader {
+		public:
+			/**
+			 * Constructor. Does not read anything yet.
+			 *
+			 * @param filename The filename, without an extension
+			 * @param variableInformation Where each variable of the (modified) program is in a state
+			 * @param numberOfThreads How many threads to parse with
+			 * */
+			ExplicitModelReader(
+				std::string const & filename
+				, storm::generator::VariableInformation const & variableInformation
+				, uint16_t numberOfThreads
+			);
+			/**
+			 * Reads the transitions (.tra). Entries are sorted by column within each row.
+			 *
+			 * @return The transition matrix
+			 * */
+			storm::storage::SparseMatrix<double> readTransitions();
+			/**
+			 * Reads the variable values of each state (.sta)
+			 *
+			 * @param numberOfStates The number of states in the model
+			 * */
+			void readStates(uint64_t numberOfStates);
+			/**
+			 * Reads the labels of each state (.lab)
+			 *
+			 * @param numberOfStates The number of states in the model
+			 * @return The labeling
+			 * */
+			storm::models::sparse::StateLabeling readLabels(uint64_t numberOfStates);
+			/**
+			 * Evaluates an expression over every state read by readStates()
+			 *
+			 * @param expression The (boolean) expression
+			 * @return The states the expression holds in
+			 * */
+			storm::storage::BitVector getStatesSatisfying(storm::expressions::Expression const & expression) const;
+		private:
+			std::string filename;
+			storm::generator::VariableInformation const & variableInformation;
+			uint16_t numberOfThreads;
+			// Rounded up to whole words, so every word of a state holds 64 bits
+			uint64_t bitsPerState;
+			uint64_t wordsPerState;
+			uint64_t numberOfStates;
+			std::vector<uint64_t> stateWords;
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_EXPLICITMODELREADER_H
@@ -0,0 +1,255 @@
+#include "ExplicitModelWriter.h"
+#include "BufferedFileWriter.h"
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/**
+ * Implementation for ExplicitModelWriter methods
+ * */
+
+namespace stamina {
+	namespace util {
+		/**
+		 * Gets the reward model to export (the first one by name), or nullptr if there is none
+		 * */
+		template <typename ValueType>
+		static storm::models::sparse::StandardRewardModel<ValueType> const *
+		exportedRewardModel(storm::models::sparse::Model<ValueType> const & model) {
+			storm::models::sparse::StandardRewardModel<ValueType> const * rewardModel = nullptr;
+			std::string const * rewardModelName = nullptr;
+			for (auto const & nameAndModel : model.getRewardModels()) {
+				if (rewardModelName == nullptr || nameAndModel.first < *rewardModelName) {
+					rewardModelName = &nameAndModel.first;
+					rewardModel = &nameAndModel.second;
+				}
+			}
+			return rewardModel;
+		}
+
+		/**
+		 * Writes a sparse matrix as "row column value" lines, after a header with the number of rows and
+		 * entries
+		 * */
+		template <typename ValueType>
+		static void
+		writeMatrix(storm::storage::SparseMatrix<ValueType> const & matrix, BufferedFileWriter & out) {
+			out.writeUnsigned(matrix.getRowCount());
+			out.write(' ');
+			out.writeUnsigned(matrix.getEntryCount());
+			out.write('\n');
+			for (uint64_t row = 0; row < matrix.getRowCount(); ++row) {
+				for (auto const & entry : matrix.getRow(row)) {
+					out.writeUnsigned(row);
+					out.write(' ');
+					out.writeUnsigned(entry.getColumn());
+					out.write(' ');
+					out.writeDouble(static_cast<double>(entry.getValue()));
+					out.write('\n');
+				}
+			}
+		}
+
+		template <typename ValueType, typename StateType>
+		ExplicitModelWriter<ValueType, StateType>::ExplicitModelWriter(
+			std::shared_ptr<storm::models::sparse::Model<ValueType>> model
+			, ConcurrentStateStorage<StateType> const & states
+			, storm::generator::VariableInformation const & variableInformation
+		) : model(model)
+			, states(states)
+			, variableInformation(variableInformation)
+		{
+			// Intentionally left empty
+		}
+
+		template <typename ValueType, typename StateType>
+		void
+		ExplicitModelWriter<ValueType, StateType>::write(std::string const & filename) const {
+			std::vector<std::function<void()>> writers = {
+				[&]() { writeTransitions(filename + ".tra"); }
+				, [&]() { writeStates(filename + ".sta"); }
+				, [&]() { writeLabels(filename + ".lab"); }
+				, [&]() { writeStateRewards(filename + ".srew"); }
+				, [&]() { writeTransitionRewards(filename + ".trew"); }
+			};
+			std::vector<std::exception_ptr> errors(writers.size());
+			std::vector<std::thread> threads;
+			for (uint8_t i = 0; i < writers.size(); ++i) {
+				threads.emplace_back([&, i]() {
+					try {
+						writers[i]();
+					}
+					catch (...) {
+						errors[i] = std::current_exception();
+					}
+				});
+			}
+			for (auto & thread : threads) {
+				thread.join();
+			}
+			for (auto const & error : errors) {
+				if (error) {
+					std::rethrow_exception(error);
+				}
+			}
+		}
+
+		template <typename ValueType, typename StateType>
+		void
+		ExplicitModelWriter<ValueType, StateType>::writeTransitions(std::string const & filename) const {
+			BufferedFileWriter out(filename);
+			writeMatrix(model->getTransitionMatrix(), out);
+			out.close();
+		}
+
+		template <typename ValueType, typename StateType>
+		void
+		ExplicitModelWriter<ValueType, StateType>::writeStates(std::string const & filename) const {
+			uint64_t numberOfStates = model->getNumberOfStates();
+			if (states.size() < numberOfStates) {
+				throw std::runtime_error("The state storage has fewer states than the model!");
+			}
+			// Variables in the order they are in the state (which is the order of the program)
+			struct Variable {
+				std::string name;
+				uint64_t bitOffset;
+				uint64_t bitWidth;
+				int64_t lowerBound;
+				bool isBoolean;
+			};
+			std::vector<Variable> variables;
+			for (auto const & booleanVariable : variableInformation.booleanVariables) {
+				variables.push_back({booleanVariable.variable.getName(), booleanVariable.bitOffset, 1, 0, true});
+			}
+			for (auto const & integerVariable : variableInformation.integerVariables) {
+				variables.push_back({
+					integerVariable.variable.getName()
+					, integerVariable.bitOffset
+					, integerVariable.bitWidth
+					, static_cast<int64_t>(integerVariable.lowerBound)
+					, false
+				});
+			}
+			std::sort(variables.begin(), variables.end(), [](Variable const & first, Variable const & second) {
+				return first.bitOffset < second.bitOffset;
+			});
+
+			BufferedFileWriter out(filename);
+			out.write('(');
+			for (uint64_t i = 0; i < variables.size(); ++i) {
+				if (i > 0) { out.write(','); }
+				out.write(variables[i].name);
+			}
+			out.write(")\n");
+			// Each state is unpacked into the same CompressedState
+			CompressedState state(states.getBitsPerState());
+			for (uint64_t id = 0; id < numberOfStates; ++id) {
+				states.getState(id, state);
+				out.writeUnsigned(id);
+				out.write(":(");
+				for (uint64_t i = 0; i < variables.size(); ++i) {
+					if (i > 0) { out.write(','); }
+					uint64_t value = state.getAsInt(variables[i].bitOffset, variables[i].bitWidth);
+					if (variables[i].isBoolean) {
+						out.write(value ? "true" : "false");
+					}
+					else {
+						out.writeSigned(static_cast<int64_t>(value) + variables[i].lowerBound);
+					}
+				}
+				out.write(")\n");
+			}
+			out.close();
+		}
+
+		template <typename ValueType, typename StateType>
+		void
+		ExplicitModelWriter<ValueType, StateType>::writeLabels(std::string const & filename) const {
+			auto const & labeling = model->getStateLabeling();
+			// PRISM puts init and deadlock first
+			std::vector<std::string> labels;
+			for (std::string const label : {"init", "deadlock"}) {
+				if (labeling.containsLabel(label)) { labels.push_back(label); }
+			}
+			for (auto const & label : labeling.getLabels()) {
+				if (label != "init" && label != "deadlock") { labels.push_back(label); }
+			}
+			std::vector<storm::storage::BitVector const *> statesWithLabel;
+			for (auto const & label : labels) {
+				statesWithLabel.push_back(&labeling.getStates(label));
+			}
+
+			BufferedFileWriter out(filename);
+			for (uint64_t i = 0; i < labels.size(); ++i) {
+				if (i > 0) { out.write(' '); }
+				out.writeUnsigned(i);
+				out.write("=\"");
+				out.write(labels[i]);
+				out.write('"');
+			}
+			out.write('\n');
+			for (uint64_t state = 0; state < model->getNumberOfStates(); ++state) {
+				bool hasLabel = false;
+				for (uint64_t i = 0; i < labels.size(); ++i) {
+					if (!statesWithLabel[i]->get(state)) { continue; }
+					if (!hasLabel) {
+						out.writeUnsigned(state);
+						out.write(':');
+						hasLabel = true;
+					}
+					out.write(' ');
+					out.writeUnsigned(i);
+				}
+				if (hasLabel) { out.write('\n'); }
+			}
+			out.close();
+		}
+
+		template <typename ValueType, typename StateType>
+		bool
+		ExplicitModelWriter<ValueType, StateType>::writeStateRewards(std::string const & filename) const {
+			auto rewardModel = exportedRewardModel(*model);
+			if (rewardModel == nullptr || !rewardModel->hasStateRewards()) {
+				return false;
+			}
+			auto const & rewards = rewardModel->getStateRewardVector();
+			uint64_t numberNonZero = std::count_if(rewards.begin(), rewards.end(), [](ValueType const & reward) {
+				return reward != storm::utility::zero<ValueType>();
+			});
+			BufferedFileWriter out(filename);
+			out.writeUnsigned(rewards.size());
+			out.write(' ');
+			out.writeUnsigned(numberNonZero);
+			out.write('\n');
+			for (uint64_t state = 0; state < rewards.size(); ++state) {
+				if (rewards[state] == storm::utility::zero<ValueType>()) { continue; }
+				out.writeUnsigned(state);
+				out.write(' ');
+				out.writeDouble(static_cast<double>(rewards[state]));
+				out.write('\n');
+			}
+			out.close();
+			return true;
+		}
+
+		template <typename ValueType, typename StateType>
+		bool
+		ExplicitModelWriter<ValueType, StateType>::writeTransitionRewards(std::string const & filename) const {
+			auto rewardModel = exportedRewardModel(*model);
+			if (rewardModel == nullptr || !rewardModel->hasTransitionRewards()) {
+				return false;
+			}
+			BufferedFileWriter out(filename);
+			writeMatrix(rewardModel->getTransitionRewardMatrix(), out);
+			out.close();
+			return true;
+		}
+
+		// Forward declare
+		template class ExplicitModelWriter<double, uint32_t>;
+	} // namespace util
+} // namespace stamina
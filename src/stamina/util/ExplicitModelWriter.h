@@ -0,0 +1,84 @@
+#ifndef STAMINA_UTIL_EXPLICITMODELWRITER_H
+#define STAMINA_UTIL_EXPLICITMODELWRITER_H
+
+#include "ConcurrentStateStorage.h"
+
+#include <memory>
+#include <string>
+
+#include "storm/generator/VariableInformation.h"
+#include "storm/models/sparse/Model.h"
+#include "storm/models/sparse/StandardRewardModel.h"
+#include "storm/utility/constants.h"
+
+/**
+ * Exports a truncated model to PRISM's explicit file formats:
+ * 	1. <filename>.tra: the transitions, from the (CSR) transition matrix built from the builder's
+ * 	TransitionStore
+ * 	2. <filename>.sta: the value of each variable in each state, read back from the packed states in
+ * 	the builder's ConcurrentStateStorage
+ * 	3. <filename>.lab: the labels of each state
+ * 	4. <filename>.srew and <filename>.trew: the state and transition rewards of the first reward model,
+ * 	if the model has them
+ *
+ * Every file is streamed through its own BufferedFileWriter, so nothing is formatted into a string
+ * per state or transition, and the files are written in parallel. Since state IDs in the state storage
+ * are the row indices of the transition matrix, state 0 is the absorbing state.
+ * */
+namespace stamina {
+	namespace util {
+		template <typename ValueType, typename StateType>
+		class ExplicitModelWriter {
+		public:
+			/**
+			 * Constructor. The model and state storage must outlive the writer.
+			 *
+			 * @param model The truncated model
+			 * @param states The states of the model, by ID
+			 * @param variableInformation Where each variable is in the packed states
+			 * */
+			ExplicitModelWriter(
+				std::shared_ptr<storm::models::sparse::Model<ValueType>> model
+				, ConcurrentStateStorage<StateType> const & states
+				, storm::generator::VariableInformation const & variableInformation
+			);
+			/**
+			 * Writes all of the files, each on its own thread. Throws std::runtime_error if any of them
+			 * could not be written.
+			 *
+			 * @param filename The filename, without an extension
+			 * */
+			void write(std::string const & filename) const;
+			/**
+			 * Writes the transitions (.tra)
+			 * */
+			void writeTransitions(std::string const & filename) const;
+			/**
+			 * Writes the variable values of each state (.sta)
+			 * */
+			void writeStates(std::string const & filename) const;
+			/**
+			 * Writes the labels of each state (.lab)
+			 * */
+			void writeLabels(std::string const & filename) const;
+			/**
+			 * Writes the state rewards (.srew). Does nothing if there are none.
+			 *
+			 * @return Whether or not the file was written
+			 * */
+			bool writeStateRewards(std::string const & filename) const;
+			/**
+			 * Writes the transition rewards (.trew). Does nothing if there are none.
+			 *
+			 * @return Whether or not the file was written
+			 * */
+			bool writeTransitionRewards(std::string const & filename) const;
+		private:
+			std::shared_ptr<storm::models::sparse::Model<ValueType>> model;
+			ConcurrentStateStorage<StateType> const & states;
+			storm::generator::VariableInformation const & variableInformation;
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_EXPLICITMODELWRITER_H
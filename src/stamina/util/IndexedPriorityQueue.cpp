@@ -0,0 +1,154 @@
+#include "IndexedPriorityQueue.h"
+#include "../builder/StaminaModelBuilder.h"
+
+// Position of states which are not in the heap
+#define NOT_IN_HEAP UINT64_MAX
+
+/**
+ * Implementation for IndexedPriorityQueue methods
+ * */
+
+namespace stamina {
+	namespace util {
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::IndexedPriorityQueue() {
+			// Intentionally left empty
+		}
+
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		void
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::push(ProbabilityStateType const & state) {
+			if (contains(state.index)) {
+				update(state);
+				return;
+			}
+			if (positions.size() <= state.index) {
+				positions.resize(static_cast<uint64_t>(state.index) + 1, NOT_IN_HEAP);
+			}
+			heap.push_back(state);
+			positions[state.index] = heap.size() - 1;
+			siftUp(heap.size() - 1);
+		}
+
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		ProbabilityStateType
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::top() const {
+			return heap.front();
+		}
+
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		void
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::pop() {
+			positions[heap.front().index] = NOT_IN_HEAP;
+			ProbabilityStateType last = heap.back();
+			heap.pop_back();
+			if (!heap.empty()) {
+				place(last, 0);
+				siftDown(0);
+			}
+		}
+
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		void
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::update(ProbabilityStateType const & state) {
+			if (!contains(state.index)) {
+				return;
+			}
+			uint64_t position = positions[state.index];
+			siftUp(position);
+			// If it did not move up, it may have to move down
+			if (heap[position] == state) {
+				siftDown(position);
+			}
+		}
+
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		bool
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::contains(StateType index) const {
+			return index < positions.size() && positions[index] != NOT_IN_HEAP;
+		}
+
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		bool
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::empty() const {
+			return heap.empty();
+		}
+
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		uint64_t
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::size() const {
+			return heap.size();
+		}
+
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		uint64_t
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::getSizeInBytes() const {
+			return heap.capacity() * sizeof(ProbabilityStateType) + positions.capacity() * sizeof(uint64_t);
+		}
+
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		void
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::clear() {
+			heap.clear();
+			positions.clear();
+		}
+
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		std::vector<ProbabilityStateType> const &
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::getStates() const {
+			return heap;
+		}
+
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		void
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::siftUp(uint64_t position) {
+			ProbabilityStateType state = heap[position];
+			while (position > 0) {
+				uint64_t parent = (position - 1) / 2;
+				// comparison(a, b) is true if a has a lower priority than b
+				if (!comparison(heap[parent], state)) {
+					break;
+				}
+				place(heap[parent], position);
+				position = parent;
+			}
+			place(state, position);
+		}
+
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		void
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::siftDown(uint64_t position) {
+			ProbabilityStateType state = heap[position];
+			uint64_t size = heap.size();
+			while (true) {
+				uint64_t child = 2 * position + 1;
+				if (child >= size) {
+					break;
+				}
+				if (child + 1 < size && comparison(heap[child], heap[child + 1])) {
+					++child;
+				}
+				if (!comparison(state, heap[child])) {
+					break;
+				}
+				place(heap[child], position);
+				position = child;
+			}
+			place(state, position);
+		}
+
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		void
+		IndexedPriorityQueue<StateType, ProbabilityStateType, Comparison>::place(ProbabilityStateType const & state, uint64_t position) {
+			heap[position] = state;
+			positions[state.index] = position;
+		}
+
+		// Forward declare
+		template class IndexedPriorityQueue<
+			uint32_t
+			, builder::StaminaModelBuilder<double, storm::models::sparse::StandardRewardModel<double>, uint32_t>::ProbabilityState
+			, builder::StaminaModelBuilder<double, storm::models::sparse::StandardRewardModel<double>, uint32_t>::ProbabilityStateComparison
+		>;
+	}
+}
@@ -0,0 +1,82 @@
+#ifndef STAMINA_UTIL_INDEXEDPRIORITYQUEUE_H
+#define STAMINA_UTIL_INDEXEDPRIORITYQUEUE_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Binary heap of ProbabilityState handles which knows where each state is in the heap, so the priority of a
+ * state can be raised or lowered in place (with update()) rather than pushing it a second time. Each
+ * state is in the heap at most once.
+ *
+ * Positions are kept in a vector indexed by state ID (ProbabilityStateType::index), which works since
+ * state IDs are dense.
+ * */
+namespace stamina {
+	namespace util {
+		template <typename StateType, typename ProbabilityStateType, typename Comparison>
+		class IndexedPriorityQueue {
+		public:
+			/**
+			 * Constructor
+			 * */
+			IndexedPriorityQueue();
+			/**
+			 * Adds a state to the heap. If it is already in the heap, its position is updated instead.
+			 *
+			 * @param state The state to add
+			 * */
+			void push(ProbabilityStateType const & state);
+			/**
+			 * The state with the highest priority
+			 * */
+			ProbabilityStateType top() const;
+			/**
+			 * Removes the state with the highest priority
+			 * */
+			void pop();
+			/**
+			 * Restores the heap order after the priority of a state has changed (in either direction).
+			 * Does nothing if the state is not in the heap.
+			 *
+			 * @param state The state whose priority changed
+			 * */
+			void update(ProbabilityStateType const & state);
+			/**
+			 * Whether or not a state is in the heap
+			 * */
+			bool contains(StateType index) const;
+			bool empty() const;
+			uint64_t size() const;
+			/**
+			 * The bytes used by the heap and the position of each state
+			 * */
+			uint64_t getSizeInBytes() const;
+			void clear();
+			/**
+			 * All states in the heap, in heap order (not sorted)
+			 * */
+			std::vector<ProbabilityStateType> const & getStates() const;
+		private:
+			/**
+			 * Moves the state at a position up until its parent has a higher priority
+			 * */
+			void siftUp(uint64_t position);
+			/**
+			 * Moves the state at a position down until its children have lower priorities
+			 * */
+			void siftDown(uint64_t position);
+			/**
+			 * Puts a state at a position and records that position
+			 * */
+			void place(ProbabilityStateType const & state, uint64_t position);
+			/* Data Members */
+			std::vector<ProbabilityStateType> heap;
+			// Position of each state in heap, or NOT_IN_HEAP
+			std::vector<uint64_t> positions;
+			Comparison comparison;
+		};
+	}
+}
+
+#endif // STAMINA_UTIL_INDEXEDPRIORITYQUEUE_H
@@ -0,0 +1,91 @@
+#include "LogQueue.h"
+
+#include <cstring>
+#include <thread>
+
+/**
+ * Implementation for LogQueue methods
+ * */
+
+namespace stamina {
+	namespace util {
+		LogQueue::LogQueue(uint8_t capacityExponent)
+			: records(new Record[1ULL << capacityExponent])
+			, mask((1ULL << capacityExponent) - 1)
+			, tail(0)
+			, head(0)
+		{
+			for (uint64_t i = 0; i <= mask; i++) {
+				records[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		LogQueue::~LogQueue() {
+			// Records which were never drained may still own overflow text
+			drain([](char const *, uint32_t) {});
+		}
+
+		void
+		LogQueue::push(std::initializer_list<std::string_view> pieces) {
+			uint64_t position = tail.load(std::memory_order_relaxed);
+			Record * record;
+			while (true) {
+				record = &records[position & mask];
+				uint64_t sequence = record->sequence.load(std::memory_order_acquire);
+				int64_t difference = static_cast<int64_t>(sequence - position);
+				if (difference == 0) {
+					if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+						break;
+					}
+				}
+				else {
+					// Full (the consumer has not freed this slot yet) or another producer took it
+					if (difference < 0) {
+						std::this_thread::yield();
+					}
+					position = tail.load(std::memory_order_relaxed);
+				}
+			}
+			uint64_t length = 0;
+			for (auto const & piece : pieces) {
+				length += piece.size();
+			}
+			record->length = static_cast<uint32_t>(length);
+			char * text = record->text;
+			record->overflow = nullptr;
+			if (length > RECORD_TEXT_SIZE) {
+				record->overflow = new char[length];
+				text = record->overflow;
+			}
+			for (auto const & piece : pieces) {
+				std::memcpy(text, piece.data(), piece.size());
+				text += piece.size();
+			}
+			record->sequence.store(position + 1, std::memory_order_release);
+		}
+
+		uint64_t
+		LogQueue::drain(std::function<void(char const *, uint32_t)> const & write) {
+			uint64_t drained = 0;
+			while (!empty()) {
+				Record & record = records[head & mask];
+				if (record.overflow) {
+					write(record.overflow, record.length);
+					delete[] record.overflow;
+				}
+				else {
+					write(record.text, record.length);
+				}
+				record.sequence.store(head + mask + 1, std::memory_order_release);
+				head++;
+				drained++;
+			}
+			return drained;
+		}
+
+		bool
+		LogQueue::empty() const {
+			return records[head & mask].sequence.load(std::memory_order_acquire) != head + 1;
+		}
+	} // namespace util
+} // namespace stamina
@@ -0,0 +1,65 @@
+#ifndef STAMINA_UTIL_LOGQUEUE_H
+#define STAMINA_UTIL_LOGQUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string_view>
+
+/**
+ * Bounded lock-free queue of preformatted log records, with many producers and a single consumer.
+ *
+ * Each slot carries a sequence number which tells producers when it is free and the consumer when it
+ * has been published, so a push is a compare-and-swap on the tail and a copy into the slot. Messages
+ * which do not fit in a slot are copied to the heap and freed by the consumer. If the queue is full,
+ * producers yield until the consumer frees a slot rather than dropping records.
+ * */
+namespace stamina {
+	namespace util {
+		class LogQueue {
+		public:
+			static const uint32_t RECORD_TEXT_SIZE = 240;
+			/**
+			 * Constructor
+			 *
+			 * @param capacityExponent Exponent on 2 of the number of records
+			 * */
+			LogQueue(uint8_t capacityExponent = 10); // 2 ^ 10
+			~LogQueue();
+			/**
+			 * Copies the concatenation of some pieces of text into a new record. Thread-safe.
+			 *
+			 * @param pieces The text of the record
+			 * */
+			void push(std::initializer_list<std::string_view> pieces);
+			/**
+			 * Passes each published record to a function, in order, and frees it. Must only be called
+			 * by one thread at a time.
+			 *
+			 * @param write Called with the text and length of each record
+			 * @return The number of records drained
+			 * */
+			uint64_t drain(std::function<void(char const *, uint32_t)> const & write);
+			/**
+			 * Whether the next record is published. Only meaningful to the consumer.
+			 * */
+			bool empty() const;
+		private:
+			struct Record {
+				std::atomic<uint64_t> sequence;
+				uint32_t length;
+				// Only set if length > RECORD_TEXT_SIZE
+				char * overflow;
+				char text[RECORD_TEXT_SIZE];
+			};
+			std::unique_ptr<Record[]> records;
+			uint64_t const mask;
+			alignas(64) std::atomic<uint64_t> tail;
+			alignas(64) uint64_t head;
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_LOGQUEUE_H
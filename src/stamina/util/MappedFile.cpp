@@ -0,0 +1,59 @@
+#include "MappedFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Implementation for MappedFile methods
+ * */
+
+namespace stamina {
+	namespace util {
+		MappedFile::MappedFile(std::string const & filename)
+			: filename(filename)
+			, data(nullptr)
+			, length(0)
+		{
+			int fileDescriptor = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fileDescriptor < 0) {
+				throw std::runtime_error("Could not open " + filename + ": " + std::strerror(errno));
+			}
+			struct stat status;
+			if (fstat(fileDescriptor, &status) != 0) {
+				int error = errno;
+				::close(fileDescriptor);
+				throw std::runtime_error("Could not read " + filename + ": " + std::strerror(error));
+			}
+			length = status.st_size;
+			if (length > 0) {
+				void * address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+				if (address == MAP_FAILED) {
+					int error = errno;
+					::close(fileDescriptor);
+					throw std::runtime_error("Could not map " + filename + ": " + std::strerror(error));
+				}
+				data = static_cast<char const *>(address);
+				// Files are read front to back
+				madvise(address, length, MADV_SEQUENTIAL);
+			}
+			::close(fileDescriptor);
+		}
+
+		MappedFile::~MappedFile() {
+			if (data != nullptr) {
+				munmap(const_cast<char *>(data), length);
+			}
+		}
+
+		void
+		MappedFile::malformed(char const * position) const {
+			throw std::runtime_error("Malformed contents in " + filename + " at byte " + std::to_string(position - data));
+		}
+	} // namespace util
+} // namespace stamina
@@ -0,0 +1,46 @@
+#ifndef STAMINA_UTIL_MAPPEDFILE_H
+#define STAMINA_UTIL_MAPPEDFILE_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * A file mapped read-only into memory for as long as this exists. Used to read the files written by
+ * ExplicitModelWriter and CheckpointFile without copying them into buffers first.
+ *
+ * Errors (the file cannot be opened or mapped) are thrown as std::runtime_error.
+ * */
+namespace stamina {
+	namespace util {
+		class MappedFile {
+		public:
+			/**
+			 * Constructor. Maps the whole file.
+			 *
+			 * @param filename The file to map
+			 * */
+			MappedFile(std::string const & filename);
+			/**
+			 * Destructor. Unmaps the file
+			 * */
+			~MappedFile();
+			MappedFile(MappedFile const &) = delete;
+			MappedFile & operator=(MappedFile const &) = delete;
+			char const * begin() const { return data; }
+			char const * end() const { return data + length; }
+			uint64_t size() const { return length; }
+			/**
+			 * Throws an error about malformed contents
+			 *
+			 * @param position Where in the file the contents are malformed
+			 * */
+			[[noreturn]] void malformed(char const * position) const;
+			std::string const filename;
+		private:
+			char const * data;
+			uint64_t length;
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_MAPPEDFILE_H
@@ -0,0 +1,111 @@
+#include "MemoryAccounting.h"
+#include "SpillFile.h"
+#include "../StaminaMessages.h"
+
+#include <cstdio>
+
+/**
+ * Implementation for MemoryAccounting methods
+ * */
+
+namespace stamina {
+	namespace util {
+		std::mutex MemoryAccounting::usageLock;
+		std::map<void const *, MemoryAccounting::Usage> MemoryAccounting::current;
+		MemoryAccounting::Usage MemoryAccounting::peak;
+		uint64_t MemoryAccounting::cap = 0;
+		bool MemoryAccounting::spilling = false;
+
+		uint64_t
+		MemoryAccounting::Usage::getTotal() const {
+			uint64_t total = 0;
+			for (uint8_t subsystem = 0; subsystem < NUMBER_OF_SUBSYSTEMS; subsystem++) {
+				total += bytes[subsystem];
+			}
+			return total;
+		}
+
+		MemoryAccounting::Usage &
+		MemoryAccounting::Usage::operator+=(Usage const & other) {
+			for (uint8_t subsystem = 0; subsystem < NUMBER_OF_SUBSYSTEMS; subsystem++) {
+				bytes[subsystem] += other.bytes[subsystem];
+			}
+			return *this;
+		}
+
+		std::string
+		MemoryAccounting::Usage::toString() const {
+			std::string description;
+			char line[128];
+			for (uint8_t subsystem = 0; subsystem < NUMBER_OF_SUBSYSTEMS; subsystem++) {
+				std::snprintf(line, sizeof(line), "\t%s: %.1f MB\n", getSubsystemName(static_cast<Subsystem>(subsystem)), bytes[subsystem] / 1048576.0);
+				description += line;
+			}
+			std::snprintf(line, sizeof(line), "\ttotal: %.1f MB\n", getTotal() / 1048576.0);
+			description += line;
+			return description;
+		}
+
+		void
+		MemoryAccounting::setCap(uint64_t bytes) {
+			std::lock_guard<std::mutex> guard(usageLock);
+			cap = bytes;
+		}
+
+		uint64_t
+		MemoryAccounting::getCap() {
+			std::lock_guard<std::mutex> guard(usageLock);
+			return cap;
+		}
+
+		bool
+		MemoryAccounting::record(void const * source, Usage const & usage) {
+			std::lock_guard<std::mutex> guard(usageLock);
+			current[source] = usage;
+			Usage total;
+			for (auto const & sourceAndUsage : current) {
+				total += sourceAndUsage.second;
+			}
+			if (total.getTotal() > peak.getTotal()) {
+				peak = total;
+			}
+			if (cap == 0) {
+				return false;
+			}
+			// Spilled blocks are counted in the usage, but they are on disk
+			uint64_t spilledBytes = SpillFile::getSpilledBytes();
+			uint64_t residentBytes = total.getTotal() > spilledBytes ? total.getTotal() - spilledBytes : 0;
+			if (!spilling && residentBytes >= cap / 4 * 3) {
+				spilling = true;
+				SpillFile::spillFromNowOn();
+				StaminaMessages::warning("Over three quarters of the memory cap (" + std::to_string(cap >> 20) + " MB) are in use. Spilling new blocks to disk.");
+			}
+			return residentBytes > cap;
+		}
+
+		void
+		MemoryAccounting::forget(void const * source) {
+			std::lock_guard<std::mutex> guard(usageLock);
+			current.erase(source);
+		}
+
+		MemoryAccounting::Usage
+		MemoryAccounting::getPeak() {
+			std::lock_guard<std::mutex> guard(usageLock);
+			return peak;
+		}
+
+		char const *
+		MemoryAccounting::getSubsystemName(Subsystem subsystem) {
+			switch (subsystem) {
+				case STATE_STORAGE: return "state_storage";
+				case PROBABILITY_STATES: return "probability_states";
+				case TRANSITIONS: return "transitions";
+				case FRONTIER: return "frontier";
+				case LABELING_AND_REWARDS: return "labeling_and_rewards";
+				case TRANSITION_MATRIX: return "transition_matrix";
+				default: return "unknown";
+			}
+		}
+	} // namespace util
+} // namespace stamina
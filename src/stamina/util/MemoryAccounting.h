@@ -0,0 +1,89 @@
+#ifndef STAMINA_UTIL_MEMORYACCOUNTING_H
+#define STAMINA_UTIL_MEMORYACCOUNTING_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * Accounts for the memory used by each part of the builders (the state storage, the reachability of
+ * each state, the transitions waiting for the matrix, the frontier, labels and rewards, and the
+ * transition matrix of the last model), so that we can tell where the memory of a large model went.
+ *
+ * The builders measure what they hold themselves (by asking each of their containers for its size in
+ * bytes) and hand the measurement to record(), which keeps the latest one from each builder. What they
+ * hold together is what counts towards the peak and the cap, since several properties may be checked
+ * at once, each with its own builder.
+ *
+ * If a cap is set, blocks are spilled to the scratch file (see SpillFile) from the time three quarters
+ * of the cap are in RAM, and record() tells the caller once the cap itself is exceeded, so that it can
+ * stop before the OOM killer stops it. Spilled blocks do not count towards the cap.
+ *
+ * All methods are thread-safe.
+ * */
+namespace stamina {
+	namespace util {
+		class MemoryAccounting {
+		public:
+			enum Subsystem : uint8_t {
+				// The state hash table and the bits of each state (ConcurrentStateStorage)
+				STATE_STORAGE = 0
+				// The reachability and flags of each state (ProbabilityStateArray)
+				, PROBABILITY_STATES
+				// Transitions waiting to be put in the matrix (TransitionStore and its StateMemoryPool)
+				, TRANSITIONS
+				// States waiting to be explored, in this iteration or a later one
+				, FRONTIER
+				// Choice labels, and the state labeling and reward models of the last model
+				, LABELING_AND_REWARDS
+				// The transition matrix of the last model
+				, TRANSITION_MATRIX
+				, NUMBER_OF_SUBSYSTEMS
+			};
+			/* Bytes used by each subsystem */
+			struct Usage {
+				uint64_t bytes[NUMBER_OF_SUBSYSTEMS] = {};
+				uint64_t getTotal() const;
+				Usage & operator+=(Usage const & other);
+				/**
+				 * Describes each subsystem (in MB) on its own line, followed by the total
+				 * */
+				std::string toString() const;
+			};
+			/**
+			 * Sets the most RAM the builders may use together
+			 *
+			 * @param bytes The cap. 0 means no cap.
+			 * */
+			static void setCap(uint64_t bytes);
+			static uint64_t getCap();
+			/**
+			 * Records what a builder is using now, replacing what it used when it was last recorded.
+			 * Starts spilling blocks to disk if three quarters of the cap are in RAM.
+			 *
+			 * @param source The builder
+			 * @param usage What it is using
+			 * @return Whether the builders together are over the cap
+			 * */
+			static bool record(void const * source, Usage const & usage);
+			/**
+			 * Stops counting what a builder used (e.g., because it was destroyed). The peak is kept.
+			 * */
+			static void forget(void const * source);
+			/**
+			 * Gets what the builders were using together when the most memory was in use
+			 * */
+			static Usage getPeak();
+			static char const * getSubsystemName(Subsystem subsystem);
+		private:
+			static std::mutex usageLock;
+			static std::map<void const *, Usage> current;
+			static Usage peak;
+			static uint64_t cap;
+			static bool spilling;
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_MEMORYACCOUNTING_H
@@ -0,0 +1,198 @@
+#include "Metrics.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+/**
+ * Implementation for Metrics methods
+ * */
+
+namespace stamina {
+	namespace util {
+		std::mutex Metrics::runsLock;
+		std::vector<Metrics::Run> Metrics::runs;
+
+		namespace {
+			/**
+			 * Writes a string as a JSON string literal
+			 * */
+			void
+			writeString(std::ostream & out, std::string const & value) {
+				out << '"';
+				for (char c : value) {
+					if (c == '"' || c == '\\') {
+						out << '\\' << c;
+					}
+					else if (static_cast<unsigned char>(c) < 0x20) {
+						char escaped[8];
+						std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+						out << escaped;
+					}
+					else {
+						out << c;
+					}
+				}
+				out << '"';
+			}
+
+			/**
+			 * Writes a double as a JSON number (or null, since JSON has no infinity or NaN)
+			 * */
+			void
+			writeNumber(std::ostream & out, double value) {
+				if (!std::isfinite(value)) {
+					out << "null";
+					return;
+				}
+				char number[32];
+				std::snprintf(number, sizeof(number), "%.17g", value);
+				out << number;
+			}
+
+			/**
+			 * Writes the bytes used by each subsystem, and the total, as a JSON object
+			 * */
+			void
+			writeMemory(std::ostream & out, MemoryAccounting::Usage const & usage) {
+				out << "{";
+				for (uint8_t subsystem = 0; subsystem < MemoryAccounting::NUMBER_OF_SUBSYSTEMS; subsystem++) {
+					writeString(out, MemoryAccounting::getSubsystemName(static_cast<MemoryAccounting::Subsystem>(subsystem)));
+					out << ": " << usage.bytes[subsystem] << ", ";
+				}
+				out << "\"total\": " << usage.getTotal() << "}";
+			}
+		} // namespace
+
+		void
+		Metrics::Iteration::addPerimeterState(double pi) {
+			perimeterStates++;
+			perimeterPi += pi;
+			uint64_t bucket = PI_HISTOGRAM_BUCKETS - 1;
+			if (pi >= 0.1) {
+				bucket = 0;
+			}
+			else if (pi > 0.0) {
+				// 10^-(i+1) <= pi < 10^-i
+				double exponent = std::ceil(-std::log10(pi)) - 1.0;
+				if (exponent < PI_HISTOGRAM_BUCKETS) {
+					bucket = static_cast<uint64_t>(exponent);
+				}
+			}
+			perimeterPiHistogram[bucket]++;
+		}
+
+		void
+		Metrics::addRun(Run run) {
+			std::lock_guard<std::mutex> guard(runsLock);
+			runs.push_back(std::move(run));
+		}
+
+		void
+		Metrics::write(
+			std::string const & filename
+			, std::string const & method
+			, std::map<std::string, double> const & parameters
+		) {
+			std::lock_guard<std::mutex> guard(runsLock);
+			std::ofstream out(filename);
+			if (!out) {
+				throw std::runtime_error("Cannot open " + filename + " for writing");
+			}
+			out << "{\n\t\"method\": ";
+			writeString(out, method);
+			out << ",\n\t\"parameters\": {";
+			bool first = true;
+			for (auto const & parameter : parameters) {
+				out << (first ? "\n\t\t" : ",\n\t\t");
+				writeString(out, parameter.first);
+				out << ": ";
+				writeNumber(out, parameter.second);
+				first = false;
+			}
+			out << "\n\t},\n\t\"peak_memory\": ";
+		writeMemory(out, MemoryAccounting::getPeak());
+		out << ",\n\t\"runs\": [";
+			for (uint64_t r = 0; r < runs.size(); r++) {
+				Run const & run = runs[r];
+				out << (r == 0 ? "\n\t\t{" : ",\n\t\t{");
+				out << "\n\t\t\t\"property\": ";
+				writeString(out, run.property);
+				out << ",\n\t\t\t\"total_time\": ";
+				writeNumber(out, run.totalTime);
+				out << ",\n\t\t\t\"iterations\": [";
+				for (uint64_t i = 0; i < run.iterations.size(); i++) {
+					Iteration const & iteration = run.iterations[i];
+					out << (i == 0 ? "\n\t\t\t\t{" : ",\n\t\t\t\t{");
+					out << "\n\t\t\t\t\t\"refinement_iteration\": " << iteration.refinementIteration;
+					out << ",\n\t\t\t\t\t\"kappa\": ";
+					writeNumber(out, iteration.kappa);
+					out << ",\n\t\t\t\t\t\"approx_factor\": ";
+					writeNumber(out, iteration.approxFactor);
+					out << ",\n\t\t\t\t\t\"exploration_iterations\": " << iteration.exploration.iterations;
+					out << ",\n\t\t\t\t\t\"states_dequeued\": " << iteration.exploration.statesDequeued;
+					out << ",\n\t\t\t\t\t\"peak_frontier_size\": " << iteration.exploration.peakFrontierSize;
+					out << ",\n\t\t\t\t\t\"states\": " << iteration.numberOfStates;
+					out << ",\n\t\t\t\t\t\"transitions\": " << iteration.numberOfTransitions;
+					out << ",\n\t\t\t\t\t\"hash_lookups\": " << iteration.hashLookups;
+					out << ",\n\t\t\t\t\t\"hash_probes\": " << iteration.hashProbes;
+					out << ",\n\t\t\t\t\t\"perimeter_states\": " << iteration.perimeterStates;
+					out << ",\n\t\t\t\t\t\"perimeter_pi\": ";
+					writeNumber(out, iteration.perimeterPi);
+					// Each bucket is labeled with its lower bound
+					out << ",\n\t\t\t\t\t\"perimeter_pi_histogram\": [";
+					for (uint64_t b = 0; b < PI_HISTOGRAM_BUCKETS; b++) {
+						out << (b == 0 ? "" : ", ") << "{\"at_least\": ";
+						writeNumber(out, b + 1 == PI_HISTOGRAM_BUCKETS ? 0.0 : std::pow(10.0, -static_cast<double>(b + 1)));
+						out << ", \"states\": " << iteration.perimeterPiHistogram[b] << "}";
+					}
+					out << "]";
+					out << ",\n\t\t\t\t\t\"build_time\": ";
+					writeNumber(out, iteration.buildTime);
+					out << ",\n\t\t\t\t\t\"check_time\": ";
+					writeNumber(out, iteration.checkTime);
+					out << ",\n\t\t\t\t\t\"solver_sweeps\": " << iteration.solverSweeps;
+					out << ",\n\t\t\t\t\t\"results\": [";
+					for (uint64_t p = 0; p < iteration.results.size(); p++) {
+						out << (p == 0 ? "" : ", ");
+						writeNumber(out, iteration.results[p]);
+					}
+					out << "]";
+					out << ",\n\t\t\t\t\t\"memory\": ";
+					writeMemory(out, iteration.memory);
+					if (iteration.hasPerfCounters) {
+						// Events which could not be counted are null
+						out << ",\n\t\t\t\t\t\"perf_counters\": {";
+						for (uint8_t phase = 0; phase < PerfCounters::NUMBER_OF_PHASES; phase++) {
+							out << (phase == 0 ? "\n\t\t\t\t\t\t" : ",\n\t\t\t\t\t\t");
+							writeString(out, PerfCounters::getPhaseName(static_cast<PerfCounters::Phase>(phase)));
+							out << ": {";
+							for (uint8_t event = 0; event < PerfCounters::NUMBER_OF_EVENTS; event++) {
+								PerfCounters::Event countedEvent = static_cast<PerfCounters::Event>(event);
+								out << (event == 0 ? "" : ", ");
+								writeString(out, PerfCounters::getEventName(countedEvent));
+								out << ": ";
+								if (PerfCounters::isAvailable(countedEvent)) {
+									out << iteration.perfCounters.counts[phase][event];
+								}
+								else {
+									out << "null";
+								}
+							}
+							out << "}";
+						}
+						out << "\n\t\t\t\t\t}";
+					}
+					out << "\n\t\t\t\t}";
+				}
+				out << (run.iterations.empty() ? "]" : "\n\t\t\t]");
+				out << "\n\t\t}";
+			}
+			out << (runs.empty() ? "]" : "\n\t]") << "\n}\n";
+			if (!out) {
+				throw std::runtime_error("Cannot write to " + filename);
+			}
+		}
+	} // namespace util
+} // namespace stamina
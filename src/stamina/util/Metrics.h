@@ -0,0 +1,110 @@
+#ifndef STAMINA_UTIL_METRICS_H
+#define STAMINA_UTIL_METRICS_H
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MemoryAccounting.h"
+#include "PerfCounters.h"
+
+/**
+ * Registry of what happened in each refinement iteration, written out as JSON (--metricsOut) so that
+ * kappa, reduceKappa and approxFactor can be tuned across many runs.
+ *
+ * The builders keep an Exploration while they explore and fill in the rest of an Iteration once a
+ * build is done. StaminaModelChecker adds the times and results, and hands a Run to addRun() once a
+ * property (or a set of properties checked together) is done. addRun() is thread-safe, since several
+ * properties may be checked at once.
+ * */
+namespace stamina {
+	namespace util {
+		class Metrics {
+		public:
+			/* The number of buckets in the histogram of perimeter reachability */
+			static const uint8_t PI_HISTOGRAM_BUCKETS = 16;
+			/* Counters kept by a builder during a single build */
+			struct Exploration {
+				// Passes of the exploration loop (each with a smaller kappa)
+				uint64_t iterations = 0;
+				// States taken off the frontier, whether or not they were expanded
+				uint64_t statesDequeued = 0;
+				// The largest the frontier got, sampled whenever a state is taken off it
+				uint64_t peakFrontierSize = 0;
+				void noteFrontierSize(uint64_t size) {
+					if (size > peakFrontierSize) {
+						peakFrontierSize = size;
+					}
+				}
+			};
+			/* Everything recorded for a single refinement iteration */
+			struct Iteration {
+				uint64_t refinementIteration = 0;
+				// When the build started
+				double kappa = 0.0;
+				double approxFactor = 0.0;
+				Exploration exploration;
+				uint64_t numberOfStates = 0;
+				uint64_t numberOfTransitions = 0;
+				// Lookups and probes of the state hash table during the build
+				uint64_t hashLookups = 0;
+				uint64_t hashProbes = 0;
+				uint64_t perimeterStates = 0;
+				// The total reachability of the perimeter states
+				double perimeterPi = 0.0;
+				// Bucket i counts the perimeter states with 10^-(i+1) <= pi < 10^-i. The last bucket also
+				// counts everything smaller (including 0) and the first everything larger.
+				std::array<uint64_t, PI_HISTOGRAM_BUCKETS> perimeterPiHistogram = {};
+				// Seconds
+				double buildTime = 0.0;
+				double checkTime = 0.0;
+				uint64_t solverSweeps = 0;
+				// Results for the initial state, in the order the properties were given
+				std::vector<double> results;
+				// What the hardware counters counted in each phase (only if they were enabled)
+				bool hasPerfCounters = false;
+				PerfCounters::Totals perfCounters;
+				// What the builder was using at the end of the iteration
+				MemoryAccounting::Usage memory;
+				/**
+				 * Adds a perimeter state to perimeterPi and perimeterPiHistogram
+				 *
+				 * @param pi The reachability of the state
+				 * */
+				void addPerimeterState(double pi);
+			};
+			/* A property pair, or all of the properties when they share one truncation */
+			struct Run {
+				std::string property;
+				std::vector<Iteration> iterations;
+				// Seconds
+				double totalTime = 0.0;
+			};
+			/**
+			 * Adds a finished run. Thread-safe.
+			 * */
+			static void addRun(Run run);
+			/**
+			 * Writes every run added so far as JSON. Throws std::runtime_error if the file cannot be
+			 * written.
+			 *
+			 * @param filename The file to write to
+			 * @param method The truncation method
+			 * @param parameters The parameters the runs were made with, by name
+			 * */
+			static void write(
+				std::string const & filename
+				, std::string const & method
+				, std::map<std::string, double> const & parameters
+			);
+		private:
+			static std::mutex runsLock;
+			static std::vector<Run> runs;
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_METRICS_H
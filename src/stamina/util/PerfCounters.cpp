@@ -0,0 +1,281 @@
+#include "PerfCounters.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+	#include <linux/perf_event.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif // __linux__
+
+/**
+ * Implementation for PerfCounters methods
+ * */
+
+namespace stamina {
+	namespace util {
+		bool PerfCounters::enabled = false;
+		bool PerfCounters::available[NUMBER_OF_EVENTS] = {};
+
+		namespace {
+			/* The counters of the current thread, and the phases it is in */
+			struct ThreadCounters {
+				struct Frame {
+					PerfCounters * counters;
+					PerfCounters::Phase phase;
+				};
+				// The group leader (TASK_CLOCK). -1 if the group could not be opened.
+				int leader = -1;
+				int fds[PerfCounters::NUMBER_OF_EVENTS];
+				// Where each event is in a read of the group. -1 if the event is not counted.
+				int position[PerfCounters::NUMBER_OF_EVENTS];
+				uint64_t numberOpened = 0;
+				bool opened = false;
+				uint64_t last[PerfCounters::NUMBER_OF_EVENTS] = {};
+				std::vector<Frame> stack;
+
+				ThreadCounters() {
+					for (uint8_t event = 0; event < PerfCounters::NUMBER_OF_EVENTS; event++) {
+						fds[event] = -1;
+						position[event] = -1;
+					}
+				}
+				~ThreadCounters() {
+#ifdef __linux__
+					for (uint8_t event = 0; event < PerfCounters::NUMBER_OF_EVENTS; event++) {
+						if (fds[event] >= 0) {
+							close(fds[event]);
+						}
+					}
+#endif // __linux__
+				}
+				/**
+				 * Opens as many events as possible in a single group
+				 * */
+				void open() {
+					opened = true;
+#ifdef __linux__
+					for (uint8_t event = 0; event < PerfCounters::NUMBER_OF_EVENTS; event++) {
+						perf_event_attr attributes;
+						std::memset(&attributes, 0, sizeof(attributes));
+						attributes.size = sizeof(attributes);
+						attributes.exclude_kernel = 1;
+						attributes.exclude_hv = 1;
+						attributes.read_format = PERF_FORMAT_GROUP;
+						switch (event) {
+							case PerfCounters::TASK_CLOCK:
+								attributes.type = PERF_TYPE_SOFTWARE;
+								attributes.config = PERF_COUNT_SW_TASK_CLOCK;
+								attributes.disabled = 1;
+								break;
+							case PerfCounters::CYCLES:
+								attributes.type = PERF_TYPE_HARDWARE;
+								attributes.config = PERF_COUNT_HW_CPU_CYCLES;
+								break;
+							case PerfCounters::INSTRUCTIONS:
+								attributes.type = PERF_TYPE_HARDWARE;
+								attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+								break;
+							case PerfCounters::LLC_MISSES:
+								attributes.type = PERF_TYPE_HW_CACHE;
+								attributes.config = PERF_COUNT_HW_CACHE_LL
+									| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+									| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+								break;
+							case PerfCounters::BRANCH_MISSES:
+								attributes.type = PERF_TYPE_HARDWARE;
+								attributes.config = PERF_COUNT_HW_BRANCH_MISSES;
+								break;
+						}
+						// This thread, on any CPU
+						int fd = syscall(__NR_perf_event_open, &attributes, 0, -1, leader, 0);
+						if (fd < 0) {
+							if (event == PerfCounters::TASK_CLOCK) {
+								return;
+							}
+							// Not every event is available everywhere (e.g., in most VMs)
+							continue;
+						}
+						if (event == PerfCounters::TASK_CLOCK) {
+							leader = fd;
+						}
+						fds[event] = fd;
+						position[event] = numberOpened++;
+					}
+					ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+					ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif // __linux__
+				}
+				/**
+				 * Reads every event of the group. Events which are not counted read as 0.
+				 * */
+				void read(uint64_t * values) {
+					// The number of values, then the values
+					uint64_t buffer[1 + PerfCounters::NUMBER_OF_EVENTS] = {};
+#ifdef __linux__
+					if (leader >= 0 && ::read(leader, buffer, sizeof(buffer)) < 0) {
+						buffer[0] = 0;
+					}
+#endif // __linux__
+					for (uint8_t event = 0; event < PerfCounters::NUMBER_OF_EVENTS; event++) {
+						values[event] = position[event] >= 0 && static_cast<uint64_t>(position[event]) < buffer[0]
+							? buffer[1 + position[event]]
+							: 0;
+					}
+				}
+			};
+
+			thread_local ThreadCounters threadCounters;
+		} // namespace
+
+		PerfCounters::Totals &
+		PerfCounters::Totals::operator+=(Totals const & other) {
+			for (uint8_t phase = 0; phase < NUMBER_OF_PHASES; phase++) {
+				for (uint8_t event = 0; event < NUMBER_OF_EVENTS; event++) {
+					counts[phase][event] += other.counts[phase][event];
+				}
+			}
+			return *this;
+		}
+
+		PerfCounters::Totals &
+		PerfCounters::Totals::operator-=(Totals const & other) {
+			for (uint8_t phase = 0; phase < NUMBER_OF_PHASES; phase++) {
+				for (uint8_t event = 0; event < NUMBER_OF_EVENTS; event++) {
+					counts[phase][event] -= other.counts[phase][event];
+				}
+			}
+			return *this;
+		}
+
+		std::string
+		PerfCounters::Totals::toString() const {
+			std::string description;
+			char line[256];
+			for (uint8_t phase = 0; phase < NUMBER_OF_PHASES; phase++) {
+				uint64_t const * phaseCounts = counts[phase];
+				if (phaseCounts[TASK_CLOCK] == 0) {
+					continue;
+				}
+				int length = std::snprintf(line, sizeof(line), "\t%s: %.3f s", getPhaseName(static_cast<Phase>(phase)), phaseCounts[TASK_CLOCK] * 1e-9);
+				if (isAvailable(CYCLES) && isAvailable(INSTRUCTIONS) && phaseCounts[CYCLES] > 0) {
+					length += std::snprintf(line + length, sizeof(line) - length, ", %.2f instructions per cycle", static_cast<double>(phaseCounts[INSTRUCTIONS]) / phaseCounts[CYCLES]);
+				}
+				if (isAvailable(INSTRUCTIONS) && phaseCounts[INSTRUCTIONS] > 0) {
+					double thousands = phaseCounts[INSTRUCTIONS] / 1000.0;
+					if (isAvailable(LLC_MISSES)) {
+						length += std::snprintf(line + length, sizeof(line) - length, ", %.2f LLC misses", phaseCounts[LLC_MISSES] / thousands);
+					}
+					if (isAvailable(BRANCH_MISSES)) {
+						length += std::snprintf(line + length, sizeof(line) - length, ", %.2f branch misses", phaseCounts[BRANCH_MISSES] / thousands);
+					}
+					if (isAvailable(LLC_MISSES) || isAvailable(BRANCH_MISSES)) {
+						std::snprintf(line + length, sizeof(line) - length, " per 1000 instructions");
+					}
+				}
+				description += line;
+				description += '\n';
+			}
+			return description;
+		}
+
+		PerfCounters::PerfCounters() {
+			for (uint8_t phase = 0; phase < NUMBER_OF_PHASES; phase++) {
+				for (uint8_t event = 0; event < NUMBER_OF_EVENTS; event++) {
+					counts[phase][event].store(0, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		bool
+		PerfCounters::enable() {
+			if (!threadCounters.opened) {
+				threadCounters.open();
+			}
+			for (uint8_t event = 0; event < NUMBER_OF_EVENTS; event++) {
+				available[event] = threadCounters.position[event] >= 0;
+			}
+			enabled = threadCounters.leader >= 0;
+			return enabled;
+		}
+
+		bool
+		PerfCounters::isAvailable(Event event) {
+			return available[event];
+		}
+
+		char const *
+		PerfCounters::getPhaseName(Phase phase) {
+			switch (phase) {
+				case EXPAND: return "expand";
+				case INTERN: return "intern";
+				case TRANSITION_MATRIX: return "transition_matrix";
+				case LABELING: return "labeling";
+				case CHECK: return "check";
+				default: return "unknown";
+			}
+		}
+
+		char const *
+		PerfCounters::getEventName(Event event) {
+			switch (event) {
+				case TASK_CLOCK: return "task_clock_ns";
+				case CYCLES: return "cycles";
+				case INSTRUCTIONS: return "instructions";
+				case LLC_MISSES: return "llc_misses";
+				case BRANCH_MISSES: return "branch_misses";
+				default: return "unknown";
+			}
+		}
+
+		PerfCounters::Totals
+		PerfCounters::getTotals() const {
+			Totals totals;
+			for (uint8_t phase = 0; phase < NUMBER_OF_PHASES; phase++) {
+				for (uint8_t event = 0; event < NUMBER_OF_EVENTS; event++) {
+					totals.counts[phase][event] = counts[phase][event].load(std::memory_order_relaxed);
+				}
+			}
+			return totals;
+		}
+
+		void
+		PerfCounters::begin(PerfCounters & counters, Phase phase) {
+			if (!threadCounters.opened) {
+				threadCounters.open();
+			}
+			countSinceLastRead();
+			threadCounters.stack.push_back({&counters, phase});
+		}
+
+		void
+		PerfCounters::end() {
+			countSinceLastRead();
+			threadCounters.stack.pop_back();
+		}
+
+		void
+		PerfCounters::countSinceLastRead() {
+			uint64_t now[NUMBER_OF_EVENTS];
+			threadCounters.read(now);
+			if (!threadCounters.stack.empty()) {
+				uint64_t deltas[NUMBER_OF_EVENTS];
+				for (uint8_t event = 0; event < NUMBER_OF_EVENTS; event++) {
+					deltas[event] = now[event] - threadCounters.last[event];
+				}
+				threadCounters.stack.back().counters->add(threadCounters.stack.back().phase, deltas);
+			}
+			std::memcpy(threadCounters.last, now, sizeof(now));
+		}
+
+		void
+		PerfCounters::add(Phase phase, uint64_t const * deltas) {
+			for (uint8_t event = 0; event < NUMBER_OF_EVENTS; event++) {
+				counts[phase][event].fetch_add(deltas[event], std::memory_order_relaxed);
+			}
+		}
+	} // namespace util
+} // namespace stamina
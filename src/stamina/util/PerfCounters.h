@@ -0,0 +1,107 @@
+#ifndef STAMINA_UTIL_PERFCOUNTERS_H
+#define STAMINA_UTIL_PERFCOUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * Hardware performance counters (through Linux's perf_event_open) for each phase of exploration and
+ * checking, so that we can tell whether a model is bound by memory latency (LLC misses in the state
+ * hash table) or by compute (instructions in expression evaluation).
+ *
+ * Each thread opens its own group of counters the first time it enters a phase. A Scope reads the
+ * group when the phase starts and ends, and adds the difference to the totals of its PerfCounters. If
+ * phases are nested (e.g., interning a state while expanding another), the counts go to the innermost
+ * phase only. Counters are only read while enable() has been called, so a Scope is a single branch
+ * otherwise.
+ * */
+namespace stamina {
+	namespace util {
+		class PerfCounters {
+		public:
+			enum Phase : uint8_t {
+				EXPAND = 0
+				, INTERN
+				, TRANSITION_MATRIX
+				, LABELING
+				, CHECK
+				, NUMBER_OF_PHASES
+			};
+			enum Event : uint8_t {
+				// Software clock (in ns) which is available even where hardware counters are not
+				TASK_CLOCK = 0
+				, CYCLES
+				, INSTRUCTIONS
+				, LLC_MISSES
+				, BRANCH_MISSES
+				, NUMBER_OF_EVENTS
+			};
+			/* A count of every event in every phase */
+			struct Totals {
+				uint64_t counts[NUMBER_OF_PHASES][NUMBER_OF_EVENTS] = {};
+				Totals & operator+=(Totals const & other);
+				Totals & operator-=(Totals const & other);
+				/**
+				 * Describes each phase on its own line: instructions per cycle, LLC and branch misses per
+				 * 1000 instructions and time. Phases without any counts are left out.
+				 * */
+				std::string toString() const;
+			};
+			/* Counts events from its construction to its destruction towards a phase */
+			class Scope {
+			public:
+				Scope(PerfCounters & counters, Phase phase) : active(enabled) {
+					if (active) {
+						begin(counters, phase);
+					}
+				}
+				~Scope() {
+					if (active) {
+						end();
+					}
+				}
+				Scope(Scope const &) = delete;
+				Scope & operator=(Scope const &) = delete;
+			private:
+				bool const active;
+			};
+			PerfCounters();
+			/**
+			 * Turns counting on for every PerfCounters, if perf_event_open works on this system. Must
+			 * be called before any other threads are started.
+			 *
+			 * @return Whether counting was turned on
+			 * */
+			static bool enable();
+			static bool isEnabled() { return enabled; }
+			/**
+			 * Whether an event could be counted when enable() was called
+			 * */
+			static bool isAvailable(Event event);
+			static char const * getPhaseName(Phase phase);
+			static char const * getEventName(Event event);
+			/**
+			 * Gets what has been counted so far. Thread-safe.
+			 * */
+			Totals getTotals() const;
+		private:
+			static void begin(PerfCounters & counters, Phase phase);
+			static void end();
+			/**
+			 * Reads this thread's counters, and adds what was counted since the last read to the
+			 * innermost phase it is in
+			 * */
+			static void countSinceLastRead();
+			/**
+			 * Adds counts to the totals of a phase
+			 * */
+			void add(Phase phase, uint64_t const * deltas);
+			static bool enabled;
+			static bool available[NUMBER_OF_EVENTS];
+			std::atomic<uint64_t> counts[NUMBER_OF_PHASES][NUMBER_OF_EVENTS];
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_PERFCOUNTERS_H
@@ -0,0 +1,169 @@
+#include "ProbabilityStateArray.h"
+
+/**
+ * Implementation for ProbabilityStateArray methods
+ * */
+
+namespace stamina {
+	namespace util {
+		template <typename StateType>
+		ProbabilityStateArray<StateType>::ProbabilityStateArray(uint8_t blockSizeExponent)
+			: blockSizeExponent(blockSizeExponent)
+			, blockSize(1ULL << blockSizeExponent)
+			, maxNumberOfBlocks(((static_cast<uint64_t>(static_cast<StateType>(-1))) >> blockSizeExponent) + 1)
+			, blocks(new std::atomic<Block *>[maxNumberOfBlocks])
+			, numElements(0)
+			, numberTerminal(0)
+		{
+			for (uint64_t i = 0; i < maxNumberOfBlocks; i++) {
+				blocks[i].store(nullptr, std::memory_order_relaxed);
+			}
+		}
+
+		template <typename StateType>
+		ProbabilityStateArray<StateType>::~ProbabilityStateArray() {
+			clear();
+		}
+
+		template <typename StateType>
+		void
+		ProbabilityStateArray<StateType>::clear() {
+			for (uint64_t i = 0; i < maxNumberOfBlocks; i++) {
+				Block * block = blocks[i].exchange(nullptr);
+				if (block) { delete block; }
+			}
+			numElements = 0;
+			numberTerminal = 0;
+		}
+
+		template <typename StateType>
+		typename ProbabilityStateArray<StateType>::ProbabilityState
+		ProbabilityStateArray<StateType>::get(StateType index) {
+			Block * block = blocks[index >> blockSizeExponent].load(std::memory_order_acquire);
+			if (block == nullptr) {
+				return ProbabilityState();
+			}
+			// Acquire, so that the data written by emplace() is visible
+			uint64_t word = flagWord(block, EXISTS, index).load(std::memory_order_acquire);
+			if (((word >> (index & 63)) & 1) == 0) {
+				return ProbabilityState();
+			}
+			return ProbabilityState(this, index);
+		}
+
+		template <typename StateType>
+		typename ProbabilityStateArray<StateType>::ProbabilityState
+		ProbabilityStateArray<StateType>::emplace(
+			StateType index
+			, double pi
+			, bool terminal
+			, uint8_t iterationLastSeen
+		) {
+			Block * block = blockFor(index);
+			uint64_t offset = index & (blockSize - 1);
+			block->pi[offset] = pi;
+			block->iterationLastSeen[offset] = iterationLastSeen;
+			setFlag(TERMINAL, index, terminal);
+			setFlag(NEW, index, true);
+			setFlag(ASSIGNED_IN_REMAPPING, index, false);
+			setFlag(PUT_IN_TERMINAL_QUEUE, index, false);
+			uint64_t previous = flagWord(block, EXISTS, index).fetch_or(1ULL << (index & 63), std::memory_order_release);
+			if (((previous >> (index & 63)) & 1) == 0) {
+				numElements++;
+			}
+			return ProbabilityState(this, index);
+		}
+
+		template <typename StateType>
+		bool
+		ProbabilityStateArray<StateType>::contains(StateType index) const {
+			Block * block = blocks[index >> blockSizeExponent].load(std::memory_order_acquire);
+			return block != nullptr && ((flagWord(block, EXISTS, index).load(std::memory_order_acquire) >> (index & 63)) & 1);
+		}
+
+		template <typename StateType>
+		uint64_t
+		ProbabilityStateArray<StateType>::size() const {
+			return numElements;
+		}
+
+		template <typename StateType>
+		uint64_t
+		ProbabilityStateArray<StateType>::getSizeInBytes() const {
+			uint64_t bytesPerBlock = sizeof(Block)
+				+ blockSize * (sizeof(double) + sizeof(uint8_t))
+				+ ((blockSize >> 6) * NUMBER_OF_FLAGS + summaryWordsFor(blockSize)) * sizeof(std::atomic<uint64_t>);
+			uint64_t bytes = maxNumberOfBlocks * sizeof(std::atomic<Block *>);
+			for (uint64_t i = 0; i < maxNumberOfBlocks; i++) {
+				if (blocks[i].load(std::memory_order_acquire) != nullptr) {
+					bytes += bytesPerBlock;
+				}
+			}
+			return bytes;
+		}
+
+		template <typename StateType>
+		std::vector<StateType>
+		ProbabilityStateArray<StateType>::getPerimeterStates() {
+			std::vector<StateType> perimeterStates;
+			perimeterStates.reserve(getNumberTerminal());
+			uint64_t summaryWordsPerBlock = summaryWordsFor(blockSize);
+			for (uint64_t blockIndex = 0; blockIndex < maxNumberOfBlocks; blockIndex++) {
+				Block * block = blocks[blockIndex].load(std::memory_order_acquire);
+				if (block == nullptr) {
+					continue;
+				}
+				for (uint64_t summaryWord = 0; summaryWord < summaryWordsPerBlock; summaryWord++) {
+					uint64_t summary = block->terminalSummary[summaryWord].load(std::memory_order_relaxed);
+					while (summary != 0) {
+						uint64_t word = (summaryWord << 6) + __builtin_ctzll(summary);
+						summary &= summary - 1;
+						// Scan 64 states at a time
+						uint64_t terminal = block->flags[word * NUMBER_OF_FLAGS + TERMINAL].load(std::memory_order_relaxed);
+						if (terminal == 0) {
+							// All of the states in this word have been explored since
+							block->terminalSummary[summaryWord].fetch_and(~(1ULL << (word & 63)), std::memory_order_relaxed);
+							continue;
+						}
+						while (terminal != 0) {
+							uint64_t bit = __builtin_ctzll(terminal);
+							perimeterStates.push_back(static_cast<StateType>((blockIndex << blockSizeExponent) + (word << 6) + bit));
+							terminal &= terminal - 1;
+						}
+					}
+				}
+			}
+			return perimeterStates;
+		}
+
+		template <typename StateType>
+		typename ProbabilityStateArray<StateType>::Block *
+		ProbabilityStateArray<StateType>::blockFor(StateType index) {
+			uint64_t blockIndex = index >> blockSizeExponent;
+			Block * block = blocks[blockIndex].load(std::memory_order_acquire);
+			if (block != nullptr) {
+				return block;
+			}
+			std::lock_guard<std::mutex> guard(blockLock);
+			block = blocks[blockIndex].load(std::memory_order_relaxed);
+			if (block == nullptr) {
+				block = new Block();
+				block->pi.reset(new double[blockSize]());
+				block->iterationLastSeen.reset(new uint8_t[blockSize]());
+				block->flags.reset(new std::atomic<uint64_t>[(blockSize >> 6) * NUMBER_OF_FLAGS]);
+				for (uint64_t i = 0; i < (blockSize >> 6) * NUMBER_OF_FLAGS; i++) {
+					block->flags[i].store(0, std::memory_order_relaxed);
+				}
+				block->terminalSummary.reset(new std::atomic<uint64_t>[summaryWordsFor(blockSize)]);
+				for (uint64_t i = 0; i < summaryWordsFor(blockSize); i++) {
+					block->terminalSummary[i].store(0, std::memory_order_relaxed);
+				}
+				blocks[blockIndex].store(block, std::memory_order_release);
+			}
+			return block;
+		}
+
+		// Forward declare
+		template class ProbabilityStateArray<uint32_t>;
+	}
+}
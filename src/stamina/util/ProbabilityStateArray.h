@@ -0,0 +1,195 @@
+#ifndef STAMINA_UTIL_PROBABILITYSTATEARRAY_H
+#define STAMINA_UTIL_PROBABILITYSTATEARRAY_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Per-state exploration data (reachability and flags), stored as a structure of arrays indexed
+ * directly by state ID. Since state IDs are dense, there is no lookup and no pointer per state: pi is
+ * a dense array of doubles, the last iteration a state was seen is a byte array, and each flag is a
+ * bitset. That is under 10 bytes per state.
+ *
+ * The arrays are split into blocks which never move once allocated, so that the iterative builder's
+ * workers can use a state while another worker creates new ones. Flags are updated atomically since
+ * the flags of up to 64 states share a word; pi and the iteration are guarded by the caller (the
+ * per-state mutexes in ModelBuilderMutex).
+ *
+ * States are used through ProbabilityState, which is a handle (this array and a state ID) with the
+ * same interface as the pooled object it replaces.
+ *
+ * The perimeter (the set of terminal states) is maintained as the terminal flags change: a counter
+ * gives the number of terminal states in O(1), and each block has a summary bitset of which of its
+ * terminal flag words may be non-zero, so listing the perimeter skips the words without any terminal
+ * states rather than scanning every state.
+ * */
+namespace stamina {
+	namespace util {
+		template <typename StateType>
+		class ProbabilityStateArray {
+		public:
+			/* Flags kept for each state */
+			enum Flag : uint8_t {
+				EXISTS = 0
+				, TERMINAL
+				, NEW
+				, ASSIGNED_IN_REMAPPING
+				, PUT_IN_TERMINAL_QUEUE
+				, NUMBER_OF_FLAGS
+			};
+			/**
+			 * Handle to the data of a single state. Default constructed handles (and those returned by
+			 * get() for states without data) are false.
+			 * */
+			class ProbabilityState {
+			public:
+				ProbabilityState() : index(0), array(nullptr) { /* Intentionally left empty */ }
+				ProbabilityState(ProbabilityStateArray * array, StateType index) : index(index), array(array) {
+					// Intentionally left empty
+				}
+				explicit operator bool() const { return array != nullptr; }
+				double getPi() const { return array->piFor(index); }
+				void addToPi(double add) { array->piFor(index) += add; }
+				void setPi(double pi) { array->piFor(index) = pi; }
+				bool isTerminal() const { return array->getFlag(TERMINAL, index); }
+				void setTerminal(bool terminal) { array->setFlag(TERMINAL, index, terminal); }
+				bool isNew() const { return array->getFlag(NEW, index); }
+				void setNew(bool isNew) { array->setFlag(NEW, index, isNew); }
+				bool isAssignedInRemapping() const { return array->getFlag(ASSIGNED_IN_REMAPPING, index); }
+				void setAssignedInRemapping(bool assigned) { array->setFlag(ASSIGNED_IN_REMAPPING, index, assigned); }
+				bool wasPutInTerminalQueue() const { return array->getFlag(PUT_IN_TERMINAL_QUEUE, index); }
+				void setPutInTerminalQueue(bool put) { array->setFlag(PUT_IN_TERMINAL_QUEUE, index, put); }
+				uint8_t getIterationLastSeen() const { return array->iterationFor(index); }
+				void setIterationLastSeen(uint8_t iteration) { array->iterationFor(index) = iteration; }
+				inline bool operator==(const ProbabilityState & rhs) const {
+					return index == rhs.index;
+				}
+				StateType index;
+			private:
+				ProbabilityStateArray * array;
+			};
+			/**
+			 * Constructor
+			 *
+			 * @param blockSizeExponent Exponent on 2 of the number of states in each block
+			 * */
+			ProbabilityStateArray(uint8_t blockSizeExponent = 16); // 2 ^ 16
+			~ProbabilityStateArray();
+			/**
+			 * Clears all states and frees all memory
+			 * */
+			void clear();
+			/**
+			 * Gets the handle of a state. If the state has no data, the handle is false.
+			 *
+			 * @param index The state ID
+			 * @return The handle
+			 * */
+			ProbabilityState get(StateType index);
+			/**
+			 * Creates the data for a state (which is new, and has not been put in the terminal queue)
+			 *
+			 * @param index The state ID
+			 * @param pi The initial reachability
+			 * @param terminal Whether the state is on the perimeter
+			 * @param iterationLastSeen The iteration it is created in
+			 * @return The handle
+			 * */
+			ProbabilityState emplace(StateType index, double pi, bool terminal, uint8_t iterationLastSeen);
+			/**
+			 * Whether or not a state has data
+			 * */
+			bool contains(StateType index) const;
+			/**
+			 * The number of states with data
+			 * */
+			uint64_t size() const;
+			/**
+			 * The bytes used by the blocks which have been allocated, and the table of blocks
+			 * */
+			uint64_t getSizeInBytes() const;
+			/**
+			 * Gets a vector of all of the terminal states, in order of state ID. Must not be called while
+			 * other threads are changing terminal flags.
+			 *
+			 * @return A vector of all perimeter states
+			 * */
+			std::vector<StateType> getPerimeterStates();
+			/**
+			 * Gets the number of terminal states
+			 * */
+			uint64_t getNumberTerminal() const { return numberTerminal.load(std::memory_order_relaxed); }
+		private:
+			/* A block of states. The flag words of each group of 64 states are next to each other. */
+			struct Block {
+				std::unique_ptr<double[]> pi;
+				std::unique_ptr<uint8_t[]> iterationLastSeen;
+				std::unique_ptr<std::atomic<uint64_t>[]> flags;
+				// One bit for each TERMINAL flag word, which is set when the word becomes non-zero. It is
+				// only cleared (lazily) by getPerimeterStates()
+				std::unique_ptr<std::atomic<uint64_t>[]> terminalSummary;
+			};
+			/**
+			 * The number of summary words for a block of a certain size (one bit per flag word)
+			 * */
+			static uint64_t summaryWordsFor(uint64_t blockSize) { return ((blockSize >> 6) + 63) >> 6; }
+			/**
+			 * Gets the block which holds a state, allocating it if needed
+			 * */
+			Block * blockFor(StateType index);
+			double & piFor(StateType index) {
+				return blocks[index >> blockSizeExponent].load(std::memory_order_acquire)->pi[index & (blockSize - 1)];
+			}
+			uint8_t & iterationFor(StateType index) {
+				return blocks[index >> blockSizeExponent].load(std::memory_order_acquire)->iterationLastSeen[index & (blockSize - 1)];
+			}
+			std::atomic<uint64_t> & flagWord(Block * block, Flag flag, StateType index) const {
+				return block->flags[((index & (blockSize - 1)) >> 6) * NUMBER_OF_FLAGS + flag];
+			}
+			bool getFlag(Flag flag, StateType index) const {
+				Block * block = blocks[index >> blockSizeExponent].load(std::memory_order_acquire);
+				return (flagWord(block, flag, index).load(std::memory_order_relaxed) >> (index & 63)) & 1;
+			}
+			void setFlag(Flag flag, StateType index, bool value) {
+				Block * block = blocks[index >> blockSizeExponent].load(std::memory_order_acquire);
+				uint64_t mask = 1ULL << (index & 63);
+				uint64_t previous;
+				if (value) {
+					previous = flagWord(block, flag, index).fetch_or(mask, std::memory_order_relaxed);
+				}
+				else {
+					previous = flagWord(block, flag, index).fetch_and(~mask, std::memory_order_relaxed);
+				}
+				if (flag == TERMINAL && ((previous & mask) != 0) != value) {
+					updatePerimeter(block, index, value);
+				}
+			}
+			/**
+			 * Keeps the terminal count and summary up to date when a terminal flag flips
+			 * */
+			void updatePerimeter(Block * block, StateType index, bool terminal) {
+				if (terminal) {
+					numberTerminal.fetch_add(1, std::memory_order_relaxed);
+					uint64_t word = (index & (blockSize - 1)) >> 6;
+					block->terminalSummary[word >> 6].fetch_or(1ULL << (word & 63), std::memory_order_relaxed);
+				}
+				else {
+					numberTerminal.fetch_sub(1, std::memory_order_relaxed);
+				}
+			}
+			/* Data Members */
+			const uint8_t blockSizeExponent;
+			const uint64_t blockSize;
+			const uint64_t maxNumberOfBlocks;
+			std::unique_ptr<std::atomic<Block *>[]> blocks;
+			std::mutex blockLock;
+			std::atomic<uint64_t> numElements;
+			std::atomic<uint64_t> numberTerminal;
+		};
+	}
+}
+
+#endif // STAMINA_UTIL_PROBABILITYSTATEARRAY_H
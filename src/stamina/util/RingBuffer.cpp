@@ -0,0 +1,58 @@
+#include "RingBuffer.h"
+
+/**
+ * Implementation for RingBuffer methods
+ * */
+
+namespace stamina {
+	namespace util {
+		template <typename T>
+		RingBuffer<T>::RingBuffer(uint8_t capacityExponent)
+			: items(new T[1ULL << capacityExponent])
+			, capacity(1ULL << capacityExponent)
+			, head(0)
+			, count(0)
+		{
+			// Intentionally left empty
+		}
+
+		template <typename T>
+		void
+		RingBuffer<T>::push_back(T item) {
+			if (count == capacity) {
+				grow();
+			}
+			items[(head + count) & (capacity - 1)] = item;
+			count++;
+		}
+
+		template <typename T>
+		void
+		RingBuffer<T>::pop_front() {
+			head = (head + 1) & (capacity - 1);
+			count--;
+		}
+
+		template <typename T>
+		void
+		RingBuffer<T>::clear() {
+			head = 0;
+			count = 0;
+		}
+
+		template <typename T>
+		void
+		RingBuffer<T>::grow() {
+			std::unique_ptr<T[]> newItems(new T[capacity * 2]);
+			for (uint64_t i = 0; i < count; i++) {
+				newItems[i] = items[(head + i) & (capacity - 1)];
+			}
+			items = std::move(newItems);
+			capacity *= 2;
+			head = 0;
+		}
+
+		// Forward declare
+		template class RingBuffer<uint32_t>;
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef STAMINA_UTIL_RINGBUFFER_H
+#define STAMINA_UTIL_RINGBUFFER_H
+
+#include <cstdint>
+#include <memory>
+
+/**
+ * FIFO queue in a single growable array, used for the frontier of state IDs.
+ *
+ * Unlike std::deque, a push or pop never allocates unless the buffer is full (in which case its
+ * capacity is doubled), and the elements are kept in one contiguous array. The capacity is always a
+ * power of 2 so that wrapping around is a mask rather than a modulo.
+ * */
+namespace stamina {
+	namespace util {
+		template <typename T>
+		class RingBuffer {
+		public:
+			/**
+			 * Constructor
+			 *
+			 * @param capacityExponent Exponent on 2 of the initial capacity
+			 * */
+			RingBuffer(uint8_t capacityExponent = 10); // 2 ^ 10
+			/**
+			 * Adds an item to the back
+			 * */
+			void push_back(T item);
+			/**
+			 * The item at the front
+			 * */
+			T front() const { return items[head]; }
+			/**
+			 * Removes the item at the front
+			 * */
+			void pop_front();
+			/**
+			 * The item a certain number of places from the front
+			 * */
+			T operator[](uint64_t position) const { return items[(head + position) & (capacity - 1)]; }
+			bool empty() const { return count == 0; }
+			uint64_t size() const { return count; }
+			/**
+			 * The bytes used by the items (including the unused part of the array)
+			 * */
+			uint64_t getSizeInBytes() const { return capacity * sizeof(T); }
+			/**
+			 * Removes all items, keeping the memory
+			 * */
+			void clear();
+		private:
+			/**
+			 * Doubles the capacity, moving the items to the start of the new array
+			 * */
+			void grow();
+			std::unique_ptr<T[]> items;
+			uint64_t capacity;
+			uint64_t head;
+			uint64_t count;
+		};
+	}
+}
+
+#endif // STAMINA_UTIL_RINGBUFFER_H
@@ -0,0 +1,159 @@
+#include "SpillFile.h"
+#include "../StaminaMessages.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ * Implementation for SpillFile methods
+ * */
+
+namespace stamina {
+	namespace util {
+		/**
+		 * Rounds a size up to a whole number of pages
+		 * */
+		static uint64_t
+		roundToPages(uint64_t bytes) {
+			uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+			return (bytes + pageSize - 1) / pageSize * pageSize;
+		}
+
+		void
+		SpillFile::configure(uint64_t ramBudget, std::string const & directory) {
+			std::lock_guard<std::mutex> guard(spillLock);
+			SpillFile::ramBudget = ramBudget;
+			SpillFile::directory = directory;
+		}
+
+		void
+		SpillFile::spillFromNowOn() {
+			std::lock_guard<std::mutex> guard(spillLock);
+			// A budget of 0 would mean never spilling
+			uint64_t budget = residentBytes > 0 ? residentBytes : 1;
+			if (ramBudget == 0 || budget < ramBudget) {
+				ramBudget = budget;
+			}
+		}
+
+		void *
+		SpillFile::allocate(uint64_t bytes) {
+			std::lock_guard<std::mutex> guard(spillLock);
+			if (ramBudget == 0 || residentBytes + bytes <= ramBudget) {
+				void * address = std::calloc(1, bytes);
+				if (address == nullptr) {
+					StaminaMessages::errorAndExit("Out of memory allocating a block of " + std::to_string(bytes) + " bytes!", STAMINA_ERRORS::ERR_MEMORY_EXCEEDED);
+				}
+				residentBytes += bytes;
+				return address;
+			}
+			if (fileDescriptor < 0) {
+				open();
+			}
+			return map(bytes);
+		}
+
+		void
+		SpillFile::free(void * address, uint64_t bytes) {
+			if (address == nullptr) {
+				return;
+			}
+			if (!isSpilled(address)) {
+				std::free(address);
+				std::lock_guard<std::mutex> guard(spillLock);
+				residentBytes -= bytes;
+				return;
+			}
+			std::lock_guard<std::mutex> guard(spillLock);
+			uint64_t size = roundToPages(bytes);
+			uint64_t offset = static_cast<char *>(address) - reserved.load();
+			// Put the reservation back over the block, and give its disk space back
+			mmap(address, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+			fallocate(fileDescriptor, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, size);
+			freeRanges.emplace(size, offset);
+			spilledBytes -= size;
+		}
+
+		bool
+		SpillFile::isSpilled(void const * address) {
+			char const * byte = static_cast<char const *>(address);
+			char const * start = reserved.load();
+			return start != nullptr && byte >= start && byte < start + RESERVED_BYTES;
+		}
+
+		void
+		SpillFile::releasePages(void * address, uint64_t bytes) {
+			if (!isSpilled(address)) {
+				return;
+			}
+			// Unlike MADV_PAGEOUT, this does not force the pages out of the page cache, so reading them
+			// again is a minor fault unless the kernel has needed the memory since
+			madvise(address, roundToPages(bytes), MADV_DONTNEED);
+		}
+
+		uint64_t
+		SpillFile::getResidentBytes() {
+			std::lock_guard<std::mutex> guard(spillLock);
+			return residentBytes;
+		}
+
+		uint64_t
+		SpillFile::getSpilledBytes() {
+			std::lock_guard<std::mutex> guard(spillLock);
+			return spilledBytes;
+		}
+
+		void
+		SpillFile::open() {
+			std::string path = directory + "/stamina-spill-XXXXXX";
+			std::vector<char> pathBuffer(path.begin(), path.end());
+			pathBuffer.push_back('\0');
+			fileDescriptor = mkstemp(pathBuffer.data());
+			if (fileDescriptor < 0) {
+				StaminaMessages::errorAndExit("Could not create scratch file in " + directory + ": " + std::strerror(errno), STAMINA_ERRORS::ERR_MEMORY_EXCEEDED);
+			}
+			// The file is deleted as soon as it is closed (including when the process dies)
+			unlink(pathBuffer.data());
+			void * range = mmap(nullptr, RESERVED_BYTES, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if (range == MAP_FAILED) {
+				StaminaMessages::errorAndExit("Could not reserve address space for the scratch file: " + std::string(std::strerror(errno)), STAMINA_ERRORS::ERR_MEMORY_EXCEEDED);
+			}
+			reserved = static_cast<char *>(range);
+			StaminaMessages::info("RAM budget of " + std::to_string(ramBudget >> 20) + " MB reached. Spilling to a scratch file in " + directory);
+		}
+
+		void *
+		SpillFile::map(uint64_t bytes) {
+			uint64_t size = roundToPages(bytes);
+			uint64_t offset;
+			auto range = freeRanges.find(size);
+			if (range != freeRanges.end()) {
+				// Holes are punched when blocks are freed, so this is already zeroed
+				offset = range->second;
+				freeRanges.erase(range);
+			}
+			else {
+				if (fileEnd + size > RESERVED_BYTES) {
+					StaminaMessages::errorAndExit("Scratch file is full!", STAMINA_ERRORS::ERR_MEMORY_EXCEEDED);
+				}
+				offset = fileEnd;
+				fileEnd += size;
+				if (ftruncate(fileDescriptor, fileEnd) != 0) {
+					StaminaMessages::errorAndExit("Could not grow scratch file: " + std::string(std::strerror(errno)), STAMINA_ERRORS::ERR_MEMORY_EXCEEDED);
+				}
+			}
+			void * address = mmap(reserved.load() + offset, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fileDescriptor, offset);
+			if (address == MAP_FAILED) {
+				StaminaMessages::errorAndExit("Could not map scratch file: " + std::string(std::strerror(errno)), STAMINA_ERRORS::ERR_MEMORY_EXCEEDED);
+			}
+			spilledBytes += size;
+			return address;
+		}
+	} // namespace util
+} // namespace stamina
@@ -0,0 +1,102 @@
+#ifndef STAMINA_UTIL_SPILLFILE_H
+#define STAMINA_UTIL_SPILLFILE_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * Source of the large blocks used by StateMemoryPool and the state arena in ConcurrentStateStorage.
+ *
+ * Blocks come from RAM until the RAM budget is used up. After that, they are mapped from a scratch
+ * file, so the kernel can write them back to disk rather than the process being OOM-killed. The
+ * scratch file is unlinked as soon as it is created, so it goes away with the process.
+ *
+ * All of the spilled blocks live in a single reserved range of virtual memory, which is how free()
+ * tells the two kinds of block apart. Spilled blocks which are no longer written can be dropped from
+ * the process's resident set with releasePages(). Their contents stay in the scratch file (and, until
+ * the kernel needs the memory, in the page cache), so the pages which are read again later are mapped
+ * back in one at a time rather than being read back from disk all at once.
+ *
+ * All methods are thread-safe.
+ * */
+namespace stamina {
+	namespace util {
+		class SpillFile {
+		public:
+			/**
+			 * Sets up spilling. Must be called before any blocks are allocated.
+			 *
+			 * @param ramBudget The number of bytes of blocks to keep in RAM. 0 means never spill.
+			 * @param directory The directory to create the scratch file in
+			 * */
+			static void configure(uint64_t ramBudget, std::string const & directory);
+			/**
+			 * Lowers the RAM budget to what is already in RAM, so that every block allocated from now on
+			 * is spilled (e.g., because the memory cap is close)
+			 * */
+			static void spillFromNowOn();
+			/**
+			 * Allocates a zeroed block
+			 *
+			 * @param bytes The size of the block
+			 * @return The block
+			 * */
+			static void * allocate(uint64_t bytes);
+			/**
+			 * Frees a block returned by allocate()
+			 *
+			 * @param address The block
+			 * @param bytes The size passed to allocate()
+			 * */
+			static void free(void * address, uint64_t bytes);
+			/**
+			 * Whether or not a block was mapped from the scratch file
+			 * */
+			static bool isSpilled(void const * address);
+			/**
+			 * Drops the pages of a spilled block from the resident set (with MADV_DONTNEED). Nothing is
+			 * lost, since the block is a shared mapping of the scratch file, and pages are mapped back in
+			 * when they are next used. Does nothing for blocks in RAM.
+			 *
+			 * @param address The block
+			 * @param bytes The size passed to allocate()
+			 * */
+			static void releasePages(void * address, uint64_t bytes);
+			/**
+			 * The number of bytes of blocks in RAM
+			 * */
+			static uint64_t getResidentBytes();
+			/**
+			 * The number of bytes of blocks in the scratch file
+			 * */
+			static uint64_t getSpilledBytes();
+		private:
+			/**
+			 * Creates the scratch file and reserves the address range. spillLock must be held.
+			 * */
+			static void open();
+			/**
+			 * Maps part of the scratch file. spillLock must be held.
+			 * */
+			static void * map(uint64_t bytes);
+			// 1 TiB of address space for spilled blocks
+			static const uint64_t RESERVED_BYTES = 1ULL << 40;
+			inline static std::mutex spillLock;
+			inline static uint64_t ramBudget = 0;
+			inline static std::string directory = "/tmp";
+			inline static uint64_t residentBytes = 0;
+			inline static uint64_t spilledBytes = 0;
+			inline static int fileDescriptor = -1;
+			inline static std::atomic<char *> reserved{nullptr};
+			// End of the used part of the scratch file
+			inline static uint64_t fileEnd = 0;
+			// Freed ranges of the scratch file (size to offsets)
+			inline static std::multimap<uint64_t, uint64_t> freeRanges;
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_SPILLFILE_H
@@ -1,6 +1,11 @@
 #include "StateMemoryPool.h"
-#include "../builder/StaminaModelBuilder.h"
-#include "../StaminaMessages.h"
+#include "SpillFile.h"
+#include "TransitionStore.h"
+
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <utility>
 
 /**
  * Implementation for StaminaMemoryPool methods
@@ -12,54 +17,189 @@ namespace stamina {
 	namespace util {
 		template <typename T>
 		StateMemoryPool<T>::StateMemoryPool(uint8_t blockSize)
-			: blockSize(2 << blockSize)
+			: blockSize(1ULL << blockSize)
+			, currentBlock(nullptr)
 			, usedThisBlock(0)
 		{
-			// Create the first block
-			blocks.push_back(new T[this->blockSize]);
+			// Intentionally left empty
 		}
 
 		template <typename T>
 		StateMemoryPool<T>::~StateMemoryPool() {
-			// TODO: We get an error in freeAll()
-			// There would be a memory leak but this lasts until the end of program execution
-			// freeAll();
+			freeAll();
 		}
 
 		template <typename T>
 		void
 		StateMemoryPool<T>::freeAll() {
-			for (T * block : blocks) {
-				if (block) { delete block; }
+			for (Block & block : blocks) {
+				releaseBlock(block);
 			}
+			blocks.clear();
+			freeLists.clear();
+			currentBlock = nullptr;
+			usedThisBlock = 0;
 		}
 
 		template <typename T>
 		T *
 		StateMemoryPool<T>::allocate(uint32_t number) {
-			if (number > blockSize - usedThisBlock) {
-				// TODO: be smarter about this
-				StaminaMessages::error("Cannot allocate array of this size on current block!");
-				return nullptr;
+			uint8_t size = sizeClass(std::max(number, 1u));
+			uint64_t runSize = 1ULL << size;
+			// Reuse freed memory of this size class, or split a larger one
+			for (uint8_t larger = size; larger < freeLists.size(); larger++) {
+				if (freeLists[larger].empty()) {
+					continue;
+				}
+				T * address = freeLists[larger].back();
+				freeLists[larger].pop_back();
+				addFreeRun(address + runSize, (1ULL << larger) - runSize);
+				return address;
+			}
+			// Arrays larger than a block get their own
+			if (runSize > blockSize) {
+				return createBlock(runSize);
 			}
-			// We have enough memory in the current block to offer
-			T * addressToReturn = blocks[blocks.size() - 1] + usedThisBlock;
-			usedThisBlock += number;
-			// Create new block if necessary
-			if (usedThisBlock == blockSize) {
-				blocks.push_back(new T[blockSize]);
+			if (currentBlock == nullptr || runSize > blockSize - usedThisBlock) {
+				// Keep what is left of the current block for smaller allocations
+				if (currentBlock != nullptr) {
+					addFreeRun(currentBlock + usedThisBlock, blockSize - usedThisBlock);
+				}
+				currentBlock = createBlock(blockSize);
 				usedThisBlock = 0;
 			}
+			T * addressToReturn = currentBlock + usedThisBlock;
+			usedThisBlock += runSize;
 			return addressToReturn;
 		}
 
+		template <typename T>
+		void
+		StateMemoryPool<T>::free(T * address, uint32_t number) {
+			if (address == nullptr) {
+				return;
+			}
+			uint8_t size = sizeClass(std::max(number, 1u));
+			if (freeLists.size() <= size) {
+				freeLists.resize(size + 1);
+			}
+			freeLists[size].push_back(address);
+		}
+
+		template <typename T>
+		void
+		StateMemoryPool<T>::defrag() {
+			std::less<T *> before;
+			std::vector<std::pair<T *, uint64_t>> runs;
+			for (uint8_t size = 0; size < freeLists.size(); size++) {
+				for (T * address : freeLists[size]) {
+					runs.emplace_back(address, 1ULL << size);
+				}
+			}
+			freeLists.clear();
+			// The unused end of the current block is free too
+			if (currentBlock != nullptr && usedThisBlock < blockSize) {
+				runs.emplace_back(currentBlock + usedThisBlock, blockSize - usedThisBlock);
+			}
+			std::sort(runs.begin(), runs.end(), [&before](auto const & first, auto const & second) {
+				return before(first.first, second.first);
+			});
+			std::sort(blocks.begin(), blocks.end(), [&before](Block const & first, Block const & second) {
+				return before(first.data, second.data);
+			});
+			std::vector<Block> keptBlocks;
+			auto run = runs.begin();
+			for (Block & block : blocks) {
+				T * blockEnd = block.data + block.size;
+				// Merge the neighbouring free runs in this block
+				std::vector<std::pair<T *, uint64_t>> merged;
+				for (; run != runs.end() && before(run->first, blockEnd); ++run) {
+					if (!merged.empty() && merged.back().first + merged.back().second == run->first) {
+						merged.back().second += run->second;
+					}
+					else {
+						merged.push_back(*run);
+					}
+				}
+				bool isCurrent = block.data == currentBlock;
+				if (merged.size() == 1 && merged.front().first == block.data && merged.front().second == block.size) {
+					// Nothing in this block is allocated
+					releaseBlock(block);
+					if (isCurrent) {
+						currentBlock = nullptr;
+						usedThisBlock = 0;
+					}
+					continue;
+				}
+				keptBlocks.push_back(block);
+				for (auto const & freeRun : merged) {
+					if (isCurrent && freeRun.first + freeRun.second == blockEnd) {
+						// Give the end of the current block back to the bump allocator
+						usedThisBlock = freeRun.first - block.data;
+					}
+					else {
+						addFreeRun(freeRun.first, freeRun.second);
+					}
+				}
+			}
+			blocks = std::move(keptBlocks);
+		}
+
+		template <typename T>
+		uint64_t
+		StateMemoryPool<T>::getCapacity() const {
+			uint64_t capacity = 0;
+			for (Block const & block : blocks) {
+				capacity += block.size;
+			}
+			return capacity;
+		}
+
+		template <typename T>
+		uint8_t
+		StateMemoryPool<T>::sizeClass(uint64_t number) {
+			uint8_t size = 0;
+			while ((1ULL << size) < number) {
+				size++;
+			}
+			return size;
+		}
+
+		template <typename T>
+		void
+		StateMemoryPool<T>::addFreeRun(T * address, uint64_t number) {
+			while (number > 0) {
+				uint8_t size = 63 - __builtin_clzll(number);
+				if (freeLists.size() <= size) {
+					freeLists.resize(size + 1);
+				}
+				freeLists[size].push_back(address);
+				address += 1ULL << size;
+				number -= 1ULL << size;
+			}
+		}
+
+		template <typename T>
+		T *
+		StateMemoryPool<T>::createBlock(uint64_t size) {
+			T * data = static_cast<T *>(SpillFile::allocate(size * sizeof(T)));
+			for (uint64_t i = 0; i < size; i++) {
+				new (data + i) T();
+			}
+			blocks.push_back({data, size});
+			return data;
+		}
+
+		template <typename T>
+		void
+		StateMemoryPool<T>::releaseBlock(Block & block) {
+			for (uint64_t i = 0; i < block.size; i++) {
+				block.data[i].~T();
+			}
+			SpillFile::free(block.data, block.size * sizeof(T));
+		}
+
 		// Forward declare
-		template class StateMemoryPool<
-			builder::StaminaModelBuilder<
-				double
-				, storm::models::sparse::StandardRewardModel<double>
-				, uint32_t
-			>::ProbabilityState
-		>;
+		template class StateMemoryPool<TransitionStore<double, uint32_t>::Segment>;
 	}
 }
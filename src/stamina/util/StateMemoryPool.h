@@ -1,8 +1,6 @@
 #ifndef STATEMEMORYPOOL_H
 #define STATEMEMORYPOOL_H
 
-// #include <deque>
-// #include <ordered_set>
 #include <cstdint>
 #include <vector>
 
@@ -14,14 +12,17 @@
  * very slow. This allocates a pool of larger blocks to reduce the number of system-calls (since each
  * call to malloc() -- invoked by new -- is a system call to ask for more memory)
  *
- * This memory pool makes a few assumptions to increase performance:
- *	1. All states are assumed to be in memory from allocation-time until the program. The STAMINA memory
- *	pool allows for dynamic deletion, but defragmentation must be explicitly invoked using the defrag()
- *	method and is not automatically called.
- *	2. For now, defrag() has not been implemented, requiring
+ * Allocations are rounded up to a size class (a power of 2 number of elements). Memory given back with
+ * free() goes on the free list for its size class and is handed out again by allocate(). The pool
+ * makes a few assumptions to increase performance:
+ *	1. The caller knows how many elements it allocated, and passes that number to free().
+ *	2. Memory is reused as is: no constructors or destructors are run on allocate() or free().
+ *	3. Free lists are not merged automatically. defrag() must be explicitly invoked (for example,
+ *	between refinement iterations) to merge neighbouring free memory and release blocks which are
+ *	entirely free.
  *
- * Future work:
- * 	1. Offload excess memory to a swapfile which is deleted on StateMemoryPool destruction
+ * Blocks come from SpillFile, so once the RAM budget is used up they are mapped from a scratch file
+ * rather than allocated with new.
  *
  *
  * This file created by Josh Jeppson on May 27, 2022
@@ -32,33 +33,70 @@ namespace stamina {
 		class StateMemoryPool {
 		public:
 			/**
-			 * Constructor. Creates the first block of the pool
+			 * Constructor. Blocks are created as they are needed.
 			 *
-			 * @param blockSize Exponent on 2 of
+			 * @param blockSize Exponent on 2 of the number of elements in each block
 			 * */
-			StateMemoryPool(uint8_t blockSize = 13); // 2 ^ 12
+			StateMemoryPool(uint8_t blockSize = 13); // 2 ^ 13
 			/**
 			 * Destructor. Frees all of the memory allocated by the memory pool
 			 * */
 			~StateMemoryPool();
 			/**
-			 * Allocates a T value and returns a pointer to it
+			 * Allocates a contiguous array of T values and returns a pointer to it. Arrays which are larger
+			 * than a block get a block of their own.
+			 *
+			 * @param number The number of elements
 			 * */
 			T * allocate(uint32_t number = 1);
 			/**
-			 * Clears all memory
+			 * Gives memory back to the pool so that it can be reused
+			 *
+			 * @param address The address returned by allocate()
+			 * @param number The number of elements passed to allocate()
+			 * */
+			void free(T * address, uint32_t number = 1);
+			/**
+			 * Merges neighbouring free memory into larger size classes, and releases every block in which
+			 * nothing is allocated. Nothing which is still allocated is moved.
+			 * */
+			void defrag();
+			/**
+			 * Clears all memory. All addresses returned by allocate() become invalid.
 			 * */
 			void freeAll();
-			// Methods that will be implemented when defragmentation is added
-			// void free(T * address); // knows the number used
-			// void defrag();
+			/**
+			 * The number of elements held in blocks (allocated or free)
+			 * */
+			uint64_t getCapacity() const;
 		private:
-			const uint32_t blockSize;
-			uint32_t usedThisBlock;
-			std::vector<T *> blocks;
-			// Will be used when defragmentation is implemented
-			// std::deque<std::pair<T*, uint32_t>> deletedBlocks; // Blocks which have been deleted
-			// std::ordered_set<std::pair<T*, uint32_t>> nonSingleBlocks; // Blocks of arrays
+			struct Block {
+				T * data;
+				uint64_t size;
+			};
+			/**
+			 * The size class which fits a number of elements (exponent on 2)
+			 * */
+			static uint8_t sizeClass(uint64_t number);
+			/**
+			 * Puts a run of free elements on the free lists, split into the largest size classes possible
+			 * */
+			void addFreeRun(T * address, uint64_t number);
+			/**
+			 * Creates a block and returns its memory
+			 * */
+			T * createBlock(uint64_t size);
+			/**
+			 * Gives the memory of a block back to SpillFile
+			 * */
+			void releaseBlock(Block & block);
+			const uint64_t blockSize;
+			// The block which small allocations are cut from
+			T * currentBlock;
+			uint64_t usedThisBlock;
+			std::vector<Block> blocks;
+			// Free memory, by size class
+			std::vector<std::vector<T *>> freeLists;
 		};
 	}
 }
@@ -0,0 +1,260 @@
+#include "StatePredicate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// Deepest stack a predicate can use (expressions are rarely more than a few levels deep)
+#define MAX_STACK_DEPTH 64
+
+/**
+ * Implementation for StatePredicate methods
+ * */
+
+namespace stamina {
+	namespace util {
+		StatePredicate::StatePredicate(
+			storm::expressions::Expression const & expression
+			, storm::generator::VariableInformation const & variableInformation
+			, uint64_t bitsPerState
+		) : bitsPerState(bitsPerState)
+			, maxStackDepth(0)
+		{
+			compile(expression, variableInformation);
+			// Work out how deep the stack gets
+			uint64_t depth = 0;
+			for (auto const & instruction : program) {
+				if (instruction.opcode == LOAD || instruction.opcode == CONSTANT) {
+					depth++;
+				}
+				else {
+					depth -= numberOfOperands(instruction.opcode) - 1;
+				}
+				maxStackDepth = std::max(maxStackDepth, depth);
+			}
+			if (maxStackDepth > MAX_STACK_DEPTH) {
+				throw std::runtime_error("Expression is too deeply nested: " + expression.toString());
+			}
+		}
+
+		bool
+		StatePredicate::evaluate(CompressedState const & state) const {
+			double stack[MAX_STACK_DEPTH];
+			uint64_t top = 0;
+			for (auto const & instruction : program) {
+				switch (instruction.opcode) {
+					case LOAD:
+						stack[top++] = instruction.value + static_cast<double>(state.getAsInt(instruction.bitOffset, instruction.bitWidth));
+						break;
+					case CONSTANT:
+						stack[top++] = instruction.value;
+						break;
+					default: {
+						uint8_t operands = numberOfOperands(instruction.opcode);
+						top -= operands;
+						stack[top] = apply(
+							instruction.opcode
+							, stack[top]
+							, operands > 1 ? stack[top + 1] : 0.0
+							, operands > 2 ? stack[top + 2] : 0.0
+						);
+						top++;
+					}
+				}
+			}
+			return stack[0] != 0.0;
+		}
+
+		void
+		StatePredicate::evaluate(uint64_t const * const * states, uint64_t count, uint8_t * results) const {
+			// One column of the stack for each level, with a value for each state
+			std::vector<double> stack(maxStackDepth * count);
+			uint64_t top = 0;
+			for (auto const & instruction : program) {
+				if (instruction.opcode == LOAD) {
+					double * column = stack.data() + top * count;
+					for (uint64_t i = 0; i < count; ++i) {
+						uint64_t value = (states[i][instruction.word] >> instruction.shift) & instruction.mask;
+						if (instruction.lowBits != 0) {
+							value = (value << instruction.lowBits) | (states[i][instruction.word + 1] >> instruction.lowShift);
+						}
+						column[i] = instruction.value + static_cast<double>(value);
+					}
+					top++;
+				}
+				else if (instruction.opcode == CONSTANT) {
+					std::fill(stack.data() + top * count, stack.data() + (top + 1) * count, instruction.value);
+					top++;
+				}
+				else {
+					uint8_t operands = numberOfOperands(instruction.opcode);
+					top -= operands;
+					double * first = stack.data() + top * count;
+					double const * second = operands > 1 ? first + count : first;
+					double const * third = operands > 2 ? first + 2 * count : first;
+					for (uint64_t i = 0; i < count; ++i) {
+						first[i] = apply(instruction.opcode, first[i], second[i], third[i]);
+					}
+					top++;
+				}
+			}
+			for (uint64_t i = 0; i < count; ++i) {
+				results[i] = stack[i] != 0.0;
+			}
+		}
+
+		void
+		StatePredicate::compile(
+			storm::expressions::Expression const & expression
+			, storm::generator::VariableInformation const & variableInformation
+		) {
+			using storm::expressions::OperatorType;
+			if (expression.isLiteral()) {
+				Instruction instruction = {};
+				instruction.opcode = CONSTANT;
+				if (expression.hasBooleanType()) {
+					instruction.value = expression.evaluateAsBool() ? 1.0 : 0.0;
+				}
+				else {
+					instruction.value = expression.evaluateAsDouble();
+				}
+				program.push_back(instruction);
+				return;
+			}
+			if (expression.isVariable()) {
+				std::string name = expression.getIdentifier();
+				for (auto const & booleanVariable : variableInformation.booleanVariables) {
+					if (booleanVariable.variable.getName() == name) {
+						addLoad(booleanVariable.bitOffset, 1, 0.0);
+						return;
+					}
+				}
+				for (auto const & integerVariable : variableInformation.integerVariables) {
+					if (integerVariable.variable.getName() == name) {
+						addLoad(integerVariable.bitOffset, integerVariable.bitWidth, static_cast<double>(integerVariable.lowerBound));
+						return;
+					}
+				}
+				throw std::runtime_error("Variable " + name + " is not part of the state");
+			}
+			if (!expression.isFunctionApplication()) {
+				throw std::runtime_error("Cannot compile expression " + expression.toString());
+			}
+			Opcode opcode;
+			switch (expression.getOperator()) {
+				case OperatorType::And: opcode = AND; break;
+				case OperatorType::Or: opcode = OR; break;
+				case OperatorType::Xor: opcode = XOR; break;
+				case OperatorType::Implies: opcode = IMPLIES; break;
+				case OperatorType::Iff: opcode = IFF; break;
+				case OperatorType::Plus: opcode = PLUS; break;
+				case OperatorType::Minus: opcode = expression.getNumberOfOperands() == 1 ? NEGATE : MINUS; break;
+				case OperatorType::Times: opcode = TIMES; break;
+				case OperatorType::Divide: opcode = DIVIDE; break;
+				case OperatorType::Min: opcode = MIN; break;
+				case OperatorType::Max: opcode = MAX; break;
+				case OperatorType::Power: opcode = POWER; break;
+				case OperatorType::Modulo: opcode = MODULO; break;
+				case OperatorType::Equal: opcode = EQUAL; break;
+				case OperatorType::NotEqual: opcode = NOT_EQUAL; break;
+				case OperatorType::Less: opcode = LESS; break;
+				case OperatorType::LessOrEqual: opcode = LESS_OR_EQUAL; break;
+				case OperatorType::Greater: opcode = GREATER; break;
+				case OperatorType::GreaterOrEqual: opcode = GREATER_OR_EQUAL; break;
+				case OperatorType::Not: opcode = NOT; break;
+				case OperatorType::Floor: opcode = FLOOR; break;
+				case OperatorType::Ceil: opcode = CEIL; break;
+				case OperatorType::Ite: opcode = ITE; break;
+				default:
+					throw std::runtime_error("Cannot compile expression " + expression.toString());
+			}
+			if (expression.getNumberOfOperands() != numberOfOperands(opcode)) {
+				throw std::runtime_error("Cannot compile expression " + expression.toString());
+			}
+			for (uint64_t i = 0; i < expression.getNumberOfOperands(); ++i) {
+				compile(expression.getOperand(i), variableInformation);
+			}
+			Instruction instruction = {};
+			instruction.opcode = opcode;
+			program.push_back(instruction);
+		}
+
+		void
+		StatePredicate::addLoad(uint64_t bitOffset, uint64_t bitWidth, double lowerBound) {
+			Instruction instruction = {};
+			instruction.opcode = LOAD;
+			instruction.value = lowerBound;
+			instruction.bitOffset = bitOffset;
+			instruction.bitWidth = bitWidth;
+			// Packed words hold 64 bits each (most significant first), except the last, which holds the
+			// rest of the bits in its lowest bits
+			auto bitsInWord = [this](uint64_t word) {
+				return std::min<uint64_t>(64, bitsPerState - (word << 6));
+			};
+			uint64_t position = bitOffset & 63;
+			instruction.word = bitOffset >> 6;
+			if (position + bitWidth <= 64) {
+				instruction.shift = bitsInWord(instruction.word) - position - bitWidth;
+				instruction.mask = bitWidth >= 64 ? ~0ULL : ((1ULL << bitWidth) - 1);
+				instruction.lowBits = 0;
+			}
+			else {
+				uint64_t highBits = 64 - position;
+				instruction.shift = 0;
+				instruction.mask = (1ULL << highBits) - 1;
+				instruction.lowBits = bitWidth - highBits;
+				instruction.lowShift = bitsInWord(instruction.word + 1) - instruction.lowBits;
+			}
+			program.push_back(instruction);
+		}
+
+		double
+		StatePredicate::apply(Opcode opcode, double first, double second, double third) {
+			switch (opcode) {
+				case NOT: return first == 0.0;
+				case NEGATE: return -first;
+				case FLOOR: return std::floor(first);
+				case CEIL: return std::ceil(first);
+				case AND: return first != 0.0 && second != 0.0;
+				case OR: return first != 0.0 || second != 0.0;
+				case XOR: return (first != 0.0) != (second != 0.0);
+				case IFF: return (first != 0.0) == (second != 0.0);
+				case IMPLIES: return first == 0.0 || second != 0.0;
+				case PLUS: return first + second;
+				case MINUS: return first - second;
+				case TIMES: return first * second;
+				case DIVIDE: return first / second;
+				case MIN: return std::min(first, second);
+				case MAX: return std::max(first, second);
+				case POWER: return std::pow(first, second);
+				case MODULO: return std::fmod(first, second);
+				case EQUAL: return first == second;
+				case NOT_EQUAL: return first != second;
+				case LESS: return first < second;
+				case LESS_OR_EQUAL: return first <= second;
+				case GREATER: return first > second;
+				case GREATER_OR_EQUAL: return first >= second;
+				case ITE: return first != 0.0 ? second : third;
+				default: return 0.0;
+			}
+		}
+
+		uint8_t
+		StatePredicate::numberOfOperands(Opcode opcode) {
+			switch (opcode) {
+				case LOAD:
+				case CONSTANT:
+					return 0;
+				case NOT:
+				case NEGATE:
+				case FLOOR:
+				case CEIL:
+					return 1;
+				case ITE:
+					return 3;
+				default:
+					return 2;
+			}
+		}
+	} // namespace util
+} // namespace stamina
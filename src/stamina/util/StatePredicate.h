@@ -0,0 +1,123 @@
+#ifndef STAMINA_UTIL_STATEPREDICATE_H
+#define STAMINA_UTIL_STATEPREDICATE_H
+
+#include "../StateSpaceInformation.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "storm/storage/expressions/Expression.h"
+#include "storm/generator/VariableInformation.h"
+
+/**
+ * A boolean expression over the variables of a model (such as the property expression used for
+ * property based refinement), compiled once into a small stack machine.
+ *
+ * Each variable is read straight from its bit offset in the state, so evaluating the predicate does
+ * not need a valuation, or the generator to have the state loaded. Arithmetic is done on doubles
+ * (which hold every integer a PRISM variable can take exactly).
+ *
+ * The batch version evaluates the predicate for many states at once, one instruction at a time over
+ * all of them, which is much cheaper than interpreting the program once per state. It works on
+ * states as they are packed in the arena of ConcurrentStateStorage.
+ * */
+namespace stamina {
+	namespace util {
+		class StatePredicate {
+		public:
+			/**
+			 * Compiles an expression. Throws std::runtime_error if the expression uses a variable which
+			 * is not in the state or an operator which is not supported.
+			 *
+			 * @param expression The (boolean) expression
+			 * @param variableInformation Where each variable is in the state
+			 * @param bitsPerState The number of bits in each state
+			 * */
+			StatePredicate(
+				storm::expressions::Expression const & expression
+				, storm::generator::VariableInformation const & variableInformation
+				, uint64_t bitsPerState
+			);
+			/**
+			 * Evaluates the predicate for a single state
+			 * */
+			bool evaluate(CompressedState const & state) const;
+			/**
+			 * Evaluates the predicate for many states at once
+			 *
+			 * @param states The words of each state (as returned by ConcurrentStateStorage::getWords())
+			 * @param count The number of states
+			 * @param results Set to 1 for each state the predicate holds in, and 0 otherwise
+			 * */
+			void evaluate(uint64_t const * const * states, uint64_t count, uint8_t * results) const;
+		private:
+			enum Opcode : uint8_t {
+				LOAD = 0
+				, CONSTANT
+				, NOT
+				, NEGATE
+				, FLOOR
+				, CEIL
+				, AND
+				, OR
+				, XOR
+				, IFF
+				, IMPLIES
+				, PLUS
+				, MINUS
+				, TIMES
+				, DIVIDE
+				, MIN
+				, MAX
+				, POWER
+				, MODULO
+				, EQUAL
+				, NOT_EQUAL
+				, LESS
+				, LESS_OR_EQUAL
+				, GREATER
+				, GREATER_OR_EQUAL
+				, ITE
+			};
+			struct Instruction {
+				Opcode opcode;
+				// For CONSTANT, the constant. For LOAD, the lower bound of the variable
+				double value;
+				// For LOAD, where the variable is in a CompressedState
+				uint64_t bitOffset;
+				uint64_t bitWidth;
+				// For LOAD, where the variable is in the packed words of a state. Variables which span
+				// two words have their low bits in the next word.
+				uint64_t word;
+				uint64_t shift;
+				uint64_t mask;
+				uint64_t lowBits;
+				uint64_t lowShift;
+			};
+			/**
+			 * Appends the instructions for an expression (operands first)
+			 * */
+			void compile(
+				storm::expressions::Expression const & expression
+				, storm::generator::VariableInformation const & variableInformation
+			);
+			/**
+			 * Appends a LOAD for the variable with a certain bit offset and width
+			 * */
+			void addLoad(uint64_t bitOffset, uint64_t bitWidth, double lowerBound);
+			/**
+			 * Applies an operator (which is not LOAD or CONSTANT) to operands
+			 * */
+			static double apply(Opcode opcode, double first, double second, double third);
+			/**
+			 * The number of operands an operator takes
+			 * */
+			static uint8_t numberOfOperands(Opcode opcode);
+			std::vector<Instruction> program;
+			uint64_t bitsPerState;
+			uint64_t maxStackDepth;
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_STATEPREDICATE_H
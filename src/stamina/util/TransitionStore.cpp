@@ -0,0 +1,207 @@
+#include "TransitionStore.h"
+
+#include <algorithm>
+
+/**
+ * Implementation for TransitionStore methods
+ * */
+
+namespace stamina {
+	namespace util {
+		template <typename ValueType, typename StateType>
+		TransitionStore<ValueType, StateType>::TransitionStore()
+			: numberOfTransitions(0)
+		{
+			// Intentionally left empty
+		}
+
+		template <typename ValueType, typename StateType>
+		void
+		TransitionStore<ValueType, StateType>::addTransition(StateType from, StateType to, ValueType value) {
+			uint64_t neededRows = static_cast<uint64_t>(std::max(from, to)) + 1;
+			if (rowTails.size() < neededRows) {
+				rowTails.resize(neededRows, nullptr);
+				replacesPrevious.resize(neededRows, false);
+			}
+			if (from < placeholderRows.size() && placeholderRows[from]) {
+				// The self-loop was only there because the row was empty
+				placeholderRows[from] = false;
+				replacesPrevious[from] = true;
+			}
+			Segment * tail = rowTails[from];
+			if (tail == nullptr || tail->count == TRANSITION_SEGMENT_SIZE) {
+				Segment * segment = segmentPool.allocate();
+				segment->count = 0;
+				segment->previous = tail;
+				rowTails[from] = segment;
+				tail = segment;
+			}
+			tail->columns[tail->count] = to;
+			tail->values[tail->count] = value;
+			tail->count++;
+			numberOfTransitions++;
+		}
+
+		template <typename ValueType, typename StateType>
+		void
+		TransitionStore<ValueType, StateType>::clearRow(StateType row) {
+			if (rowTails.size() <= row) {
+				rowTails.resize(static_cast<uint64_t>(row) + 1, nullptr);
+				replacesPrevious.resize(static_cast<uint64_t>(row) + 1, false);
+			}
+			releaseRow(row);
+			replacesPrevious[row] = true;
+			if (row < placeholderRows.size()) {
+				placeholderRows[row] = false;
+			}
+		}
+
+		template <typename ValueType, typename StateType>
+		bool
+		TransitionStore<ValueType, StateType>::rowIsEmpty(StateType row) const {
+			return row >= rowTails.size() || rowTails[row] == nullptr;
+		}
+
+		template <typename ValueType, typename StateType>
+		uint64_t
+		TransitionStore<ValueType, StateType>::getNumberOfRows() const {
+			return rowTails.size();
+		}
+
+		template <typename ValueType, typename StateType>
+		uint64_t
+		TransitionStore<ValueType, StateType>::getNumberOfTransitions() const {
+			return numberOfTransitions;
+		}
+
+		template <typename ValueType, typename StateType>
+		uint64_t
+		TransitionStore<ValueType, StateType>::getSizeInBytes() const {
+			return segmentPool.getCapacity() * sizeof(Segment)
+				+ rowTails.capacity() * sizeof(Segment *)
+				+ (replacesPrevious.capacity() + placeholderRows.capacity()) / 8;
+		}
+
+		template <typename ValueType, typename StateType>
+		storm::storage::SparseMatrix<ValueType>
+		TransitionStore<ValueType, StateType>::buildMatrix(
+			uint64_t numberOfRows
+			, storm::storage::SparseMatrix<ValueType> const * previous
+		) {
+			typedef typename storm::storage::SparseMatrix<ValueType>::index_type IndexType;
+			typedef storm::storage::MatrixEntry<IndexType, ValueType> Entry;
+			uint64_t previousRows = previous == nullptr ? 0 : previous->getRowCount();
+			std::vector<IndexType> rowIndications;
+			std::vector<Entry> columnsAndValues;
+			std::vector<bool> newPlaceholderRows(numberOfRows, false);
+			rowIndications.reserve(numberOfRows + 1);
+			columnsAndValues.reserve(
+				(previous == nullptr ? 0 : previous->getEntryCount()) + numberOfTransitions + numberOfRows - std::min(numberOfRows, previousRows)
+			);
+			rowIndications.push_back(0);
+			for (uint64_t row = 0; row < numberOfRows; ++row) {
+				uint64_t rowStart = columnsAndValues.size();
+				Segment const * segment = row < rowTails.size() ? rowTails[row] : nullptr;
+				bool copyPrevious = row < previousRows && !(row < replacesPrevious.size() && replacesPrevious[row]);
+				if (copyPrevious) {
+					auto previousRow = previous->getRow(row);
+					columnsAndValues.insert(columnsAndValues.end(), previousRow.begin(), previousRow.end());
+					if (segment == nullptr) {
+						// Unchanged since the last build, and already sorted
+						newPlaceholderRows[row] = row < placeholderRows.size() && placeholderRows[row];
+						rowIndications.push_back(columnsAndValues.size());
+						continue;
+					}
+				}
+				else if (segment == nullptr) {
+					// This state is deadlock (or has not been explored yet)
+					columnsAndValues.emplace_back(row, storm::utility::one<ValueType>());
+					newPlaceholderRows[row] = true;
+					rowIndications.push_back(columnsAndValues.size());
+					continue;
+				}
+				for (; segment != nullptr; segment = segment->previous) {
+					for (uint32_t i = 0; i < segment->count; ++i) {
+						columnsAndValues.emplace_back(segment->columns[i], segment->values[i]);
+					}
+				}
+				auto begin = columnsAndValues.begin() + rowStart;
+				std::sort(
+					begin
+					, columnsAndValues.end()
+					, [](Entry const & first, Entry const & second) {
+						return first.getColumn() < second.getColumn();
+					}
+				);
+				// Sum transitions to the same column
+				auto last = begin;
+				for (auto it = begin + 1; it != columnsAndValues.end(); ++it) {
+					if (it->getColumn() == last->getColumn()) {
+						last->setValue(last->getValue() + it->getValue());
+					}
+					else {
+						*(++last) = *it;
+					}
+				}
+				columnsAndValues.erase(last + 1, columnsAndValues.end());
+				rowIndications.push_back(columnsAndValues.size());
+			}
+			// Everything is in the matrix now, so the segments are given back to the pool, which releases
+			// blocks that are no longer used
+			for (uint64_t row = 0; row < rowTails.size(); ++row) {
+				releaseRow(row);
+			}
+			segmentPool.defrag();
+			std::fill(replacesPrevious.begin(), replacesPrevious.end(), false);
+			placeholderRows = std::move(newPlaceholderRows);
+			numberOfTransitions = 0;
+			return storm::storage::SparseMatrix<ValueType>(
+				numberOfRows
+				, std::move(rowIndications)
+				, std::move(columnsAndValues)
+				, boost::none // All models are deterministic
+			);
+		}
+
+		template <typename ValueType, typename StateType>
+		void
+		TransitionStore<ValueType, StateType>::forEachTransition(
+			uint64_t numberOfRows
+			, storm::storage::SparseMatrix<ValueType> const * previous
+			, std::function<void (StateType, StateType, ValueType)> const & function
+		) const {
+			uint64_t previousRows = previous == nullptr ? 0 : previous->getRowCount();
+			for (uint64_t row = 0; row < numberOfRows; ++row) {
+				bool copyPrevious = row < previousRows
+					&& !(row < replacesPrevious.size() && replacesPrevious[row])
+					&& !(row < placeholderRows.size() && placeholderRows[row]);
+				if (copyPrevious) {
+					for (auto const & entry : previous->getRow(row)) {
+						function(row, entry.getColumn(), entry.getValue());
+					}
+				}
+				for (Segment const * segment = row < rowTails.size() ? rowTails[row] : nullptr; segment != nullptr; segment = segment->previous) {
+					for (uint32_t i = 0; i < segment->count; ++i) {
+						function(row, segment->columns[i], segment->values[i]);
+					}
+				}
+			}
+		}
+
+		template <typename ValueType, typename StateType>
+		void
+		TransitionStore<ValueType, StateType>::releaseRow(StateType row) {
+			Segment * segment = rowTails[row];
+			while (segment != nullptr) {
+				Segment * previousSegment = segment->previous;
+				numberOfTransitions -= segment->count;
+				segmentPool.free(segment);
+				segment = previousSegment;
+			}
+			rowTails[row] = nullptr;
+		}
+
+		// Forward declare
+		template class TransitionStore<double, uint32_t>;
+	}
+}
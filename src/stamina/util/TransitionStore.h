@@ -0,0 +1,124 @@
+#ifndef STAMINA_UTIL_TRANSITIONSTORE_H
+#define STAMINA_UTIL_TRANSITIONSTORE_H
+
+#include "StateMemoryPool.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "storm/storage/SparseMatrix.h"
+
+// Number of transitions in each segment of a row
+#define TRANSITION_SEGMENT_SIZE 8
+
+/**
+ * Append-only store for the transitions of a model while it is being built.
+ *
+ * States are explored in no particular order, so transitions are not added row by row. Each row is a
+ * linked list of fixed-size segments (allocated from a StateMemoryPool), each of which has separate
+ * arrays for columns and values. When the model is built, the rows are compacted into CSR form and
+ * handed directly to storm::storage::SparseMatrix, without going through SparseMatrixBuilder.
+ *
+ * The store is incremental: buildMatrix() can be given the matrix it built last time, in which case
+ * only rows which changed since then are compacted, and every other row is copied over as is. After
+ * each build, all segments are given back to the pool (which releases its blocks), so between builds
+ * the store only holds what changed.
+ * */
+namespace stamina {
+	namespace util {
+		template <typename ValueType, typename StateType>
+		class TransitionStore {
+		public:
+			/* A piece of a single row */
+			struct Segment {
+				StateType columns[TRANSITION_SEGMENT_SIZE];
+				ValueType values[TRANSITION_SEGMENT_SIZE];
+				uint32_t count;
+				// The segment which was filled before this one
+				Segment * previous;
+			};
+			/**
+			 * Constructor
+			 * */
+			TransitionStore();
+			/**
+			 * Adds a transition. Creates the rows for both states if they do not exist yet. If the row
+			 * was only a placeholder self-loop in the last matrix built, the self-loop is dropped.
+			 *
+			 * @param from The state the transition is from (row)
+			 * @param to The state the transition goes to (column)
+			 * @param value The rate or probability of the transition
+			 * */
+			void addTransition(StateType from, StateType to, ValueType value);
+			/**
+			 * Removes all transitions in a row, including those in the last matrix built. Used when a
+			 * perimeter state, which was connected to the absorbing state, is explored.
+			 *
+			 * @param row The row to clear
+			 * */
+			void clearRow(StateType row);
+			/**
+			 * Whether or not a row has any transitions added since the last build
+			 * */
+			bool rowIsEmpty(StateType row) const;
+			/**
+			 * The number of rows which have been created
+			 * */
+			uint64_t getNumberOfRows() const;
+			/**
+			 * The number of transitions which have been added since the last build (including duplicates)
+			 * */
+			uint64_t getNumberOfTransitions() const;
+			/**
+			 * The bytes used by the segments (allocated or free) and the row tables
+			 * */
+			uint64_t getSizeInBytes() const;
+			/**
+			 * Compacts the transitions into a sparse matrix. Within each row, the entries are sorted by
+			 * column and transitions to the same column are summed. Rows without any transitions get a
+			 * self-loop.
+			 *
+			 * @param numberOfRows The number of rows (and columns) in the matrix. Must be at least
+			 * getNumberOfRows()
+			 * @param previous The matrix returned by the last call to this method, if it is still around.
+			 * Rows which were not cleared or added to since are copied from it.
+			 * @return The transition matrix
+			 * */
+			storm::storage::SparseMatrix<ValueType> buildMatrix(
+				uint64_t numberOfRows
+				, storm::storage::SparseMatrix<ValueType> const * previous = nullptr
+			);
+			/**
+			 * Calls a function for every transition which the next call to buildMatrix() would put in the
+			 * matrix, without building it or changing the store. Transitions to the same column are not
+			 * summed, and rows which would only get a placeholder self-loop are skipped, so adding the
+			 * transitions to an empty store gives the same matrix.
+			 *
+			 * @param numberOfRows The number of rows, as for buildMatrix()
+			 * @param previous The matrix returned by the last call to buildMatrix(), as for buildMatrix()
+			 * @param function Called with the row, column and value of each transition, in order of row
+			 * */
+			void forEachTransition(
+				uint64_t numberOfRows
+				, storm::storage::SparseMatrix<ValueType> const * previous
+				, std::function<void (StateType, StateType, ValueType)> const & function
+			) const;
+		private:
+			/**
+			 * Gives all segments of a row back to the pool
+			 * */
+			void releaseRow(StateType row);
+			StateMemoryPool<Segment> segmentPool;
+			// The most recently filled segment of each row
+			std::vector<Segment *> rowTails;
+			// Rows whose entries in the previous matrix should not be copied
+			std::vector<bool> replacesPrevious;
+			// Rows which only had a self-loop because they were empty in the previous matrix
+			std::vector<bool> placeholderRows;
+			uint64_t numberOfTransitions;
+		};
+	} // namespace util
+} // namespace stamina
+
+#endif // STAMINA_UTIL_TRANSITIONSTORE_H
@@ -0,0 +1,227 @@
+/**
+ * Checks that stamina::builder::CompiledNextStateGenerator builds the same CTMC as STORM's
+ * PrismNextStateGenerator. See README.md
+ * */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "storm/utility/initialize.h"
+#include "storm/api/storm.h"
+#include "storm-parsers/api/storm-parsers.h"
+#include "storm-parsers/parser/PrismParser.h"
+#include "storm/generator/CompressedState.h"
+#include "storm/generator/PrismNextStateGenerator.h"
+#include "storm/models/sparse/StateLabeling.h"
+#include "storm/storage/sparse/StateStorage.h"
+
+#include "stamina/builder/CompiledNextStateGenerator.h"
+
+// Relative difference allowed between the rates from the two generators
+#define RATE_TOLERANCE 1e-12
+#define DEFAULT_MAX_STATES 20000
+
+typedef storm::generator::PrismNextStateGenerator<double, uint32_t> Generator;
+typedef stamina::builder::CompiledNextStateGenerator<double, uint32_t> CompiledGenerator;
+typedef storm::generator::CompressedState CompressedState;
+
+/* The part of a CTMC explored by a generator */
+struct Exploration {
+	Exploration(uint64_t bitsPerState) : stateStorage(bitsPerState) {}
+	storm::storage::sparse::StateStorage<uint32_t> stateStorage;
+	// The bits of each state, by index
+	std::vector<CompressedState> states;
+	// The total rate to each successor of each state (by index). Empty for deadlocks.
+	std::vector<std::map<uint32_t, double>> transitions;
+	// Whether each state was expanded
+	std::vector<bool> expanded;
+	storm::models::sparse::StateLabeling labeling;
+};
+
+/**
+ * Explores the model breadth-first, one level at a time, until the level in which at least
+ * maxStates states have been expanded. Since whole levels are expanded, both generators explore
+ * the same states, even if they give the successors of a state in a different order.
+ * */
+Exploration
+explore(Generator & generator, uint64_t maxStates) {
+	Exploration exploration(generator.getStateSize());
+	std::vector<uint32_t> level;
+	std::function<uint32_t (CompressedState const&)> addState = [&](CompressedState const& state) {
+		uint32_t newId = exploration.states.size();
+		uint32_t id = exploration.stateStorage.stateToId.findOrAdd(state, newId);
+		if (id == newId) {
+			exploration.states.push_back(state);
+			exploration.transitions.emplace_back();
+			exploration.expanded.push_back(false);
+			level.push_back(id);
+		}
+		return id;
+	};
+	exploration.stateStorage.initialStateIndices = generator.getInitialStates(addState);
+	uint64_t numberExpanded = 0;
+	while (!level.empty() && numberExpanded < maxStates) {
+		std::vector<uint32_t> current;
+		current.swap(level);
+		for (uint32_t id : current) {
+			// The generator keeps a pointer to the loaded state, and addState() may move states
+			CompressedState state = exploration.states[id];
+			generator.load(state);
+			auto behavior = generator.expand(addState);
+			for (auto const & choice : behavior) {
+				for (auto const & stateAndRate : choice) {
+					exploration.transitions[id][stateAndRate.first] += stateAndRate.second;
+				}
+			}
+			exploration.expanded[id] = true;
+			if (exploration.transitions[id].empty()) {
+				exploration.stateStorage.deadlockStateIndices.push_back(id);
+			}
+			++numberExpanded;
+		}
+	}
+	exploration.labeling = generator.label(
+		exploration.stateStorage
+		, exploration.stateStorage.initialStateIndices
+		, exploration.stateStorage.deadlockStateIndices
+	);
+	return exploration;
+}
+
+/**
+ * Gets the index in the other exploration of a state with the given index in this one, or -1 if the
+ * other exploration did not find it
+ * */
+int64_t
+findIn(Exploration const & other, Exploration const & exploration, uint32_t id) {
+	CompressedState const & state = exploration.states[id];
+	if (!other.stateStorage.stateToId.contains(state)) {
+		return -1;
+	}
+	return other.stateStorage.stateToId.getValue(state);
+}
+
+/**
+ * Compares the two explorations by the bits of each state, and prints the first few differences
+ *
+ * @return Whether they are the same CTMC
+ * */
+bool
+compare(Exploration const & expected, Exploration const & actual) {
+	uint64_t differences = 0;
+	auto report = [&](std::string const & difference) {
+		if (differences++ < 10) {
+			std::cout << "\t" << difference << std::endl;
+		}
+	};
+	if (expected.states.size() != actual.states.size()) {
+		report("STORM found " + std::to_string(expected.states.size()) + " states, the compiled generator "
+			+ std::to_string(actual.states.size()));
+	}
+	// Maps the indices in the expected exploration to the actual one
+	std::vector<int64_t> toActual(expected.states.size());
+	for (uint32_t id = 0; id < expected.states.size(); ++id) {
+		toActual[id] = findIn(actual, expected, id);
+		if (toActual[id] < 0) {
+			report("State " + std::to_string(id) + " was not found by the compiled generator");
+		}
+	}
+	for (uint32_t id = 0; id < actual.states.size(); ++id) {
+		if (findIn(expected, actual, id) < 0) {
+			report("The compiled generator found a state STORM did not (its state " + std::to_string(id) + ")");
+		}
+	}
+	for (uint32_t id = 0; id < expected.states.size(); ++id) {
+		if (toActual[id] < 0) {
+			continue;
+		}
+		uint32_t actualId = toActual[id];
+		if (expected.expanded[id] != actual.expanded[actualId]) {
+			report("State " + std::to_string(id) + " was expanded by only one of the generators");
+			continue;
+		}
+		// The successors, by their index in the actual exploration
+		std::map<int64_t, double> expectedTransitions;
+		for (auto const & successorAndRate : expected.transitions[id]) {
+			expectedTransitions[toActual[successorAndRate.first]] += successorAndRate.second;
+		}
+		auto const & actualTransitions = actual.transitions[actualId];
+		bool same = expectedTransitions.size() == actualTransitions.size();
+		auto actualIt = actualTransitions.begin();
+		for (auto expectedIt = expectedTransitions.begin(); same && expectedIt != expectedTransitions.end(); ++expectedIt, ++actualIt) {
+			double tolerance = RATE_TOLERANCE * std::max(std::fabs(expectedIt->second), std::fabs(actualIt->second));
+			same = expectedIt->first == actualIt->first
+				&& std::fabs(expectedIt->second - actualIt->second) <= tolerance;
+		}
+		if (!same) {
+			report("State " + std::to_string(id) + " has different successors or rates");
+		}
+	}
+	std::set<std::string> expectedLabels = expected.labeling.getLabels();
+	std::set<std::string> actualLabels = actual.labeling.getLabels();
+	if (expectedLabels != actualLabels) {
+		report("The generators give different labels");
+	}
+	for (auto const & label : expectedLabels) {
+		if (!actual.labeling.containsLabel(label)) {
+			continue;
+		}
+		storm::storage::BitVector const & expectedStates = expected.labeling.getStates(label);
+		storm::storage::BitVector const & actualStates = actual.labeling.getStates(label);
+		for (uint32_t id = 0; id < expected.states.size(); ++id) {
+			if (toActual[id] >= 0 && expectedStates.get(id) != actualStates.get(toActual[id])) {
+				report("Label \"" + label + "\" differs in state " + std::to_string(id));
+			}
+		}
+	}
+	if (differences > 10) {
+		std::cout << "\t(and " << differences - 10 << " more differences)" << std::endl;
+	}
+	return differences == 0;
+}
+
+int
+main(int argc, char ** argv) {
+	std::vector<std::string> modelFiles;
+	uint64_t maxStates = DEFAULT_MAX_STATES;
+	for (int arg = 1; arg < argc; ++arg) {
+		std::string argument(argv[arg]);
+		if (argument.rfind("--maxStates=", 0) == 0) {
+			maxStates = std::strtoull(argument.substr(12).c_str(), nullptr, 10);
+		}
+		else {
+			modelFiles.push_back(argument);
+		}
+	}
+	if (modelFiles.empty()) {
+		std::cerr << "Usage: " << argv[0] << " model.prism [moreModels.prism...] [--maxStates=N]" << std::endl;
+		return 1;
+	}
+	storm::utility::setUp();
+	bool pass = true;
+	for (auto const & modelFile : modelFiles) {
+		storm::prism::Program program = storm::parser::PrismParser::parse(modelFile).substituteConstantsFormulas();
+		storm::generator::NextStateGeneratorOptions options;
+		options.setBuildAllLabels();
+		Generator generator(program, options);
+		CompiledGenerator compiledGenerator(program, options);
+		bool same = compiledGenerator.isCompiled();
+		if (!same) {
+			std::cout << "\tThe model was not compiled, so there is nothing to compare" << std::endl;
+		}
+		else {
+			same = compare(explore(generator, maxStates), explore(compiledGenerator, maxStates));
+		}
+		std::cout << (same ? "PASS" : "FAIL") << ": " << modelFile << std::endl;
+		pass &= same;
+	}
+	std::cout << (pass ? "All models match" : "Some models do not match") << std::endl;
+	return pass ? 0 : 1;
+}
@@ -0,0 +1,347 @@
+/**
+ * Checks stamina::util::CtmcSolver against STORM's SparseCtmcCslModelChecker. See README.md
+ * */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "storm/utility/initialize.h"
+#include "storm/api/storm.h"
+#include "storm-parsers/api/storm-parsers.h"
+#include "storm-parsers/parser/PrismParser.h"
+#include "storm-parsers/parser/FormulaParser.h"
+#include "storm/generator/CompressedState.h"
+#include "storm/generator/PrismNextStateGenerator.h"
+#include "storm/logic/Formulas.h"
+#include "storm/modelchecker/csl/SparseCtmcCslModelChecker.h"
+#include "storm/modelchecker/results/ExplicitQuantitativeCheckResult.h"
+#include "storm/models/sparse/Ctmc.h"
+#include "storm/storage/BitVectorHashMap.h"
+#include "storm/storage/SparseMatrix.h"
+#include "storm/storage/expressions/ExpressionEvaluator.h"
+
+#include "stamina/util/CtmcSolver.h"
+
+// Largest difference allowed between our result and STORM's, in any state
+#define TOLERANCE 1e-4
+// The same as StaminaModelChecker
+#define PRECISION 1e-6
+#define MAX_ITERATIONS 10000
+
+typedef storm::generator::PrismNextStateGenerator<double, uint32_t> Generator;
+typedef storm::generator::CompressedState CompressedState;
+using stamina::util::CtmcSolver;
+
+/* A CTMC truncated the way STAMINA truncates it. State 0 is the absorbing state. */
+struct TruncatedModel {
+	storm::storage::SparseMatrix<double> rateMatrix;
+	// The bits of each state (empty for the absorbing state)
+	std::vector<CompressedState> states;
+	uint32_t initialState;
+};
+
+/* An until property (phi U psi, or phi U<=t psi) on the original model */
+struct UntilProperty {
+	std::string name;
+	storm::expressions::Expression phi;
+	storm::expressions::Expression psi;
+	// Negative if the property has no time bound
+	double timeBound;
+};
+
+/**
+ * Explores the model breadth-first, expanding at most maxExplored states. The states which were
+ * found but not expanded are the perimeter. Like StaminaModelBuilder::connectTerminalStatesToAbsorbing(),
+ * each perimeter state keeps its transitions to states in the model, and gets a transition to the
+ * absorbing state with the total rate of the others, even if that rate is 0.
+ * */
+TruncatedModel
+truncate(Generator & generator, uint64_t maxExplored) {
+	TruncatedModel model;
+	storm::storage::BitVectorHashMap<uint32_t> stateToId(generator.getStateSize(), 1024);
+	std::deque<uint32_t> frontier;
+	model.states.emplace_back();
+	std::function<uint32_t (CompressedState const&)> addState = [&](CompressedState const& state) {
+		uint32_t newId = model.states.size();
+		uint32_t id = stateToId.findOrAdd(state, newId);
+		if (id == newId) {
+			model.states.push_back(state);
+			frontier.push_back(id);
+		}
+		return id;
+	};
+	std::function<uint32_t (CompressedState const&)> stateOrAbsorbing = [&](CompressedState const& state) -> uint32_t {
+		return stateToId.contains(state) ? stateToId.getValue(state) : 0;
+	};
+	model.initialState = generator.getInitialStates(addState).front();
+
+	// Entries of each row, by column (so that they are added to the matrix in order)
+	std::vector<std::map<uint32_t, double>> rows(1);
+	rows[0][0] = 1.0;
+	uint64_t explored = 0;
+	while (!frontier.empty()) {
+		uint32_t id = frontier.front();
+		frontier.pop_front();
+		bool perimeter = explored >= maxExplored;
+		++explored;
+		// The generator keeps a pointer to the state, and addState() may move model.states
+		CompressedState state = model.states[id];
+		generator.load(state);
+		auto behavior = generator.expand(perimeter ? stateOrAbsorbing : addState);
+		rows.resize(model.states.size());
+		if (behavior.empty()) {
+			rows[id][id] += 1.0;
+			continue;
+		}
+		if (perimeter) {
+			rows[id].emplace(0, 0.0);
+		}
+		for (auto const & choice : behavior) {
+			for (auto const & stateAndRate : choice) {
+				rows[id][stateAndRate.first] += stateAndRate.second;
+			}
+		}
+	}
+
+	storm::storage::SparseMatrixBuilder<double> builder(rows.size(), rows.size(), 0, true);
+	for (uint64_t row = 0; row < rows.size(); ++row) {
+		for (auto const & entry : rows[row]) {
+			builder.addNextValue(row, entry.first, entry.second);
+		}
+	}
+	model.rateMatrix = builder.build();
+	return model;
+}
+
+/**
+ * Finds the states of the model which satisfy an expression. The absorbing state satisfies none.
+ * */
+storm::storage::BitVector
+evaluate(
+	storm::expressions::Expression const & expression
+	, TruncatedModel const & model
+	, Generator const & generator
+	, storm::expressions::ExpressionEvaluator<double> & evaluator
+) {
+	storm::storage::BitVector result(model.states.size(), false);
+	for (uint64_t state = 1; state < model.states.size(); ++state) {
+		storm::generator::unpackStateIntoEvaluator(model.states[state], generator.getVariableInformation(), evaluator);
+		result.set(state, evaluator.asBool(expression));
+	}
+	return result;
+}
+
+/**
+ * Gets the probability of phi U psi (or phi U<=t psi) in each state from STORM's checker
+ * */
+std::vector<double>
+checkWithStorm(
+	TruncatedModel const & model
+	, storm::storage::BitVector const & phi
+	, storm::storage::BitVector const & psi
+	, double timeBound
+) {
+	storm::models::sparse::StateLabeling labeling(model.states.size());
+	labeling.addLabel("init");
+	labeling.addLabelToState("init", model.initialState);
+	labeling.addLabel("phi", phi);
+	labeling.addLabel("psi", psi);
+	storm::models::sparse::Ctmc<double> ctmc(model.rateMatrix, labeling);
+	storm::modelchecker::SparseCtmcCslModelChecker<storm::models::sparse::Ctmc<double>> checker(ctmc);
+	std::string bound = timeBound < 0.0 ? "" : "<=" + std::to_string(timeBound);
+	auto formula = storm::parser::FormulaParser().parseSingleFormulaFromString("P=? [ \"phi\" U" + bound + " \"psi\" ]");
+	auto result = checker.check(storm::modelchecker::CheckTask<>(*formula, false));
+	return result->asExplicitQuantitativeCheckResult<double>().getValueVector();
+}
+
+/**
+ * Compares our solution with the expected one in every state. A NaN is never close enough.
+ *
+ * @return Whether they match
+ * */
+bool
+compare(
+	std::string const & name
+	, std::vector<double> const & expected
+	, std::vector<double> const & actual
+	, uint32_t initialState
+) {
+	double largestDifference = 0.0;
+	bool match = expected.size() == actual.size();
+	for (uint64_t state = 0; match && state < expected.size(); ++state) {
+		double difference = std::fabs(expected[state] - actual[state]);
+		if (!(difference <= TOLERANCE)) {
+			match = false;
+		}
+		largestDifference = std::max(largestDifference, difference);
+	}
+	std::cout << (match ? "PASS " : "FAIL ") << name << ": " << actual[initialState]
+		<< " (expected " << expected[initialState] << ", largest difference " << largestDifference << ")\n";
+	return match;
+}
+
+/**
+ * Finds the until properties in a property file. Eventually (F psi) is checked as true U psi.
+ * */
+std::vector<UntilProperty>
+getUntilProperties(std::string const & filename, storm::prism::Program const & program) {
+	std::vector<UntilProperty> untilProperties;
+	for (auto const & property : storm::api::parsePropertiesForPrismProgram(filename, program)) {
+		auto const & formula = *property.getRawFormula();
+		if (!formula.isProbabilityOperatorFormula()) {
+			continue;
+		}
+		auto const & pathFormula = formula.asProbabilityOperatorFormula().getSubformula();
+		UntilProperty untilProperty;
+		untilProperty.name = property.getName();
+		untilProperty.timeBound = -1.0;
+		if (pathFormula.isUntilFormula()) {
+			untilProperty.phi = pathFormula.asUntilFormula().getLeftSubformula().toExpression(program.getManager());
+			untilProperty.psi = pathFormula.asUntilFormula().getRightSubformula().toExpression(program.getManager());
+		}
+		else if (pathFormula.isEventuallyFormula()) {
+			untilProperty.phi = program.getManager().boolean(true);
+			untilProperty.psi = pathFormula.asEventuallyFormula().getSubformula().toExpression(program.getManager());
+		}
+		else if (pathFormula.isBoundedUntilFormula() && pathFormula.asBoundedUntilFormula().hasUpperBound()) {
+			auto const & boundedUntil = pathFormula.asBoundedUntilFormula();
+			untilProperty.phi = boundedUntil.getLeftSubformula().toExpression(program.getManager());
+			untilProperty.psi = boundedUntil.getRightSubformula().toExpression(program.getManager());
+			untilProperty.timeBound = boundedUntil.getUpperBound().evaluateAsDouble();
+		}
+		else {
+			continue;
+		}
+		untilProperties.push_back(untilProperty);
+	}
+	return untilProperties;
+}
+
+/**
+ * A perimeter state whose only other transition is a self-loop has a zero rate to the absorbing
+ * state. That must not make it a maybe state for Pmax (it used to give NaN). Checks each property on
+ * its own, and all of them in one solve.
+ * */
+bool
+testZeroRateToAbsorbing() {
+	// 1 goes to 2 or 3 at the same rate. 2 only loops (with a zero rate to the absorbing state 0),
+	// and 3 is the goal.
+	storm::storage::SparseMatrixBuilder<double> builder(4, 4, 0, true);
+	builder.addNextValue(0, 0, 1.0);
+	builder.addNextValue(1, 2, 1.0);
+	builder.addNextValue(1, 3, 1.0);
+	builder.addNextValue(2, 0, 0.0);
+	builder.addNextValue(2, 2, 1.0);
+	builder.addNextValue(3, 3, 1.0);
+	TruncatedModel model;
+	model.rateMatrix = builder.build();
+	model.states.resize(4);
+	model.initialState = 1;
+
+	storm::storage::BitVector phi(4, true);
+	storm::storage::BitVector psiMin(4, false);
+	psiMin.set(3);
+	storm::storage::BitVector psiMax(psiMin);
+	psiMax.set(0);
+	double boundedValue = 0.5 * (1.0 - std::exp(-2.0));
+	std::vector<CtmcSolver::UntilProblem> problems;
+	std::vector<std::string> names;
+	std::vector<std::vector<double>> expected;
+	for (double timeBound : {-1.0, 1.0}) {
+		for (auto const & psi : {psiMin, psiMax}) {
+			problems.push_back({phi, psi, timeBound, {}});
+			names.push_back(std::string("zero rate to absorbing, ") + (psi.get(0) ? "Pmax" : "Pmin") + (timeBound < 0.0 ? "" : " (t <= 1)"));
+			expected.push_back({psi.get(0) ? 1.0 : 0.0, timeBound < 0.0 ? 0.5 : boundedValue, 0.0, 1.0});
+		}
+	}
+	bool pass = true;
+	CtmcSolver batchSolver(PRECISION, MAX_ITERATIONS);
+	batchSolver.setModel(model.rateMatrix);
+	auto batchSolutions = batchSolver.solve(problems);
+	for (uint64_t problem = 0; problem < problems.size(); ++problem) {
+		CtmcSolver solver(PRECISION, MAX_ITERATIONS);
+		solver.setModel(model.rateMatrix);
+		auto solution = solver.solve({problems[problem]})[0];
+		auto stormSolution = checkWithStorm(model, phi, problems[problem].psi, problems[problem].timeBound);
+		pass &= compare(names[problem], expected[problem], solution, model.initialState);
+		pass &= compare(names[problem] + " vs STORM", stormSolution, solution, model.initialState);
+		pass &= compare(names[problem] + ", batched", expected[problem], batchSolutions[problem], model.initialState);
+		pass &= compare(names[problem] + ", batched vs STORM", stormSolution, batchSolutions[problem], model.initialState);
+	}
+	return pass;
+}
+
+int
+main(int argc, char ** argv) {
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " model.prism properties.csl [maxStates]" << std::endl;
+		return 1;
+	}
+	uint64_t maxStates = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 20000;
+	storm::utility::setUp();
+	storm::prism::Program program = storm::parser::PrismParser::parse(argv[1]).substituteConstantsFormulas();
+	std::vector<UntilProperty> properties = getUntilProperties(argv[2], program);
+	storm::generator::NextStateGeneratorOptions options;
+	Generator generator(program, options);
+	storm::expressions::ExpressionEvaluator<double> evaluator(program.getManager());
+
+	bool pass = testZeroRateToAbsorbing();
+	for (auto const & property : properties) {
+		// Every property is checked unbounded, and also with its time bound if it has one, for both
+		// Pmin and Pmax
+		std::vector<double> timeBounds = {-1.0};
+		if (property.timeBound >= 0.0) {
+			timeBounds.push_back(property.timeBound);
+		}
+		uint64_t numberOfProblems = 2 * timeBounds.size();
+		// Like StaminaModelChecker, each solver is kept across truncations (each of which is a subset
+		// of the next), and unbounded properties are warm-started from the last solution. Every
+		// problem is solved on its own, and all of them together (as StaminaModelChecker does).
+		std::vector<CtmcSolver> solvers(numberOfProblems, CtmcSolver(PRECISION, MAX_ITERATIONS));
+		CtmcSolver batchSolver(PRECISION, MAX_ITERATIONS);
+		std::vector<std::vector<double>> previous(numberOfProblems);
+		std::vector<std::vector<double>> previousBatch(numberOfProblems);
+		for (uint64_t explored = std::max<uint64_t>(maxStates / 16, 1); explored <= maxStates; explored *= 4) {
+			TruncatedModel model = truncate(generator, explored);
+			storm::storage::BitVector phi = evaluate(property.phi, model, generator, evaluator);
+			storm::storage::BitVector psiMin = evaluate(property.psi, model, generator, evaluator);
+			storm::storage::BitVector psiMax(psiMin);
+			psiMax.set(0);
+			batchSolver.setModel(model.rateMatrix);
+			std::vector<CtmcSolver::UntilProblem> batch;
+			std::vector<std::string> names;
+			for (double timeBound : timeBounds) {
+				for (auto const & psi : {psiMin, psiMax}) {
+					uint64_t problem = batch.size();
+					batch.push_back({phi, psi, timeBound, {}});
+					names.push_back(property.name + (timeBound < 0.0 ? "" : " (t <= " + std::to_string(timeBound) + ")")
+						+ ", " + std::to_string(model.states.size()) + " states" + (psi.get(0) ? ", Pmax" : ", Pmin"));
+					CtmcSolver::UntilProblem single = batch.back();
+					solvers[problem].setModel(model.rateMatrix);
+					if (timeBound < 0.0) {
+						single.initialGuess = solvers[problem].warmStart(previous[problem], 0);
+						batch.back().initialGuess = batchSolver.warmStart(previousBatch[problem], 0);
+					}
+					previous[problem] = solvers[problem].solve({single})[0];
+				}
+			}
+			previousBatch = batchSolver.solve(batch);
+			for (uint64_t problem = 0; problem < numberOfProblems; ++problem) {
+				auto stormSolution = checkWithStorm(model, phi, batch[problem].psi, batch[problem].timeBound);
+				pass &= compare(names[problem], stormSolution, previous[problem], model.initialState);
+				pass &= compare(names[problem] + ", batched", stormSolution, previousBatch[problem], model.initialState);
+				pass &= compare(names[problem] + ", batched vs single", previous[problem], previousBatch[problem], model.initialState);
+			}
+		}
+	}
+	std::cout << (pass ? "All results match" : "Some results do not match") << std::endl;
+	return pass ? 0 : 1;
+}
@@ -0,0 +1,258 @@
+/**
+ * Checks that stamina::util::ExplicitModelReader reads back what stamina::util::ExplicitModelWriter
+ * writes. See README.md
+ * */
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "storm/utility/initialize.h"
+#include "storm/api/storm.h"
+#include "storm-parsers/api/storm-parsers.h"
+#include "storm-parsers/parser/PrismParser.h"
+#include "storm/generator/CompressedState.h"
+#include "storm/generator/PrismNextStateGenerator.h"
+#include "storm/models/sparse/Ctmc.h"
+#include "storm/models/sparse/StateLabeling.h"
+#include "storm/storage/SparseMatrix.h"
+#include "storm/storage/expressions/ExpressionEvaluator.h"
+
+#include "stamina/util/ConcurrentStateStorage.h"
+#include "stamina/util/ExplicitModelReader.h"
+#include "stamina/util/ExplicitModelWriter.h"
+
+typedef storm::generator::PrismNextStateGenerator<double, uint32_t> Generator;
+typedef storm::generator::CompressedState CompressedState;
+using stamina::util::ConcurrentStateStorage;
+using stamina::util::ExplicitModelReader;
+using stamina::util::ExplicitModelWriter;
+
+/**
+ * Explores the model breadth-first, expanding at most maxExplored states, and builds a CTMC of the
+ * states found. States which were found but not expanded (and deadlocks) get a self-loop. Each state
+ * is labeled with the labels of the program, and with "init", "deadlock" and "perimeter".
+ *
+ * @param rateFactor What every rate is multiplied by
+ * */
+std::shared_ptr<storm::models::sparse::Ctmc<double>>
+explore(
+	Generator & generator
+	, storm::prism::Program const & program
+	, ConcurrentStateStorage<uint32_t> & states
+	, uint64_t maxExplored
+	, double rateFactor
+) {
+	std::deque<uint32_t> frontier;
+	std::function<uint32_t (CompressedState const&)> addState = [&](CompressedState const& state) {
+		auto idAndAdded = states.findOrAdd(state);
+		if (idAndAdded.second) {
+			frontier.push_back(idAndAdded.first);
+		}
+		return idAndAdded.first;
+	};
+	std::vector<uint32_t> initialStates = generator.getInitialStates(addState);
+
+	// Entries of each row, by column (so that they are added to the matrix in order)
+	std::vector<std::map<uint32_t, double>> rows;
+	std::vector<uint32_t> deadlocks;
+	std::vector<uint32_t> perimeter;
+	uint64_t explored = 0;
+	while (!frontier.empty()) {
+		uint32_t id = frontier.front();
+		frontier.pop_front();
+		rows.resize(states.size());
+		if (explored >= maxExplored) {
+			rows[id][id] = rateFactor;
+			perimeter.push_back(id);
+			continue;
+		}
+		++explored;
+		CompressedState state = states.getState(id);
+		generator.load(state);
+		auto behavior = generator.expand(addState);
+		rows.resize(states.size());
+		for (auto const & choice : behavior) {
+			for (auto const & stateAndRate : choice) {
+				rows[id][stateAndRate.first] += stateAndRate.second * rateFactor;
+			}
+		}
+		if (rows[id].empty()) {
+			deadlocks.push_back(id);
+			rows[id][id] = rateFactor;
+		}
+	}
+
+	storm::storage::SparseMatrixBuilder<double> builder(rows.size(), rows.size(), 0, true);
+	for (uint64_t row = 0; row < rows.size(); ++row) {
+		for (auto const & entry : rows[row]) {
+			builder.addNextValue(row, entry.first, entry.second);
+		}
+	}
+
+	storm::models::sparse::StateLabeling labeling(rows.size());
+	labeling.addLabel("init");
+	for (uint32_t id : initialStates) {
+		labeling.addLabelToState("init", id);
+	}
+	labeling.addLabel("deadlock");
+	for (uint32_t id : deadlocks) {
+		labeling.addLabelToState("deadlock", id);
+	}
+	storm::expressions::ExpressionEvaluator<double> evaluator(program.getManager());
+	std::vector<std::pair<std::string, storm::expressions::Expression>> expressions;
+	for (auto const & label : program.getLabels()) {
+		expressions.emplace_back(label.getName(), label.getStatePredicateExpression());
+	}
+	labeling.addLabel("perimeter");
+	for (uint32_t id : perimeter) {
+		labeling.addLabelToState("perimeter", id);
+	}
+	for (auto const & nameAndExpression : expressions) {
+		labeling.addLabel(nameAndExpression.first);
+	}
+	for (uint64_t id = 0; id < rows.size(); ++id) {
+		storm::generator::unpackStateIntoEvaluator(states.getState(id), generator.getVariableInformation(), evaluator);
+		for (auto const & nameAndExpression : expressions) {
+			if (evaluator.asBool(nameAndExpression.second)) {
+				labeling.addLabelToState(nameAndExpression.first, id);
+			}
+		}
+	}
+	return std::make_shared<storm::models::sparse::Ctmc<double>>(builder.build(), labeling);
+}
+
+/**
+ * Compares the model read back with the model written, and prints the first few differences
+ *
+ * @return Whether they are the same
+ * */
+bool
+compare(
+	storm::models::sparse::Ctmc<double> const & written
+	, ConcurrentStateStorage<uint32_t> const & states
+	, Generator const & generator
+	, storm::prism::Program const & program
+	, ExplicitModelReader & reader
+) {
+	uint64_t differences = 0;
+	auto report = [&](std::string const & difference) {
+		if (differences++ < 10) {
+			std::cout << "\t" << difference << std::endl;
+		}
+	};
+
+	// Transitions. Rates are written in their shortest exact form, so they must match exactly.
+	auto matrix = reader.readTransitions();
+	auto const & writtenMatrix = written.getTransitionMatrix();
+	uint64_t numberOfStates = writtenMatrix.getRowCount();
+	if (matrix.getRowCount() != numberOfStates || matrix.getEntryCount() != writtenMatrix.getEntryCount()) {
+		report("Read " + std::to_string(matrix.getRowCount()) + " states and " + std::to_string(matrix.getEntryCount())
+			+ " transitions, but wrote " + std::to_string(numberOfStates) + " and " + std::to_string(writtenMatrix.getEntryCount()));
+	}
+	else {
+		for (uint64_t row = 0; row < numberOfStates; ++row) {
+			auto readRow = matrix.getRow(row);
+			auto writtenRow = writtenMatrix.getRow(row);
+			bool same = readRow.getNumberOfEntries() == writtenRow.getNumberOfEntries();
+			for (auto readIt = readRow.begin(), writtenIt = writtenRow.begin(); same && readIt != readRow.end(); ++readIt, ++writtenIt) {
+				same = readIt->getColumn() == writtenIt->getColumn() && readIt->getValue() == writtenIt->getValue();
+			}
+			if (!same) {
+				report("The transitions of state " + std::to_string(row) + " differ");
+			}
+		}
+	}
+
+	// States. The reader cannot hand back the states themselves, so each value of each variable is
+	// checked by evaluating (variable = value) over the states read, as the importer evaluates labels.
+	reader.readStates(numberOfStates);
+	auto const & variableInformation = generator.getVariableInformation();
+	std::vector<std::pair<storm::expressions::Expression, std::function<int64_t (CompressedState const&)>>> variables;
+	for (auto const & variable : variableInformation.booleanVariables) {
+		uint64_t bitOffset = variable.bitOffset;
+		variables.emplace_back(variable.variable.getExpression(), [bitOffset](CompressedState const& state) -> int64_t {
+			return state.get(bitOffset);
+		});
+	}
+	for (auto const & variable : variableInformation.integerVariables) {
+		uint64_t bitOffset = variable.bitOffset;
+		uint64_t bitWidth = variable.bitWidth;
+		int64_t lowerBound = variable.lowerBound;
+		variables.emplace_back(variable.variable.getExpression(), [bitOffset, bitWidth, lowerBound](CompressedState const& state) -> int64_t {
+			return static_cast<int64_t>(state.getAsInt(bitOffset, bitWidth)) + lowerBound;
+		});
+	}
+	for (auto const & variable : variables) {
+		// The states with each value of the variable
+		std::map<int64_t, storm::storage::BitVector> statesWithValue;
+		for (uint64_t id = 0; id < numberOfStates; ++id) {
+			int64_t value = variable.second(states.getState(id));
+			auto it = statesWithValue.emplace(value, storm::storage::BitVector(numberOfStates, false)).first;
+			it->second.set(id);
+		}
+		for (auto const & valueAndStates : statesWithValue) {
+			storm::expressions::Expression expression = variable.first.hasBooleanType()
+				? (valueAndStates.first ? variable.first : !variable.first)
+				: variable.first == program.getManager().integer(valueAndStates.first);
+			if (reader.getStatesSatisfying(expression) != valueAndStates.second) {
+				report("The states where " + expression.toString() + " differ");
+			}
+		}
+	}
+
+	// Labels
+	auto labeling = reader.readLabels(numberOfStates);
+	auto const & writtenLabeling = written.getStateLabeling();
+	if (labeling.getLabels() != writtenLabeling.getLabels()) {
+		report("The labels differ");
+	}
+	for (auto const & label : writtenLabeling.getLabels()) {
+		if (labeling.containsLabel(label) && labeling.getStates(label) != writtenLabeling.getStates(label)) {
+			report("The states with label \"" + label + "\" differ");
+		}
+	}
+
+	if (differences > 10) {
+		std::cout << "\t(and " << differences - 10 << " more differences)" << std::endl;
+	}
+	return differences == 0;
+}
+
+int
+main(int argc, char ** argv) {
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " model.prism [maxStates] [filename]" << std::endl;
+		return 1;
+	}
+	uint64_t maxStates = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 20000;
+	std::string filename = argc > 3 ? argv[3] : "roundTrip";
+	storm::utility::setUp();
+	storm::prism::Program program = storm::parser::PrismParser::parse(argv[1]).substituteConstantsFormulas();
+	storm::generator::NextStateGeneratorOptions options;
+	Generator generator(program, options);
+
+	bool pass = true;
+	// Rates divided by 3 have no short decimal form, so they check that no precision is lost
+	for (double rateFactor : {1.0, 1.0 / 3.0}) {
+		ConcurrentStateStorage<uint32_t> states(generator.getStateSize());
+		auto model = explore(generator, program, states, maxStates, rateFactor);
+		ExplicitModelWriter<double, uint32_t> writer(model, states, generator.getVariableInformation());
+		writer.write(filename);
+		// With one thread, and with more threads than some files have lines
+		for (uint16_t numberOfThreads : {1, 7}) {
+			ExplicitModelReader reader(filename, generator.getVariableInformation(), numberOfThreads);
+			bool same = compare(*model, states, generator, program, reader);
+			std::cout << (same ? "PASS" : "FAIL") << ": " << model->getNumberOfStates() << " states, rates times "
+				<< rateFactor << ", read with " << numberOfThreads << " threads" << std::endl;
+			pass &= same;
+		}
+	}
+	std::cout << (pass ? "All round trips match" : "Some round trips do not match") << std::endl;
+	return pass ? 0 : 1;
+}
@@ -3,8 +3,7 @@
 #include <cstdlib>
 #include <ctime>
 
-#include "../../src/stamina/util/StateIndexArray.h"
-#include "../../src/stamina/StaminaModelBuilder.h"
+#include "../../src/stamina/util/ProbabilityStateArray.h"
 // #include <unordered_set>
 
 #define NUM_TO_INSERT 50000000
@@ -50,15 +49,11 @@ int nextPrime(int N) {
 
 int main(int argc, char ** argv) {
 	int numToInsert = atoi(argv[1]);
-	stamina::util::StateIndexArray<uint32_t, stamina::StaminaModelBuilder<double, storm::models::sparse::StandardRewardModel<double>, uint32_t>::ProbabilityState> set;
+	stamina::util::ProbabilityStateArray<uint32_t> set;
 	for (int i = 0; i < numToInsert; i++) {
-		CompressedState cs(0);
-		std::shared_ptr<stamina::StaminaModelBuilder<double, storm::models::sparse::StandardRewardModel<double>, uint32_t>::ProbabilityState> state(
-			cs
-			, i
-		);
-		set.put(i, state);
-		// auto result = set.find(i);
+		auto state = set.emplace(i, 0.0, true, 0);
+		state.addToPi(1.0);
+		// auto result = set.get(i);
 	}
 	return 0;
 }
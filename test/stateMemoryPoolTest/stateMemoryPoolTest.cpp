@@ -0,0 +1,164 @@
+/**
+ * Unit tests for stamina::util::StateMemoryPool. See README.md
+ * */
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "stamina/util/StateMemoryPool.h"
+#include "stamina/util/TransitionStore.h"
+
+// Small blocks, so that the tests can fill them: 2 ^ 4 = 16 elements
+#define BLOCK_SIZE_EXPONENT 4
+#define BLOCK_SIZE 16
+
+// The element type the pool is instantiated for
+typedef stamina::util::TransitionStore<double, uint32_t>::Segment Segment;
+typedef stamina::util::StateMemoryPool<Segment> Pool;
+
+bool
+check(std::string const & name, bool passed) {
+	std::cout << (passed ? "PASS" : "FAIL") << ": " << name << std::endl;
+	return passed;
+}
+
+/**
+ * Writes to every element of an allocation, so that memory errors show up under a sanitizer
+ * */
+void
+touch(Segment * address, uint32_t number) {
+	for (uint32_t i = 0; i < number; i++) {
+		address[i].count = i;
+		address[i].previous = nullptr;
+	}
+}
+
+/**
+ * Memory given back with free() is handed out again, within its size class or split from a larger one
+ * */
+bool
+testReuse() {
+	Pool pool(BLOCK_SIZE_EXPONENT);
+	bool pass = true;
+	Segment * single = pool.allocate(1);
+	touch(single, 1);
+	pool.free(single, 1);
+	pass &= check("A freed element is reused", pool.allocate(1) == single);
+
+	// 3 elements are rounded up to 4
+	Segment * run = pool.allocate(3);
+	touch(run, 3);
+	pool.free(run, 3);
+	pass &= check("A freed run is reused for the same size class", pool.allocate(4) == run);
+	pool.free(run, 4);
+	Segment * first = pool.allocate(1);
+	Segment * second = pool.allocate(2);
+	pass &= check(
+		"A freed run is split for smaller allocations"
+		, first >= run && first < run + 4 && second >= run && second + 2 <= run + 4
+			&& (first < second || first >= second + 2)
+	);
+	pass &= check("Reusing memory does not create blocks", pool.getCapacity() == BLOCK_SIZE);
+	return pass;
+}
+
+/**
+ * defrag() merges neighbouring free memory, and releases blocks in which nothing is allocated
+ * */
+bool
+testDefrag() {
+	Pool pool(BLOCK_SIZE_EXPONENT);
+	bool pass = true;
+	// Fill the first block one element at a time, and start a second
+	std::vector<Segment *> firstBlock;
+	for (uint32_t i = 0; i < BLOCK_SIZE; i++) {
+		firstBlock.push_back(pool.allocate(1));
+		touch(firstBlock.back(), 1);
+	}
+	Segment * inSecondBlock = pool.allocate(1);
+	pass &= check("A second block is created once the first is full", pool.getCapacity() == 2 * BLOCK_SIZE);
+
+	// Two neighbouring elements are merged into a run of 2
+	pool.free(firstBlock[0], 1);
+	pool.free(firstBlock[1], 1);
+	pool.defrag();
+	pass &= check("Blocks which are still used are kept", pool.getCapacity() == 2 * BLOCK_SIZE);
+	pass &= check("Neighbouring free elements are merged", pool.allocate(2) == firstBlock[0]);
+	pass &= check("Merged memory does not create blocks", pool.getCapacity() == 2 * BLOCK_SIZE);
+
+	pool.free(firstBlock[0], 2);
+	for (uint32_t i = 2; i < BLOCK_SIZE; i++) {
+		pool.free(firstBlock[i], 1);
+	}
+	pool.defrag();
+	pass &= check("An empty block is released", pool.getCapacity() == BLOCK_SIZE);
+
+	pool.free(inSecondBlock, 1);
+	pool.defrag();
+	pass &= check("The current block is released once it is empty", pool.getCapacity() == 0);
+	Segment * afterRelease = pool.allocate(1);
+	touch(afterRelease, 1);
+	pass &= check("Allocating after every block was released creates a block", pool.getCapacity() == BLOCK_SIZE);
+	return pass;
+}
+
+/**
+ * Arrays larger than a block get a block of their own, which is reused and released like any other
+ * */
+bool
+testOversized() {
+	Pool pool(BLOCK_SIZE_EXPONENT);
+	bool pass = true;
+	Segment * small = pool.allocate(1);
+	touch(small, 1);
+	// 40 elements are rounded up to 64
+	Segment * large = pool.allocate(40);
+	touch(large, 40);
+	pass &= check("An oversized array gets its own block", pool.getCapacity() == BLOCK_SIZE + 64);
+	pass &= check("An oversized array is not cut from the current block", large < small || large >= small + BLOCK_SIZE);
+	Segment * nextSmall = pool.allocate(1);
+	pass &= check("Small allocations continue in the current block", nextSmall == small + 1);
+
+	pool.free(large, 40);
+	pass &= check("A freed oversized array is reused", pool.allocate(64) == large);
+	pass &= check("Reusing an oversized array does not create blocks", pool.getCapacity() == BLOCK_SIZE + 64);
+
+	pool.free(large, 64);
+	pool.defrag();
+	pass &= check("A freed oversized block is released", pool.getCapacity() == BLOCK_SIZE);
+	return pass;
+}
+
+/**
+ * freeAll() releases every block, and the pool can be used again afterwards
+ * */
+bool
+testFreeAll() {
+	Pool pool(BLOCK_SIZE_EXPONENT);
+	bool pass = true;
+	for (uint32_t number : {1, 3, 7, 16, 40}) {
+		touch(pool.allocate(number), number);
+	}
+	pool.free(pool.allocate(2), 2);
+	pool.freeAll();
+	pass &= check("freeAll() releases every block", pool.getCapacity() == 0);
+
+	Segment * first = pool.allocate(1);
+	touch(first, 1);
+	Segment * second = pool.allocate(1);
+	touch(second, 1);
+	pass &= check("The pool can be used after freeAll()", second == first + 1 && pool.getCapacity() == BLOCK_SIZE);
+	return pass;
+}
+
+int
+main() {
+	bool pass = true;
+	pass &= testReuse();
+	pass &= testDefrag();
+	pass &= testOversized();
+	pass &= testFreeAll();
+	std::cout << (pass ? "All tests passed" : "Some tests failed") << std::endl;
+	return pass ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+/**
+ * Benchmarks the different ways of giving states IDs during exploration. See README.md
+ * */
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <string>
+
+#include "storm/utility/initialize.h"
+#include "storm/storage/BitVectorHashMap.h"
+#include "storm/generator/PrismNextStateGenerator.h"
+#include "storm-parsers/parser/PrismParser.h"
+
+#include "stamina/util/ConcurrentStateStorage.h"
+
+typedef storm::generator::PrismNextStateGenerator<double, uint32_t> Generator;
+using stamina::CompressedState;
+typedef stamina::util::ConcurrentStateStorage<uint32_t> StateStorage;
+
+struct Result {
+	uint64_t states = 0;
+	uint64_t successors = 0;
+	uint64_t lookups = 0;
+	uint64_t probes = 0;
+	double seconds = 0;
+};
+
+/**
+ * Breadth-first search through the model
+ *
+ * @param generator The generator to expand states with
+ * @param maxStates Stop once this many states are found
+ * @param callback Gives IDs to states. Also told whether the state is new through the second argument
+ * @param afterExpand Called after the initial states are found and after each expansion (for batching)
+ * */
+Result
+explore(
+	Generator & generator
+	, uint64_t maxStates
+	, std::function<uint32_t (CompressedState const&, bool&)> callback
+	, std::function<void (std::deque<CompressedState>&)> afterExpand
+) {
+	Result result;
+	std::deque<CompressedState> frontier;
+	auto start = std::chrono::high_resolution_clock::now();
+	std::function<uint32_t (CompressedState const&)> stateToIdCallback = [&](CompressedState const& state) {
+		bool isNew = false;
+		uint32_t id = callback(state, isNew);
+		++result.successors;
+		if (isNew) {
+			frontier.push_back(state);
+		}
+		return id;
+	};
+	generator.getInitialStates(stateToIdCallback);
+	afterExpand(frontier);
+	while (!frontier.empty() && result.states < maxStates) {
+		CompressedState state = frontier.front();
+		frontier.pop_front();
+		++result.states;
+		generator.load(state);
+		generator.expand(stateToIdCallback);
+		afterExpand(frontier);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	result.seconds = std::chrono::duration<double>(end - start).count();
+	return result;
+}
+
+void
+printResult(std::string name, Result const & result) {
+	std::cout << name << ":\n";
+	std::cout << "\tExplored " << result.states << " states (" << result.successors << " successors) in " << result.seconds << " s\n";
+	std::cout << "\tLookups: " << result.lookups << " (" << (double) result.lookups / result.successors << " per successor)\n";
+	if (result.probes > 0) {
+		std::cout << "\tSlots probed: " << result.probes << " (" << (double) result.probes / result.lookups << " per lookup)\n";
+	}
+}
+
+int
+main(int argc, char ** argv) {
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " model.prism [maxStates]" << std::endl;
+		return 1;
+	}
+	uint64_t maxStates = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10000000;
+	storm::utility::setUp();
+	storm::prism::Program program = storm::parser::PrismParser::parse(argv[1]).substituteConstantsFormulas();
+	storm::generator::NextStateGeneratorOptions options;
+
+	{
+		// What the builders used to do
+		Generator generator(program, options);
+		storm::storage::BitVectorHashMap<uint32_t> stateToId(generator.getStateSize(), 1024);
+		uint64_t lookups = 0;
+		Result result = explore(
+			generator
+			, maxStates
+			, [&](CompressedState const& state, bool & isNew) {
+				uint32_t newIndex = stateToId.size();
+				uint32_t actualIndex = newIndex;
+				lookups++;
+				if (stateToId.contains(state)) {
+					lookups++;
+					actualIndex = stateToId.getValue(state);
+				}
+				lookups++;
+				stateToId.findOrAdd(state, actualIndex);
+				isNew = actualIndex == newIndex;
+				return actualIndex;
+			}
+			, [](std::deque<CompressedState>&) {}
+		);
+		result.lookups = lookups;
+		printResult("storm::storage::BitVectorHashMap (contains, getValue, findOrAdd)", result);
+	}
+	{
+		Generator generator(program, options);
+		StateStorage storage(generator.getStateSize());
+		Result result = explore(
+			generator
+			, maxStates
+			, [&](CompressedState const& state, bool & isNew) {
+				auto indexAndWasAdded = storage.findOrAdd(state);
+				isNew = indexAndWasAdded.second;
+				return indexAndWasAdded.first;
+			}
+			, [](std::deque<CompressedState>&) {}
+		);
+		result.lookups = storage.getNumberOfLookups();
+		result.probes = storage.getNumberOfProbes();
+		printResult("ConcurrentStateStorage (findOrAdd)", result);
+	}
+	{
+		Generator generator(program, options);
+		StateStorage storage(generator.getStateSize());
+		StateStorage::Batch batch(generator.getStateSize());
+		Result result = explore(
+			generator
+			, maxStates
+			, [&](CompressedState const& state, bool & isNew) {
+				// New states are put in the frontier once the batch is interned
+				isNew = false;
+				return batch.add(state);
+			}
+			, [&](std::deque<CompressedState> & frontier) {
+				storage.findOrAdd(batch);
+				for (uint64_t i = 0; i < batch.size(); ++i) {
+					if (batch.wasAdded(i)) {
+						frontier.push_back(batch.getState(i));
+					}
+				}
+				batch.clear();
+			}
+		);
+		result.lookups = storage.getNumberOfLookups();
+		result.probes = storage.getNumberOfProbes();
+		printResult("ConcurrentStateStorage::Batch", result);
+	}
+	return 0;
+}